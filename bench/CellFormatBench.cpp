@@ -0,0 +1,83 @@
+// 单元格转换的性能测试：每种显示方式、字节序和实现转换一整屏数据的耗时，并检查各实现的结果一致
+// 用法: cell_format_bench [每屏行数，默认100] [每行字节数，默认64]
+#include "CellFormat.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+static double NowSeconds()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count() / 1e9;
+}
+
+static void Generate(std::vector<uint8_t>& vecData, size_t nSize)
+{
+    vecData.resize(nSize);
+    uint64_t x = 0x9E3779B97F4A7C15ull;
+    for (size_t i = 0; i < nSize; i++)
+    {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        vecData[i] = (uint8_t)x;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    size_t nRows = argc > 1 ? strtoull(argv[1], NULL, 10) : 100;
+    size_t nBytesPerRow = argc > 2 ? strtoull(argv[2], NULL, 10) : 64;
+    if (!nRows || !nBytesPerRow)
+    {
+        fprintf(stderr, "usage: %s [rows] [bytes per row]\n", argv[0]);
+        return 1;
+    }
+    std::vector<uint8_t> vecData;
+    Generate(vecData, nRows * nBytesPerRow);
+    int nBest = CCellFormatter::GetBestImplementation();
+    printf("screen: %zu rows x %zu bytes, best implementation: %s\n", nRows, nBytesPerRow,
+           CCellFormatter::GetImplementationName(nBest));
+
+    int bMismatch = 0;
+    for (int nFormat = 0; nFormat < CELL_FORMAT_COUNT; nFormat++)
+    {
+        for (int bBigEndian = 0; bBigEndian <= 1; bBigEndian++)
+        {
+            if (bBigEndian && nFormat <= CELL_I8)
+                continue;
+            std::vector<char> vecExpected;
+            for (int nImpl = FORMAT_IMPL_SCALAR; nImpl <= nBest; nImpl++)
+            {
+                CCellFormatter formatter(nFormat, bBigEndian, nImpl);
+                size_t nCount = vecData.size() / formatter.GetElementSize();
+                std::vector<char> vecText(nCount * formatter.GetTextWidth());
+                // 一屏的数据很少，重复多次取平均
+                int nRepeat = 0;
+                double dStart = NowSeconds();
+                double dElapsed = 0;
+                do
+                {
+                    formatter.Format(&vecData[0], nCount, &vecText[0]);
+                    nRepeat++;
+                    dElapsed = NowSeconds() - dStart;
+                } while (dElapsed < 0.2);
+                if (vecExpected.empty())
+                {
+                    vecExpected = vecText;
+                }
+                else if (vecText != vecExpected)
+                {
+                    printf("  MISMATCH %s\n", CCellFormatter::GetImplementationName(nImpl));
+                    bMismatch = 1;
+                }
+                printf("  %-4s %-2s %-7s %9.1f us/screen  %7.1f ns/cell\n", CCellFormatter::GetFormatName(nFormat),
+                       bBigEndian ? "be" : "le", CCellFormatter::GetImplementationName(nImpl),
+                       dElapsed / nRepeat * 1e6, dElapsed / nRepeat / nCount * 1e9);
+            }
+        }
+    }
+    return bMismatch;
+}
@@ -0,0 +1,143 @@
+// 查找内核的性能测试：在内存里生成数据，比较kmp.cpp的KMP/KMP_ignore_case和CSearchKernel各实现的吞吐量
+// 用法: search_bench [数据大小(MB)，默认2048]
+#include "SearchKernel.h"
+#include "kmp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+static const size_t kMaxKmpChunk = 0x40000000;
+
+static double NowSeconds()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count() / 1e9;
+}
+
+// 类似可执行文件的数据：大约一半是0，其余是随机字节
+static void Generate(std::vector<uint8_t>& vecData, size_t nSize)
+{
+    vecData.resize(nSize);
+    uint64_t x = 0x9E3779B97F4A7C15ull;
+    for (size_t i = 0; i < nSize; i += 8)
+    {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        for (size_t j = 0; j < 8 && i + j < nSize; j++)
+        {
+            uint8_t c = (uint8_t)(x >> (j * 8));
+            vecData[i + j] = (c & 0x80) ? 0 : c;
+        }
+    }
+}
+
+// 用原来的KMP函数数出所有匹配
+static size_t CountKmp(const std::vector<uint8_t>& vecData, const std::vector<uint8_t>& vecPattern, int bIgnoreCase)
+{
+    std::vector<uint8_t> vecLower(vecPattern);
+    std::vector<int> vecNext(vecPattern.size());
+    if (bIgnoreCase)
+    {
+        for (size_t i = 0; i < vecLower.size(); i++)
+            vecLower[i] = (uint8_t)(vecLower[i] - 'A') < 26 ? vecLower[i] | 0x20 : vecLower[i];
+        kmp_cal_next_ignore_case(&vecLower[0], (int)vecLower.size(), &vecNext[0]);
+    }
+    else
+    {
+        kmp_cal_next(&vecLower[0], (int)vecLower.size(), &vecNext[0]);
+    }
+    size_t nCount = 0;
+    size_t nPos = 0;
+    while (nPos + vecLower.size() <= vecData.size())
+    {
+        size_t nLeft = vecData.size() - nPos;
+        int nChunk = nLeft > kMaxKmpChunk ? (int)kMaxKmpChunk : (int)nLeft;
+        int nFound = bIgnoreCase
+            ? KMP_ignore_case(&vecData[nPos], nChunk, &vecLower[0], (int)vecLower.size(), &vecNext[0])
+            : KMP(&vecData[nPos], nChunk, &vecLower[0], (int)vecLower.size(), &vecNext[0]);
+        if (nFound >= 0)
+        {
+            nCount++;
+            nPos += nFound + 1;
+        }
+        else
+        {
+            nPos += nChunk - (vecLower.size() - 1);
+            if ((size_t)nChunk == nLeft)
+                break;
+        }
+    }
+    return nCount;
+}
+
+static size_t CountKernel(const std::vector<uint8_t>& vecData, const CSearchKernel& kernel)
+{
+    size_t nCount = 0;
+    const uint8_t* pData = &vecData[0];
+    const uint8_t* pEnd = pData + vecData.size();
+    const uint8_t* pFound;
+    while ((pFound = kernel.Find(pData, pEnd - pData)) != NULL)
+    {
+        nCount++;
+        pData = pFound + 1;
+    }
+    return nCount;
+}
+
+static void Report(const char* szName, size_t nSize, double dSeconds, size_t nCount)
+{
+    printf("  %-18s %8.0f MB/s  %6.3f s  %zu hits\n", szName, nSize / dSeconds / (1024 * 1024), dSeconds, nCount);
+}
+
+int main(int argc, char* argv[])
+{
+    size_t nMegabytes = argc > 1 ? strtoull(argv[1], NULL, 10) : 2048;
+    if (!nMegabytes)
+    {
+        fprintf(stderr, "usage: %s [size in MB]\n", argv[0]);
+        return 1;
+    }
+    std::vector<uint8_t> vecData;
+    Generate(vecData, nMegabytes << 20);
+    printf("data: %zu MB, best kernel: %s\n", nMegabytes,
+           CSearchKernel::GetImplementationName(CSearchKernel::GetBestImplementation()));
+
+    // 取数据末尾的一段作为模式，保证至少有一个匹配且要扫描整个数据
+    static const size_t kLengths[] = { 1, 2, 4, 8, 16, 32 };
+    int bMismatch = 0;
+    for (int bIgnoreCase = 0; bIgnoreCase <= 1; bIgnoreCase++)
+    {
+        for (size_t l = 0; l < sizeof(kLengths) / sizeof(kLengths[0]); l++)
+        {
+            size_t nLength = kLengths[l];
+            std::vector<uint8_t> vecPattern(vecData.end() - nLength - 3, vecData.end() - 3);
+            printf("pattern %zu bytes%s\n", nLength, bIgnoreCase ? ", ignore case" : "");
+
+            double dStart = NowSeconds();
+            size_t nExpected = CountKmp(vecData, vecPattern, bIgnoreCase);
+            Report(bIgnoreCase ? "KMP_ignore_case" : "KMP", vecData.size(), NowSeconds() - dStart, nExpected);
+
+            for (int nImpl = KERNEL_SCALAR; nImpl <= CSearchKernel::GetBestImplementation(); nImpl++)
+            {
+                CSearchKernel kernel(&vecPattern[0], nLength, bIgnoreCase, nImpl);
+                // 单字节区分大小写时各实现都是memchr，只测一次
+                if (kernel.GetImplementation() != nImpl)
+                    continue;
+                dStart = NowSeconds();
+                size_t nCount = CountKernel(vecData, kernel);
+                char szName[32];
+                snprintf(szName, sizeof(szName), "kernel/%s", CSearchKernel::GetImplementationName(kernel.GetImplementation()));
+                Report(szName, vecData.size(), NowSeconds() - dStart, nCount);
+                if (nCount != nExpected)
+                {
+                    printf("  MISMATCH: expected %zu hits\n", nExpected);
+                    bMismatch = 1;
+                }
+            }
+        }
+    }
+    return bMismatch;
+}
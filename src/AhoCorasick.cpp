@@ -0,0 +1,196 @@
+#include "AhoCorasick.h"
+#include <string.h>
+
+// 转移表项的最高位表示目标状态结束了某个模式
+static const uint16_t kOutputFlag16 = 0x8000;
+static const uint32_t kOutputFlag32 = 0x80000000;
+
+static inline uint8_t ToLower(uint8_t c)
+{
+    return (uint8_t)(c - 'A') < 26 ? c | 0x20 : c;
+}
+
+CAhoCorasickMatcher::CAhoCorasickMatcher(const std::vector<std::vector<uint8_t> >& vecPatterns, int bIgnoreCase)
+    : m_nClasses(1), m_nStates(1), m_nMaxLength(0), m_nState(0)
+{
+    // 等价类：模式里出现的每个字节一类，其余字节共用第0类；256个字节都出现时每个字节一类
+    uint8_t aUsed[256] = { 0 };
+    uint32_t nUsed = 0;
+    for (size_t i = 0; i < vecPatterns.size(); i++)
+    {
+        for (size_t j = 0; j < vecPatterns[i].size(); j++)
+        {
+            uint8_t c = bIgnoreCase ? ToLower(vecPatterns[i][j]) : vecPatterns[i][j];
+            if (!aUsed[c])
+            {
+                aUsed[c] = 1;
+                nUsed++;
+            }
+        }
+    }
+    memset(m_aClass, 0, sizeof(m_aClass));
+    m_nClasses = nUsed == 256 ? 0 : 1;
+    for (int c = 0; c < 256; c++)
+    {
+        if (aUsed[c])
+            m_aClass[c] = (uint8_t)m_nClasses++;
+    }
+    if (bIgnoreCase)
+    {
+        for (int c = 'A'; c <= 'Z'; c++)
+            m_aClass[c] = m_aClass[c | 0x20];
+    }
+
+    // 字典树，-1表示没有转移；空模式不会匹配，只占一个序号
+    std::vector<int32_t> vecGoto(m_nClasses, -1);
+    std::vector<std::vector<uint32_t> > vecOut(1);
+    for (size_t i = 0; i < vecPatterns.size(); i++)
+    {
+        const std::vector<uint8_t>& pattern = vecPatterns[i];
+        m_vecLengths.push_back((uint32_t)pattern.size());
+        if (pattern.empty())
+            continue;
+        if (pattern.size() > m_nMaxLength)
+            m_nMaxLength = pattern.size();
+        uint32_t nState = 0;
+        for (size_t j = 0; j < pattern.size(); j++)
+        {
+            uint32_t nClass = m_aClass[pattern[j]];
+            if (vecGoto[nState * m_nClasses + nClass] < 0)
+            {
+                vecGoto[nState * m_nClasses + nClass] = (int32_t)m_nStates++;
+                vecGoto.resize(m_nStates * m_nClasses, -1);
+                vecOut.resize(m_nStates);
+            }
+            nState = vecGoto[nState * m_nClasses + nClass];
+        }
+        vecOut[nState].push_back((uint32_t)i);
+    }
+
+    // 按层次遍历补全转移，同时求失败链：缺少的转移取失败状态的转移，
+    // 输出合并失败状态的输出（失败状态层次更浅，已经处理过）
+    std::vector<uint32_t> vecFail(m_nStates, 0);
+    std::vector<uint32_t> vecQueue;
+    vecQueue.reserve(m_nStates);
+    for (uint32_t c = 0; c < m_nClasses; c++)
+    {
+        int32_t nNext = vecGoto[c];
+        if (nNext < 0)
+        {
+            vecGoto[c] = 0;
+        }
+        else
+        {
+            vecFail[nNext] = 0;
+            vecQueue.push_back(nNext);
+        }
+    }
+    for (size_t q = 0; q < vecQueue.size(); q++)
+    {
+        uint32_t nState = vecQueue[q];
+        const std::vector<uint32_t>& vecInherit = vecOut[vecFail[nState]];
+        vecOut[nState].insert(vecOut[nState].end(), vecInherit.begin(), vecInherit.end());
+        for (uint32_t c = 0; c < m_nClasses; c++)
+        {
+            int32_t nNext = vecGoto[nState * m_nClasses + c];
+            int32_t nFallback = vecGoto[vecFail[nState] * m_nClasses + c];
+            if (nNext < 0)
+            {
+                vecGoto[nState * m_nClasses + c] = nFallback;
+            }
+            else
+            {
+                vecFail[nNext] = nFallback;
+                vecQueue.push_back(nNext);
+            }
+        }
+    }
+
+    m_vecOutputStart.resize(m_nStates + 1);
+    for (uint32_t s = 0; s < m_nStates; s++)
+    {
+        m_vecOutputStart[s] = (uint32_t)m_vecOutputs.size();
+        m_vecOutputs.insert(m_vecOutputs.end(), vecOut[s].begin(), vecOut[s].end());
+    }
+    m_vecOutputStart[m_nStates] = (uint32_t)m_vecOutputs.size();
+
+    // 表项直接存目标状态乘以类数后的下标，扫描时省掉一次乘法
+    size_t nEntries = (size_t)m_nStates * m_nClasses;
+    if (nEntries <= kOutputFlag16)
+    {
+        m_vecTable16.resize(nEntries);
+        for (size_t i = 0; i < nEntries; i++)
+        {
+            uint32_t nNext = vecGoto[i];
+            m_vecTable16[i] = (uint16_t)(nNext * m_nClasses | (vecOut[nNext].empty() ? 0 : kOutputFlag16));
+        }
+    }
+    else
+    {
+        m_vecTable32.resize(nEntries);
+        for (size_t i = 0; i < nEntries; i++)
+        {
+            uint32_t nNext = vecGoto[i];
+            m_vecTable32[i] = nNext * m_nClasses | (vecOut[nNext].empty() ? 0 : kOutputFlag32);
+        }
+    }
+}
+
+size_t CAhoCorasickMatcher::GetTableSize() const
+{
+    return m_vecTable16.size() * sizeof(uint16_t) + m_vecTable32.size() * sizeof(uint32_t);
+}
+
+void CAhoCorasickMatcher::Report(uint32_t nState, FileOffset nEnd, std::vector<SearchHit>& vecHits)
+{
+    uint32_t nIndex = nState / m_nClasses;
+    for (uint32_t i = m_vecOutputStart[nIndex]; i < m_vecOutputStart[nIndex + 1]; i++)
+    {
+        SearchHit hit;
+        hit.nPattern = m_vecOutputs[i];
+        hit.nLength = m_vecLengths[hit.nPattern];
+        hit.nOffset = nEnd - hit.nLength;
+        vecHits.push_back(hit);
+    }
+}
+
+template<typename Entry>
+size_t CAhoCorasickMatcher::ScanTable(const Entry* pTable, const uint8_t* pData, size_t nLength, FileOffset nBase,
+                                      std::vector<SearchHit>& vecHits, size_t nMaxHits)
+{
+    const Entry nFlag = (Entry)1 << (sizeof(Entry) * 8 - 1);
+    const uint8_t* aClass = m_aClass;
+    Entry nState = (Entry)m_nState;
+    size_t nHits = 0;
+    for (size_t i = 0; i < nLength; i++)
+    {
+        nState = pTable[nState + aClass[pData[i]]];
+        if (nState & nFlag)
+        {
+            nState &= ~nFlag;
+            size_t nBefore = vecHits.size();
+            Report(nState, nBase + i + 1, vecHits);
+            nHits += vecHits.size() - nBefore;
+            // 同一个位置结束的模式一起报告
+            if (nHits >= nMaxHits)
+            {
+                m_nState = nState;
+                return i + 1;
+            }
+        }
+    }
+    m_nState = nState;
+    return nLength;
+}
+
+size_t CAhoCorasickMatcher::Scan(const uint8_t* pData, size_t nLength, FileOffset nBase,
+                                 std::vector<SearchHit>& vecHits, size_t nMaxHits)
+{
+    if (!m_nMaxLength)
+    {
+        return nLength;
+    }
+    if (!m_vecTable16.empty())
+        return ScanTable(&m_vecTable16[0], pData, nLength, nBase, vecHits, nMaxHits);
+    return ScanTable(&m_vecTable32[0], pData, nLength, nBase, vecHits, nMaxHits);
+}
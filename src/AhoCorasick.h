@@ -0,0 +1,53 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include "Search.h"
+
+/************************************************************************/
+/* multi-pattern streaming matcher (Aho-Corasick).
+/* the automaton is built once into a complete DFA: every state has a
+/* transition for every input, so scanning is one table load per byte no
+/* matter how many patterns there are. inputs are first mapped to byte
+/* equivalence classes (bytes that occur in no pattern share one class,
+/* and with ignore-case 'A'-'Z' share the class of 'a'-'z'), which keeps
+/* a row of the table as narrow as the set of bytes the patterns use.
+/* the table uses 16 bit entries when it fits, 32 bit otherwise; the top
+/* bit of an entry marks target states that end at least one pattern.
+/* SearchHit::nPattern is the index of the pattern in the constructor.
+/************************************************************************/
+class CAhoCorasickMatcher : public CMatcher
+{
+public:
+    CAhoCorasickMatcher(const std::vector<std::vector<uint8_t> >& vecPatterns, int bIgnoreCase = FALSE);
+    void Reset() { m_nState = 0; }
+    size_t Scan(const uint8_t* pData, size_t nLength, FileOffset nBase,
+                std::vector<SearchHit>& vecHits, size_t nMaxHits);
+    size_t GetMaxLength() const { return m_nMaxLength; }
+    CMatcher* Clone() const { return new CAhoCorasickMatcher(*this); }
+
+    /************************************************************************/
+    /* size of the automaton, for reporting.
+    /************************************************************************/
+    size_t GetPatternCount() const { return m_vecLengths.size(); }
+    size_t GetStateCount() const { return m_nStates; }
+    size_t GetClassCount() const { return m_nClasses; }
+    size_t GetTableSize() const;   // 转移表的字节数
+
+private:
+    template<typename Entry>
+    size_t ScanTable(const Entry* pTable, const uint8_t* pData, size_t nLength, FileOffset nBase,
+                     std::vector<SearchHit>& vecHits, size_t nMaxHits);
+    // 状态nState（已乘过类数）结束的所有模式
+    void Report(uint32_t nState, FileOffset nEnd, std::vector<SearchHit>& vecHits);
+
+    uint8_t m_aClass[256];                // 字节 -> 等价类
+    uint32_t m_nClasses;
+    uint32_t m_nStates;
+    std::vector<uint16_t> m_vecTable16;   // 状态数*类数不超过0x8000时使用
+    std::vector<uint32_t> m_vecTable32;   // 否则使用这个
+    std::vector<uint32_t> m_vecOutputStart; // 每个状态结束的模式在m_vecOutputs中的范围
+    std::vector<uint32_t> m_vecOutputs;   // 模式序号，包括沿失败链继承来的
+    std::vector<uint32_t> m_vecLengths;   // 每个模式的长度
+    size_t m_nMaxLength;
+    uint32_t m_nState;                    // 跨缓冲区保留的状态（已乘过类数）
+};
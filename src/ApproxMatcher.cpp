@@ -0,0 +1,241 @@
+#include "ApproxMatcher.h"
+#include <string.h>
+
+// 每个字节值在模式中出现的位置，第i位对应模式的第i个字节
+static void BuildMasks(const uint8_t* pPattern, size_t nLength, uint64_t* pMask)
+{
+    memset(pMask, 0, 256 * sizeof(uint64_t));
+    for (size_t i = 0; i < nLength; i++)
+        pMask[pPattern[i]] |= (uint64_t)1 << i;
+}
+
+// CHammingMatcher
+
+CHammingMatcher::CHammingMatcher(const uint8_t* pPattern, size_t nLength, uint32_t nMaxErrors)
+    : m_nPatternLength(nLength), m_nMaxErrors(nMaxErrors)
+{
+    BuildMasks(pPattern, nLength, m_aMask);
+    Reset();
+}
+
+void CHammingMatcher::Reset()
+{
+    m_vecStates.assign(m_nMaxErrors + 1, 0);
+}
+
+size_t CHammingMatcher::Scan(const uint8_t* pData, size_t nLength, FileOffset nBase,
+                             std::vector<SearchHit>& vecHits, size_t nMaxHits)
+{
+    size_t nPattern = m_nPatternLength;
+    if (!nPattern || nPattern > APPROX_MAX_PATTERN || m_nMaxErrors >= nPattern)
+    {
+        return nLength;
+    }
+    uint64_t nHigh = (uint64_t)1 << (nPattern - 1);
+    uint64_t* pStates = &m_vecStates[0];
+    uint32_t nMaxErrors = m_nMaxErrors;
+    size_t nHits = 0;
+    for (size_t i = 0; i < nLength; i++)
+    {
+        uint64_t nMask = m_aMask[pData[i]];
+        // 新的第j个状态：前缀在这个字节相同且之前最多j个不同，或者这个字节不同且之前最多j-1个不同
+        uint64_t nPrev = pStates[0];
+        uint64_t nState = ((nPrev << 1) | 1) & nMask;
+        pStates[0] = nState;
+        for (uint32_t j = 1; j <= nMaxErrors; j++)
+        {
+            uint64_t nOld = pStates[j];
+            nState = (((nOld << 1) | 1) & nMask) | ((nPrev << 1) | 1);
+            pStates[j] = nState;
+            nPrev = nOld;
+        }
+        if (nState & nHigh)
+        {
+            SearchHit hit;
+            hit.nOffset = nBase + i + 1 - nPattern;
+            hit.nLength = nPattern;
+            hit.nPattern = 0;
+            vecHits.push_back(hit);
+            if (++nHits >= nMaxHits)
+            {
+                return i + 1;
+            }
+        }
+    }
+    return nLength;
+}
+
+// CEditDistanceMatcher
+
+CEditDistanceMatcher::CEditDistanceMatcher(const uint8_t* pPattern, size_t nLength, uint32_t nMaxErrors)
+    : m_vecPattern(pPattern, pPattern + nLength), m_nMaxErrors(nMaxErrors)
+{
+    BuildMasks(pPattern, nLength, m_aMask);
+    Reset();
+}
+
+void CEditDistanceMatcher::Reset()
+{
+    // 空文本：第i行的距离是i，纵向差全部是+1
+    m_nPv = ~(uint64_t)0;
+    m_nMv = 0;
+    m_nScore = (uint32_t)m_vecPattern.size();
+    m_nPosition = 0;
+    m_bStarted = FALSE;
+    m_bPending = FALSE;
+    m_nBestEnd = 0;
+    m_nBestScore = 0;
+    m_nNextStart = 0;
+    m_nNextEnd = 0;
+    m_vecHistory.clear();
+}
+
+void CEditDistanceMatcher::KeepHistory(const uint8_t* pData, size_t nLength)
+{
+    size_t nKeep = GetMaxLength();
+    if (nLength >= nKeep)
+    {
+        m_vecHistory.assign(pData + nLength - nKeep, pData + nLength);
+        return;
+    }
+    m_vecHistory.insert(m_vecHistory.end(), pData, pData + nLength);
+    if (m_vecHistory.size() > nKeep)
+        m_vecHistory.erase(m_vecHistory.begin(), m_vecHistory.end() - nKeep);
+}
+
+int CEditDistanceMatcher::Report(const uint8_t* pData, size_t nLength, FileOffset nBase, std::vector<SearchHit>& vecHits)
+{
+    size_t nPattern = m_vecPattern.size();
+    // 距离不超过nMaxErrors的匹配不会长于nPattern+nMaxErrors，也不能与上一个匹配重叠
+    FileOffset nFrom = m_nBestEnd + 1 >= m_nNextStart + nPattern + m_nMaxErrors
+        ? m_nBestEnd + 1 - nPattern - m_nMaxErrors : m_nNextStart;
+    m_vecWindow.clear();
+    for (FileOffset nOffset = nFrom; nOffset <= m_nBestEnd; nOffset++)
+    {
+        if (nOffset >= nBase && nOffset - nBase < nLength)
+            m_vecWindow.push_back(pData[nOffset - nBase]);
+        else
+            m_vecWindow.push_back(m_vecHistory[m_vecHistory.size() - (size_t)(nBase - nOffset)]);
+    }
+
+    // 从结尾往前：m_vecRow[j]是模式的后i个字节与窗口的后j个字节的编辑距离
+    size_t nWindow = m_vecWindow.size();
+    m_vecRow.resize(nWindow + 1);
+    for (size_t j = 0; j <= nWindow; j++)
+        m_vecRow[j] = (uint32_t)j;
+    for (size_t i = 1; i <= nPattern; i++)
+    {
+        uint8_t c = m_vecPattern[nPattern - i];
+        uint32_t nDiagonal = m_vecRow[0];
+        m_vecRow[0] = (uint32_t)i;
+        for (size_t j = 1; j <= nWindow; j++)
+        {
+            uint32_t nUp = m_vecRow[j];
+            uint32_t nValue = nDiagonal + (c != m_vecWindow[nWindow - j]);
+            if (nUp + 1 < nValue)
+                nValue = nUp + 1;
+            if (m_vecRow[j - 1] + 1 < nValue)
+                nValue = m_vecRow[j - 1] + 1;
+            m_vecRow[j] = nValue;
+            nDiagonal = nUp;
+        }
+    }
+    // 距离最小的长度，相同时取最接近模式长度的
+    size_t nBest = 0;
+    for (size_t j = 1; j <= nWindow; j++)
+    {
+        size_t nDiff = j > nPattern ? j - nPattern : nPattern - j;
+        size_t nBestDiff = nBest > nPattern ? nBest - nPattern : nPattern - nBest;
+        if (!nBest || m_vecRow[j] < m_vecRow[nBest] || (m_vecRow[j] == m_vecRow[nBest] && nDiff < nBestDiff))
+            nBest = j;
+    }
+
+    m_bPending = FALSE;
+    // 结尾处的距离可能来自与上一个匹配重叠的起点，不重叠的起点都超出了限制
+    if (!nBest || m_vecRow[nBest] > m_nMaxErrors)
+        return FALSE;
+
+    SearchHit hit;
+    hit.nOffset = m_nBestEnd + 1 - nBest;
+    hit.nLength = nBest;
+    hit.nPattern = 0;
+    vecHits.push_back(hit);
+    // 下一个匹配从这个匹配之后开始，最短nPattern-nMaxErrors个字节
+    m_nNextStart = m_nBestEnd + 1;
+    m_nNextEnd = m_nBestEnd + nPattern - m_nMaxErrors;
+    return TRUE;
+}
+
+size_t CEditDistanceMatcher::Scan(const uint8_t* pData, size_t nLength, FileOffset nBase,
+                                  std::vector<SearchHit>& vecHits, size_t nMaxHits)
+{
+    size_t nPattern = m_vecPattern.size();
+    if (!nPattern || nPattern > APPROX_MAX_PATTERN || m_nMaxErrors >= nPattern)
+    {
+        return nLength;
+    }
+    if (!m_bStarted)
+    {
+        m_bStarted = TRUE;
+        m_nNextStart = nBase;
+        m_nNextEnd = nBase;
+    }
+
+    uint64_t nHigh = (uint64_t)1 << (nPattern - 1);
+    uint64_t nPv = m_nPv, nMv = m_nMv;
+    uint32_t nScore = m_nScore;
+    uint32_t nMaxErrors = m_nMaxErrors;
+    int bPending = m_bPending;
+    size_t nHits = 0;
+    size_t nConsumed = nLength;
+    for (size_t i = 0; i < nLength; i++)
+    {
+        // 一列的更新：Eq是匹配的行，Ph/Mh是横向差为+1/-1的行
+        uint64_t nEq = m_aMask[pData[i]];
+        uint64_t nXv = nEq | nMv;
+        uint64_t nXh = (((nEq & nPv) + nPv) ^ nPv) | nEq;
+        uint64_t nPh = nMv | ~(nXh | nPv);
+        uint64_t nMh = nPv & nXh;
+        if (nPh & nHigh)
+            nScore++;
+        else if (nMh & nHigh)
+            nScore--;
+        nPh <<= 1;
+        nMh <<= 1;
+        nPv = nMh | ~(nXv | nPh);
+        nMv = nPh & nXv;
+
+        if (nScore > nMaxErrors && !bPending)
+            continue;
+        FileOffset nEnd = nBase + i;
+        if (nScore <= nMaxErrors && nEnd >= m_nNextEnd && (!bPending || nScore < m_nBestScore))
+        {
+            bPending = TRUE;
+            m_nBestEnd = nEnd;
+            m_nBestScore = nScore;
+        }
+        // 距离重新超出，或者往后nMaxErrors个字节都没有更好的结尾
+        if (bPending && (nScore > nMaxErrors || nEnd - m_nBestEnd >= nMaxErrors))
+        {
+            bPending = FALSE;
+            if (Report(pData, nLength, nBase, vecHits) && ++nHits >= nMaxHits)
+            {
+                nConsumed = i + 1;
+                break;
+            }
+        }
+    }
+    m_nPv = nPv;
+    m_nMv = nMv;
+    m_nScore = nScore;
+    m_bPending = bPending;
+    m_nPosition = nBase + nConsumed;
+    KeepHistory(pData, nConsumed);
+    return nConsumed;
+}
+
+void CEditDistanceMatcher::Flush(std::vector<SearchHit>& vecHits)
+{
+    if (m_bPending)
+        Report(NULL, 0, m_nPosition, vecHits);
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include "Search.h"
+
+// 近似查找的模式最长的字节数（一个64位字）
+enum {
+    APPROX_MAX_PATTERN = 64,
+};
+
+/************************************************************************/
+/* streaming matcher for the places where a pattern occurs with at most
+/* nMaxErrors substituted bytes (Hamming distance), bit-parallel (the
+/* shift-and "bitap" automaton of Wu and Manber): one 64-bit word per
+/* number of errors tells which prefixes of the pattern end at the
+/* current byte with that many mismatches, so a byte costs nMaxErrors+1
+/* shifts, ands and ors whatever the data.
+/* every offset is reported, like the exact matchers; hits have the
+/* length of the pattern.
+/* the pattern is 1 to APPROX_MAX_PATTERN bytes and nMaxErrors is less
+/* than its length.
+/************************************************************************/
+class CHammingMatcher : public CMatcher
+{
+public:
+    CHammingMatcher(const uint8_t* pPattern, size_t nLength, uint32_t nMaxErrors);
+    void Reset();
+    size_t Scan(const uint8_t* pData, size_t nLength, FileOffset nBase,
+                std::vector<SearchHit>& vecHits, size_t nMaxHits);
+    size_t GetMaxLength() const { return m_nPatternLength; }
+    CMatcher* Clone() const { return new CHammingMatcher(*this); }
+private:
+    size_t m_nPatternLength;
+    uint32_t m_nMaxErrors;
+    uint64_t m_aMask[256];             // 每个字节值在模式中出现的位置
+    std::vector<uint64_t> m_vecStates; // 第j个：以当前字节结尾、最多j个不同的模式前缀
+};
+
+/************************************************************************/
+/* streaming matcher for the places where a pattern occurs within an edit
+/* distance of nMaxErrors (substituted, inserted or deleted bytes), with
+/* the bit-vector algorithm of Myers: the column of the edit distance
+/* table is kept as vertical deltas in two 64-bit words and updated with
+/* a dozen word operations per byte; the bottom cell is the distance of
+/* the best match ending at the current byte.
+/* around an occurrence several consecutive ends are within the limit;
+/* one hit is reported per occurrence, at the end with the least
+/* distance in the next nMaxErrors bytes, and its start is found with a
+/* small table over the last bytes. the next hit cannot overlap it. a
+/* decision may wait nMaxErrors bytes, Flush() reports the last one.
+/* the pattern is 1 to APPROX_MAX_PATTERN bytes and nMaxErrors is less
+/* than its length.
+/************************************************************************/
+class CEditDistanceMatcher : public CMatcher
+{
+public:
+    CEditDistanceMatcher(const uint8_t* pPattern, size_t nLength, uint32_t nMaxErrors);
+    void Reset();
+    size_t Scan(const uint8_t* pData, size_t nLength, FileOffset nBase,
+                std::vector<SearchHit>& vecHits, size_t nMaxHits);
+    void Flush(std::vector<SearchHit>& vecHits);
+    // 最长的匹配再加上决定报告哪个结尾要等的字节
+    size_t GetMaxLength() const { return m_vecPattern.size() + 2 * m_nMaxErrors; }
+    CMatcher* Clone() const { return new CEditDistanceMatcher(*this); }
+private:
+    // 报告结尾在m_nBestEnd的匹配，pData是偏移nBase处的当前数据（nLength字节）；不重叠的起点都超出限制时返回FALSE
+    int Report(const uint8_t* pData, size_t nLength, FileOffset nBase, std::vector<SearchHit>& vecHits);
+    // 把已消耗的数据记入m_vecHistory，只保留最后GetMaxLength()个字节
+    void KeepHistory(const uint8_t* pData, size_t nLength);
+
+    std::vector<uint8_t> m_vecPattern;
+    uint32_t m_nMaxErrors;
+    uint64_t m_aMask[256];
+
+    // 跨缓冲区保留的状态
+    uint64_t m_nPv;                    // 纵向差为+1的位置
+    uint64_t m_nMv;                    // 纵向差为-1的位置
+    uint32_t m_nScore;                 // 以当前字节结尾的最佳匹配的距离
+    FileOffset m_nPosition;            // 下一个字节的偏移
+    int m_bStarted;
+    int m_bPending;                    // 有一个还没有报告的匹配
+    FileOffset m_nBestEnd;             // 它的结尾
+    uint32_t m_nBestScore;
+    FileOffset m_nNextStart;           // 上一个匹配之后的偏移，下一个匹配的起点不能在它之前
+    FileOffset m_nNextEnd;             // 下一个匹配最早的结尾
+    std::vector<uint8_t> m_vecHistory; // 之前的数据的最后几个字节，计算匹配起点用
+    std::vector<uint8_t> m_vecWindow;  // 计算起点时的临时数据
+    std::vector<uint32_t> m_vecRow;
+};
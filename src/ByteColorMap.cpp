@@ -0,0 +1,81 @@
+#include "ByteColorMap.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// 默认分类颜色都很浅，黑色文字仍然清楚，也和选择的浅蓝、查找结果的黄色区分得开
+static const Fl_Color kZeroColor = fl_rgb_color(0xE0, 0xE0, 0xE0);     // 0x00
+static const Fl_Color kFullColor = fl_rgb_color(0xFF, 0xD0, 0xD0);     // 0xFF
+static const Fl_Color kPrintColor = fl_rgb_color(0xD8, 0xF5, 0xD8);    // 可打印ASCII
+static const Fl_Color kControlColor = fl_rgb_color(0xD8, 0xE4, 0xFF);  // 其他0x01~0x1F、0x7F
+static const Fl_Color kHighColor = fl_rgb_color(0xEC, 0xDE, 0xF8);     // 0x80~0xFE
+
+ByteColorMap::ByteColorMap() {
+    build();
+}
+
+void ByteColorMap::build() {
+    for (int i = 0; i < 256; i++) {
+        if (i == 0x00) m_colors[i] = kZeroColor;
+        else if (i == 0xFF) m_colors[i] = kFullColor;
+        else if (i >= 0x20 && i <= 0x7E) m_colors[i] = kPrintColor;
+        else if (i < 0x80) m_colors[i] = kControlColor;
+        else m_colors[i] = kHighColor;
+    }
+    for (const ByteColorRange& range : m_ranges) {
+        for (int i = range.low; i <= range.high; i++) m_colors[i] = range.color;
+    }
+}
+
+// 设置用户范围并重建颜色表
+void ByteColorMap::SetRanges(const std::vector<ByteColorRange>& ranges) {
+    m_ranges = ranges;
+    build();
+}
+
+// 解析"00-1F=C0C0FF, 90=FFC0C0"，范围之间用逗号、分号或空白分隔
+bool ByteColorMap::ParseRanges(const char* text, std::vector<ByteColorRange>& ranges) {
+    ranges.clear();
+    const char* p = text;
+    while (*p) {
+        if (*p == ',' || *p == ';' || *p == ' ' || *p == '\t') {
+            p++;
+            continue;
+        }
+        char* end = nullptr;
+        unsigned long low = strtoul(p, &end, 16);
+        if (end == p || low > 0xFF) return false;
+        unsigned long high = low;
+        p = end;
+        if (*p == '-') {
+            high = strtoul(++p, &end, 16);
+            if (end == p || high > 0xFF || high < low) return false;
+            p = end;
+        }
+        if (*p != '=') return false;
+        unsigned long rgb = strtoul(++p, &end, 16);
+        if (end - p != 6) return false;
+        p = end;
+        ByteColorRange range;
+        range.low = (uint8_t)low;
+        range.high = (uint8_t)high;
+        range.color = fl_rgb_color((uchar)(rgb >> 16), (uchar)(rgb >> 8), (uchar)rgb);
+        ranges.push_back(range);
+    }
+    return true;
+}
+
+std::string ByteColorMap::FormatRanges(const std::vector<ByteColorRange>& ranges) {
+    std::string text;
+    for (const ByteColorRange& range : ranges) {
+        char item[32];
+        unsigned rgb = range.color >> 8;
+        if (range.low == range.high)
+            snprintf(item, sizeof(item), "%02X=%06X", range.low, rgb);
+        else
+            snprintf(item, sizeof(item), "%02X-%02X=%06X", range.low, range.high, rgb);
+        if (!text.empty()) text += ", ";
+        text += item;
+    }
+    return text;
+}
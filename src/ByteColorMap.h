@@ -0,0 +1,42 @@
+#ifndef BYTECOLORMAP_H
+#define BYTECOLORMAP_H
+
+#include <FL/Enumerations.H>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 用户指定的一段字节值的颜色，覆盖默认的分类颜色
+struct ByteColorRange {
+    uint8_t low, high;  // 字节值范围[low, high]
+    Fl_Color color;
+};
+
+// 按字节值着色的256项颜色表：先按类别（0、0xFF、可打印、控制字符、高位）取默认颜色，
+// 再按顺序套上用户的范围，后面的范围优先。绘制时每个字节查一次表
+class ByteColorMap {
+private:
+    Fl_Color m_colors[256];
+    std::vector<ByteColorRange> m_ranges;
+
+    void build();
+
+public:
+    ByteColorMap();
+
+    // 设置用户范围并重建颜色表
+    void SetRanges(const std::vector<ByteColorRange>& ranges);
+    const std::vector<ByteColorRange>& GetRanges() const { return m_ranges; }
+
+    Fl_Color operator[](uint8_t value) const { return m_colors[value]; }
+
+    // 默认的背景色，不着色的字节和它相同
+    static Fl_Color Background() { return FL_WHITE; }
+
+    // 范围的文字形式，例如"00-1F=C0C0FF, 90=FFC0C0"（十六进制的字节值和RGB），空文字表示没有范围；
+    // 格式不对时返回false
+    static bool ParseRanges(const char* text, std::vector<ByteColorRange>& ranges);
+    static std::string FormatRanges(const std::vector<ByteColorRange>& ranges);
+};
+
+#endif // BYTECOLORMAP_H
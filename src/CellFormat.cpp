@@ -0,0 +1,370 @@
+#include "CellFormat.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#if defined(__has_include)
+#if __has_include(<charconv>) && __cplusplus >= 201703L
+#include <charconv>
+#endif
+#endif
+
+// 与SearchKernel.cpp相同：GCC/Clang在x86上用target属性单独编译向量版本，运行时按CPU选择
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define FOOLHEX_FORMAT_X86 1
+#include <immintrin.h>
+#endif
+
+static const char kHexDigits[] = "0123456789ABCDEF";
+
+// 每种显示方式的元素大小、文字宽度（最长的值，例如i64的最小值有20个字符）和名字
+static const struct {
+    uint32_t nSize;
+    uint32_t nWidth;
+    const char* pName;
+} kFormats[CELL_FORMAT_COUNT] = {
+    { 1, 2, "hex" },
+    { 1, 3, "u8" },
+    { 1, 4, "i8" },
+    { 2, 5, "u16" },
+    { 2, 6, "i16" },
+    { 4, 10, "u32" },
+    { 4, 11, "i32" },
+    { 8, 20, "u64" },
+    { 8, 20, "i64" },
+    { 4, 15, "f32" },   // 能还原出原来的值的最短形式，或%.9g
+    { 8, 24, "f64" },   // 同上，或%.17g
+};
+
+// 00~99的两位数字，整数每次查表写两位
+struct DigitPairTable
+{
+    char pairs[200];
+    DigitPairTable()
+    {
+        for (int i = 0; i < 100; i++)
+        {
+            pairs[i * 2] = (char)('0' + i / 10);
+            pairs[i * 2 + 1] = (char)('0' + i % 10);
+        }
+    }
+};
+static const DigitPairTable kDigitPairs;
+
+// 从pEnd往前写v的十进制数字，返回第一个数字的位置
+static inline char* WriteDecimal(uint64_t v, char* pEnd)
+{
+    while (v >= 100)
+    {
+        uint32_t n = (uint32_t)(v % 100);
+        v /= 100;
+        pEnd -= 2;
+        memcpy(pEnd, &kDigitPairs.pairs[n * 2], 2);
+    }
+    if (v >= 10)
+    {
+        pEnd -= 2;
+        memcpy(pEnd, &kDigitPairs.pairs[v * 2], 2);
+    }
+    else
+    {
+        *--pEnd = (char)('0' + v);
+    }
+    return pEnd;
+}
+
+static void FormatHexScalar(const uint8_t* pData, size_t nCount, char* pText)
+{
+    for (size_t i = 0; i < nCount; i++)
+    {
+        pText[i * 2] = kHexDigits[pData[i] >> 4];
+        pText[i * 2 + 1] = kHexDigits[pData[i] & 0x0F];
+    }
+}
+
+// 每nSize个字节倒序，nBytes是nSize的整数倍
+static void SwapBytesScalar(const uint8_t* pSrc, size_t nBytes, uint32_t nSize, uint8_t* pDst)
+{
+    for (size_t i = 0; i < nBytes; i += nSize)
+    {
+        for (uint32_t j = 0; j < nSize; j++)
+        {
+            pDst[i + j] = pSrc[i + nSize - 1 - j];
+        }
+    }
+}
+
+#if defined(FOOLHEX_FORMAT_X86)
+
+// pshufb的掩码：每nSize个字节倒序，两个128位通道相同
+static void BuildSwapMask(uint32_t nSize, uint8_t* pMask)
+{
+    for (uint32_t j = 0; j < 32; j++)
+    {
+        pMask[j] = (uint8_t)((j & 15) / nSize * nSize + (nSize - 1 - j % nSize));
+    }
+}
+
+__attribute__((target("ssse3")))
+static void SwapBytesSsse3(const uint8_t* pSrc, size_t nBytes, uint32_t nSize, uint8_t* pDst)
+{
+    uint8_t arrMask[32];
+    BuildSwapMask(nSize, arrMask);
+    __m128i mask = _mm_loadu_si128((const __m128i*)arrMask);
+    size_t i = 0;
+    for (; i + 16 <= nBytes; i += 16)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i*)(pSrc + i));
+        _mm_storeu_si128((__m128i*)(pDst + i), _mm_shuffle_epi8(x, mask));
+    }
+    SwapBytesScalar(pSrc + i, nBytes - i, nSize, pDst + i);
+}
+
+__attribute__((target("avx2")))
+static void SwapBytesAvx2(const uint8_t* pSrc, size_t nBytes, uint32_t nSize, uint8_t* pDst)
+{
+    uint8_t arrMask[32];
+    BuildSwapMask(nSize, arrMask);
+    // 元素不跨越16字节的通道，按通道的shuffle就够了
+    __m256i mask = _mm256_loadu_si256((const __m256i*)arrMask);
+    size_t i = 0;
+    for (; i + 32 <= nBytes; i += 32)
+    {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(pSrc + i));
+        _mm256_storeu_si256((__m256i*)(pDst + i), _mm256_shuffle_epi8(x, mask));
+    }
+    SwapBytesScalar(pSrc + i, nBytes - i, nSize, pDst + i);
+}
+
+// 高低4位分别查16个字符的表，再交错成两个字符一个字节
+__attribute__((target("ssse3")))
+static void FormatHexSsse3(const uint8_t* pData, size_t nCount, char* pText)
+{
+    const __m128i digits = _mm_loadu_si128((const __m128i*)kHexDigits);
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    size_t i = 0;
+    for (; i + 16 <= nCount; i += 16)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i*)(pData + i));
+        __m128i hi = _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(x, 4), nibble));
+        __m128i lo = _mm_shuffle_epi8(digits, _mm_and_si128(x, nibble));
+        _mm_storeu_si128((__m128i*)(pText + i * 2), _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128((__m128i*)(pText + i * 2 + 16), _mm_unpackhi_epi8(hi, lo));
+    }
+    FormatHexScalar(pData + i, nCount - i, pText + i * 2);
+}
+
+__attribute__((target("avx2")))
+static void FormatHexAvx2(const uint8_t* pData, size_t nCount, char* pText)
+{
+    const __m256i digits = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)kHexDigits));
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    size_t i = 0;
+    for (; i + 32 <= nCount; i += 32)
+    {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(pData + i));
+        __m256i hi = _mm256_shuffle_epi8(digits, _mm256_and_si256(_mm256_srli_epi16(x, 4), nibble));
+        __m256i lo = _mm256_shuffle_epi8(digits, _mm256_and_si256(x, nibble));
+        // unpack按128位通道交错：a是字节0-7和16-23的字符，b是8-15和24-31的字符
+        __m256i a = _mm256_unpacklo_epi8(hi, lo);
+        __m256i b = _mm256_unpackhi_epi8(hi, lo);
+        _mm256_storeu_si256((__m256i*)(pText + i * 2), _mm256_permute2x128_si256(a, b, 0x20));
+        _mm256_storeu_si256((__m256i*)(pText + i * 2 + 32), _mm256_permute2x128_si256(a, b, 0x31));
+    }
+    FormatHexSsse3(pData + i, nCount - i, pText + i * 2);
+}
+
+#endif
+
+// 把元素读成64位值，有符号的做符号扩展，浮点数转成double的位；主机是小端
+template<typename T>
+static void WidenInteger(const uint8_t* pSource, size_t nCount, uint64_t* pValues)
+{
+    for (size_t i = 0; i < nCount; i++)
+    {
+        T v;
+        memcpy(&v, pSource + i * sizeof(T), sizeof(T));
+        pValues[i] = (uint64_t)(int64_t)v;
+    }
+}
+
+// 浮点数保留原来的位，f32放在低32位
+template<typename T>
+static void WidenFloat(const uint8_t* pSource, size_t nCount, uint64_t* pValues)
+{
+    for (size_t i = 0; i < nCount; i++)
+    {
+        uint64_t v = 0;
+        memcpy(&v, pSource + i * sizeof(T), sizeof(T));
+        pValues[i] = v;
+    }
+}
+
+// 把浮点数写到szValue，返回长度。有std::to_chars时用它（能还原原值的最短形式，比snprintf快得多）
+template<typename T>
+static int WriteFloat(uint64_t nBits, char* szValue, size_t nSize)
+{
+    T v;
+    memcpy(&v, &nBits, sizeof(T));
+#if defined(__cpp_lib_to_chars)
+    std::to_chars_result result = std::to_chars(szValue, szValue + nSize, v);
+    if (result.ec == std::errc())
+        return (int)(result.ptr - szValue);
+#endif
+    return snprintf(szValue, nSize, sizeof(T) == 4 ? "%.9g" : "%.17g", (double)v);
+}
+
+CCellFormatter::CCellFormatter(int nFormat /*= CELL_HEX*/, int bBigEndian /*= 0*/, int nImpl /*= FORMAT_IMPL_AUTO*/)
+{
+    int nBest = GetBestImplementation();
+    m_nImpl = (nImpl == FORMAT_IMPL_AUTO || nImpl > nBest) ? nBest : nImpl;
+    SetFormat(nFormat, bBigEndian);
+}
+
+void CCellFormatter::SetFormat(int nFormat, int bBigEndian)
+{
+    if (nFormat < 0 || nFormat >= CELL_FORMAT_COUNT)
+    {
+        nFormat = CELL_HEX;
+    }
+    m_nFormat = nFormat;
+    m_bBigEndian = bBigEndian ? 1 : 0;
+    m_nElementSize = kFormats[nFormat].nSize;
+    m_nTextWidth = kFormats[nFormat].nWidth;
+}
+
+void CCellFormatter::Format(const uint8_t* pData, size_t nCount, char* pText)
+{
+    if (!nCount)
+    {
+        return;
+    }
+    if (m_nFormat == CELL_HEX)
+    {
+#if defined(FOOLHEX_FORMAT_X86)
+        if (m_nImpl == FORMAT_IMPL_AVX2)
+        {
+            FormatHexAvx2(pData, nCount, pText);
+            return;
+        }
+        if (m_nImpl == FORMAT_IMPL_SSSE3)
+        {
+            FormatHexSsse3(pData, nCount, pText);
+            return;
+        }
+#endif
+        FormatHexScalar(pData, nCount, pText);
+        return;
+    }
+
+    // 第一遍：整个区域一起调整字节序、扩展成64位
+    const uint8_t* pSource = pData;
+    size_t nBytes = nCount * m_nElementSize;
+    if (m_bBigEndian && m_nElementSize > 1)
+    {
+        m_vecSwapped.resize(nBytes);
+#if defined(FOOLHEX_FORMAT_X86)
+        if (m_nImpl == FORMAT_IMPL_AVX2)
+            SwapBytesAvx2(pData, nBytes, m_nElementSize, &m_vecSwapped[0]);
+        else if (m_nImpl == FORMAT_IMPL_SSSE3)
+            SwapBytesSsse3(pData, nBytes, m_nElementSize, &m_vecSwapped[0]);
+        else
+#endif
+            SwapBytesScalar(pData, nBytes, m_nElementSize, &m_vecSwapped[0]);
+        pSource = &m_vecSwapped[0];
+    }
+    m_vecValues.resize(nCount);
+    uint64_t* pValues = &m_vecValues[0];
+    switch (m_nFormat)
+    {
+    case CELL_U8:  WidenInteger<uint8_t>(pSource, nCount, pValues); break;
+    case CELL_I8:  WidenInteger<int8_t>(pSource, nCount, pValues); break;
+    case CELL_U16: WidenInteger<uint16_t>(pSource, nCount, pValues); break;
+    case CELL_I16: WidenInteger<int16_t>(pSource, nCount, pValues); break;
+    case CELL_U32: WidenInteger<uint32_t>(pSource, nCount, pValues); break;
+    case CELL_I32: WidenInteger<int32_t>(pSource, nCount, pValues); break;
+    case CELL_F32: WidenFloat<float>(pSource, nCount, pValues); break;
+    case CELL_F64: WidenFloat<double>(pSource, nCount, pValues); break;
+    default:       memcpy(pValues, pSource, nBytes); break;
+    }
+
+    // 第二遍：每个值写到自己的槽位里，右对齐
+    memset(pText, ' ', nCount * m_nTextWidth);
+    uint32_t nWidth = m_nTextWidth;
+    switch (m_nFormat)
+    {
+    case CELL_U8:
+    case CELL_U16:
+    case CELL_U32:
+    case CELL_U64:
+        for (size_t i = 0; i < nCount; i++)
+        {
+            WriteDecimal(pValues[i], pText + (i + 1) * nWidth);
+        }
+        break;
+    case CELL_F32:
+    case CELL_F64:
+        for (size_t i = 0; i < nCount; i++)
+        {
+            char szValue[32];
+            int n = m_nFormat == CELL_F32 ? WriteFloat<float>(pValues[i], szValue, sizeof(szValue))
+                                          : WriteFloat<double>(pValues[i], szValue, sizeof(szValue));
+            n = std::max(0, std::min(n, (int)nWidth));
+            memcpy(pText + (i + 1) * nWidth - n, szValue, n);
+        }
+        break;
+    default:
+        for (size_t i = 0; i < nCount; i++)
+        {
+            int64_t v = (int64_t)pValues[i];
+            char* pEnd = pText + (i + 1) * nWidth;
+            if (v < 0)
+            {
+                char* pDigits = WriteDecimal(0 - (uint64_t)v, pEnd);
+                *--pDigits = '-';
+            }
+            else
+            {
+                WriteDecimal((uint64_t)v, pEnd);
+            }
+        }
+        break;
+    }
+}
+
+void CCellFormatter::FormatPartial(const uint8_t* pData, size_t nBytes, char* pText) const
+{
+    memset(pText, ' ', m_nTextWidth);
+    nBytes = std::min<size_t>(nBytes, m_nTextWidth / 2);
+    FormatHexScalar(pData, nBytes, pText + m_nTextWidth - nBytes * 2);
+}
+
+const char* CCellFormatter::GetFormatName(int nFormat)
+{
+    return nFormat >= 0 && nFormat < CELL_FORMAT_COUNT ? kFormats[nFormat].pName : "?";
+}
+
+int CCellFormatter::GetBestImplementation()
+{
+#if defined(FOOLHEX_FORMAT_X86)
+    static int s_nBest = __builtin_cpu_supports("avx2") ? FORMAT_IMPL_AVX2
+                       : __builtin_cpu_supports("ssse3") ? FORMAT_IMPL_SSSE3 : FORMAT_IMPL_SCALAR;
+    return s_nBest;
+#else
+    return FORMAT_IMPL_SCALAR;
+#endif
+}
+
+const char* CCellFormatter::GetImplementationName(int nImpl)
+{
+    switch (nImpl)
+    {
+    case FORMAT_IMPL_SCALAR:
+        return "scalar";
+    case FORMAT_IMPL_SSSE3:
+        return "ssse3";
+    case FORMAT_IMPL_AVX2:
+        return "avx2";
+    default:
+        return "auto";
+    }
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+// 表格数据列的显示方式，一个单元格显示一个元素
+enum CellFormat {
+    CELL_HEX = 0,   // 每个字节两位十六进制，只有这种方式可以直接输入编辑
+    CELL_U8,
+    CELL_I8,
+    CELL_U16,
+    CELL_I16,
+    CELL_U32,
+    CELL_I32,
+    CELL_U64,
+    CELL_I64,
+    CELL_F32,
+    CELL_F64,
+    CELL_FORMAT_COUNT,
+};
+
+// 转换的实现，FORMAT_IMPL_AUTO按CPU自动选择
+enum {
+    FORMAT_IMPL_AUTO = 0,
+    FORMAT_IMPL_SCALAR,
+    FORMAT_IMPL_SSSE3,
+    FORMAT_IMPL_AVX2,
+};
+
+/************************************************************************/
+/* converts the visible bytes of the table to cell text a whole region at
+/* a time instead of cell by cell.
+/* typed formats take two passes: the elements are first gathered into
+/* an array of 64-bit values (byte-swapped for big endian with pshufb,
+/* 16/32 bytes per instruction, then sign or zero extended in a loop the
+/* compiler vectorizes), and every value is then written right-aligned
+/* into a fixed-width slot, integers two digits per table lookup, floats
+/* with std::to_chars where the library has it. hex is one pass that
+/* expands 16/32 bytes to digits per pshufb.
+/* the implementation is picked once from the running CPU, like
+/* CSearchKernel; the scalar one is used on other CPUs/compilers.
+/************************************************************************/
+class CCellFormatter
+{
+public:
+    CCellFormatter(int nFormat = CELL_HEX, int bBigEndian = 0, int nImpl = FORMAT_IMPL_AUTO);
+
+    void SetFormat(int nFormat, int bBigEndian);
+    int GetFormat() const { return m_nFormat; }
+    int IsBigEndian() const { return m_bBigEndian; }
+
+    /************************************************************************/
+    /* bytes per element / characters per cell text.
+    /************************************************************************/
+    uint32_t GetElementSize() const { return m_nElementSize; }
+    uint32_t GetTextWidth() const { return m_nTextWidth; }
+
+    /************************************************************************/
+    /* write nCount elements of pData (nCount * GetElementSize() bytes) to
+    /* pText, GetTextWidth() characters each, right-aligned and padded with
+    /* spaces, without a terminating zero.
+    /************************************************************************/
+    void Format(const uint8_t* pData, size_t nCount, char* pText);
+
+    /************************************************************************/
+    /* the nBytes (< element size) bytes of an incomplete element at the end
+    /* of a row or of the data, as hex digits right-aligned in one slot.
+    /************************************************************************/
+    void FormatPartial(const uint8_t* pData, size_t nBytes, char* pText) const;
+
+    static const char* GetFormatName(int nFormat);
+    static int GetBestImplementation();
+    static const char* GetImplementationName(int nImpl);
+
+private:
+    int m_nFormat;
+    int m_bBigEndian;
+    int m_nImpl;
+    uint32_t m_nElementSize;
+    uint32_t m_nTextWidth;
+    std::vector<uint8_t> m_vecSwapped;  // 大端时字节交换后的数据，重复使用
+    std::vector<uint64_t> m_vecValues;  // 第一遍的结果，浮点数存为double的位
+};
@@ -0,0 +1,478 @@
+#include "DataSummary.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static const ByteSummary kUnknown = { 0, 0, 0, 0 };
+
+void CByteSummarizer::Reset()
+{
+    memset(m_arrCount, 0, sizeof(m_arrCount));
+    m_nBytes = 0;
+    m_nZeroRun = 0;
+    m_nZeroRunBytes = 0;
+}
+
+void CByteSummarizer::Add(const uint8_t* pData, size_t nLength)
+{
+    for (size_t i = 0; i < nLength; i++)
+    {
+        uint8_t nByte = pData[i];
+        m_arrCount[nByte]++;
+        if (nByte == 0)
+        {
+            m_nZeroRun++;
+        }
+        else if (m_nZeroRun)
+        {
+            if (m_nZeroRun >= ZERO_RUN_MIN)
+                m_nZeroRunBytes += m_nZeroRun;
+            m_nZeroRun = 0;
+        }
+    }
+    m_nBytes += nLength;
+}
+
+void CByteSummarizer::Get(ByteSummary* pSummary)
+{
+    if (!m_nBytes)
+    {
+        *pSummary = kUnknown;
+        return;
+    }
+    double dBytes = (double)m_nBytes;
+    double dEntropy = 0;
+    uint64_t nAscii = m_arrCount['\t'] + m_arrCount['\n'] + m_arrCount['\r'];
+    for (int i = 0; i < 256; i++)
+    {
+        if (m_arrCount[i])
+        {
+            double p = m_arrCount[i] / dBytes;
+            dEntropy -= p * std::log2(p);
+        }
+        if (i >= 0x20 && i < 0x7F)
+            nAscii += m_arrCount[i];
+    }
+    // 块末尾的连续0也算，块与块之间不连起来
+    uint64_t nZero = m_nZeroRunBytes + (m_nZeroRun >= ZERO_RUN_MIN ? m_nZeroRun : 0);
+    pSummary->fEntropy = (float)dEntropy;
+    pSummary->fZero = (float)(nZero / dBytes);
+    pSummary->fAscii = (float)(nAscii / dBytes);
+    pSummary->fKnown = 1;
+}
+
+CSummaryPyramid::CSummaryPyramid()
+    : m_nSize(0), m_nBlockSize(1)
+{
+}
+
+void CSummaryPyramid::Reset(FileOffset nSize, uint32_t nBlockSize)
+{
+    m_nSize = 0;
+    m_nBlockSize = nBlockSize ? nBlockSize : 1;
+    m_vecLevels.clear();
+    Resize(nSize);
+}
+
+void CSummaryPyramid::Resize(FileOffset nSize)
+{
+    size_t nOldBlocks = GetBlockCount();
+    size_t nBlocks = (size_t)((nSize + m_nBlockSize - 1) / m_nBlockSize);
+    m_nSize = nSize;
+    if (m_vecLevels.empty())
+    {
+        m_vecLevels.resize(1);
+    }
+    m_vecLevels[0].resize(nBlocks, kUnknown);
+    BuildLevels();
+    // 原来的最后一块和新加的块上面的节点要重新合并
+    size_t nFirst = std::min(nOldBlocks, nBlocks);
+    UpdateParents(nFirst ? nFirst - 1 : 0, nBlocks);
+}
+
+void CSummaryPyramid::SetBlocks(size_t nFirst, const ByteSummary* pSummaries, size_t nCount)
+{
+    std::vector<ByteSummary>& vecBlocks = m_vecLevels[0];
+    if (nFirst >= vecBlocks.size())
+    {
+        return;
+    }
+    nCount = std::min(nCount, vecBlocks.size() - nFirst);
+    std::copy(pSummaries, pSummaries + nCount, vecBlocks.begin() + nFirst);
+    UpdateParents(nFirst, nFirst + nCount);
+}
+
+void CSummaryPyramid::Query(FileOffset nStart, FileOffset nEnd, Total* pTotal) const
+{
+    if (nEnd > m_nSize)
+    {
+        // 超出已知大小的部分（还没统计到的追加数据）算作未知
+        FileOffset nOutside = nEnd - std::max(nStart, m_nSize);
+        pTotal->dBytes += (double)nOutside;
+        nEnd = m_nSize;
+    }
+    if (nStart >= nEnd)
+    {
+        return;
+    }
+    // 节点不长于查询范围的最粗一层，范围内最多约FANOUT+1个节点
+    size_t nLevel = 0;
+    while (nLevel + 1 < m_vecLevels.size() && NodeSize(nLevel + 1) <= nEnd - nStart)
+    {
+        nLevel++;
+    }
+    FileOffset nNodeSize = NodeSize(nLevel);
+    const std::vector<ByteSummary>& vecNodes = m_vecLevels[nLevel];
+    for (size_t i = (size_t)(nStart / nNodeSize); i < vecNodes.size() && (FileOffset)i * nNodeSize < nEnd; i++)
+    {
+        FileOffset nNodeStart = (FileOffset)i * nNodeSize;
+        FileOffset nNodeEnd = std::min(nNodeStart + nNodeSize, m_nSize);
+        FileOffset nOverlap = std::min(nEnd, nNodeEnd) - std::max(nStart, nNodeStart);
+        AddTotal(pTotal, vecNodes[i], (double)nOverlap);
+    }
+}
+
+void CSummaryPyramid::AddTotal(Total* pTotal, const ByteSummary& summary, double dBytes)
+{
+    double dKnown = dBytes * summary.fKnown;
+    pTotal->dBytes += dBytes;
+    pTotal->dKnown += dKnown;
+    pTotal->dEntropy += dKnown * summary.fEntropy;
+    pTotal->dZero += dKnown * summary.fZero;
+    pTotal->dAscii += dKnown * summary.fAscii;
+}
+
+void CSummaryPyramid::GetAverage(const Total& total, ByteSummary* pSummary)
+{
+    if (total.dKnown <= 0 || total.dBytes <= 0)
+    {
+        *pSummary = kUnknown;
+        return;
+    }
+    pSummary->fEntropy = (float)(total.dEntropy / total.dKnown);
+    pSummary->fZero = (float)(total.dZero / total.dKnown);
+    pSummary->fAscii = (float)(total.dAscii / total.dKnown);
+    pSummary->fKnown = (float)(total.dKnown / total.dBytes);
+}
+
+FileOffset CSummaryPyramid::NodeSize(size_t nLevel) const
+{
+    FileOffset nSize = m_nBlockSize;
+    while (nLevel--)
+    {
+        nSize *= FANOUT;
+    }
+    return nSize;
+}
+
+void CSummaryPyramid::BuildLevels()
+{
+    size_t nLevels = 1;
+    while (m_vecLevels[nLevels - 1].size() > 1)
+    {
+        size_t nCount = (m_vecLevels[nLevels - 1].size() + FANOUT - 1) / FANOUT;
+        if (m_vecLevels.size() <= nLevels)
+        {
+            m_vecLevels.resize(nLevels + 1);
+        }
+        m_vecLevels[nLevels].resize(nCount, kUnknown);
+        nLevels++;
+    }
+    m_vecLevels.resize(nLevels);
+}
+
+void CSummaryPyramid::UpdateParents(size_t nFirst, size_t nEnd)
+{
+    for (size_t nLevel = 1; nLevel < m_vecLevels.size() && nFirst < nEnd; nLevel++)
+    {
+        const std::vector<ByteSummary>& vecChildren = m_vecLevels[nLevel - 1];
+        std::vector<ByteSummary>& vecNodes = m_vecLevels[nLevel];
+        FileOffset nChildSize = NodeSize(nLevel - 1);
+        nFirst /= FANOUT;
+        nEnd = std::min((nEnd + FANOUT - 1) / FANOUT, vecNodes.size());
+        for (size_t i = nFirst; i < nEnd; i++)
+        {
+            Total total = { 0, 0, 0, 0, 0 };
+            size_t nChildEnd = std::min((i + 1) * FANOUT, vecChildren.size());
+            for (size_t j = i * FANOUT; j < nChildEnd; j++)
+            {
+                FileOffset nChildStart = (FileOffset)j * nChildSize;
+                AddTotal(&total, vecChildren[j], (double)(std::min(nChildStart + nChildSize, m_nSize) - nChildStart));
+            }
+            GetAverage(total, &vecNodes[i]);
+        }
+    }
+}
+
+CDataSummary::CDataSummary()
+    : m_pFile(NULL), m_nAddedDone(0), m_nFileSize(0), m_nBlockSize(MIN_BLOCK_SIZE),
+      m_nBlockCount(0), m_nChunkCount(0), m_bStop(false), m_nNextChunk(0), m_nChunksDone(0), m_nBytesDone(0)
+{
+    m_added.Reset(0, ADDED_BLOCK_SIZE);
+}
+
+CDataSummary::~CDataSummary()
+{
+    Detach();
+}
+
+void CDataSummary::Attach(CLargeFile* pFile, const Notify& notify)
+{
+    Detach();
+    LargeInteger nSize;
+    pFile->GetFileSizeEx(&nSize);
+    m_pFile = pFile;
+    m_notify = notify;
+    m_nFileSize = nSize.QuadPart;
+    // 块数不超过MAX_BLOCKS，再大的文件金字塔也只占十几MB
+    m_nBlockSize = MIN_BLOCK_SIZE;
+    while (m_nFileSize / m_nBlockSize >= MAX_BLOCKS)
+    {
+        m_nBlockSize *= 2;
+    }
+    m_original.Reset(m_nFileSize, m_nBlockSize);
+    m_added.Reset(0, ADDED_BLOCK_SIZE);
+    m_nAddedDone = 0;
+    m_nBlockCount = m_original.GetBlockCount();
+    m_nChunkCount = (m_nBlockCount + CSummaryPyramid::FANOUT - 1) / CSummaryPyramid::FANOUT;
+    m_nNextChunk = 0;
+    m_nChunksDone = 0;
+    m_nBytesDone = 0;
+    m_tLastNotify = std::chrono::steady_clock::now();
+    m_bStop = false;
+
+    // 统计主要受读盘速度限制，线程不必太多
+    uint32_t nThreads = std::max(1u, std::min<uint32_t>(std::thread::hardware_concurrency(), WORKER_COUNT));
+    nThreads = (uint32_t)std::min<size_t>(nThreads, m_nChunkCount);
+    for (uint32_t i = 0; i < nThreads; i++)
+    {
+        m_vecThreads.push_back(std::thread(&CDataSummary::WorkerMain, this));
+    }
+}
+
+void CDataSummary::Detach()
+{
+    m_bStop = true;
+    for (size_t i = 0; i < m_vecThreads.size(); i++)
+    {
+        m_vecThreads[i].join();
+    }
+    m_vecThreads.clear();
+    m_pFile = NULL;
+    m_notify = Notify();
+    m_vecFinished.clear();
+    m_nFileSize = 0;
+    m_nBlockCount = 0;
+    m_nChunkCount = 0;
+    m_nChunksDone = 0;
+    m_nBytesDone = 0;
+    m_original.Reset(0, MIN_BLOCK_SIZE);
+    m_added.Reset(0, ADDED_BLOCK_SIZE);
+    m_nAddedDone = 0;
+}
+
+int CDataSummary::Update(CEditBuffer* pBuffer)
+{
+    int bChanged = FALSE;
+    std::vector<Chunk> vecFinished;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        vecFinished.swap(m_vecFinished);
+    }
+    for (size_t i = 0; i < vecFinished.size(); i++)
+    {
+        m_original.SetBlocks(vecFinished[i].nFirstBlock, &vecFinished[i].vecBlocks[0], vecFinished[i].vecBlocks.size());
+        bChanged = TRUE;
+    }
+
+    // 追加缓冲区只会变长，从最后一个不满的块开始统计新追加的数据
+    FileOffset nAdded = pBuffer->GetAddedSize();
+    if (nAdded < m_added.GetSize())
+    {
+        m_added.Reset(0, ADDED_BLOCK_SIZE);
+        m_nAddedDone = 0;
+    }
+    if (nAdded != m_added.GetSize())
+    {
+        m_added.Resize(nAdded);
+        std::vector<ByteSummary> vecBlocks;
+        CByteSummarizer summarizer;
+        for (FileOffset nOffset = m_nAddedDone; nOffset < nAdded; nOffset += ADDED_BLOCK_SIZE)
+        {
+            ByteSummary summary;
+            summarizer.Reset();
+            summarizer.Add(pBuffer->GetAddedData(nOffset), (size_t)std::min<FileOffset>(ADDED_BLOCK_SIZE, nAdded - nOffset));
+            summarizer.Get(&summary);
+            vecBlocks.push_back(summary);
+        }
+        m_added.SetBlocks((size_t)(m_nAddedDone / ADDED_BLOCK_SIZE), &vecBlocks[0], vecBlocks.size());
+        m_nAddedDone = nAdded / ADDED_BLOCK_SIZE * ADDED_BLOCK_SIZE;
+        bChanged = TRUE;
+    }
+    return bChanged;
+}
+
+void CDataSummary::Render(CEditBuffer* pBuffer, size_t nSlices, std::vector<ByteSummary>& vecSlices)
+{
+    vecSlices.assign(nSlices, kUnknown);
+    FileOffset nSize = pBuffer->GetSize();
+    if (!nSlices || !nSize)
+    {
+        return;
+    }
+    std::vector<CSummaryPyramid::Total> vecTotals(nSlices);
+    memset(&vecTotals[0], 0, nSlices * sizeof(vecTotals[0]));
+    // 第i片的结尾是nSize*(i+1)/nSlices，拆开计算避免溢出
+    FileOffset nQuotient = nSize / nSlices;
+    FileOffset nRemainder = nSize % nSlices;
+    size_t nSlice = 0;
+    FileOffset nSliceEnd = nQuotient + nRemainder / nSlices;
+
+    // 片段和切片都按偏移顺序前进，每段只查一次金字塔
+    pBuffer->ForEachPiece([&](FileOffset nLogical, const EditPiece& piece) -> bool
+    {
+        FileOffset nPos = nLogical;
+        FileOffset nPieceEnd = nLogical + piece.nLength;
+        while (nPos < nPieceEnd)
+        {
+            while (nSliceEnd <= nPos)
+            {
+                nSlice++;
+                nSliceEnd = (FileOffset)(nSlice + 1) * nQuotient + (FileOffset)(nSlice + 1) * nRemainder / nSlices;
+            }
+            FileOffset nEnd = std::min(nPieceEnd, nSliceEnd);
+            FileOffset nSource = piece.nOffset + (nPos - nLogical);
+            CSummaryPyramid::Total* pTotal = &vecTotals[nSlice];
+            if (piece.nSource == PIECE_ORIGINAL)
+            {
+                m_original.Query(nSource, nSource + (nEnd - nPos), pTotal);
+            }
+            else if (piece.nSource == PIECE_ADDED)
+            {
+                m_added.Query(nSource, nSource + (nEnd - nPos), pTotal);
+            }
+            else
+            {
+                // 填充片段不用读数据
+                bool bPrintable = (piece.nFill >= 0x20 && piece.nFill < 0x7F) || piece.nFill == '\t' || piece.nFill == '\n' || piece.nFill == '\r';
+                ByteSummary fill = { 0, piece.nFill == 0 ? 1.0f : 0.0f, bPrintable ? 1.0f : 0.0f, 1 };
+                CSummaryPyramid::AddTotal(pTotal, fill, (double)(nEnd - nPos));
+            }
+            nPos = nEnd;
+        }
+        return true;
+    });
+    for (size_t i = 0; i < nSlices; i++)
+    {
+        CSummaryPyramid::GetAverage(vecTotals[i], &vecSlices[i]);
+    }
+}
+
+void CDataSummary::GetProgress(FileOffset* pnDone, FileOffset* pnTotal)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    *pnDone = m_nBytesDone;
+    *pnTotal = m_nFileSize;
+}
+
+int CDataSummary::SummarizeBlock(FileOffset nStart, size_t nLength, PinnedView& view, CByteSummarizer& summarizer, ByteSummary* pSummary)
+{
+    summarizer.Reset();
+    size_t nDone = 0;
+    while (nDone < nLength)
+    {
+        if (m_bStop)
+        {
+            return FALSE;
+        }
+        FileOffset nPos = nStart + nDone;
+        if (!view.pData || nPos < view.nStart || nPos >= view.nStart + view.dwSize)
+        {
+            // 块比视图小，一个视图固定一次就读完它覆盖的所有块，少抢缓存锁
+            UnpinView(view);
+            LargeInteger nVisit;
+            nVisit.QuadPart = nPos;
+            uint32_t dwView = 0;
+            const uint8_t* pData = (const uint8_t*)m_pFile->PinFilePosition(nVisit, &dwView);
+            if (!pData || !dwView)
+            {
+                return FALSE;
+            }
+            view.pData = pData;
+            view.nStart = nPos;
+            view.dwSize = dwView;
+        }
+        size_t n = std::min((size_t)(view.nStart + view.dwSize - nPos), nLength - nDone);
+        summarizer.Add(view.pData + (nPos - view.nStart), n);
+        nDone += n;
+    }
+    summarizer.Get(pSummary);
+    return TRUE;
+}
+
+void CDataSummary::UnpinView(PinnedView& view)
+{
+    if (view.pData)
+    {
+        m_pFile->UnpinView(view.pData);
+        view.pData = NULL;
+    }
+}
+
+void CDataSummary::WorkerMain()
+{
+    CByteSummarizer summarizer;
+    for (;;)
+    {
+        size_t nChunk = m_nNextChunk++;
+        if (m_bStop || nChunk >= m_nChunkCount)
+        {
+            return;
+        }
+        Chunk chunk;
+        chunk.nFirstBlock = nChunk * CSummaryPyramid::FANOUT;
+        size_t nCount = std::min<size_t>(CSummaryPyramid::FANOUT, m_nBlockCount - chunk.nFirstBlock);
+        FileOffset nStart = (FileOffset)chunk.nFirstBlock * m_nBlockSize;
+        FileOffset nEnd = std::min<FileOffset>(nStart + (FileOffset)nCount * m_nBlockSize, m_nFileSize);
+        LargeInteger nAdvise;
+        nAdvise.QuadPart = nStart;
+        m_pFile->AdviseWillNeed(nAdvise, nEnd - nStart);
+
+        chunk.vecBlocks.resize(nCount);
+        PinnedView view = { NULL, 0, 0 };
+        for (size_t i = 0; i < nCount; i++)
+        {
+            FileOffset nBlock = nStart + (FileOffset)i * m_nBlockSize;
+            if (!SummarizeBlock(nBlock, (size_t)std::min<FileOffset>(m_nBlockSize, nEnd - nBlock), view, summarizer, &chunk.vecBlocks[i]))
+            {
+                if (m_bStop)
+                {
+                    UnpinView(view);
+                    return;
+                }
+                // 读不出的块保持未知
+                chunk.vecBlocks[i] = kUnknown;
+            }
+        }
+        UnpinView(view);
+
+        // 交给UI线程合并，通知不要太频繁
+        Notify notify;
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_vecFinished.push_back(std::move(chunk));
+            m_nChunksDone++;
+            m_nBytesDone += nEnd - nStart;
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            if (m_nChunksDone == m_nChunkCount || now - m_tLastNotify >= std::chrono::milliseconds(100))
+            {
+                m_tLastNotify = now;
+                notify = m_notify;
+            }
+        }
+        if (notify)
+        {
+            notify();
+        }
+    }
+}
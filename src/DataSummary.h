@@ -0,0 +1,197 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <chrono>
+#include "EditBuffer.h"
+
+// 一段数据的概况，各项都是其中已经统计过的字节上的平均值
+typedef struct {
+    float fEntropy;     // 字节分布的熵（0~8位每字节），大范围取其中各块的平均
+    float fZero;        // 处在较长的连续0中的字节比例
+    float fAscii;       // 可打印ASCII字符（含制表、换行、回车）的比例
+    float fKnown;       // 已经统计过的字节比例，0表示还不知道
+} ByteSummary;
+
+/************************************************************************/
+/* streaming statistics of one block: byte histogram for the entropy,
+/* bytes in zero runs of at least ZERO_RUN_MIN, printable ASCII bytes.
+/* the data of a block may be added in several parts.
+/************************************************************************/
+class CByteSummarizer
+{
+public:
+    enum { ZERO_RUN_MIN = 16 };
+
+    CByteSummarizer() { Reset(); }
+    void Reset();
+    void Add(const uint8_t* pData, size_t nLength);
+    void Get(ByteSummary* pSummary);
+
+private:
+    uint64_t m_arrCount[256];
+    uint64_t m_nBytes;
+    uint64_t m_nZeroRun;        // 当前这段连续0的长度
+    uint64_t m_nZeroRunBytes;   // 已结束的足够长的连续0的字节数
+};
+
+/************************************************************************/
+/* summary pyramid over one immutable (or append-only) byte source.
+/* level 0 holds one ByteSummary per block, every level above merges 64
+/* nodes of the level below, up to a single root. a range query picks the
+/* coarsest level whose nodes are not longer than the range, so it reads
+/* at most ~65 nodes whatever the size of the source (the nodes cut by
+/* the range ends count in proportion to the overlap). blocks not set yet
+/* are unknown, and the known part of every node is tracked, so a pyramid
+/* can be queried while it is being filled.
+/* not thread safe: only the UI thread touches it.
+/************************************************************************/
+class CSummaryPyramid
+{
+public:
+    enum { FANOUT = 64 };
+
+    // 查询结果的累加器，各项按已知字节数加权
+    typedef struct {
+        double dBytes;
+        double dKnown;
+        double dEntropy;
+        double dZero;
+        double dAscii;
+    } Total;
+
+    CSummaryPyramid();
+
+    /************************************************************************/
+    /* start over with nSize unknown bytes in blocks of nBlockSize.
+    /************************************************************************/
+    void Reset(FileOffset nSize, uint32_t nBlockSize);
+
+    /************************************************************************/
+    /* change the size keeping the summaries of the blocks before it; the
+    /* blocks added are unknown. used for the growing append buffer.
+    /************************************************************************/
+    void Resize(FileOffset nSize);
+
+    FileOffset GetSize() const { return m_nSize; }
+    uint32_t GetBlockSize() const { return m_nBlockSize; }
+    size_t GetBlockCount() const { return m_vecLevels.empty() ? 0 : m_vecLevels[0].size(); }
+
+    /************************************************************************/
+    /* set the summaries of nCount blocks from nFirst and update the nodes
+    /* above them.
+    /************************************************************************/
+    void SetBlocks(size_t nFirst, const ByteSummary* pSummaries, size_t nCount);
+
+    /************************************************************************/
+    /* add the summary of [nStart, nEnd) to *pTotal.
+    /************************************************************************/
+    void Query(FileOffset nStart, FileOffset nEnd, Total* pTotal) const;
+
+    static void AddTotal(Total* pTotal, const ByteSummary& summary, double dBytes);
+    static void GetAverage(const Total& total, ByteSummary* pSummary);
+
+private:
+    FileOffset NodeSize(size_t nLevel) const;
+    void BuildLevels();
+    void UpdateParents(size_t nFirst, size_t nEnd);
+
+    FileOffset m_nSize;
+    uint32_t m_nBlockSize;
+    std::vector<std::vector<ByteSummary> > m_vecLevels;
+};
+
+/************************************************************************/
+/* overview statistics of the edited data, for the minimap.
+/* the data is never summarized as a whole: there is one pyramid over the
+/* original file, filled by a few worker threads in the background (they
+/* read pinned views, so they never touch the edit buffer; pinning does
+/* not move the current view of the file, so they cannot unmap what the
+/* UI thread is visiting either), and one over
+/* the append buffer of the edit layer, extended on the UI thread by the
+/* bytes each edit appends. the summary of any edited range is composed
+/* from the pieces of the edit buffer: original and added pieces query
+/* their pyramid, fill pieces are known without reading. edits therefore
+/* never invalidate anything, even when they shift the rest of the file,
+/* and Render costs O(slices + pieces), not O(file).
+/* blocks are 64 KB, or larger so the original pyramid has at most about
+/* a million of them.
+/************************************************************************/
+class CDataSummary
+{
+public:
+    typedef std::function<void()> Notify;
+
+    CDataSummary();
+    ~CDataSummary();
+
+    /************************************************************************/
+    /* start summarizing an opened file in the background; notify is called
+    /* on a worker thread now and then while it progresses and once at the
+    /* end. Detach() must be called before the file is closed.
+    /************************************************************************/
+    void Attach(CLargeFile* pFile, const Notify& notify);
+    void Detach();
+
+    /************************************************************************/
+    /* UI thread: merge the blocks the workers finished and summarize the
+    /* data appended to pBuffer since the last call. return TRUE if
+    /* anything changed.
+    /************************************************************************/
+    int Update(CEditBuffer* pBuffer);
+
+    /************************************************************************/
+    /* UI thread: cut the edited data into nSlices equal slices and summarize
+    /* each of them.
+    /************************************************************************/
+    void Render(CEditBuffer* pBuffer, size_t nSlices, std::vector<ByteSummary>& vecSlices);
+
+    /************************************************************************/
+    /* bytes of the original file summarized so far / in total.
+    /************************************************************************/
+    void GetProgress(FileOffset* pnDone, FileOffset* pnTotal);
+
+private:
+    enum { ADDED_BLOCK_SIZE = 4096, MIN_BLOCK_SIZE = 64 * 1024, MAX_BLOCKS = 1 << 20, WORKER_COUNT = 4 };
+    // 一个后台任务：FANOUT个相邻的块
+    struct Chunk
+    {
+        size_t nFirstBlock;
+        std::vector<ByteSummary> vecBlocks;
+    };
+
+    // 工作线程固定着的视图，同一个任务的相邻块共用
+    struct PinnedView
+    {
+        const uint8_t* pData;
+        FileOffset nStart;
+        uint32_t dwSize;
+    };
+
+    void WorkerMain();
+    int SummarizeBlock(FileOffset nStart, size_t nLength, PinnedView& view, CByteSummarizer& summarizer, ByteSummary* pSummary);
+    void UnpinView(PinnedView& view);
+
+    CLargeFile* m_pFile;
+    Notify m_notify;
+    CSummaryPyramid m_original;         // 原文件，只在UI线程访问
+    CSummaryPyramid m_added;            // 追加缓冲区，只在UI线程访问
+    FileOffset m_nAddedDone;            // 追加缓冲区中已经统计过的整块的结尾
+
+    // 后台统计
+    FileOffset m_nFileSize;
+    uint32_t m_nBlockSize;
+    size_t m_nBlockCount;
+    size_t m_nChunkCount;
+    std::vector<std::thread> m_vecThreads;
+    std::atomic<bool> m_bStop;
+    std::atomic<size_t> m_nNextChunk;
+    std::mutex m_lock;                  // 保护下面的结果交付
+    std::vector<Chunk> m_vecFinished;   // 统计完、还没有并入m_original的块
+    size_t m_nChunksDone;
+    FileOffset m_nBytesDone;
+    std::chrono::steady_clock::time_point m_tLastNotify;
+};
@@ -0,0 +1,468 @@
+#include "EditBuffer.h"
+#include <cstring>
+
+// FILL片段通过Visit返回时使用的缓冲区大小
+static const uint32_t kFillChunkSize = 4096;
+
+struct CEditBuffer::Node
+{
+    EditPiece piece;
+    uint32_t nPriority;
+    FileOffset nTotal; // 子树所有片段的总长度
+    Node* pLeft;
+    Node* pRight;
+
+    void Update()
+    {
+        nTotal = piece.nLength + (pLeft ? pLeft->nTotal : 0) + (pRight ? pRight->nTotal : 0);
+    }
+};
+
+CEditBuffer::CEditBuffer()
+    : m_pFile(NULL), m_pRoot(NULL), m_nPieceCount(0), m_nSeed(2463534242u), m_bModified(FALSE)
+{
+}
+
+CEditBuffer::~CEditBuffer()
+{
+    Detach();
+}
+
+void CEditBuffer::Attach(CLargeFile* pFile)
+{
+    Detach();
+    m_pFile = pFile;
+    LargeInteger nFileSize;
+    pFile->GetFileSizeEx(&nFileSize);
+    if (nFileSize.QuadPart)
+    {
+        EditPiece piece;
+        piece.nSource = PIECE_ORIGINAL;
+        piece.nFill = 0;
+        piece.nOffset = 0;
+        piece.nLength = nFileSize.QuadPart;
+        m_pRoot = NewNode(piece);
+    }
+}
+
+void CEditBuffer::Detach()
+{
+    FreeTree(m_pRoot);
+    m_pRoot = NULL;
+    m_nPieceCount = 0;
+    m_pFile = NULL;
+    std::vector<uint8_t>().swap(m_vecAdded);
+    m_bModified = FALSE;
+}
+
+FileOffset CEditBuffer::GetSize() const
+{
+    return m_pRoot ? m_pRoot->nTotal : 0;
+}
+
+int CEditBuffer::IsModified() const
+{
+    return m_bModified;
+}
+
+size_t CEditBuffer::GetMemoryUsage() const
+{
+    return m_nPieceCount * sizeof(Node) + m_vecAdded.capacity();
+}
+
+size_t CEditBuffer::Read(FileOffset nOffset, uint8_t* pBuffer, size_t nLength)
+{
+    FileOffset nSize = GetSize();
+    if (nOffset >= nSize)
+    {
+        return 0;
+    }
+    if (nLength > nSize - nOffset)
+    {
+        nLength = (size_t)(nSize - nOffset);
+    }
+    ReadRange(m_pRoot, 0, nOffset, nOffset + nLength, pBuffer);
+    return nLength;
+}
+
+const uint8_t* CEditBuffer::Visit(FileOffset nOffset, uint32_t* pdwAvalibleSize)
+{
+    Node* pNode = m_pRoot;
+    while (pNode)
+    {
+        FileOffset nLeft = pNode->pLeft ? pNode->pLeft->nTotal : 0;
+        if (nOffset < nLeft)
+        {
+            pNode = pNode->pLeft;
+            continue;
+        }
+        nOffset -= nLeft;
+        if (nOffset >= pNode->piece.nLength)
+        {
+            nOffset -= pNode->piece.nLength;
+            pNode = pNode->pRight;
+            continue;
+        }
+
+        const EditPiece& piece = pNode->piece;
+        FileOffset nRemain = piece.nLength - nOffset;
+        uint32_t dwAvalible = nRemain > 0xFFFFFFFFull ? 0xFFFFFFFFu : (uint32_t)nRemain;
+        const uint8_t* pData = NULL;
+        if (piece.nSource == PIECE_ORIGINAL)
+        {
+            LargeInteger nVisit;
+            nVisit.QuadPart = piece.nOffset + nOffset;
+            uint32_t dwView = 0;
+            pData = (const uint8_t*)m_pFile->VisitFilePosition(nVisit, &dwView);
+            if (dwView < dwAvalible)
+                dwAvalible = dwView;
+        }
+        else if (piece.nSource == PIECE_ADDED)
+        {
+            pData = &m_vecAdded[(size_t)(piece.nOffset + nOffset)];
+        }
+        else
+        {
+            static thread_local uint8_t s_fill[kFillChunkSize];
+            memset(s_fill, piece.nFill, kFillChunkSize);
+            if (dwAvalible > kFillChunkSize)
+                dwAvalible = kFillChunkSize;
+            pData = s_fill;
+        }
+        if (pdwAvalibleSize)
+        {
+            *pdwAvalibleSize = pData ? dwAvalible : 0;
+        }
+        return pData;
+    }
+    if (pdwAvalibleSize)
+    {
+        *pdwAvalibleSize = 0;
+    }
+    return NULL;
+}
+
+int CEditBuffer::Overwrite(FileOffset nOffset, const uint8_t* pData, size_t nLength)
+{
+    FileOffset nSize = GetSize();
+    if (nOffset > nSize || !nLength)
+    {
+        return FALSE;
+    }
+    // 写过文件尾的部分相当于追加
+    FileOffset nReplace = nLength < nSize - nOffset ? nLength : nSize - nOffset;
+    EditPiece piece = AppendData(pData, nLength);
+    Replace(nOffset, nReplace, &piece, 1);
+    return TRUE;
+}
+
+int CEditBuffer::Insert(FileOffset nOffset, const uint8_t* pData, size_t nLength)
+{
+    if (nOffset > GetSize() || !nLength)
+    {
+        return FALSE;
+    }
+    EditPiece piece = AppendData(pData, nLength);
+    Replace(nOffset, 0, &piece, 1);
+    return TRUE;
+}
+
+int CEditBuffer::Delete(FileOffset nOffset, FileOffset nLength)
+{
+    FileOffset nSize = GetSize();
+    if (nOffset >= nSize || !nLength)
+    {
+        return FALSE;
+    }
+    if (nLength > nSize - nOffset)
+    {
+        nLength = nSize - nOffset;
+    }
+    Replace(nOffset, nLength, NULL, 0);
+    return TRUE;
+}
+
+int CEditBuffer::Fill(FileOffset nOffset, FileOffset nLength, uint8_t nByte)
+{
+    FileOffset nSize = GetSize();
+    if (nOffset >= nSize || !nLength)
+    {
+        return FALSE;
+    }
+    if (nLength > nSize - nOffset)
+    {
+        nLength = nSize - nOffset;
+    }
+    EditPiece piece;
+    piece.nSource = PIECE_FILL;
+    piece.nFill = nByte;
+    piece.nOffset = 0;
+    piece.nLength = nLength;
+    Replace(nOffset, nLength, &piece, 1);
+    return TRUE;
+}
+
+void CEditBuffer::GetPieces(FileOffset nOffset, FileOffset nLength, std::vector<EditPiece>& vecPieces) const
+{
+    vecPieces.clear();
+    if (nLength)
+    {
+        CollectPieces(m_pRoot, 0, nOffset, nOffset + nLength, vecPieces);
+    }
+}
+
+void CEditBuffer::ReplacePieces(FileOffset nOffset, FileOffset nDeleteLength, const std::vector<EditPiece>& vecPieces)
+{
+    Replace(nOffset, nDeleteLength, vecPieces.empty() ? NULL : &vecPieces[0], vecPieces.size());
+}
+
+void CEditBuffer::CollectPieces(const Node* pNode, FileOffset nBase, FileOffset nOffset, FileOffset nEnd, std::vector<EditPiece>& vecPieces)
+{
+    // 与ReadRange相同的区间遍历，只是取出片段而不复制数据
+    while (pNode && nBase < nEnd && nBase + pNode->nTotal > nOffset)
+    {
+        FileOffset nLeft = pNode->pLeft ? pNode->pLeft->nTotal : 0;
+        FileOffset nPieceStart = nBase + nLeft;
+        FileOffset nPieceEnd = nPieceStart + pNode->piece.nLength;
+        if (nOffset < nPieceStart)
+        {
+            CollectPieces(pNode->pLeft, nBase, nOffset, nEnd, vecPieces);
+        }
+        if (nPieceStart < nEnd && nPieceEnd > nOffset)
+        {
+            FileOffset nFrom = nPieceStart > nOffset ? nPieceStart : nOffset;
+            FileOffset nTo = nPieceEnd < nEnd ? nPieceEnd : nEnd;
+            EditPiece piece = pNode->piece;
+            if (piece.nSource != PIECE_FILL)
+                piece.nOffset += nFrom - nPieceStart;
+            piece.nLength = nTo - nFrom;
+            vecPieces.push_back(piece);
+        }
+        nBase = nPieceEnd;
+        pNode = pNode->pRight;
+    }
+}
+
+void CEditBuffer::ForEachPiece(const std::function<bool(FileOffset nLogicalOffset, const EditPiece& piece)>& fn) const
+{
+    // 显式栈的中序遍历，片段很多时也不会递归过深
+    std::vector<const Node*> vecStack;
+    const Node* pNode = m_pRoot;
+    FileOffset nLogical = 0;
+    while (pNode || !vecStack.empty())
+    {
+        while (pNode)
+        {
+            vecStack.push_back(pNode);
+            pNode = pNode->pLeft;
+        }
+        pNode = vecStack.back();
+        vecStack.pop_back();
+        if (!fn(nLogical, pNode->piece))
+        {
+            return;
+        }
+        nLogical += pNode->piece.nLength;
+        pNode = pNode->pRight;
+    }
+}
+
+CEditBuffer::Node* CEditBuffer::NewNode(const EditPiece& piece)
+{
+    // xorshift32，只用于treap的随机优先级
+    m_nSeed ^= m_nSeed << 13;
+    m_nSeed ^= m_nSeed >> 17;
+    m_nSeed ^= m_nSeed << 5;
+
+    Node* pNode = new Node;
+    pNode->piece = piece;
+    pNode->nPriority = m_nSeed;
+    pNode->nTotal = piece.nLength;
+    pNode->pLeft = NULL;
+    pNode->pRight = NULL;
+    m_nPieceCount++;
+    return pNode;
+}
+
+void CEditBuffer::FreeTree(Node* pNode)
+{
+    std::vector<Node*> vecStack;
+    if (pNode)
+        vecStack.push_back(pNode);
+    while (!vecStack.empty())
+    {
+        Node* p = vecStack.back();
+        vecStack.pop_back();
+        if (p->pLeft)
+            vecStack.push_back(p->pLeft);
+        if (p->pRight)
+            vecStack.push_back(p->pRight);
+        delete p;
+        m_nPieceCount--;
+    }
+}
+
+void CEditBuffer::Split(Node* pNode, FileOffset nPos, Node*& pLeft, Node*& pRight)
+{
+    if (!pNode)
+    {
+        pLeft = pRight = NULL;
+        return;
+    }
+    FileOffset nLeft = pNode->pLeft ? pNode->pLeft->nTotal : 0;
+    if (nPos <= nLeft)
+    {
+        Split(pNode->pLeft, nPos, pLeft, pNode->pLeft);
+        pNode->Update();
+        pRight = pNode;
+    }
+    else if (nPos >= nLeft + pNode->piece.nLength)
+    {
+        Split(pNode->pRight, nPos - nLeft - pNode->piece.nLength, pNode->pRight, pRight);
+        pNode->Update();
+        pLeft = pNode;
+    }
+    else
+    {
+        // 切点落在片段中间，把片段一分为二
+        FileOffset nCut = nPos - nLeft;
+        EditPiece tail = pNode->piece;
+        if (tail.nSource != PIECE_FILL)
+            tail.nOffset += nCut;
+        tail.nLength -= nCut;
+        pNode->piece.nLength = nCut;
+        Node* pOldRight = pNode->pRight;
+        pNode->pRight = NULL;
+        pNode->Update();
+        pLeft = pNode;
+        pRight = Merge(NewNode(tail), pOldRight);
+    }
+}
+
+CEditBuffer::Node* CEditBuffer::Merge(Node* pLeft, Node* pRight)
+{
+    if (!pLeft)
+        return pRight;
+    if (!pRight)
+        return pLeft;
+    if (pLeft->nPriority > pRight->nPriority)
+    {
+        pLeft->pRight = Merge(pLeft->pRight, pRight);
+        pLeft->Update();
+        return pLeft;
+    }
+    pRight->pLeft = Merge(pLeft, pRight->pLeft);
+    pRight->Update();
+    return pRight;
+}
+
+int CEditBuffer::ExtendLast(Node* pNode, const EditPiece& piece)
+{
+    // 新片段与最后一个片段在来源上首尾相接时直接加长，连续输入只占一个片段
+    if (!pNode)
+    {
+        return FALSE;
+    }
+    if (pNode->pRight)
+    {
+        if (!ExtendLast(pNode->pRight, piece))
+            return FALSE;
+        pNode->nTotal += piece.nLength;
+        return TRUE;
+    }
+    EditPiece& last = pNode->piece;
+    if (last.nSource != piece.nSource)
+    {
+        return FALSE;
+    }
+    if (piece.nSource == PIECE_FILL ? last.nFill != piece.nFill : last.nOffset + last.nLength != piece.nOffset)
+    {
+        return FALSE;
+    }
+    last.nLength += piece.nLength;
+    pNode->nTotal += piece.nLength;
+    return TRUE;
+}
+
+void CEditBuffer::Replace(FileOffset nOffset, FileOffset nDeleteLength, const EditPiece* pPieces, size_t nCount)
+{
+    Node *pLeft, *pMiddle, *pRight;
+    Split(m_pRoot, nOffset, pLeft, pRight);
+    Split(pRight, nDeleteLength, pMiddle, pRight);
+    FreeTree(pMiddle);
+    for (size_t i = 0; i < nCount; i++)
+    {
+        if (pPieces[i].nLength && !ExtendLast(pLeft, pPieces[i]))
+        {
+            pLeft = Merge(pLeft, NewNode(pPieces[i]));
+        }
+    }
+    m_pRoot = Merge(pLeft, pRight);
+    m_bModified = TRUE;
+}
+
+EditPiece CEditBuffer::AppendData(const uint8_t* pData, size_t nLength)
+{
+    EditPiece piece;
+    piece.nSource = PIECE_ADDED;
+    piece.nFill = 0;
+    piece.nOffset = m_vecAdded.size();
+    piece.nLength = nLength;
+    m_vecAdded.insert(m_vecAdded.end(), pData, pData + nLength);
+    return piece;
+}
+
+void CEditBuffer::ReadRange(Node* pNode, FileOffset nBase, FileOffset nOffset, FileOffset nEnd, uint8_t* pBuffer)
+{
+    // 只进入与[nOffset, nEnd)相交的子树，代价为O(log n + 涉及的片段数)
+    while (pNode && nBase < nEnd && nBase + pNode->nTotal > nOffset)
+    {
+        FileOffset nLeft = pNode->pLeft ? pNode->pLeft->nTotal : 0;
+        FileOffset nPieceStart = nBase + nLeft;
+        FileOffset nPieceEnd = nPieceStart + pNode->piece.nLength;
+        if (nOffset < nPieceStart)
+        {
+            ReadRange(pNode->pLeft, nBase, nOffset, nEnd, pBuffer);
+        }
+        if (nPieceStart < nEnd && nPieceEnd > nOffset)
+        {
+            FileOffset nFrom = nPieceStart > nOffset ? nPieceStart : nOffset;
+            FileOffset nTo = nPieceEnd < nEnd ? nPieceEnd : nEnd;
+            CopyPiece(pNode->piece, nFrom - nPieceStart, pBuffer + (nFrom - nOffset), (size_t)(nTo - nFrom));
+        }
+        // 右子树用循环代替尾递归
+        nBase = nPieceEnd;
+        pNode = pNode->pRight;
+    }
+}
+
+void CEditBuffer::CopyPiece(const EditPiece& piece, FileOffset nInPiece, uint8_t* pBuffer, size_t nLength)
+{
+    if (piece.nSource == PIECE_ADDED)
+    {
+        memcpy(pBuffer, &m_vecAdded[(size_t)(piece.nOffset + nInPiece)], nLength);
+        return;
+    }
+    if (piece.nSource == PIECE_FILL)
+    {
+        memset(pBuffer, piece.nFill, nLength);
+        return;
+    }
+    while (nLength)
+    {
+        LargeInteger nVisit;
+        nVisit.QuadPart = piece.nOffset + nInPiece;
+        uint32_t dwAvalible = 0;
+        const uint8_t* pData = (const uint8_t*)m_pFile->VisitFilePosition(nVisit, &dwAvalible);
+        if (!pData || !dwAvalible)
+        {
+            memset(pBuffer, 0, nLength);
+            return;
+        }
+        size_t nCopy = dwAvalible < nLength ? dwAvalible : nLength;
+        memcpy(pBuffer, pData, nCopy);
+        pBuffer += nCopy;
+        nInPiece += nCopy;
+        nLength -= nCopy;
+    }
+}
@@ -0,0 +1,133 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include <functional>
+#include "LargeFile.h"
+
+// 片段的数据来源
+enum PieceSource
+{
+    PIECE_ORIGINAL = 0, // 原文件，nOffset为原文件偏移
+    PIECE_ADDED,        // 追加缓冲区，nOffset为追加缓冲区偏移
+    PIECE_FILL,         // 重复同一个字节nFill，不占数据空间
+};
+
+// 编辑后的文件由若干片段首尾相接组成
+typedef struct {
+    uint8_t nSource;
+    uint8_t nFill;
+    FileOffset nOffset;
+    FileOffset nLength;
+} EditPiece;
+
+/************************************************************************/
+/* piece table over a CLargeFile.
+/* the original file is never written; every edit only rearranges pieces
+/* that point into the original file or into an append-only buffer, so
+/* memory grows with the edits, not with the file. pieces live in an
+/* implicit treap keyed by length, giving O(log n) lookup by offset and
+/* O(log n) overwrite/insert/delete.
+/************************************************************************/
+class CEditBuffer
+{
+public:
+    CEditBuffer();
+    ~CEditBuffer();
+
+    /************************************************************************/
+    /* start editing an opened file / drop all edits.
+    /************************************************************************/
+    void Attach(CLargeFile* pFile);
+    void Detach();
+    CLargeFile* GetFile() const { return m_pFile; }
+
+    /************************************************************************/
+    /* size of the edited data.
+    /************************************************************************/
+    FileOffset GetSize() const;
+
+    /************************************************************************/
+    /* return 1 if anything has been changed since Attach().
+    /************************************************************************/
+    int IsModified() const;
+
+    /************************************************************************/
+    /* copy edited data to pBuffer, return bytes copied (less than nLength
+    /* only at the end of data).
+    /************************************************************************/
+    size_t Read(FileOffset nOffset, uint8_t* pBuffer, size_t nLength);
+
+    /************************************************************************/
+    /* return a pointer to edited data at nOffset without copying. the data
+    /* is contiguous for *pdwAvalibleSize bytes; the pointer is valid until
+    /* the next call to Visit/Read or the next edit.
+    /************************************************************************/
+    const uint8_t* Visit(FileOffset nOffset, uint32_t* pdwAvalibleSize);
+
+    /************************************************************************/
+    /* edits. return 1 if success. nOffset may equal GetSize() for Insert.
+    /************************************************************************/
+    int Overwrite(FileOffset nOffset, const uint8_t* pData, size_t nLength);
+    int Insert(FileOffset nOffset, const uint8_t* pData, size_t nLength);
+    int Delete(FileOffset nOffset, FileOffset nLength);
+
+    /************************************************************************/
+    /* overwrite [nOffset, nOffset+nLength) with nByte. stored as one FILL
+    /* piece, so the memory cost does not depend on nLength.
+    /************************************************************************/
+    int Fill(FileOffset nOffset, FileOffset nLength, uint8_t nByte);
+
+    /************************************************************************/
+    /* piece level access, used by the undo journal: copy out the pieces
+    /* covering a range (cut at the range ends) / replace a range with pieces
+    /* previously obtained from GetPieces.
+    /************************************************************************/
+    void GetPieces(FileOffset nOffset, FileOffset nLength, std::vector<EditPiece>& vecPieces) const;
+    void ReplacePieces(FileOffset nOffset, FileOffset nDeleteLength, const std::vector<EditPiece>& vecPieces);
+
+    /************************************************************************/
+    /* data of a PIECE_ADDED piece at nOffset in the append buffer; lets
+    /* other threads read a GetPieces() snapshot without going through
+    /* Visit. an edit may move the append buffer, so the caller must keep
+    /* the buffer unmodified for as long as it uses the pointer.
+    /************************************************************************/
+    const uint8_t* GetAddedData(FileOffset nOffset) const { return m_vecAdded.data() + nOffset; }
+
+    /************************************************************************/
+    /* bytes in the append buffer. it only grows until Detach(), so the
+    /* values below a size seen before never change (their address may).
+    /************************************************************************/
+    FileOffset GetAddedSize() const { return m_vecAdded.size(); }
+
+    /************************************************************************/
+    /* enumerate pieces in order; return false from the callback to stop.
+    /************************************************************************/
+    void ForEachPiece(const std::function<bool(FileOffset nLogicalOffset, const EditPiece& piece)>& fn) const;
+    size_t GetPieceCount() const { return m_nPieceCount; }
+
+    /************************************************************************/
+    /* bytes held by the edit layer itself (pieces + appended data).
+    /************************************************************************/
+    size_t GetMemoryUsage() const;
+
+private:
+    struct Node;
+
+    Node* NewNode(const EditPiece& piece);
+    void FreeTree(Node* pNode);
+    void Split(Node* pNode, FileOffset nPos, Node*& pLeft, Node*& pRight);
+    Node* Merge(Node* pLeft, Node* pRight);
+    int ExtendLast(Node* pNode, const EditPiece& piece);
+    void Replace(FileOffset nOffset, FileOffset nDeleteLength, const EditPiece* pPieces, size_t nCount);
+    static void CollectPieces(const Node* pNode, FileOffset nBase, FileOffset nOffset, FileOffset nEnd, std::vector<EditPiece>& vecPieces);
+    EditPiece AppendData(const uint8_t* pData, size_t nLength);
+    void ReadRange(Node* pNode, FileOffset nBase, FileOffset nOffset, FileOffset nEnd, uint8_t* pBuffer);
+    void CopyPiece(const EditPiece& piece, FileOffset nInPiece, uint8_t* pBuffer, size_t nLength);
+
+    CLargeFile* m_pFile;
+    Node* m_pRoot;
+    size_t m_nPieceCount;
+    std::vector<uint8_t> m_vecAdded; // 只追加，已有片段引用的数据不会被改写
+    uint32_t m_nSeed;
+    int m_bModified;
+};
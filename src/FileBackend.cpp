@@ -0,0 +1,617 @@
+#include "FileBackend.h"
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <chrono>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <sys/vfs.h>
+#include <linux/fs.h>
+#endif
+#endif
+
+// 缓冲池里最多保留的空闲缓冲区数
+static const size_t kMaxPooledBuffers = 16;
+#ifdef __linux__
+// statfs返回的FUSE文件系统类型
+static const long kFuseSuperMagic = 0x65735546;
+#endif
+
+static uint64_t NowNanoseconds()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+CFileBackend::CFileBackend()
+    : m_nStatBytes(0), m_nStatNanoseconds(0), m_nStatViews(0)
+{
+}
+
+void CFileBackend::RecordTransfer(uint64_t nBytes, uint64_t nNanoseconds)
+{
+    m_nStatBytes += nBytes;
+    m_nStatNanoseconds += nNanoseconds;
+}
+
+void CFileBackend::GetStats(BackendStats* pStats)
+{
+    if (!pStats)
+        return;
+    pStats->nBytes = m_nStatBytes;
+    pStats->nNanoseconds = m_nStatNanoseconds;
+    pStats->nViews = m_nStatViews;
+}
+
+double CFileBackend::GetThroughput()
+{
+    uint64_t nNanoseconds = m_nStatNanoseconds;
+    if (!nNanoseconds)
+        return 0;
+    return (double)m_nStatBytes / (1024.0 * 1024.0) / ((double)nNanoseconds / 1e9);
+}
+
+BackendType CFileBackend::DetectType(const char* pPath)
+{
+#ifdef _WIN32
+    return BACKEND_MMAP;
+#else
+    if (CProcessBackend::ParsePid(pPath) > 0)
+    {
+        return BACKEND_PROCESS;
+    }
+    struct stat st;
+    if (stat(pPath, &st) < 0)
+    {
+        return BACKEND_MMAP; // 让Open报告真正的错误
+    }
+    if (S_ISBLK(st.st_mode))
+    {
+        return BACKEND_MMAP;
+    }
+    if (!S_ISREG(st.st_mode) || st.st_size == 0)
+    {
+        // 管道、字符设备、大小为0的/proc文件都不能mmap
+        return BACKEND_PREAD;
+    }
+#ifdef __linux__
+    struct statfs fs;
+    if (statfs(pPath, &fs) == 0 && (long)fs.f_type == kFuseSuperMagic)
+    {
+        // FUSE上每次缺页都要走一次用户态往返，按大块pread更快
+        return BACKEND_PREAD;
+    }
+#endif
+    return BACKEND_MMAP;
+#endif
+}
+
+CFileBackend* CFileBackend::Create(BackendType eType, const char* pPath)
+{
+    if (eType == BACKEND_AUTO)
+    {
+        eType = DetectType(pPath);
+    }
+#ifndef _WIN32
+    // /proc/<pid>/mem的大小为0且有大量空洞，只有进程后端能读
+    if (CProcessBackend::ParsePid(pPath) > 0)
+    {
+        eType = BACKEND_PROCESS;
+    }
+#endif
+#ifndef _WIN32
+    switch (eType)
+    {
+    case BACKEND_PREAD:
+        return new CPreadBackend();
+    case BACKEND_PROCESS:
+        return new CProcessBackend();
+    default:
+        break;
+    }
+#endif
+    return new CMmapBackend();
+}
+
+//////////////////////////////////////////////////////////////////////////
+// CMmapBackend
+
+CMmapBackend::CMmapBackend()
+    : m_hFile(INVALID_HANDLE_VALUE), m_hMap(0), m_dwPageSize(0), m_nFileSize(0)
+{
+}
+
+CMmapBackend::~CMmapBackend()
+{
+    Close();
+}
+
+int CMmapBackend::Open(const char* pPath, uint32_t dwPageSize)
+{
+    Close();
+    m_dwPageSize = dwPageSize;
+
+#ifdef _WIN32
+    m_hFile = (int)CreateFileA(pPath,
+        GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m_hFile == INVALID_HANDLE_VALUE)
+    {
+        return FALSE;
+    }
+    LargeInteger nFileSize;
+    if (!::GetFileSizeEx((HANDLE)m_hFile, (LARGE_INTEGER*)&nFileSize))
+    {
+        Close();
+        return FALSE;
+    }
+    m_nFileSize = nFileSize.QuadPart;
+    if (!m_nFileSize)
+    {
+        return TRUE; // 空文件无法建立映射对象，由CLargeFile拒绝
+    }
+    m_hMap = (int)CreateFileMappingA((HANDLE)m_hFile, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    if (!m_hMap)
+    {
+        Close();
+        return FALSE;
+    }
+#else
+    // 写时复制映射不需要写权限，只读文件也能打开
+    m_hFile = open(pPath, O_RDWR);
+    if (m_hFile < 0 && (errno == EACCES || errno == EROFS || errno == EPERM))
+    {
+        m_hFile = open(pPath, O_RDONLY);
+    }
+    if (m_hFile < 0)
+    {
+        m_hFile = INVALID_HANDLE_VALUE;
+        return FALSE;
+    }
+    struct stat st;
+    if (fstat(m_hFile, &st) < 0)
+    {
+        Close();
+        errno = EINVAL;
+        return FALSE;
+    }
+    m_nFileSize = st.st_size;
+#ifdef BLKGETSIZE64
+    if (S_ISBLK(st.st_mode))
+    {
+        uint64_t nDeviceSize = 0;
+        if (ioctl(m_hFile, BLKGETSIZE64, &nDeviceSize) == 0)
+        {
+            m_nFileSize = nDeviceSize;
+        }
+    }
+#endif
+    // 在Linux中，我们不需要单独的文件映射对象，直接使用文件描述符
+    m_hMap = m_hFile; // 简单地复用文件描述符
+#endif
+    return TRUE;
+}
+
+void CMmapBackend::Close()
+{
+#ifdef _WIN32
+    if (m_hMap)
+    {
+        CloseHandle((HANDLE)m_hMap);
+    }
+    if (m_hFile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle((HANDLE)m_hFile);
+    }
+#else
+    // Linux平台不需要额外关闭m_hMap，因为它与m_hFile相同
+    if (m_hFile != INVALID_HANDLE_VALUE)
+    {
+        close(m_hFile);
+    }
+#endif
+    m_hFile = INVALID_HANDLE_VALUE;
+    m_hMap = 0;
+    m_nFileSize = 0;
+}
+
+uint8_t* CMmapBackend::MapView(LargeInteger nStart, uint32_t dwSize)
+{
+    m_nStatViews++;
+#ifdef _WIN32
+    return (uint8_t*)MapViewOfFile((HANDLE)m_hMap, FILE_MAP_COPY, nStart.HighPart,
+        nStart.LowPart, dwSize);
+#else
+    // Linux平台的内存映射
+    uint64_t offset = nStart.QuadPart;
+    // 确保offset是页对齐的
+    size_t page_size = m_dwPageSize;
+    uint64_t aligned_offset = offset & ~(page_size - 1);
+    size_t offset_in_page = offset - aligned_offset;
+
+    // 使用PROT_READ|PROT_WRITE和MAP_PRIVATE实现写时复制功能，与Windows的FILE_MAP_COPY对应
+    void* addr = mmap(NULL, dwSize + offset_in_page, PROT_READ | PROT_WRITE, MAP_PRIVATE, m_hMap, aligned_offset);
+    if (addr == MAP_FAILED)
+    {
+        return NULL;
+    }
+    // 返回调整后的指针，考虑页内偏移
+    return (uint8_t*)addr + offset_in_page;
+#endif
+}
+
+void CMmapBackend::UnmapView(uint8_t* pView, uint32_t dwSize)
+{
+#ifdef _WIN32
+    UnmapViewOfFile(pView);
+#else
+    munmap(pView, dwSize);
+#endif
+}
+
+void CMmapBackend::AdviseWillNeed(FileOffset nStart, uint64_t nLength)
+{
+#ifndef _WIN32
+    posix_fadvise(m_hFile, nStart, nLength, POSIX_FADV_WILLNEED);
+#endif
+}
+
+void CMmapBackend::WarmView(uint8_t* pView, uint32_t dwSize)
+{
+    uint64_t nBegin = NowNanoseconds();
+#ifndef _WIN32
+    uint8_t* pAligned = (uint8_t*)ALIGN_DOWN_POINTER_BY(pView, m_dwPageSize);
+    madvise(pAligned, dwSize + (pView - pAligned), MADV_WILLNEED);
+#endif
+    // 逐页读一个字节，把缺页留在调用线程里
+    volatile uint8_t nSink = 0;
+    for (uint32_t i = 0; i < dwSize; i += m_dwPageSize)
+    {
+        nSink += pView[i];
+    }
+    (void)nSink;
+    RecordTransfer(dwSize, NowNanoseconds() - nBegin);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// CBufferedBackend
+
+CBufferedBackend::~CBufferedBackend()
+{
+    FreePool();
+}
+
+uint8_t* CBufferedBackend::MapView(LargeInteger nStart, uint32_t dwSize)
+{
+    uint8_t* pBuffer = NULL;
+    {
+        std::lock_guard<std::mutex> lock(m_poolLock);
+        std::multimap<uint32_t, uint8_t*>::iterator it = m_mapFreeBuffers.find(dwSize);
+        if (it != m_mapFreeBuffers.end())
+        {
+            pBuffer = it->second;
+            m_mapFreeBuffers.erase(it);
+        }
+    }
+    if (!pBuffer)
+    {
+        pBuffer = (uint8_t*)malloc(dwSize);
+        if (!pBuffer)
+        {
+            return NULL;
+        }
+    }
+
+    uint64_t nBegin = NowNanoseconds();
+    if (!ReadAt(nStart.QuadPart, pBuffer, dwSize))
+    {
+        UnmapView(pBuffer, dwSize);
+        return NULL;
+    }
+    RecordTransfer(dwSize, NowNanoseconds() - nBegin);
+    m_nStatViews++;
+    return pBuffer;
+}
+
+void CBufferedBackend::UnmapView(uint8_t* pView, uint32_t dwSize)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_poolLock);
+        if (m_mapFreeBuffers.size() < kMaxPooledBuffers)
+        {
+            m_mapFreeBuffers.insert(std::make_pair(dwSize, pView));
+            return;
+        }
+    }
+    free(pView);
+}
+
+void CBufferedBackend::FreePool()
+{
+    std::lock_guard<std::mutex> lock(m_poolLock);
+    for (std::multimap<uint32_t, uint8_t*>::iterator it = m_mapFreeBuffers.begin(); it != m_mapFreeBuffers.end(); ++it)
+    {
+        free(it->second);
+    }
+    m_mapFreeBuffers.clear();
+}
+
+#ifndef _WIN32
+
+//////////////////////////////////////////////////////////////////////////
+// CPreadBackend
+
+CPreadBackend::CPreadBackend()
+    : m_hFile(INVALID_HANDLE_VALUE), m_nFileSize(0)
+{
+}
+
+CPreadBackend::~CPreadBackend()
+{
+    Close();
+}
+
+int CPreadBackend::Open(const char* pPath, uint32_t /*dwPageSize*/)
+{
+    Close();
+    int hFile = open(pPath, O_RDONLY);
+    if (hFile < 0)
+    {
+        return FALSE;
+    }
+    struct stat st;
+    if (fstat(hFile, &st) < 0)
+    {
+        close(hFile);
+        return FALSE;
+    }
+    if (S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        m_hFile = hFile;
+        m_nFileSize = st.st_size;
+        return TRUE;
+    }
+#ifdef BLKGETSIZE64
+    uint64_t nDeviceSize = 0;
+    if (S_ISBLK(st.st_mode) && ioctl(hFile, BLKGETSIZE64, &nDeviceSize) == 0)
+    {
+        m_hFile = hFile;
+        m_nFileSize = nDeviceSize;
+        return TRUE;
+    }
+#endif
+    // 大小未知或不能随机访问，先完整读出来
+    int nRet = SpoolToTempFile(hFile);
+    close(hFile);
+    return nRet;
+}
+
+int CPreadBackend::SpoolToTempFile(int hSource)
+{
+    const char* pTempDir = getenv("TMPDIR");
+    char szTemplate[MAX_PATH];
+    snprintf(szTemplate, sizeof(szTemplate), "%s/foolhex-XXXXXX", pTempDir ? pTempDir : "/tmp");
+    int hTemp = mkstemp(szTemplate);
+    if (hTemp < 0)
+    {
+        return FALSE;
+    }
+    // 临时文件只通过描述符使用，关闭即删除
+    unlink(szTemplate);
+
+    static const size_t kChunk = 1024 * 1024;
+    uint8_t* pChunk = (uint8_t*)malloc(kChunk);
+    if (!pChunk)
+    {
+        close(hTemp);
+        errno = ENOMEM;
+        return FALSE;
+    }
+    FileOffset nTotal = 0;
+    for (;;)
+    {
+        ssize_t nRead = read(hSource, pChunk, kChunk);
+        if (nRead < 0 && errno == EINTR)
+            continue;
+        if (nRead <= 0)
+            break;
+        ssize_t nWritten = 0;
+        while (nWritten < nRead)
+        {
+            ssize_t n = write(hTemp, pChunk + nWritten, nRead - nWritten);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                free(pChunk);
+                close(hTemp);
+                return FALSE;
+            }
+            nWritten += n;
+        }
+        nTotal += nRead;
+    }
+    free(pChunk);
+    m_hFile = hTemp;
+    m_nFileSize = nTotal;
+    return TRUE;
+}
+
+void CPreadBackend::Close()
+{
+    if (m_hFile != INVALID_HANDLE_VALUE)
+    {
+        close(m_hFile);
+    }
+    m_hFile = INVALID_HANDLE_VALUE;
+    m_nFileSize = 0;
+    FreePool();
+}
+
+void CPreadBackend::AdviseWillNeed(FileOffset nStart, uint64_t nLength)
+{
+    posix_fadvise(m_hFile, nStart, nLength, POSIX_FADV_WILLNEED);
+}
+
+int CPreadBackend::ReadAt(FileOffset nStart, uint8_t* pBuffer, uint32_t dwSize)
+{
+    uint32_t dwDone = 0;
+    while (dwDone < dwSize)
+    {
+        ssize_t n = pread(m_hFile, pBuffer + dwDone, dwSize - dwDone, nStart + dwDone);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        dwDone += n;
+    }
+    if (!dwDone)
+    {
+        return FALSE;
+    }
+    memset(pBuffer + dwDone, 0, dwSize - dwDone);
+    return TRUE;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// CProcessBackend
+
+CProcessBackend::CProcessBackend()
+    : m_nPid(-1), m_hMem(INVALID_HANDLE_VALUE), m_nSize(0)
+{
+}
+
+CProcessBackend::~CProcessBackend()
+{
+    Close();
+}
+
+int CProcessBackend::ParsePid(const char* pPath)
+{
+    int nPid = 0;
+    char chEnd = 0;
+    if (sscanf(pPath, "pid:%d%c", &nPid, &chEnd) == 1)
+    {
+        return nPid;
+    }
+    if (sscanf(pPath, "/proc/%d/mem%c", &nPid, &chEnd) == 1)
+    {
+        return nPid;
+    }
+    return -1;
+}
+
+int CProcessBackend::Open(const char* pPath, uint32_t /*dwPageSize*/)
+{
+    Close();
+    m_nPid = ParsePid(pPath);
+    if (m_nPid <= 0)
+    {
+        errno = EINVAL;
+        return FALSE;
+    }
+    char szPath[64];
+    snprintf(szPath, sizeof(szPath), "/proc/%d/mem", m_nPid);
+    m_hMem = open(szPath, O_RDONLY);
+    if (m_hMem < 0)
+    {
+        m_hMem = INVALID_HANDLE_VALUE;
+        return FALSE;
+    }
+    if (!LoadRegions())
+    {
+        Close();
+        return FALSE;
+    }
+    return TRUE;
+}
+
+int CProcessBackend::LoadRegions()
+{
+    char szPath[64];
+    snprintf(szPath, sizeof(szPath), "/proc/%d/maps", m_nPid);
+    FILE* fp = fopen(szPath, "r");
+    if (!fp)
+    {
+        return FALSE;
+    }
+    char szLine[512];
+    while (fgets(szLine, sizeof(szLine), fp))
+    {
+        unsigned long long nStart, nEnd;
+        char szPerms[8];
+        if (sscanf(szLine, "%llx-%llx %7s", &nStart, &nEnd, szPerms) != 3 || szPerms[0] != 'r')
+        {
+            continue;
+        }
+        Region region;
+        region.nStart = nStart;
+        region.nEnd = nEnd;
+        m_vecRegions.push_back(region);
+    }
+    fclose(fp);
+    if (m_vecRegions.empty())
+    {
+        errno = ESRCH;
+        return FALSE;
+    }
+    // /proc/<pid>/maps已按地址升序排列，最后一个区域的结尾就是“文件大小”
+    m_nSize = m_vecRegions.back().nEnd;
+    return TRUE;
+}
+
+void CProcessBackend::Close()
+{
+    if (m_hMem != INVALID_HANDLE_VALUE)
+    {
+        close(m_hMem);
+    }
+    m_hMem = INVALID_HANDLE_VALUE;
+    m_nPid = -1;
+    m_nSize = 0;
+    m_vecRegions.clear();
+    FreePool();
+}
+
+int CProcessBackend::ReadAt(FileOffset nStart, uint8_t* pBuffer, uint32_t dwSize)
+{
+    memset(pBuffer, 0, dwSize);
+    FileOffset nEnd = nStart + dwSize;
+    for (size_t i = 0; i < m_vecRegions.size(); i++)
+    {
+        const Region& region = m_vecRegions[i];
+        if (region.nEnd <= nStart)
+            continue;
+        if (region.nStart >= nEnd)
+            break;
+        FileOffset nFrom = region.nStart > nStart ? region.nStart : nStart;
+        FileOffset nTo = region.nEnd < nEnd ? region.nEnd : nEnd;
+        uint8_t* pDest = pBuffer + (nFrom - nStart);
+        size_t nLength = (size_t)(nTo - nFrom);
+        ssize_t nRead = -1;
+#ifdef __linux__
+        struct iovec local = { pDest, nLength };
+        struct iovec remote = { (void*)(uintptr_t)nFrom, nLength };
+        nRead = process_vm_readv(m_nPid, &local, 1, &remote, 1, 0);
+#endif
+        if (nRead < 0)
+        {
+            // 没有process_vm_readv或被拒绝时退回到/proc/<pid>/mem，读不到的部分保持为0
+            pread(m_hMem, pDest, nLength, nFrom);
+        }
+    }
+    return TRUE;
+}
+
+#endif // _WIN32
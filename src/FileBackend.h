@@ -0,0 +1,171 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <map>
+#include <vector>
+#include "LargeFile.h"
+
+// 后端吞吐统计
+typedef struct {
+    uint64_t nBytes;        // 交付给CLargeFile的字节数
+    uint64_t nNanoseconds;  // 花在读取/映射/预热上的时间
+    uint64_t nViews;        // 建立的视图数
+} BackendStats;
+
+/************************************************************************/
+/* storage backend behind CLargeFile.
+/* a backend hands out private, writable views of [nStart, nStart+dwSize);
+/* writes to a view never reach the underlying storage. MapView/UnmapView
+/* may be called from several threads at once.
+/************************************************************************/
+class CFileBackend
+{
+public:
+    CFileBackend();
+    virtual ~CFileBackend() {}
+
+    virtual const char* GetName() = 0;
+    virtual BackendType GetType() = 0;
+
+    /************************************************************************/
+    /* open storage, return 1 if success; if 0, use GetLastError to get error
+    /* code. dwPageSize is the alignment every view start will have.
+    /************************************************************************/
+    virtual int Open(const char* pPath, uint32_t dwPageSize) = 0;
+    virtual void Close() = 0;
+    virtual FileOffset GetSize() = 0;
+
+    virtual uint8_t* MapView(LargeInteger nStart, uint32_t dwSize) = 0;
+    virtual void UnmapView(uint8_t* pView, uint32_t dwSize) = 0;
+
+    /************************************************************************/
+    /* hint that a range will be visited soon. default does nothing.
+    /************************************************************************/
+    virtual void AdviseWillNeed(FileOffset /*nStart*/, uint64_t /*nLength*/) {}
+
+    /************************************************************************/
+    /* bring a view's data into memory on the calling thread. buffered
+    /* backends already read everything in MapView, so default does nothing.
+    /************************************************************************/
+    virtual void WarmView(uint8_t* /*pView*/, uint32_t /*dwSize*/) {}
+
+    /************************************************************************/
+    /* descriptor of the regular file the views come from, for kernel-side
+    /* copies when saving. still owned by the backend. default has none.
+    /************************************************************************/
+    virtual int GetFileHandle() { return INVALID_HANDLE_VALUE; }
+
+    /************************************************************************/
+    /* throughput accounting. mmap views are counted when they are warmed,
+    /* since mapping itself reads nothing.
+    /************************************************************************/
+    void RecordTransfer(uint64_t nBytes, uint64_t nNanoseconds);
+    void GetStats(BackendStats* pStats);
+    double GetThroughput(); // MB/s, 0 if nothing measured yet
+
+    /************************************************************************/
+    /* choose a backend for a path: process memory for "pid:<n>" and
+    /* "/proc/<n>/mem", mmap for regular local files, pread for everything
+    /* else. eType overrides the choice unless it is BACKEND_AUTO.
+    /************************************************************************/
+    static BackendType DetectType(const char* pPath);
+    static CFileBackend* Create(BackendType eType, const char* pPath);
+
+protected:
+    std::atomic<uint64_t> m_nStatBytes;
+    std::atomic<uint64_t> m_nStatNanoseconds;
+    std::atomic<uint64_t> m_nStatViews;
+};
+
+// 内存映射后端（写时复制映射，与原先CLargeFile的行为一致）
+class CMmapBackend : public CFileBackend
+{
+public:
+    CMmapBackend();
+    ~CMmapBackend();
+    const char* GetName() { return "mmap"; }
+    BackendType GetType() { return BACKEND_MMAP; }
+    int Open(const char* pPath, uint32_t dwPageSize);
+    void Close();
+    FileOffset GetSize() { return m_nFileSize; }
+    uint8_t* MapView(LargeInteger nStart, uint32_t dwSize);
+    void UnmapView(uint8_t* pView, uint32_t dwSize);
+    void AdviseWillNeed(FileOffset nStart, uint64_t nLength);
+    void WarmView(uint8_t* pView, uint32_t dwSize);
+#ifndef _WIN32
+    int GetFileHandle() { return m_hFile; }
+#endif
+private:
+    int m_hFile;
+    int m_hMap;
+    uint32_t m_dwPageSize;
+    FileOffset m_nFileSize;
+};
+
+// 带缓冲池的后端公共部分，视图是从池里取出的普通内存
+class CBufferedBackend : public CFileBackend
+{
+public:
+    ~CBufferedBackend();
+    uint8_t* MapView(LargeInteger nStart, uint32_t dwSize);
+    void UnmapView(uint8_t* pView, uint32_t dwSize);
+protected:
+    /************************************************************************/
+    /* fill the whole buffer; bytes that cannot be read must be zeroed.
+    /* return 0 only if nothing at all could be read.
+    /************************************************************************/
+    virtual int ReadAt(FileOffset nStart, uint8_t* pBuffer, uint32_t dwSize) = 0;
+    void FreePool();
+private:
+    std::mutex m_poolLock;
+    std::multimap<uint32_t, uint8_t*> m_mapFreeBuffers;
+};
+
+// pread后端；不能pread的流（管道、大小未知的/proc文件）先落到临时文件
+class CPreadBackend : public CBufferedBackend
+{
+public:
+    CPreadBackend();
+    ~CPreadBackend();
+    const char* GetName() { return "pread"; }
+    BackendType GetType() { return BACKEND_PREAD; }
+    int Open(const char* pPath, uint32_t dwPageSize);
+    void Close();
+    FileOffset GetSize() { return m_nFileSize; }
+    void AdviseWillNeed(FileOffset nStart, uint64_t nLength);
+    int GetFileHandle() { return m_hFile; } // 流会返回落地后的临时文件
+protected:
+    int ReadAt(FileOffset nStart, uint8_t* pBuffer, uint32_t dwSize);
+private:
+    int SpoolToTempFile(int hSource);
+    int m_hFile;
+    FileOffset m_nFileSize;
+};
+
+// 进程内存后端，文件偏移即目标进程的虚拟地址，未映射的地址读成0
+class CProcessBackend : public CBufferedBackend
+{
+public:
+    CProcessBackend();
+    ~CProcessBackend();
+    const char* GetName() { return "process"; }
+    BackendType GetType() { return BACKEND_PROCESS; }
+    int Open(const char* pPath, uint32_t dwPageSize);
+    void Close();
+    FileOffset GetSize() { return m_nSize; }
+    static int ParsePid(const char* pPath);
+protected:
+    int ReadAt(FileOffset nStart, uint8_t* pBuffer, uint32_t dwSize);
+private:
+    struct Region
+    {
+        FileOffset nStart;
+        FileOffset nEnd;
+    };
+    int LoadRegions();
+    int m_nPid;
+    int m_hMem;
+    FileOffset m_nSize;
+    std::vector<Region> m_vecRegions; // 按地址排序的可读区域
+};
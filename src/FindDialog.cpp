@@ -0,0 +1,862 @@
+#include "FindDialog.h"
+#include <FL/Fl.H>
+#include <FL/fl_ask.H>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cinttypes>
+#include <cerrno>
+#include <string>
+#include <memory>
+#include "AhoCorasick.h"
+#include "ApproxMatcher.h"
+#include "MaskMatcher.h"
+#include "RegexMatcher.h"
+#include "TextMatcher.h"
+#include "Unicode.h"
+
+// 查找模式，与m_modeChoice中的顺序一致
+enum {
+    FIND_MODE_HEX = 0,  // 十六进制字节串，可以带通配符
+    FIND_MODE_TEXT,     // 文本（按输入的原始字节）
+    FIND_MODE_MULTI,    // 多个模式，用分号分隔，一次扫描全部找出
+    FIND_MODE_REGEX,    // 按字节匹配的正则表达式
+    FIND_MODE_UNICODE,  // 文本，同时按UTF-8/UTF-16LE/UTF-16BE查找，忽略大小写时按Unicode规则
+    FIND_MODE_HAMMING,  // 十六进制字节串，允许若干个字节不同
+    FIND_MODE_EDIT,     // 十六进制字节串，允许若干个字节不同、多出或缺少
+};
+
+// 列表中最多显示的结果数，超出的只计数
+static const size_t kMaxListedHits = 100000;
+// 全部查找时界面取结果的间隔（秒）
+static const double kPollInterval = 0.05;
+
+// FindDialog 类的实现
+
+FindDialog::FindDialog(int w, int h, const char* title, HexTable* table)
+    : Fl_Double_Window(w, h, title), m_hexTable(table), m_reportWindow(nullptr), m_reportBrowser(nullptr),
+      m_searching(false), m_cancelled(false), m_ngramIgnoreCase(false), m_pendingDone(0), m_pendingTotal(0),
+      m_allDone(false), m_allCompleted(false), m_indexComplete(false) {
+
+    m_patternInput = new Fl_Input(80, 10, w - 90, 25, "查找内容:");
+
+    m_modeChoice = new Fl_Choice(80, 45, 120, 25, "模式:");
+    m_modeChoice->add("十六进制");
+    m_modeChoice->add("文本");
+    m_modeChoice->add("多个模式");
+    m_modeChoice->add("正则表达式");
+    m_modeChoice->add("文本(UTF-8/16)");
+    m_modeChoice->add("近似(替换)");
+    m_modeChoice->add("近似(编辑距离)");
+    m_modeChoice->value(FIND_MODE_HEX);
+
+    m_ignoreCaseCheck = new Fl_Check_Button(205, 45, 100, 25, "忽略大小写");
+
+    // 近似查找允许的差异数
+    m_errorSpinner = new Fl_Spinner(350, 45, 45, 25, "误差:");
+    m_errorSpinner->range(0, 16);
+    m_errorSpinner->step(1);
+    m_errorSpinner->value(1);
+
+    // 全部查找使用的线程数，默认每个核一个
+    m_threadSpinner = new Fl_Spinner(w - 70, 45, 60, 25, "线程:");
+    m_threadSpinner->range(1, 256);
+    m_threadSpinner->step(1);
+    m_threadSpinner->value(CParallelSearcher::GetDefaultThreadCount());
+
+    // 反复查找同一个大文件时，先用索引排除不可能匹配的块
+    m_ngramButton = new Fl_Button(10, 80, 90, 25, "建立索引");
+    m_ngramButton->callback(ngramButtonCallback, this);
+    m_ngramCheck = new Fl_Check_Button(105, 80, 100, 25, "使用索引");
+    m_ngramCheck->value(1);
+
+    // 替换内容与查找内容的写法相同；为空时删除匹配
+    m_replaceInput = new Fl_Input(270, 80, w - 365, 25, "替换为:");
+    m_replaceButton = new Fl_Button(w - 90, 80, 80, 25, "全部替换");
+    m_replaceButton->callback(replaceButtonCallback, this);
+#ifdef _WIN32
+    // Windows下后端独占打开并映射着文件，替换结果无法写回，暂不提供替换
+    m_replaceInput->hide();
+    m_replaceButton->hide();
+#endif
+
+    // 全部查找的结果，点击跳转
+    m_resultBrowser = new Fl_Hold_Browser(10, 115, w - 20, h - 200);
+    m_resultBrowser->textfont(FL_COURIER);
+    m_resultBrowser->callback(resultBrowserCallback, this);
+
+    m_statusBox = new Fl_Box(10, h - 80, w - 20, 25);
+    m_statusBox->align(FL_ALIGN_LEFT | FL_ALIGN_INSIDE);
+
+    // 创建按钮
+    m_nextButton = new Fl_Button(10, h - 40, 90, 30, "查找下一个");
+    m_nextButton->callback(nextButtonCallback, this);
+    m_prevButton = new Fl_Button(105, h - 40, 90, 30, "查找上一个");
+    m_prevButton->callback(prevButtonCallback, this);
+    m_findAllButton = new Fl_Button(200, h - 40, 80, 30, "全部查找");
+    m_findAllButton->callback(findAllButtonCallback, this);
+    m_stopButton = new Fl_Button(285, h - 40, 60, 30, "停止");
+    m_stopButton->callback(stopButtonCallback, this);
+    m_stopButton->deactivate();
+    m_reportButton = new Fl_Button(350, h - 40, 80, 30, "分块耗时");
+    m_reportButton->callback(reportButtonCallback, this);
+    m_reportButton->deactivate();
+    m_closeButton = new Fl_Button(w - 70, h - 40, 60, 30, "关闭");
+    m_closeButton->callback(closeButtonCallback, this);
+
+    resizable(m_resultBrowser);
+    end();
+}
+
+FindDialog::~FindDialog() {
+    // 先停下工作线程，它们的回调会访问这里的成员
+    Fl::remove_timeout(pollTimerCallback, this);
+    m_parallelSearcher.Cancel();
+    m_parallelSearcher.Wait();
+    delete m_reportWindow;
+}
+
+// 解析十六进制字节串，如"4D 5A 90"，空白可省略
+bool FindDialog::parseHex(const char* text, std::vector<uint8_t>& bytes) {
+    bytes.clear();
+    int nibbles = 0;
+    uint8_t byte = 0;
+    for (const char* p = text; *p; p++) {
+        char c = *p;
+        int value;
+        if (c >= '0' && c <= '9') value = c - '0';
+        else if (c >= 'a' && c <= 'f') value = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') value = c - 'A' + 10;
+        else if (c == ' ' || c == '\t' || c == ',') continue;
+        else return false;
+        byte = (byte << 4) | value;
+        if (++nibbles % 2 == 0) bytes.push_back(byte);
+    }
+    return nibbles % 2 == 0 && !bytes.empty();
+}
+
+// 解析两个字符的十六进制字节，任一位可以是?，mask中确定的位为1
+static bool parseMaskByte(const char* p, uint8_t& value, uint8_t& mask) {
+    value = 0;
+    mask = 0;
+    for (int i = 0; i < 2; i++) {
+        char c = p[i];
+        int nibble;
+        if (c >= '0' && c <= '9') nibble = c - '0';
+        else if (c >= 'a' && c <= 'f') nibble = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') nibble = c - 'A' + 10;
+        else if (c == '?') nibble = -1;
+        else return false;
+        value <<= 4;
+        mask <<= 4;
+        if (nibble >= 0) {
+            value |= nibble;
+            mask |= 0x0F;
+        }
+    }
+    return true;
+}
+
+// 解析带通配符的十六进制模式：每个字节是两位十六进制数，任一位可以是?（如"??"、"4?"），
+// 方括号内是可选的字节或范围，用|或,分隔（如"[00-1F|7F]"）；空白可省略
+bool FindDialog::parseMaskPattern(const char* text, std::vector<CByteSet>& pattern) {
+    pattern.clear();
+    const char* p = text;
+    while (*p) {
+        if (*p == ' ' || *p == '\t' || *p == ',') {
+            p++;
+            continue;
+        }
+        CByteSet set;
+        uint8_t value, mask;
+        if (*p != '[') {
+            if (!parseMaskByte(p, value, mask)) return false;
+            p += 2;
+            set.AddMasked(value, mask);
+            pattern.push_back(set);
+            continue;
+        }
+        p++;
+        for (;;) {
+            while (*p == ' ' || *p == '\t') p++;
+            if (!parseMaskByte(p, value, mask)) return false;
+            p += 2;
+            while (*p == ' ' || *p == '\t') p++;
+            if (*p == '-') {
+                // 范围的两端都必须是确定的字节
+                p++;
+                while (*p == ' ' || *p == '\t') p++;
+                uint8_t last, lastMask;
+                if (mask != 0xFF || !parseMaskByte(p, last, lastMask) || lastMask != 0xFF || last < value) return false;
+                p += 2;
+                set.AddRange(value, last);
+            } else {
+                set.AddMasked(value, mask);
+            }
+            while (*p == ' ' || *p == '\t') p++;
+            if (*p == '|' || *p == ',') {
+                p++;
+            } else if (*p == ']') {
+                p++;
+                break;
+            } else {
+                return false;
+            }
+        }
+        pattern.push_back(set);
+    }
+    return !pattern.empty();
+}
+
+// 解析分号分隔的模式列表，每项是十六进制字节串，或用双引号括起的文本，如 4D 5A; "PK"
+bool FindDialog::parsePatternList(const char* text, std::vector<std::vector<uint8_t> >& patterns) {
+    patterns.clear();
+    const char* p = text;
+    while (*p) {
+        while (*p == ' ' || *p == '\t') p++;
+        if (!*p) break;
+        std::vector<uint8_t> bytes;
+        if (*p == '"') {
+            const char* end = strchr(p + 1, '"');
+            if (!end || end == p + 1) return false;
+            bytes.assign((const uint8_t*)p + 1, (const uint8_t*)end);
+            p = end + 1;
+            while (*p == ' ' || *p == '\t') p++;
+            if (*p && *p != ';') return false;
+        } else {
+            const char* end = strchr(p, ';');
+            std::string item(p, end ? end - p : strlen(p));
+            if (!parseHex(item.c_str(), bytes)) return false;
+            p += item.size();
+        }
+        patterns.push_back(bytes);
+        if (*p == ';') p++;
+    }
+    return !patterns.empty();
+}
+
+// 按当前输入和模式创建匹配器，输入无效时返回nullptr，原因在m_patternError中
+CMatcher* FindDialog::createMatcher() {
+    m_patternError = "无效的查找内容";
+    m_patternLabels.clear();
+    m_ngramLiterals.clear();
+    m_ngramIgnoreCase = false;
+    const char* text = m_patternInput->value();
+    if (!text || !text[0]) return nullptr;
+    std::vector<uint8_t> bytes;
+    switch (m_modeChoice->value()) {
+        case FIND_MODE_HEX: {
+            std::vector<CByteSet> pattern;
+            if (!parseMaskPattern(text, pattern)) return nullptr;
+            // 没有通配符时就是普通字节串
+            bytes.resize(pattern.size());
+            for (size_t i = 0; i < pattern.size(); i++) {
+                if (!pattern[i].IsSingle(&bytes[i])) {
+                    // 索引用锚定的那段确定字节过滤
+                    CMaskMatcher* matcher = new CMaskMatcher(pattern);
+                    NgramLiteral literal;
+                    literal.nOffset = matcher->GetAnchorOffset();
+                    literal.vecBytes.resize(matcher->GetAnchorLength());
+                    for (size_t j = 0; j < literal.vecBytes.size(); j++)
+                        pattern[literal.nOffset + j].IsSingle(&literal.vecBytes[j]);
+                    m_ngramLiterals.push_back(literal);
+                    return matcher;
+                }
+            }
+            m_ngramLiterals.push_back(NgramLiteral{bytes, 0});
+            return new CLiteralMatcher(bytes.data(), bytes.size());
+        }
+        case FIND_MODE_TEXT:
+            m_ngramLiterals.push_back(NgramLiteral{std::vector<uint8_t>(text, text + strlen(text)), 0});
+            m_ngramIgnoreCase = m_ignoreCaseCheck->value() != 0;
+            return new CLiteralMatcher((const uint8_t*)text, strlen(text), m_ignoreCaseCheck->value());
+        case FIND_MODE_MULTI: {
+            // 忽略大小写对所有模式中的字母都生效
+            std::vector<std::vector<uint8_t> > patterns;
+            if (!parsePatternList(text, patterns)) return nullptr;
+            for (size_t i = 0; i < patterns.size(); i++) {
+                char label[32];
+                snprintf(label, sizeof(label), "模式 #%zu", i + 1);
+                m_patternLabels.push_back(label);
+                m_ngramLiterals.push_back(NgramLiteral{patterns[i], 0});
+            }
+            m_ngramIgnoreCase = m_ignoreCaseCheck->value() != 0;
+            return new CAhoCorasickMatcher(patterns, m_ignoreCaseCheck->value());
+        }
+        case FIND_MODE_REGEX: {
+            std::unique_ptr<CRegexMatcher> matcher(new CRegexMatcher());
+            if (!matcher->Compile(text, m_ignoreCaseCheck->value())) {
+                m_patternError = matcher->GetError();
+                return nullptr;
+            }
+            return matcher.release();
+        }
+        case FIND_MODE_UNICODE: {
+            // 输入框的内容是UTF-8
+            std::unique_ptr<CTextMatcher> matcher(new CTextMatcher());
+            if (!matcher->SetText(text, TEXT_ALL_ENCODINGS, m_ignoreCaseCheck->value())) {
+                m_patternError = "输入不是有效的UTF-8文本";
+                return nullptr;
+            }
+            for (size_t i = 0; i < matcher->GetPatternCount(); i++)
+                m_patternLabels.push_back(CTextMatcher::GetEncodingName(matcher->GetPatternEncoding((uint32_t)i)));
+            return matcher.release();
+        }
+        case FIND_MODE_HAMMING:
+        case FIND_MODE_EDIT: {
+            if (!parseHex(text, bytes)) return nullptr;
+            uint32_t errors = (uint32_t)m_errorSpinner->value();
+            if (bytes.size() > APPROX_MAX_PATTERN) {
+                m_patternError = "近似查找的模式最长64字节";
+                return nullptr;
+            }
+            if (errors >= bytes.size()) {
+                m_patternError = "误差必须小于模式长度";
+                return nullptr;
+            }
+            if (m_modeChoice->value() == FIND_MODE_HAMMING)
+                return new CHammingMatcher(bytes.data(), bytes.size(), errors);
+            return new CEditDistanceMatcher(bytes.data(), bytes.size(), errors);
+        }
+        default:
+            return nullptr;
+    }
+}
+
+// 用4-gram索引求出可能有匹配的范围，不能使用索引时返回false（需要扫描整个文件）
+bool FindDialog::queryNgramIndex(std::vector<SearchRange>& ranges) {
+    CEditBuffer* buffer = m_hexTable->GetEditBuffer();
+    CLargeFile* file = buffer->GetFile();
+    // 索引描述的是磁盘上的文件，修改过就不能用了
+    if (!m_ngramCheck->value() || m_ngramLiterals.empty() || !file || !file->IsOpenFile() || buffer->IsModified())
+        return false;
+    const char* path = file->GetFilePathName();
+    if (!m_ngramIndex.IsOpen() || m_ngramIndex.GetFilePath() != path) {
+        if (!m_ngramIndex.Open(path)) return false;
+    }
+    return m_ngramIndex.Query(m_ngramLiterals, m_ngramIgnoreCase, ranges) != 0;
+}
+
+// 为打开的文件建立4-gram索引
+void FindDialog::buildNgramIndex() {
+    if (m_searching) return;
+    CEditBuffer* buffer = m_hexTable->GetEditBuffer();
+    CLargeFile* file = buffer->GetFile();
+    if (!file || !file->IsOpenFile() || buffer->GetSize() == 0) {
+        setStatus("未打开文件");
+        return;
+    }
+    setBusy(true);
+    m_hexTable->deactivate();
+    setStatus("正在建立索引...");
+
+    // 工作线程只读文件本身，编辑层的修改不影响索引
+    std::string path = file->GetFilePathName();
+    int built = m_ngramIndex.Build(path.c_str(), file, (uint32_t)m_threadSpinner->value(),
+        [this](FileOffset done, FileOffset total) {
+            char text[128];
+            snprintf(text, sizeof(text), "正在建立索引... %" PRIu64 " / %" PRIu64 " MB", done >> 20, total >> 20);
+            setStatus(text);
+            Fl::check();
+            return !m_cancelled;
+        });
+    int error = errno;
+
+    m_hexTable->activate();
+    setBusy(false);
+
+    char text[256];
+    if (built) {
+        double seconds = m_ngramIndex.GetBuildSeconds();
+        snprintf(text, sizeof(text), "索引: %.1f MB, %" PRIu64 " 块 x %u KB | 用时 %.2f 秒, %.0f MB/s",
+                 m_ngramIndex.GetIndexBytes() / (1024.0 * 1024.0), m_ngramIndex.GetBlockCount(),
+                 m_ngramIndex.GetBlockSize() >> 10, seconds,
+                 seconds > 0 ? buffer->GetSize() / seconds / (1024 * 1024) : 0.0);
+    } else if (m_cancelled) {
+        snprintf(text, sizeof(text), "已停止建立索引");
+    } else {
+        snprintf(text, sizeof(text), "建立索引失败: %s", strerror(error));
+    }
+    setStatus(text);
+}
+
+// 按当前模式解析替换内容，每个模式序号一项（只有一项时所有模式共用），无效时返回false
+bool FindDialog::parseReplacement(CMatcher* matcher, std::vector<std::vector<uint8_t> >& replacements) {
+    replacements.clear();
+    const char* text = m_replaceInput->value();
+    if (!text) text = "";
+    switch (m_modeChoice->value()) {
+        case FIND_MODE_TEXT:
+        case FIND_MODE_REGEX:
+            replacements.push_back(std::vector<uint8_t>(text, text + strlen(text)));
+            return true;
+        case FIND_MODE_UNICODE: {
+            // 每种编码的匹配替换为同一编码的文本
+            std::vector<uint32_t> codePoints;
+            if (!DecodeUtf8(text, codePoints)) return false;
+            CTextMatcher* textMatcher = static_cast<CTextMatcher*>(matcher);
+            for (size_t i = 0; i < textMatcher->GetPatternCount(); i++) {
+                int encoding = textMatcher->GetPatternEncoding((uint32_t)i);
+                std::string encoded;
+                for (size_t j = 0; j < codePoints.size(); j++) {
+                    if (encoding == TEXT_UTF8) AppendUtf8(codePoints[j], encoded);
+                    else AppendUtf16(codePoints[j], encoding == TEXT_UTF16BE, encoded);
+                }
+                replacements.push_back(std::vector<uint8_t>(encoded.begin(), encoded.end()));
+            }
+            return true;
+        }
+        default: {
+            // 十六进制字节串，或模式列表的写法（多个模式时可以每个模式一项）
+            std::vector<uint8_t> bytes;
+            if (!text[0] || parseHex(text, bytes)) {
+                replacements.push_back(bytes);
+                return true;
+            }
+            if (!parsePatternList(text, replacements)) return false;
+            return replacements.size() == 1 ||
+                   (m_modeChoice->value() == FIND_MODE_MULTI && replacements.size() == m_patternLabels.size());
+        }
+    }
+}
+
+// 统计匹配数并确认后，把全部匹配替换掉写回文件
+void FindDialog::replaceAll() {
+    if (m_searching) return;
+    CEditBuffer* buffer = m_hexTable->GetEditBuffer();
+    if (buffer->GetSize() == 0) {
+        setStatus("未打开文件");
+        return;
+    }
+    std::unique_ptr<CMatcher> matcher(createMatcher());
+    if (!matcher) {
+        setStatus(m_patternError.c_str());
+        return;
+    }
+    std::vector<std::vector<uint8_t> > replacements;
+    if (!parseReplacement(matcher.get(), replacements)) {
+        setStatus("无效的替换内容");
+        return;
+    }
+
+    // 统计、确认和写文件期间都要处理界面事件，表格设为只读，避免编辑改动正在写出的片段
+    setBusy(true);
+    m_hexTable->deactivate();
+    m_hexTable->SetReadOnly(true);
+    setStatus("正在统计...");
+
+    // 先只统计，让用户看到会替换多少处再决定是否写文件
+    CReplaceEngine counter;
+    uint64_t count = 0;
+    int counted = counter.Count(buffer, matcher.get(), &count, [this](uint64_t done, uint64_t total) {
+        char text[128];
+        snprintf(text, sizeof(text), "正在统计... %" PRIu64 " / %" PRIu64 " MB", done >> 20, total >> 20);
+        setStatus(text);
+        Fl::check();
+        return !m_cancelled;
+    });
+    int error = errno;
+    int choice = 0;
+    if (counted && count) {
+        choice = fl_choice("将替换 %" PRIu64 " 处并写回文件%s:\n%s\n替换后不能撤销。", "取消", "全部替换", nullptr,
+                           count, buffer->IsModified() ? "（包括未保存的修改）" : "", m_hexTable->GetFileName());
+    }
+    if (choice != 1) {
+        m_hexTable->SetReadOnly(false);
+        m_hexTable->activate();
+        setBusy(false);
+        if (!counted && error == E2BIG) {
+            setStatus("有匹配超过 64 KB，无法替换");
+        } else {
+            setStatus(!counted ? "已停止" : count ? "已取消替换" : "未找到，没有需要替换的内容");
+        }
+        return;
+    }
+
+    setStatus("正在替换...");
+    ReplaceStats stats;
+    bool ok = m_hexTable->ReplaceAll(matcher.get(), replacements, [this](uint64_t done, uint64_t total) {
+        char text[128];
+        snprintf(text, sizeof(text), "正在替换... %" PRIu64 " / %" PRIu64 " MB", done >> 20, total >> 20);
+        setStatus(text);
+        Fl::check();
+        return !m_cancelled;
+    }, &stats);
+    error = errno;
+
+    m_hexTable->SetReadOnly(false);
+    m_hexTable->activate();
+    setBusy(false);
+
+    char text[256];
+    if (ok) {
+        // 文件已经重写，原来的结果和索引都不再对应
+        m_resultBrowser->clear();
+        m_hexTable->GetHitIndex().Clear();
+        m_indexComplete = false;
+        m_ngramIndex.Close();
+        snprintf(text, sizeof(text), "已替换 %" PRIu64 " 处 | %" PRIu64 " -> %" PRIu64 " MB, %.2f 秒, %.0f MB/s | 写入空闲 %.2f 秒, 等待写入 %.2f 秒",
+                 stats.nReplaced, stats.nBytesScanned >> 20, stats.nBytesWritten >> 20, stats.dSeconds,
+                 stats.dSeconds > 0 ? stats.nBytesScanned / stats.dSeconds / (1024 * 1024) : 0.0,
+                 stats.dWriterIdleSeconds, stats.dScanStallSeconds);
+    } else if (error == ECANCELED) {
+        snprintf(text, sizeof(text), "已停止替换，文件没有改变");
+    } else if (error == E2BIG) {
+        snprintf(text, sizeof(text), "有匹配超过 64 KB，无法替换，文件没有改变");
+    } else {
+        snprintf(text, sizeof(text), "替换失败: %s", strerror(error));
+    }
+    setStatus(text);
+}
+
+// 结果属于哪个模式，用于显示，只有一个模式时为空串
+std::string FindDialog::hitLabel(const std::vector<std::string>& labels, const SearchHit& hit) {
+    return hit.nPattern < labels.size() ? labels[hit.nPattern] : std::string();
+}
+
+// 当前的查找内容，与m_indexKey比较
+std::string FindDialog::patternKey() {
+    char prefix[32];
+    snprintf(prefix, sizeof(prefix), "%d%d%d:", m_modeChoice->value(), m_ignoreCaseCheck->value() ? 1 : 0,
+             (int)m_errorSpinner->value());
+    return prefix + std::string(m_patternInput->value());
+}
+
+// 用全部查找的结果索引跳到上一个/下一个，索引不可用时返回false
+bool FindDialog::findInIndex(bool forward) {
+    // 编辑后表格会清空索引；没有结果时重新扫描也只需要很短时间
+    const CHitIndex& index = m_hexTable->GetHitIndex();
+    if (!m_indexComplete || index.IsEmpty() || m_indexKey != patternKey()) return false;
+
+    FileOffset start = 0, length = 0;
+    bool hasSelection = m_hexTable->GetSelection(start, length);
+    size_t i;
+    if (forward) {
+        i = index.LowerBound(hasSelection ? start + 1 : 0);
+    } else {
+        i = index.LowerBound(hasSelection ? start : m_hexTable->GetEditBuffer()->GetSize());
+        i = i ? i - 1 : index.GetCount();
+    }
+
+    char text[160];
+    SearchHit hit;
+    if (index.GetHit(i, &hit)) {
+        m_hexTable->SelectRange(hit.nOffset, hit.nLength);
+        std::string label = hitLabel(m_indexLabels, hit);
+        snprintf(text, sizeof(text), "找到: 0x%" PRIx64 "%s%s%s | 第 %zu / %zu 个", hit.nOffset,
+                 label.empty() ? "" : " (", label.c_str(), label.empty() ? "" : ")", i + 1, index.GetCount());
+    } else {
+        snprintf(text, sizeof(text), "未找到 | 共 %zu 个", index.GetCount());
+    }
+    setStatus(text);
+    return true;
+}
+
+// 显示状态信息
+void FindDialog::setStatus(const char* text) {
+    m_statusBox->copy_label(text);
+    m_statusBox->redraw();
+}
+
+// 查找期间禁用/恢复按钮和编辑
+void FindDialog::setBusy(bool busy) {
+    m_searching = busy;
+    if (busy) {
+        m_cancelled = false;
+        m_nextButton->deactivate();
+        m_prevButton->deactivate();
+        m_findAllButton->deactivate();
+        m_ngramButton->deactivate();
+        m_replaceButton->deactivate();
+        m_stopButton->activate();
+    } else {
+        m_nextButton->activate();
+        m_prevButton->activate();
+        m_findAllButton->activate();
+        m_ngramButton->activate();
+        m_replaceButton->activate();
+        m_stopButton->deactivate();
+    }
+}
+
+// 从光标处向后/向前查找并选中结果
+void FindDialog::find(bool forward) {
+    if (m_searching) return;
+    CEditBuffer* buffer = m_hexTable->GetEditBuffer();
+    if (buffer->GetSize() == 0) {
+        setStatus("未打开文件");
+        return;
+    }
+    if (findInIndex(forward)) return;
+    std::unique_ptr<CMatcher> matcher(createMatcher());
+    if (!matcher) {
+        setStatus(m_patternError.c_str());
+        return;
+    }
+
+    // 向后从选择起点的下一个字节开始，这样连续查找不会停在同一个结果上；向前找起点在选择之前的结果
+    FileOffset start = 0, length = 0;
+    bool hasSelection = m_hexTable->GetSelection(start, length);
+
+    // 分段扫描之间处理界面事件，菜单快捷键仍然可用，查找期间表格设为只读，不能撤销、粘贴或填充
+    setBusy(true);
+    m_hexTable->deactivate();
+    m_hexTable->SetReadOnly(true);
+    setStatus("正在查找...");
+
+    SearchProgress progress = [this](FileOffset done, FileOffset total) {
+        char text[128];
+        snprintf(text, sizeof(text), "正在查找... %" PRIu64 " / %" PRIu64 " MB",
+                 done >> 20, total >> 20);
+        setStatus(text);
+        Fl::check();
+        return !m_cancelled;
+    };
+
+    CSearcher searcher;
+    std::vector<SearchRange> ranges;
+    bool useIndex = queryNgramIndex(ranges);
+    if (useIndex) searcher.SetRanges(ranges);
+    SearchHit hit;
+    int found = FALSE;
+    int completed;
+    if (forward) {
+        completed = searcher.FindNext(buffer, matcher.get(), hasSelection ? start + 1 : 0, &hit, &found, progress);
+    } else {
+        completed = searcher.FindPrev(buffer, matcher.get(), hasSelection ? start : buffer->GetSize(), &hit, &found, progress);
+    }
+
+    m_hexTable->SetReadOnly(false);
+    m_hexTable->activate();
+    setBusy(false);
+
+    char note[64] = "";
+    if (useIndex) {
+        snprintf(note, sizeof(note), " | 索引: %" PRIu64 " / %" PRIu64 " 块",
+                 m_ngramIndex.GetLastCandidateBlocks(), m_ngramIndex.GetBlockCount());
+    }
+    char text[224];
+    if (!completed) {
+        snprintf(text, sizeof(text), "已停止");
+    } else if (found) {
+        m_hexTable->SelectRange(hit.nOffset, hit.nLength);
+        std::string label = hitLabel(m_patternLabels, hit);
+        snprintf(text, sizeof(text), "找到: 0x%" PRIx64 "%s%s%s | 扫描 %" PRIu64 " MB, %.2f 秒, %.0f MB/s%s",
+                 hit.nOffset, label.empty() ? "" : " (", label.c_str(), label.empty() ? "" : ")", searcher.GetBytesScanned() >> 20,
+                 searcher.GetSeconds(), searcher.GetThroughput(), note);
+    } else {
+        snprintf(text, sizeof(text), "未找到 | 扫描 %" PRIu64 " MB, %.2f 秒, %.0f MB/s%s",
+                 searcher.GetBytesScanned() >> 20, searcher.GetSeconds(), searcher.GetThroughput(), note);
+    }
+    setStatus(text);
+}
+
+// 在后台查找全部结果
+void FindDialog::findAll() {
+    if (m_searching) return;
+    CEditBuffer* buffer = m_hexTable->GetEditBuffer();
+    if (buffer->GetSize() == 0) {
+        setStatus("未打开文件");
+        return;
+    }
+    std::unique_ptr<CMatcher> matcher(createMatcher());
+    if (!matcher) {
+        setStatus(m_patternError.c_str());
+        return;
+    }
+
+    m_resultBrowser->clear();
+    m_hexTable->GetHitIndex().Clear();
+    m_indexKey = patternKey();
+    m_indexComplete = false;
+    std::vector<SearchRange> ranges;
+    bool useIndex = queryNgramIndex(ranges);
+    m_ngramNote.clear();
+    FileOffset total = buffer->GetSize();
+    if (useIndex) {
+        total = 0;
+        for (size_t i = 0; i < ranges.size(); i++) total += ranges[i].nEnd - ranges[i].nStart;
+        char note[64];
+        snprintf(note, sizeof(note), " | 索引: %" PRIu64 " / %" PRIu64 " 块",
+                 m_ngramIndex.GetLastCandidateBlocks(), m_ngramIndex.GetBlockCount());
+        m_ngramNote = note;
+    }
+    m_pendingHits.clear();
+    m_pendingDone = 0;
+    m_pendingTotal = total;
+    m_allDone = false;
+    m_allCompleted = false;
+    m_indexLabels = m_patternLabels;
+
+    // 工作线程直接读编辑层，查找期间只能浏览不能编辑
+    setBusy(true);
+    m_reportButton->deactivate();
+    m_hexTable->SetReadOnly(true);
+    setStatus("正在查找...");
+
+    // 这两个回调在工作线程上执行，只把结果交给界面线程
+    ParallelHitsCallback onHits = [this](const std::vector<SearchHit>& hits, FileOffset done, FileOffset total) {
+        std::lock_guard<std::mutex> lock(m_pendingLock);
+        m_pendingHits.insert(m_pendingHits.end(), hits.begin(), hits.end());
+        m_pendingDone = done;
+        m_pendingTotal = total;
+    };
+    ParallelDoneCallback onDone = [this](int completed) {
+        std::lock_guard<std::mutex> lock(m_pendingLock);
+        m_allDone = true;
+        m_allCompleted = completed != 0;
+    };
+    m_parallelSearcher.Start(buffer, matcher.get(), (uint32_t)m_threadSpinner->value(), onHits, onDone,
+                             useIndex ? &ranges : nullptr);
+    Fl::add_timeout(kPollInterval, pollTimerCallback, this);
+}
+
+// 取走工作线程交付的结果并显示，查找结束后收尾
+void FindDialog::pollResults() {
+    std::vector<SearchHit> hits;
+    FileOffset done, total;
+    bool finished, completed;
+    {
+        std::lock_guard<std::mutex> lock(m_pendingLock);
+        hits.swap(m_pendingHits);
+        done = m_pendingDone;
+        total = m_pendingTotal;
+        finished = m_allDone;
+        completed = m_allCompleted;
+    }
+
+    // 每块内按结束位置报告，先按起点排好；块之间已经有序
+    std::stable_sort(hits.begin(), hits.end(), [](const SearchHit& a, const SearchHit& b) {
+        return a.nOffset < b.nOffset;
+    });
+    CHitIndex& index = m_hexTable->GetHitIndex();
+    size_t listed = index.GetCount();
+    index.Append(hits.data(), hits.size());
+    if (!hits.empty()) m_hexTable->redraw();
+    for (size_t i = 0; i < hits.size() && listed < kMaxListedHits; i++, listed++) {
+        char line[96];
+        std::string label = hitLabel(m_indexLabels, hits[i]);
+        if (!label.empty()) {
+            snprintf(line, sizeof(line), "0x%016" PRIX64 "  %s (%" PRIu64 " 字节)",
+                     hits[i].nOffset, label.c_str(), hits[i].nLength);
+        } else {
+            snprintf(line, sizeof(line), "0x%016" PRIX64 "  (%" PRIu64 " 字节)", hits[i].nOffset, hits[i].nLength);
+        }
+        m_resultBrowser->add(line);
+    }
+
+    char text[320];
+    if (!finished) {
+        snprintf(text, sizeof(text), "正在查找... 已找到 %zu 处 | %" PRIu64 " / %" PRIu64 " MB",
+                 index.GetCount(), done >> 20, total >> 20);
+        setStatus(text);
+        Fl::repeat_timeout(kPollInterval, pollTimerCallback, this);
+        return;
+    }
+
+    m_parallelSearcher.Wait();
+    m_hexTable->SetReadOnly(false);
+    setBusy(false);
+    m_indexComplete = completed;
+
+    // 汇总每块耗时
+    const std::vector<ChunkStats>& stats = m_parallelSearcher.GetChunkStats();
+    uint64_t minNs = UINT64_MAX, maxNs = 0, sumNs = 0, scanned = 0;
+    for (size_t i = 0; i < stats.size(); i++) {
+        if (!stats[i].nNanoseconds) continue;
+        minNs = std::min(minNs, stats[i].nNanoseconds);
+        maxNs = std::max(maxNs, stats[i].nNanoseconds);
+        sumNs += stats[i].nNanoseconds;
+        scanned++;
+    }
+    if (scanned) m_reportButton->activate();
+    snprintf(text, sizeof(text), "%s %zu 处%s | %u 线程, %zu 块, 窃取 %" PRIu64 " 次 | 块耗时 %.1f/%.1f/%.1f ms | %.2f 秒, %.0f MB/s%s",
+             completed ? "找到" : m_parallelSearcher.GetReadFailureCount() ? "读取失败, 查找不完整, 找到" : "已停止, 找到", index.GetCount(),
+             index.GetCount() > kMaxListedHits ? "(列表只显示前面的)" : "",
+             m_parallelSearcher.GetThreadCount(), stats.size(), m_parallelSearcher.GetStealCount(),
+             scanned ? minNs / 1e6 : 0.0, scanned ? sumNs / 1e6 / scanned : 0.0, maxNs / 1e6,
+             m_parallelSearcher.GetSeconds(), m_parallelSearcher.GetThroughput(), m_ngramNote.c_str());
+    setStatus(text);
+}
+
+// 显示全部查找的每个分块的耗时
+void FindDialog::showReport() {
+    if (!m_reportWindow) {
+        m_reportWindow = new Fl_Double_Window(520, 320, "分块耗时");
+        m_reportBrowser = new Fl_Browser(10, 10, 500, 300);
+        m_reportBrowser->textfont(FL_COURIER);
+        m_reportWindow->resizable(m_reportBrowser);
+        m_reportWindow->end();
+    }
+    m_reportBrowser->clear();
+    m_reportBrowser->add("          偏移       大小(KB) 线程  耗时(ms)     MB/s     匹配");
+    const std::vector<ChunkStats>& stats = m_parallelSearcher.GetChunkStats();
+    for (size_t i = 0; i < stats.size(); i++) {
+        const ChunkStats& chunk = stats[i];
+        char line[160];
+        if (!chunk.nNanoseconds) {
+            snprintf(line, sizeof(line), "0x%012" PRIX64 " %10" PRIu64 "    -         -        -        -  未扫描",
+                     chunk.nStart, chunk.nLength >> 10);
+        } else {
+            snprintf(line, sizeof(line), "0x%012" PRIX64 " %10" PRIu64 " %4u %9.2f %8.0f %8" PRIu64 "%s%s",
+                     chunk.nStart, chunk.nLength >> 10, chunk.nWorker, chunk.nNanoseconds / 1e6,
+                     chunk.nLength / (chunk.nNanoseconds / 1e9) / (1024 * 1024), chunk.nHits,
+                     chunk.bStolen ? "  窃取" : "", chunk.bReadFailed ? "  读取失败" : "");
+        }
+        m_reportBrowser->add(line);
+    }
+    m_reportWindow->show();
+}
+
+void FindDialog::nextButtonCallback(Fl_Widget* widget, void* data) {
+    static_cast<FindDialog*>(data)->find(true);
+}
+
+void FindDialog::prevButtonCallback(Fl_Widget* widget, void* data) {
+    static_cast<FindDialog*>(data)->find(false);
+}
+
+void FindDialog::findAllButtonCallback(Fl_Widget* widget, void* data) {
+    static_cast<FindDialog*>(data)->findAll();
+}
+
+void FindDialog::stopButtonCallback(Fl_Widget* widget, void* data) {
+    FindDialog* dialog = static_cast<FindDialog*>(data);
+    dialog->m_cancelled = true;
+    dialog->m_parallelSearcher.Cancel();
+}
+
+void FindDialog::ngramButtonCallback(Fl_Widget* widget, void* data) {
+    static_cast<FindDialog*>(data)->buildNgramIndex();
+}
+
+void FindDialog::replaceButtonCallback(Fl_Widget* widget, void* data) {
+    static_cast<FindDialog*>(data)->replaceAll();
+}
+
+void FindDialog::reportButtonCallback(Fl_Widget* widget, void* data) {
+    static_cast<FindDialog*>(data)->showReport();
+}
+
+void FindDialog::closeButtonCallback(Fl_Widget* widget, void* data) {
+    FindDialog* dialog = static_cast<FindDialog*>(data);
+    dialog->m_cancelled = true;
+    dialog->m_parallelSearcher.Cancel();
+    dialog->hide();
+}
+
+void FindDialog::resultBrowserCallback(Fl_Widget* widget, void* data) {
+    FindDialog* dialog = static_cast<FindDialog*>(data);
+    int line = dialog->m_resultBrowser->value();
+    SearchHit hit;
+    if (line < 1 || !dialog->m_hexTable->GetHitIndex().GetHit(line - 1, &hit)) {
+        // 编辑后索引已清空
+        dialog->setStatus("结果已失效，请重新查找");
+        return;
+    }
+    dialog->m_hexTable->SelectRange(hit.nOffset, hit.nLength);
+}
+
+void FindDialog::pollTimerCallback(void* data) {
+    static_cast<FindDialog*>(data)->pollResults();
+}
@@ -0,0 +1,141 @@
+#ifndef FINDDIALOG_H
+#define FINDDIALOG_H
+
+#include <FL/Fl_Double_Window.H>
+#include <FL/Fl_Input.H>
+#include <FL/Fl_Choice.H>
+#include <FL/Fl_Check_Button.H>
+#include <FL/Fl_Button.H>
+#include <FL/Fl_Box.H>
+#include <FL/Fl_Spinner.H>
+#include <FL/Fl_Hold_Browser.H>
+#include <vector>
+#include <mutex>
+#include <string>
+#include "HexTable.h"
+#include "Search.h"
+#include "ParallelSearch.h"
+#include "MaskMatcher.h"
+#include "NgramIndex.h"
+
+// 查找对话框类（非模态）
+// 查找上一个/下一个在UI线程分段扫描；全部查找在后台线程池上进行，结果按偏移顺序陆续显示。都可随时停止
+class FindDialog : public Fl_Double_Window {
+private:
+    HexTable* m_hexTable;
+    Fl_Input* m_patternInput;
+    Fl_Choice* m_modeChoice;
+    Fl_Check_Button* m_ignoreCaseCheck;
+    Fl_Spinner* m_errorSpinner;         // 近似查找允许的字节差异数
+    Fl_Spinner* m_threadSpinner;
+    Fl_Button* m_ngramButton;           // 建立4-gram索引
+    Fl_Check_Button* m_ngramCheck;      // 查找时使用4-gram索引
+    Fl_Input* m_replaceInput;           // 替换内容，按查找模式解析
+    Fl_Button* m_replaceButton;
+    Fl_Hold_Browser* m_resultBrowser;
+    Fl_Button* m_nextButton;
+    Fl_Button* m_prevButton;
+    Fl_Button* m_findAllButton;
+    Fl_Button* m_stopButton;
+    Fl_Button* m_reportButton;
+    Fl_Button* m_closeButton;
+    Fl_Box* m_statusBox;
+    Fl_Double_Window* m_reportWindow;   // 分块耗时报告，第一次查看时创建
+    Fl_Browser* m_reportBrowser;
+
+    bool m_searching;   // 是否正在查找
+    bool m_cancelled;   // 用户是否点了停止
+    std::string m_patternError; // createMatcher失败的原因
+    std::vector<std::string> m_patternLabels;   // createMatcher设置：每个模式序号显示的名称，只有一个模式时为空
+    // 文件的4-gram索引（<文件>.fhidx），只在文件未修改时使用；createMatcher给出用它过滤时匹配必须含有的字节
+    CNgramIndex m_ngramIndex;
+    std::vector<NgramLiteral> m_ngramLiterals;
+    bool m_ngramIgnoreCase;
+    std::string m_ngramNote;            // 全部查找使用了索引时的说明
+
+    // 全部查找：工作线程把按顺序合并好的结果放进m_pendingHits，界面定时取走
+    CParallelSearcher m_parallelSearcher;
+    std::mutex m_pendingLock;
+    std::vector<SearchHit> m_pendingHits;
+    FileOffset m_pendingDone;
+    FileOffset m_pendingTotal;
+    bool m_allDone;
+    bool m_allCompleted;
+    // 全部查找的结果存在表格的CHitIndex中，列表只显示前kMaxListedHits个；
+    // 查找完成后，同样的查找内容的上一个/下一个直接在索引中二分查找
+    std::string m_indexKey;             // 索引对应的查找内容（模式+大小写+误差+输入）
+    std::vector<std::string> m_indexLabels; // 索引中模式序号的名称
+    bool m_indexComplete;               // 索引是否覆盖了整个文件（没有被停止）
+
+    // 静态回调函数
+    static void nextButtonCallback(Fl_Widget* widget, void* data);
+    static void prevButtonCallback(Fl_Widget* widget, void* data);
+    static void findAllButtonCallback(Fl_Widget* widget, void* data);
+    static void stopButtonCallback(Fl_Widget* widget, void* data);
+    static void reportButtonCallback(Fl_Widget* widget, void* data);
+    static void closeButtonCallback(Fl_Widget* widget, void* data);
+    static void ngramButtonCallback(Fl_Widget* widget, void* data);
+    static void replaceButtonCallback(Fl_Widget* widget, void* data);
+    static void resultBrowserCallback(Fl_Widget* widget, void* data);
+    static void pollTimerCallback(void* data);
+
+    // 按当前输入和模式创建匹配器，输入无效时返回nullptr，原因在m_patternError中
+    CMatcher* createMatcher();
+
+    // 结果属于哪个模式（多个模式的序号、文本的编码），用于显示，只有一个模式时为空串
+    static std::string hitLabel(const std::vector<std::string>& labels, const SearchHit& hit);
+
+    // 当前的查找内容，与m_indexKey比较
+    std::string patternKey();
+
+    // 用全部查找的结果索引跳到上一个/下一个，索引不可用时返回false
+    bool findInIndex(bool forward);
+
+    // 用4-gram索引求出可能有匹配的范围，不能使用索引时返回false（需要扫描整个文件）
+    bool queryNgramIndex(std::vector<SearchRange>& ranges);
+
+    // 为打开的文件建立4-gram索引
+    void buildNgramIndex();
+
+    // 按当前模式解析替换内容，每个模式序号一项（只有一项时所有模式共用），无效时返回false
+    bool parseReplacement(CMatcher* matcher, std::vector<std::vector<uint8_t> >& replacements);
+
+    // 统计匹配数并确认后，把全部匹配替换掉写回文件
+    void replaceAll();
+
+    // 从光标处向后/向前查找并选中结果
+    void find(bool forward);
+
+    // 在后台查找全部结果
+    void findAll();
+
+    // 取走工作线程交付的结果并显示，查找结束后收尾
+    void pollResults();
+
+    // 查找期间禁用/恢复按钮和编辑
+    void setBusy(bool busy);
+
+    // 显示全部查找的每个分块的耗时
+    void showReport();
+
+    // 显示状态信息
+    void setStatus(const char* text);
+
+public:
+    FindDialog(int w, int h, const char* title, HexTable* table);
+    ~FindDialog();
+
+    // 是否正在查找（查找期间不能打开/保存文件）
+    bool isSearching() const { return m_searching; }
+
+    // 解析十六进制字节串，如"4D 5A 90"，空白可省略
+    static bool parseHex(const char* text, std::vector<uint8_t>& bytes);
+
+    // 解析带通配符的十六进制模式，如"4D 5A ?? ?? 50 45"、"E8 ?? ?? ?? ??"、"4? [00-1F|7F]"
+    static bool parseMaskPattern(const char* text, std::vector<CByteSet>& pattern);
+
+    // 解析分号分隔的模式列表，每项是十六进制字节串，或用双引号括起的文本，如 4D 5A; "PK"
+    static bool parsePatternList(const char* text, std::vector<std::vector<uint8_t> >& patterns);
+};
+
+#endif // FINDDIALOG_H
@@ -2,22 +2,66 @@
 #include <FL/Fl_File_Chooser.H>
 #include <FL/fl_ask.H>
 #include <FL/Fl_Native_File_Chooser.H>
+#include <FL/Fl_Window.H>
+#include <FL/Fl_Progress.H>
+#include <FL/Fl_Button.H>
 #include <cstdlib>  // 添加exit函数
+#include <cstring>
+#include <cerrno>
+#include <cinttypes>
+#include <chrono>
 #include "FakeType.h"
 #include "LoadStruct.h"
 
+// 概览条宽度，三列各占三分之一
+static const int kOverviewWidth = 48;
+
 // 菜单项定义
 Fl_Menu_Item HexEditorWindow::menuItems[] = {
     {"&文件", 0, 0, 0, FL_SUBMENU},
         {"&打开文件", FL_COMMAND + 'o', (Fl_Callback*)FileOpenCallback, 0},
+        {"打开进程内存...", 0, (Fl_Callback*)FileOpenProcessCallback, 0},
+        {"存储后端", 0, 0, 0, FL_SUBMENU},
+            {"自动选择", 0, (Fl_Callback*)FileBackendAutoCallback, 0, FL_MENU_RADIO | FL_MENU_VALUE},
+            {"内存映射(mmap)", 0, (Fl_Callback*)FileBackendMmapCallback, 0, FL_MENU_RADIO},
+            {"缓冲读取(pread)", 0, (Fl_Callback*)FileBackendPreadCallback, 0, FL_MENU_RADIO},
+            {0},
         {"&保存文件", FL_COMMAND + 's', (Fl_Callback*)FileSaveCallback, 0},
-        {"保存为...", FL_COMMAND + FL_SHIFT + 's', (Fl_Callback*)FileSaveCallback, 0, FL_MENU_DIVIDER},
+        {"保存为...", FL_COMMAND + FL_SHIFT + 's', (Fl_Callback*)FileSaveAsCallback, 0, FL_MENU_DIVIDER},
         {"退&出", FL_COMMAND + 'q', (Fl_Callback*)FileExitCallback, 0},
         {0},
     {"&编辑", 0, 0, 0, FL_SUBMENU},
+        {"&撤销", FL_COMMAND + 'z', (Fl_Callback*)EditUndoCallback, 0},
+        {"&重做", FL_COMMAND + 'y', (Fl_Callback*)EditRedoCallback, 0, FL_MENU_DIVIDER},
         {"&复制", FL_COMMAND + 'c', (Fl_Callback*)EditCopyCallback, 0},
-        {"&粘贴", FL_COMMAND + 'v', (Fl_Callback*)EditPasteCallback, 0, FL_MENU_DIVIDER},
+        {"&粘贴", FL_COMMAND + 'v', (Fl_Callback*)EditPasteCallback, 0},
+        {"填充选区...", 0, (Fl_Callback*)EditFillCallback, 0, FL_MENU_DIVIDER},
         {"&查找", FL_COMMAND + 'f', (Fl_Callback*)EditFindCallback, 0},
+        {"&跳转到偏移", FL_COMMAND + 'g', (Fl_Callback*)EditGotoCallback, 0},
+        {0},
+    {"&视图", 0, 0, 0, FL_SUBMENU},
+        {"每行字节数...", 0, (Fl_Callback*)ViewBytesPerRowCallback, 0, FL_MENU_DIVIDER},
+        {"十六进制", 0, (Fl_Callback*)ViewFormatCallback, 0, FL_MENU_RADIO | FL_MENU_VALUE},
+        {"u8", 0, (Fl_Callback*)ViewFormatCallback, 0, FL_MENU_RADIO},
+        {"i8", 0, (Fl_Callback*)ViewFormatCallback, 0, FL_MENU_RADIO},
+        {"u16", 0, (Fl_Callback*)ViewFormatCallback, 0, FL_MENU_RADIO},
+        {"i16", 0, (Fl_Callback*)ViewFormatCallback, 0, FL_MENU_RADIO},
+        {"u32", 0, (Fl_Callback*)ViewFormatCallback, 0, FL_MENU_RADIO},
+        {"i32", 0, (Fl_Callback*)ViewFormatCallback, 0, FL_MENU_RADIO},
+        {"u64", 0, (Fl_Callback*)ViewFormatCallback, 0, FL_MENU_RADIO},
+        {"i64", 0, (Fl_Callback*)ViewFormatCallback, 0, FL_MENU_RADIO},
+        {"f32", 0, (Fl_Callback*)ViewFormatCallback, 0, FL_MENU_RADIO},
+        {"f64", 0, (Fl_Callback*)ViewFormatCallback, 0, FL_MENU_RADIO | FL_MENU_DIVIDER},
+        {"大端序", 0, (Fl_Callback*)ViewBigEndianCallback, 0, FL_MENU_TOGGLE | FL_MENU_DIVIDER},
+        {"按字节值着色", 0, (Fl_Callback*)ViewByteColoringCallback, 0, FL_MENU_TOGGLE},
+        {"着色范围...", 0, (Fl_Callback*)ViewByteColorRangesCallback, 0, FL_MENU_DIVIDER},
+        {"文本编码", 0, 0, 0, FL_SUBMENU},
+            {"ASCII", 0, (Fl_Callback*)ViewEncodingCallback, 0, FL_MENU_RADIO | FL_MENU_VALUE},
+            {"UTF-8", 0, (Fl_Callback*)ViewEncodingCallback, 0, FL_MENU_RADIO},
+            {"UTF-16LE", 0, (Fl_Callback*)ViewEncodingCallback, 0, FL_MENU_RADIO},
+            {"UTF-16BE", 0, (Fl_Callback*)ViewEncodingCallback, 0, FL_MENU_RADIO},
+            {"GBK", 0, (Fl_Callback*)ViewEncodingCallback, 0, FL_MENU_RADIO},
+            {0},
         {0},
     {"&数据管理", 0, 0, 0, FL_SUBMENU},
         {"基础类型管理", FL_COMMAND + '+', (Fl_Callback*)ManageBasicTypeCallback, 0},
@@ -65,21 +109,34 @@ void RegBaseType()
 }
 
 HexEditorWindow::HexEditorWindow(int w, int h, const char* title)
-    : Fl_Double_Window(w, h, title) {
+    : Fl_Double_Window(w, h, title), m_findDialog(nullptr) {
     // 创建菜单栏
     m_menuBar = new Fl_Menu_Bar(0, 0, w, 30);
     m_menuBar->menu(menuItems);
     
-    // 为每个菜单项设置user_data为this指针
-    for (int i = 0; menuItems[i].text != nullptr; i++) {
+    // 为每个菜单项设置user_data为this指针（子菜单的结束标记也是空项，要遍历整个数组）
+    for (size_t i = 0; i < sizeof(menuItems) / sizeof(menuItems[0]); i++) {
         if (menuItems[i].callback_ != nullptr) {
             // 为有回调函数的菜单项设置user_data
             menuItems[i].user_data_ = this;
         }
     }
+#ifdef _WIN32
+    // Windows下后端独占打开并映射着文件，既不能原地改写也不能把临时文件换上去，暂不提供保存
+    for (size_t i = 0; i < sizeof(menuItems) / sizeof(menuItems[0]); i++) {
+        if (menuItems[i].callback_ == (Fl_Callback*)FileSaveCallback ||
+            menuItems[i].callback_ == (Fl_Callback*)FileSaveAsCallback) {
+            menuItems[i].deactivate();
+        }
+    }
+#endif
     
-    // 创建十六进制表格（调整位置，为菜单栏留出空间）
-    m_hexTable = new HexTable(10, 40, w - 20, h - 80);
+    // 创建十六进制表格（调整位置，为菜单栏留出空间，右侧留给概览条）
+    m_hexTable = new HexTable(10, 40, w - 20 - kOverviewWidth - 6, h - 80);
+
+    // 概览条放在表格之后创建，表格绘制时通知它重画位置框能在同一次刷新中生效
+    m_overviewBar = new OverviewBar(w - 10 - kOverviewWidth, 40, kOverviewWidth, h - 80, m_hexTable);
+    m_hexTable->SetOverview(m_overviewBar);
     
     // 启用表格单元格导航功能
     m_hexTable->enable_cell_nav(true);
@@ -115,6 +172,7 @@ HexEditorWindow::HexEditorWindow(int w, int h, const char* title)
 }
 
 HexEditorWindow::~HexEditorWindow() {
+    delete m_findDialog;
     delete m_statusBuffer;
 }
 
@@ -128,9 +186,21 @@ void HexEditorWindow::MenuCallback(Fl_Widget* widget, void* data) {
     }
 }
 
+// 后台查找还在读取当前文件时返回true并提示，此时不能打开/保存文件
+bool HexEditorWindow::IsBusy() {
+    if (m_findDialog && m_findDialog->isSearching()) {
+        m_statusBuffer->text("正在查找，请先停止查找");
+        return true;
+    }
+    return false;
+}
+
 // 文件菜单回调函数
 void HexEditorWindow::FileOpenCallback(Fl_Widget* widget, void* data) {
     HexEditorWindow* window = static_cast<HexEditorWindow*>(data);
+    if (window->IsBusy()) {
+        return;
+    }
     
     Fl_Native_File_Chooser chooser;
     chooser.title("选择文件");
@@ -150,9 +220,110 @@ void HexEditorWindow::FileOpenCallback(Fl_Widget* widget, void* data) {
     }
 }
 
+void HexEditorWindow::FileOpenProcessCallback(Fl_Widget* widget, void* data) {
+    HexEditorWindow* window = static_cast<HexEditorWindow*>(data);
+    if (window->IsBusy()) {
+        return;
+    }
+    const char* input = fl_input("进程ID:");
+    if (!input) {
+        return;
+    }
+    int pid = atoi(input);
+    if (pid <= 0) {
+        fl_alert("无效的进程ID: %s", input);
+        return;
+    }
+    // 进程内存总是使用进程后端，偏移即目标进程的虚拟地址
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/mem", pid);
+    if (!window->m_hexTable->OpenFile(path)) {
+        fl_alert("无法读取进程内存: %d", pid);
+    }
+}
+
+void HexEditorWindow::FileBackendAutoCallback(Fl_Widget* widget, void* data) {
+    static_cast<HexEditorWindow*>(data)->m_hexTable->SetBackendType(BACKEND_AUTO);
+}
+
+void HexEditorWindow::FileBackendMmapCallback(Fl_Widget* widget, void* data) {
+    static_cast<HexEditorWindow*>(data)->m_hexTable->SetBackendType(BACKEND_MMAP);
+}
+
+void HexEditorWindow::FileBackendPreadCallback(Fl_Widget* widget, void* data) {
+    static_cast<HexEditorWindow*>(data)->m_hexTable->SetBackendType(BACKEND_PREAD);
+}
+
 void HexEditorWindow::FileSaveCallback(Fl_Widget* widget, void* data) {
     HexEditorWindow* window = static_cast<HexEditorWindow*>(data);
-    fl_alert("保存文件功能尚未实现");
+    if (!window->m_hexTable->IsModified() || window->IsBusy()) {
+        return;
+    }
+    window->SaveWithProgress(nullptr);
+}
+
+void HexEditorWindow::FileSaveAsCallback(Fl_Widget* widget, void* data) {
+    HexEditorWindow* window = static_cast<HexEditorWindow*>(data);
+    if (window->m_hexTable->GetFileName()[0] == '\0' || window->IsBusy()) {
+        return;
+    }
+    Fl_Native_File_Chooser chooser;
+    chooser.title("保存为");
+    chooser.type(Fl_Native_File_Chooser::BROWSE_SAVE_FILE);
+    chooser.options(Fl_Native_File_Chooser::SAVEAS_CONFIRM);
+    if (chooser.show() == 0 && chooser.filename()) {
+        window->SaveWithProgress(chooser.filename());
+    }
+}
+
+// 保存进度窗口的取消按钮
+static void SaveCancelCallback(Fl_Widget* widget, void* data) {
+    *static_cast<bool*>(data) = true;
+}
+
+// 保存到path（为空时保存回原文件），显示进度并报告写入/沿用的字节数
+void HexEditorWindow::SaveWithProgress(const char* path) {
+    // 进度窗口在保存超过一小段时间后才出现，小改动的原地保存不闪窗口
+    Fl_Window* dialog = new Fl_Window(320, 90, "正在保存");
+    Fl_Progress* progress = new Fl_Progress(10, 15, 300, 25);
+    progress->minimum(0);
+    progress->maximum(1);
+    Fl_Button* cancel = new Fl_Button(230, 50, 80, 30, "取消");
+    bool cancelled = false;
+    cancel->callback(SaveCancelCallback, &cancelled);
+    dialog->end();
+    dialog->set_modal();
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    SaveProgress onProgress = [&](uint64_t done, uint64_t total) {
+        if (!dialog->shown() && std::chrono::steady_clock::now() - start > std::chrono::milliseconds(300)) {
+            dialog->show();
+        }
+        if (dialog->shown()) {
+            progress->value(total ? (float)((double)done / total) : 1.0f);
+            Fl::check();
+        }
+        return !cancelled;
+    };
+
+    SaveStats stats;
+    bool ok = m_hexTable->SaveFile(path, onProgress, &stats);
+    int error = errno;
+    dialog->hide();
+    delete dialog;
+
+    if (!ok) {
+        if (error == ECANCELED) {
+            m_statusBuffer->text("保存已取消");
+        } else {
+            fl_alert("保存失败: %s", strerror(error));
+        }
+        return;
+    }
+    char message[256];
+    snprintf(message, sizeof(message), "已保存(%s): 写入 %" PRIu64 " 字节, 沿用 %" PRIu64 " 字节, 复制 %" PRIu64 " 字节, 耗时 %.2f 秒",
+             stats.bInPlace ? "原地" : "重写", stats.nBytesWritten, stats.nBytesReused, stats.nBytesCopied, stats.dSeconds);
+    m_statusBuffer->text(message);
 }
 
 void HexEditorWindow::FileExitCallback(Fl_Widget* widget, void* data) {
@@ -160,6 +331,16 @@ void HexEditorWindow::FileExitCallback(Fl_Widget* widget, void* data) {
 }
 
 // 编辑菜单回调函数
+void HexEditorWindow::EditUndoCallback(Fl_Widget* widget, void* data) {
+    HexEditorWindow* window = static_cast<HexEditorWindow*>(data);
+    window->m_hexTable->Undo();
+}
+
+void HexEditorWindow::EditRedoCallback(Fl_Widget* widget, void* data) {
+    HexEditorWindow* window = static_cast<HexEditorWindow*>(data);
+    window->m_hexTable->Redo();
+}
+
 void HexEditorWindow::EditCopyCallback(Fl_Widget* widget, void* data) {
     HexEditorWindow* window = static_cast<HexEditorWindow*>(data);
     fl_alert("复制功能尚未实现");
@@ -167,15 +348,148 @@ void HexEditorWindow::EditCopyCallback(Fl_Widget* widget, void* data) {
 
 void HexEditorWindow::EditPasteCallback(Fl_Widget* widget, void* data) {
     HexEditorWindow* window = static_cast<HexEditorWindow*>(data);
-    fl_alert("粘贴功能尚未实现");
+    // 剪贴板内容通过FL_PASTE事件送到表格
+    Fl::paste(*window->m_hexTable, 1);
+}
+
+void HexEditorWindow::EditFillCallback(Fl_Widget* widget, void* data) {
+    HexEditorWindow* window = static_cast<HexEditorWindow*>(data);
+    if (window->m_hexTable->GetFileSize() == 0) {
+        return;
+    }
+    const char* input = fl_input("填充字节（十六进制）:", "00");
+    if (!input) {
+        return;
+    }
+    char* end = nullptr;
+    unsigned long value = strtoul(input, &end, 16);
+    if (end == input || value > 0xFF) {
+        fl_alert("无效的字节: %s", input);
+        return;
+    }
+    window->m_hexTable->FillSelection((uint8_t)value);
 }
 
 void HexEditorWindow::EditFindCallback(Fl_Widget* widget, void* data) {
     HexEditorWindow* window = static_cast<HexEditorWindow*>(data);
-    fl_alert("查找功能尚未实现");
+    if (!window->m_findDialog) {
+        window->m_findDialog = new FindDialog(520, 360, "查找", window->m_hexTable);
+    }
+    window->m_findDialog->show();
+}
+
+void HexEditorWindow::EditGotoCallback(Fl_Widget* widget, void* data) {
+    HexEditorWindow* window = static_cast<HexEditorWindow*>(data);
+    if (window->m_hexTable->GetFileSize() == 0) {
+        return;
+    }
+    const char* input = fl_input("跳转到偏移（十六进制）:", "0");
+    if (!input) {
+        return;
+    }
+    char* end = nullptr;
+    unsigned long long offset = strtoull(input, &end, 16);
+    if (end == input) {
+        fl_alert("无效的偏移: %s", input);
+        return;
+    }
+    window->m_hexTable->GotoOffset(offset);
 }
 
 // 视图菜单回调函数
+void HexEditorWindow::ViewBytesPerRowCallback(Fl_Widget* widget, void* data) {
+    HexEditorWindow* window = static_cast<HexEditorWindow*>(data);
+    char current[32];
+    snprintf(current, sizeof(current), "%zu", window->m_hexTable->GetBytesPerRow());
+    const char* input = fl_input("每行字节数（数字或基础类型名，例如 int）:", current);
+    if (!input) {
+        return;
+    }
+    // 可以直接输入类型名，行宽设成这个类型的大小，便于按记录查看数组
+    char* end = nullptr;
+    unsigned long long bytesPerRow = strtoull(input, &end, 10);
+    if (end == input || *end != '\0') {
+        BindingType* type = BindingType::FindTypeByName(s2ws(input).c_str());
+        bytesPerRow = type && type->m_nTypeSize > 0 ? (unsigned long long)type->m_nTypeSize : 0;
+    }
+    if (bytesPerRow == 0 || bytesPerRow > HexTable::kMaxBytesPerRow) {
+        fl_alert("无效的每行字节数: %s（1~%zu）", input, HexTable::kMaxBytesPerRow);
+        return;
+    }
+    window->m_hexTable->SetBytesPerRow((size_t)bytesPerRow);
+}
+
+void HexEditorWindow::ViewFormatCallback(Fl_Widget* widget, void* data) {
+    HexEditorWindow* window = static_cast<HexEditorWindow*>(data);
+    const Fl_Menu_Item* item = static_cast<Fl_Menu_*>(widget)->mvalue();
+    if (!item || !item->label()) {
+        return;
+    }
+    // 菜单项的文字就是显示方式的名字，十六进制除外
+    int format = CELL_HEX;
+    for (int i = 1; i < CELL_FORMAT_COUNT; i++) {
+        if (strcmp(item->label(), CCellFormatter::GetFormatName(i)) == 0) {
+            format = i;
+        }
+    }
+    window->m_hexTable->SetCellFormat(format, window->m_hexTable->IsBigEndian());
+}
+
+void HexEditorWindow::ViewBigEndianCallback(Fl_Widget* widget, void* data) {
+    HexEditorWindow* window = static_cast<HexEditorWindow*>(data);
+    const Fl_Menu_Item* item = static_cast<Fl_Menu_*>(widget)->mvalue();
+    if (!item) {
+        return;
+    }
+    window->m_hexTable->SetCellFormat(window->m_hexTable->GetCellFormat(), item->value() != 0);
+}
+
+void HexEditorWindow::ViewByteColoringCallback(Fl_Widget* widget, void* data) {
+    HexEditorWindow* window = static_cast<HexEditorWindow*>(data);
+    const Fl_Menu_Item* item = static_cast<Fl_Menu_*>(widget)->mvalue();
+    if (!item) {
+        return;
+    }
+    window->m_hexTable->SetByteColoring(item->value() != 0);
+}
+
+void HexEditorWindow::ViewByteColorRangesCallback(Fl_Widget* widget, void* data) {
+    HexEditorWindow* window = static_cast<HexEditorWindow*>(data);
+    std::string current = ByteColorMap::FormatRanges(window->m_hexTable->GetByteColorRanges());
+    const char* input = fl_input("着色范围（十六进制，例如 00-1F=C0C0FF, 90=FFC0C0），覆盖默认的分类颜色:",
+                                 current.c_str());
+    if (!input) {
+        return;
+    }
+    std::vector<ByteColorRange> ranges;
+    if (!ByteColorMap::ParseRanges(input, ranges)) {
+        fl_alert("无效的着色范围: %s", input);
+        return;
+    }
+    window->m_hexTable->SetByteColorRanges(ranges);
+    // 设置了范围就打开着色
+    if (!window->m_hexTable->IsByteColoring()) {
+        window->m_hexTable->SetByteColoring(true);
+        Fl_Menu_Item* item = const_cast<Fl_Menu_Item*>(window->m_menuBar->find_item(ViewByteColoringCallback));
+        if (item) item->set();
+    }
+}
+
+void HexEditorWindow::ViewEncodingCallback(Fl_Widget* widget, void* data) {
+    HexEditorWindow* window = static_cast<HexEditorWindow*>(data);
+    const Fl_Menu_Item* item = static_cast<Fl_Menu_*>(widget)->mvalue();
+    if (!item || !item->label()) {
+        return;
+    }
+    // 菜单项的文字就是编码的名字
+    for (int i = 0; i < DECODE_ENCODING_COUNT; i++) {
+        if (strcmp(item->label(), CTextDecoder::GetEncodingName(i)) == 0) {
+            window->m_hexTable->SetTextEncoding(i);
+        }
+    }
+}
+
+// 数据管理菜单回调函数
 void HexEditorWindow::ManageStructTypeCallback(Fl_Widget* widget, void* data) {
     HexEditorWindow* window = static_cast<HexEditorWindow*>(data);
     fl_alert("功能尚未实现");
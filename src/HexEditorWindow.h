@@ -9,18 +9,28 @@
 #include <FL/Fl_Menu_Item.H>
 #include "HexTable.h"
 #include "BasicTypeManagerDialog.h"
+#include "FindDialog.h"
+#include "OverviewBar.h"
 
 // 主应用窗口类
 class HexEditorWindow : public Fl_Double_Window {
 private:
     HexTable* m_hexTable;
+    OverviewBar* m_overviewBar; // 表格右侧的文件概览条
     Fl_Text_Display* m_statusDisplay;
     Fl_Text_Buffer* m_statusBuffer;
     Fl_Menu_Bar* m_menuBar;
+    FindDialog* m_findDialog;   // 查找对话框，第一次查找时创建
 
     // 菜单项数组
     static Fl_Menu_Item menuItems[];
 
+    // 保存到path（为空时保存回原文件），显示进度并报告写入/沿用的字节数
+    void SaveWithProgress(const char* path);
+
+    // 后台查找还在读取当前文件时返回true并提示，此时不能打开/保存文件
+    bool IsBusy();
+
 public:
     HexEditorWindow(int w, int h, const char* title);
     ~HexEditorWindow();
@@ -30,13 +40,30 @@ public:
 
     // 文件菜单回调函数
     static void FileOpenCallback(Fl_Widget* widget, void* data);
+    static void FileOpenProcessCallback(Fl_Widget* widget, void* data);
+    static void FileBackendAutoCallback(Fl_Widget* widget, void* data);
+    static void FileBackendMmapCallback(Fl_Widget* widget, void* data);
+    static void FileBackendPreadCallback(Fl_Widget* widget, void* data);
     static void FileSaveCallback(Fl_Widget* widget, void* data);
+    static void FileSaveAsCallback(Fl_Widget* widget, void* data);
     static void FileExitCallback(Fl_Widget* widget, void* data);
 
     // 编辑菜单回调函数
+    static void EditUndoCallback(Fl_Widget* widget, void* data);
+    static void EditRedoCallback(Fl_Widget* widget, void* data);
     static void EditCopyCallback(Fl_Widget* widget, void* data);
     static void EditPasteCallback(Fl_Widget* widget, void* data);
+    static void EditFillCallback(Fl_Widget* widget, void* data);
     static void EditFindCallback(Fl_Widget* widget, void* data);
+    static void EditGotoCallback(Fl_Widget* widget, void* data);
+
+    // 视图菜单回调函数
+    static void ViewBytesPerRowCallback(Fl_Widget* widget, void* data);
+    static void ViewFormatCallback(Fl_Widget* widget, void* data);
+    static void ViewBigEndianCallback(Fl_Widget* widget, void* data);
+    static void ViewByteColoringCallback(Fl_Widget* widget, void* data);
+    static void ViewByteColorRangesCallback(Fl_Widget* widget, void* data);
+    static void ViewEncodingCallback(Fl_Widget* widget, void* data);
 
     // 数据管理菜单回调函数
     static void ManageBasicTypeCallback(Fl_Widget* widget, void* data);
@@ -1,12 +1,50 @@
 #include "HexTable.h"
+#include "OverviewBar.h"
 #include <FL/fl_draw.H>
+#include <FL/fl_utf8.h>
 #include <FL/Fl_Window.H>
+#include <FL/Fl.H>
 #include <cstdio>
 #include <cstring>
 #include <cstdlib>
 #include <fcntl.h>
 #include <unistd.h>
 #include <algorithm>
+#include <cinttypes>
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Fl_Table的行数和像素高度都是int，表格最多只放这么多行，
+// 更大的文件通过移动m_firstRow（虚拟滚动窗口）来访问
+static const int kMaxTableRows = 1 << 20;
+// 顶行距离窗口边缘少于这么多行时重新定位窗口
+static const int kRebaseMargin = kMaxTableRows / 8;
+// 每个视图窗口的页数，窗口越大预取线程每次能提前准备的数据越多
+static const uint32_t kViewPageCount = 64;
+// 表格文字的字号
+static const int kFontSize = 12;
+// 一帧的预算（毫秒），滚动时要保持60帧每秒
+static const double kFrameBudgetMs = 1000.0 / 60;
+// 帧耗时写进状态栏的最小间隔（毫秒），状态栏不必每帧重绘
+static const uint64_t kFrameStatusInterval = 500;
+// 绘制前等待屏幕数据的最长时间（毫秒），数据在内存中时这段时间内就能读完，不会闪出占位
+static const uint32_t kLoadWaitMs = 4;
+
+// 字节对应的两个十六进制字符和可打印字符，绘制时查表，不再逐个sprintf
+struct ByteTextTable {
+    char hex[256][2];
+    char ascii[256];
+    ByteTextTable() {
+        static const char digits[] = "0123456789ABCDEF";
+        for (int i = 0; i < 256; i++) {
+            hex[i][0] = digits[i >> 4];
+            hex[i][1] = digits[i & 0x0F];
+            ascii[i] = (i >= 32 && i <= 126) ? (char)i : '.';
+        }
+    }
+};
+static const ByteTextTable kByteText;
 
 // 设置并返回支持中文的等宽字体
 Fl_Font HexTable::getFixedFont() {
@@ -15,38 +53,257 @@ Fl_Font HexTable::getFixedFont() {
     return FL_COURIER;
 }
 
-// 格式化字节为十六进制字符串
-void HexTable::formatByte(char* buf, uint8_t byte) {
-    sprintf(buf, "%02X", byte);
+// 把[firstRow, lastRow]在屏幕缓冲区中的数据一次转换成区域文字。
+// 行宽是元素大小的整数倍时，缓冲区中连续的整行首尾相接，一次Format就能转换完；
+// 否则逐行转换，行末不满一个元素的字节按十六进制显示
+void HexTable::formatRegion(FileOffset firstRow, FileOffset lastRow) {
+    m_regionFrame = m_frameSerial;
+    m_regionFirstRow = firstRow;
+    m_regionRows = (size_t)(lastRow - firstRow + 1);
+    size_t width = m_formatter.GetTextWidth();
+    size_t elementSize = m_formatter.GetElementSize();
+    size_t rowText = m_cellsPerRow * width;
+    m_regionText.assign(m_regionRows * rowText, ' ');
+    m_regionAscii.assign(m_regionRows * m_bytesPerRow, ' ');
+    m_regionBytes.assign(m_regionRows, 0);
+    if (m_byteColoring)
+        m_regionColors.assign(m_regionRows * m_bytesPerRow, ByteColorMap::Background());
+    for (size_t i = 0; i < m_regionRows; ) {
+        FileOffset offset = (firstRow + i) * m_bytesPerRow;
+        if (offset < m_visitOffset || offset - m_visitOffset >= m_bufferSize) {
+            i++;
+            continue;
+        }
+        const uint8_t* data = m_buffer + (offset - m_visitOffset);
+        size_t available = m_bufferSize - (size_t)(offset - m_visitOffset);
+        size_t rows = 1;
+        size_t bytes;
+        if (m_bytesPerRow % elementSize == 0 && available >= m_bytesPerRow) {
+            rows = std::min(m_regionRows - i, available / m_bytesPerRow);
+            bytes = rows * m_bytesPerRow;
+            m_formatter.Format(data, bytes / elementSize, &m_regionText[i * rowText]);
+            for (size_t r = 0; r < rows; r++) m_regionBytes[i + r] = m_bytesPerRow;
+        } else {
+            bytes = std::min(available, m_bytesPerRow);
+            size_t whole = bytes / elementSize;
+            m_formatter.Format(data, whole, &m_regionText[i * rowText]);
+            if (bytes % elementSize)
+                m_formatter.FormatPartial(data + whole * elementSize, bytes % elementSize,
+                                          &m_regionText[i * rowText + whole * width]);
+            m_regionBytes[i] = bytes;
+        }
+        i += rows;
+    }
+
+    // 文本列和着色逐行处理；解码结果按整个屏幕缓冲区缓存，跨行的字符在它开始的行里显示
+    const uint32_t* glyphs = nullptr;
+    if (m_textDecoder.GetEncoding() != DECODE_ASCII && m_bufferSize)
+        glyphs = m_textDecoder.Decode(m_buffer, m_bufferSize, m_visitOffset, m_bufferSerial);
+    m_regionWide.clear();
+    m_regionWideStart.assign(m_regionRows + 1, 0);
+    for (size_t i = 0; i < m_regionRows; i++) {
+        m_regionWideStart[i] = m_regionWide.size();
+        size_t bytes = m_regionBytes[i];
+        if (bytes == 0) continue;
+        size_t index = (size_t)((firstRow + i) * m_bytesPerRow - m_visitOffset);
+        const uint8_t* data = m_buffer + index;
+        char* ascii = &m_regionAscii[i * m_bytesPerRow];
+        if (!glyphs) {
+            for (size_t j = 0; j < bytes; j++) ascii[j] = kByteText.ascii[data[j]];
+        } else {
+            const uint32_t* rowGlyphs = glyphs + index;
+            for (size_t j = 0; j < bytes; j++) {
+                if (rowGlyphs[j] < 0x80) {
+                    ascii[j] = (char)rowGlyphs[j];
+                } else if (rowGlyphs[j] != GLYPH_CONTINUATION) {
+                    WideGlyph glyph;
+                    glyph.index = (uint16_t)j;
+                    glyph.length = (uint8_t)fl_utf8encode(rowGlyphs[j], glyph.text);
+                    m_regionWide.push_back(glyph);
+                }
+            }
+        }
+        if (m_byteColoring) {
+            Fl_Color* colors = &m_regionColors[i * m_bytesPerRow];
+            for (size_t j = 0; j < bytes; j++) colors[j] = m_byteColors[data[j]];
+        }
+    }
+    m_regionWideStart[m_regionRows] = m_regionWide.size();
+}
+
+// 从区域文字中取出fileRow的数据列和ASCII文字，格式化偏移，同一帧内已取出时直接返回
+void HexTable::formatRow(FileOffset fileRow) {
+    if (m_rowTextFrame == m_frameSerial && m_rowTextRow == fileRow) return;
+    m_rowTextFrame = m_frameSerial;
+    m_rowTextRow = fileRow;
+    // 可见区域在本帧开始时已经转换好，不在其中的行单独转换
+    if (m_regionFrame != m_frameSerial || fileRow < m_regionFirstRow || fileRow - m_regionFirstRow >= m_regionRows)
+        formatRegion(fileRow, fileRow);
+    size_t index = (size_t)(fileRow - m_regionFirstRow);
+    m_rowText = &m_regionText[index * m_cellsPerRow * m_formatter.GetTextWidth()];
+    m_rowAscii = &m_regionAscii[index * m_bytesPerRow];
+    m_rowColors = m_byteColoring ? &m_regionColors[index * m_bytesPerRow] : nullptr;
+    m_rowWideCount = m_regionWideStart[index + 1] - m_regionWideStart[index];
+    m_rowWide = m_rowWideCount ? &m_regionWide[m_regionWideStart[index]] : nullptr;
+    m_rowTextBytes = m_regionBytes[index];
+    FileOffset offset = fileRow * m_bytesPerRow;
+    m_rowExpectedBytes = offset < m_fileSize ? (size_t)std::min<FileOffset>(m_bytesPerRow, m_fileSize - offset) : 0;
+    if (m_rowTextBytes < m_rowExpectedBytes) m_framePlaceholder = true;
+
+    // 偏移至少8位，超过4GB时按需要加位数
+    static const char digits[] = "0123456789abcdef";
+    int length = 8;
+    while (length < 16 && (offset >> (length * 4))) length++;
+    for (int i = 0; i < length; i++) {
+        m_rowOffset[i] = digits[(offset >> ((length - 1 - i) * 4)) & 0x0F];
+    }
+    m_rowOffsetLength = length;
+
+    if (!selectionSpan(m_drawSelection, fileRow, m_rowSelFirst, m_rowSelLast)) {
+        m_rowSelFirst = 1;
+        m_rowSelLast = 0;
+    }
+}
+
+// 当前的选择状态
+HexTable::SelectionState HexTable::selectionState() const {
+    SelectionState sel;
+    sel.rowStart = m_rowStartSelect;
+    sel.rowEnd = m_rowEndSelect;
+    sel.colStart = m_colStartSelect;
+    sel.colEnd = m_colEndSelect;
+    sel.vertical = m_isVertSelecting;
+    sel.low4 = m_isLow4BitEditing;
+    return sel;
 }
 
-// 获取可打印字符或替代字符
-char HexTable::getPrintableChar(uint8_t byte) {
-    return (byte >= 32 && byte <= 126) ? byte : '.';
+// sel在fileRow中选中的数据列[first, last]，没有时返回false
+bool HexTable::selectionSpan(const SelectionState& sel, FileOffset fileRow, int& first, int& last) const {
+    if (sel.rowStart < 0 || sel.rowEnd < 0 || sel.colStart < 0 || sel.colEnd < 0)
+        return false;
+    int64_t row = (int64_t)fileRow;
+    if (sel.vertical) {
+        // 列选择：矩形块
+        if (row < std::min(sel.rowStart, sel.rowEnd) || row > std::max(sel.rowStart, sel.rowEnd))
+            return false;
+        first = std::min(sel.colStart, sel.colEnd);
+        last = std::max(sel.colStart, sel.colEnd);
+    } else {
+        // 按字节顺序的连续范围，起点可以在终点之后
+        int64_t r0 = sel.rowStart, r1 = sel.rowEnd;
+        int c0 = sel.colStart, c1 = sel.colEnd;
+        if (r1 < r0 || (r1 == r0 && c1 < c0)) {
+            std::swap(r0, r1);
+            std::swap(c0, c1);
+        }
+        if (row < r0 || row > r1)
+            return false;
+        first = row == r0 ? c0 : 1;
+        last = row == r1 ? c1 : (int)m_cellsPerRow;
+    }
+    // 偏移列和ASCII列不显示选择
+    first = std::max(first, 1);
+    last = std::min(last, (int)m_cellsPerRow);
+    return first <= last;
+}
+
+// 只重绘选择从old变成当前状态时变化了的单元格
+void HexTable::redrawSelectionChange(const SelectionState& old) {
+    SelectionState sel = selectionState();
+    if (m_fileSize == 0 || (old.rowStart == sel.rowStart && old.rowEnd == sel.rowEnd && old.colStart == sel.colStart &&
+                            old.colEnd == sel.colEnd && old.vertical == sel.vertical && old.low4 == sel.low4))
+        return;
+    int r1, r2, c1, c2;
+    visible_cells(r1, r2, c1, c2);
+    if (r1 < 0 || r2 < r1)
+        return;
+    // 逐个可见行比较前后选中的列，求出变化的单元格的外接矩形
+    int top = -1, bottom = -1, left = INT32_MAX, right = -1;
+    for (int r = r1; r <= r2; r++) {
+        FileOffset fileRow = fileRowOf(r);
+        int f0, l0, f1, l1;
+        bool had = selectionSpan(old, fileRow, f0, l0);
+        bool has = selectionSpan(sel, fileRow, f1, l1);
+        int lo, hi;
+        if (!had && !has) {
+            continue;
+        } else if (!had || !has || old.low4 != sel.low4) {
+            // 高/低4位的状态改变时每个选中单元格的画法都变了
+            lo = had ? (has ? std::min(f0, f1) : f0) : f1;
+            hi = had ? (has ? std::max(l0, l1) : l0) : l1;
+        } else if (f0 == f1 && l0 == l1) {
+            continue;
+        } else {
+            lo = f0 != f1 ? std::min(f0, f1) : std::min(l0, l1) + 1;
+            hi = l0 != l1 ? std::max(l0, l1) : std::max(f0, f1) - 1;
+        }
+        if (top < 0) top = r;
+        bottom = r;
+        left = std::min(left, lo);
+        right = std::max(right, hi);
+    }
+    if (top >= 0 && left <= right)
+        redraw_range(top, bottom, left, right);
+}
+
+// 只重绘[start, end)字节所在的可见单元格（数据列和ASCII列）
+void HexTable::redrawBytes(FileOffset start, FileOffset end) {
+    if (end <= start || m_fileRowCount == 0)
+        return;
+    int r1, r2, c1, c2;
+    visible_cells(r1, r2, c1, c2);
+    if (r1 < 0 || r2 < r1)
+        return;
+    FileOffset firstRow = start / m_bytesPerRow;
+    FileOffset lastRow = (end - 1) / m_bytesPerRow;
+    if (lastRow < fileRowOf(r1) || firstRow > fileRowOf(r2))
+        return;
+    int top = tableRowOf(std::max(firstRow, fileRowOf(r1)));
+    int bottom = tableRowOf(std::min(lastRow, fileRowOf(r2)));
+    // 一行之内只到改动的字节，跨行时是整行；ASCII列总要重绘
+    int left = firstRow == lastRow ? cellOfByte((size_t)(start % m_bytesPerRow)) : 1;
+    redraw_range(top, bottom, left, (int)m_cellsPerRow + 1);
+}
+
+// 记录一帧的绘制耗时，定期（或forceStatus时立即）刷新状态
+void HexTable::recordFrame(double ms, bool forceStatus) {
+    m_frameCount++;
+    m_frameLastMs = ms;
+    m_frameAvgMs = m_frameCount == 1 ? ms : m_frameAvgMs + (ms - m_frameAvgMs) / 16;
+    m_frameMaxMs = std::max(m_frameMaxMs, ms);
+    m_frameWorstMs = std::max(m_frameWorstMs, ms);
+    if (ms > kFrameBudgetMs) m_slowFrames++;
+    uint64_t now = (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    if (forceStatus || now - m_frameStatusTick >= kFrameStatusInterval) {
+        m_frameStatusTick = now;
+        UpdateStatus();
+        m_frameMaxMs = 0;
+    }
 }
 
 HexTable::HexTable(int x, int y, int w, int h)
-    : Fl_Table(x, y, w, h), m_buffer(nullptr), m_bufferSize(0), 
-      m_fileSize(0), m_bytesPerRow(16), m_visitOffset(0), m_statusBuffer(nullptr),
+    : Fl_Table(x, y, w, h), m_overview(nullptr), m_overviewTop(0), m_buffer(nullptr), m_bufferSize(0), m_bufferCapacity(0), m_bufferSerial(0),
+      m_fileSize(0), m_bytesPerRow(16), m_cellsPerRow(16), m_byteColoring(false), m_visitOffset(0), m_loadPending(false), m_loadSerial(0),
+      m_loadOffset(0), m_loadLength(0), m_loadFailed(false), m_fileRowCount(0), m_firstRow(0),
+      m_backendType(BACKEND_AUTO), m_statusBuffer(nullptr),
       m_isSelecting(false), m_isVertSelecting(false), m_rowStartSelect(-1),
-      m_colStartSelect(-1), m_rowEndSelect(-1), m_colEndSelect(-1) {
+      m_colStartSelect(-1), m_rowEndSelect(-1), m_colEndSelect(-1),
+      m_isLow4BitEditing(false), m_isInsertMode(false), m_isReadOnly(false), m_statusModified(false),
+      m_hitMaskStart(0), m_frameSerial(0), m_regionFrame(UINT64_MAX), m_regionFirstRow(0), m_regionRows(0),
+      m_rowTextFrame(UINT64_MAX), m_rowTextRow(0), m_rowTextBytes(0), m_rowExpectedBytes(0),
+      m_rowText(nullptr), m_rowAscii(nullptr), m_rowColors(nullptr), m_rowWide(nullptr), m_rowWideCount(0), m_rowOffsetLength(0), m_rowSelFirst(1), m_rowSelLast(0), m_charWidth(0), m_textBaseline(0), m_frameCount(0), m_slowFrames(0),
+      m_frameLastMs(0), m_frameAvgMs(0), m_frameMaxMs(0), m_frameWorstMs(0), m_framePlaceholder(false),
+      m_placeholderFrames(0), m_frameStatusTick(0) {
     m_fileName[0] = '\0';
+    m_drawSelection = selectionState();
     
     // 设置支持中文的等宽字体
-    fl_font(getFixedFont(), 12);
+    fl_font(getFixedFont(), kFontSize);
     
-    // 配置表格
-    cols(1 + m_bytesPerRow + 1); // 偏移列 + 十六进制数据列 + ASCII列
+    // 配置表格：偏移列 + 数据列 + ASCII列
     col_header(1);
-    col_width(0, 80); // 偏移列宽度
-    
-    // 设置十六进制数据列宽度
-    for (int i = 1; i <= m_bytesPerRow; i++) {
-        col_width(i, 40);
-    }
-    
-    // 设置ASCII列宽度
-    col_width(m_bytesPerRow + 1, 180);
+    layoutColumns();
     
     row_header(0);
     row_height_all(m_rowHeight);
@@ -66,7 +323,7 @@ bool HexTable::OpenFile(const char* fileName) {
     // 先关闭可能已经打开的文件
     CloseFile();
     
-    if (m_largeFile.OpenFile(fileName) != 1) {
+    if (m_largeFile.OpenFile(fileName, kViewPageCount, m_backendType) != 1) {
         return false;
     }
     
@@ -74,23 +331,30 @@ bool HexTable::OpenFile(const char* fileName) {
     strncpy(m_fileName, fileName, sizeof(m_fileName) - 1);
     m_fileName[sizeof(m_fileName) - 1] = '\0';
     
-    // 获取文件大小
-    LargeInteger fileSize;
-    m_largeFile.GetFileSizeEx(&fileSize);
-    m_fileSize = fileSize.QuadPart;
+    // 获取文件大小，之后的大小以编辑层为准
+    m_editBuffer.Attach(&m_largeFile);
+    m_journal.Attach(&m_editBuffer);
+    m_fileSize = m_editBuffer.GetSize();
 
     // 重置起始偏移量
     m_visitOffset = 0;
-    // 更新表格行数 - 使用实际文件行数
-    size_t rowCount = (m_fileSize + m_bytesPerRow - 1) / m_bytesPerRow;
-    rows(rowCount);
-
-    m_largeFile.VisitFilePosition(0);
-    uint32_t nFileOffsetLow, nFileOffsetHigh, dwAvalibleSize;
-    m_buffer = (uint8_t*)m_largeFile.GetMappingInfo(nFileOffsetLow, nFileOffsetHigh, dwAvalibleSize);
-    m_bufferSize = dwAvalibleSize;
-    if (!m_buffer || !m_bufferSize)
-        CloseFile();
+    m_firstRow = 0;
+    // 更新表格行数 - 文件行数超过kMaxTableRows时只放一个窗口
+    m_fileRowCount = (m_fileSize + m_bytesPerRow - 1) / m_bytesPerRow;
+    rows((int)std::min<FileOffset>(m_fileRowCount, kMaxTableRows));
+    // 超过4GB的偏移量需要更多位数
+    col_width(0, m_fileSize > 0xFFFFFFFFull ? 110 : 80);
+
+    // 不在UI线程上试读文件，读不出时由后台读取报告，状态栏显示读取失败
+    m_bufferSize = 0;
+    m_loadPending = false;
+    m_loadFailed = false;
+    m_frameWorstMs = 0;
+    m_placeholderFrames = 0;
+    m_prefetcher.Attach(&m_largeFile);
+    m_loader.Attach(&m_largeFile, [this]() { Fl::awake(screenLoadedCallback, this); });
+    m_summary.Attach(&m_largeFile, [this]() { Fl::awake(summaryUpdatedCallback, this); });
+    if (m_overview) m_overview->DataChanged();
     // 更新状态信息
     UpdateStatus();
     redraw();
@@ -99,15 +363,146 @@ bool HexTable::OpenFile(const char* fileName) {
 
 // 关闭文件
 void HexTable::CloseFile() {
-    // 清空缓冲区但不释放（因为缓冲区在构造时创建，析构时释放）
-    m_buffer = 0;
+    // 清空缓冲区但不释放（缓冲区在析构时释放）
+    m_bufferSize = 0;
     m_fileSize = 0;
     m_visitOffset = 0;
+    m_fileRowCount = 0;
+    m_firstRow = 0;
     m_fileName[0] = '\0';
+    m_prefetcher.Detach();
+    m_loader.Detach();
+    m_summary.Detach();
+    if (m_overview) m_overview->DataChanged();
+    m_loadPending = false;
+    m_loadFailed = false;
+    m_hitIndex.Clear();
+    m_journal.Clear();
+    m_editBuffer.Detach();
     m_largeFile.CloseFile();
     UpdateStatus();
 }
 
+// 保存编辑结果到path（为空时保存回原文件），成功后重新打开保存的文件
+bool HexTable::SaveFile(const char* path, const SaveProgress& progress, SaveStats* stats) {
+    if (m_fileName[0] == '\0') return false;
+    std::string target = (path && path[0]) ? path : m_fileName;
+    CSaveEngine engine;
+    if (!engine.Save(&m_editBuffer, target.c_str(), progress)) {
+        return false;
+    }
+    if (stats) engine.GetStats(stats);
+    reopenFile(target.c_str());
+    return true;
+}
+
+// 把替换全部匹配后的数据写回原文件，成功后重新打开
+bool HexTable::ReplaceAll(CMatcher* matcher, const std::vector<std::vector<uint8_t> >& replacements,
+                          const SaveProgress& progress, ReplaceStats* stats) {
+    if (m_fileName[0] == '\0') return false;
+    std::string target = m_fileName;
+    CReplaceEngine engine;
+    if (!engine.ReplaceAll(&m_editBuffer, matcher, replacements, target.c_str(), progress)) {
+        return false;
+    }
+    if (stats) engine.GetStats(stats);
+    reopenFile(target.c_str());
+    return true;
+}
+
+// 编辑层的片段已经不能描述新文件，重新打开并回到原来的位置
+void HexTable::reopenFile(const char* path) {
+    FileOffset topRow = fileRowOf(row_position());
+    FileOffset cursor = m_rowStartSelect >= 0 && m_colStartSelect >= 1
+        ? (FileOffset)m_rowStartSelect * m_bytesPerRow + byteOfCell(m_colStartSelect) : 0;
+    // 重新打开失败时文件已经保存成功，表格保持关闭状态
+    if (OpenFile(path) && m_fileSize) {
+        GotoOffset(std::min(cursor, m_fileSize - 1));
+        setTopFileRow(topRow);
+    }
+}
+
+// 选中[start, start+length)并滚动到起点
+void HexTable::SelectRange(FileOffset start, FileOffset length) {
+    if (m_fileSize == 0) return;
+    GotoOffset(std::min(start, m_fileSize - 1));
+    if (length > 1) {
+        FileOffset last = std::min(start + length, m_fileSize) - 1;
+        m_rowEndSelect = last / m_bytesPerRow;
+        m_colEndSelect = cellOfByte((size_t)(last % m_bytesPerRow));
+        m_isVertSelecting = false;
+        redraw();
+    }
+}
+
+// 撤销
+bool HexTable::Undo() {
+    FileOffset start, length;
+    if (m_isReadOnly) return false;
+    if (!m_journal.Undo(&start, &length)) return false;
+    m_isLow4BitEditing = false;
+    onDataChanged();
+    SelectRange(start, length);
+    return true;
+}
+
+// 重做
+bool HexTable::Redo() {
+    FileOffset start, length;
+    if (m_isReadOnly) return false;
+    if (!m_journal.Redo(&start, &length)) return false;
+    m_isLow4BitEditing = false;
+    onDataChanged();
+    SelectRange(start, length);
+    return true;
+}
+
+// 用同一个字节填充选择范围，整个范围只占一个片段和一条撤销记录
+bool HexTable::FillSelection(uint8_t value) {
+    FileOffset start, length;
+    if (m_isReadOnly || !getSelectionRange(start, length)) return false;
+    if (!m_journal.Fill(start, length, value)) return false;
+    onDataChanged();
+    SelectRange(start, length);
+    return true;
+}
+
+// 粘贴剪贴板文本：十六进制文本按字节值解析，否则按原始字节
+void HexTable::pasteText(const char* text, int length) {
+    if (m_isReadOnly || m_fileSize == 0 || length <= 0) return;
+    FileOffset start, selected;
+    if (!getSelectionRange(start, selected)) return;
+
+    std::vector<uint8_t> data;
+    data.reserve(length / 2);
+    bool isHex = true;
+    int nibbles = 0;
+    uint8_t byte = 0;
+    for (int i = 0; i < length && isHex; i++) {
+        char c = text[i];
+        int value;
+        if (c >= '0' && c <= '9') value = c - '0';
+        else if (c >= 'a' && c <= 'f') value = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') value = c - 'A' + 10;
+        else if (c == ' ' || c == '\t' || c == '\r' || c == '\n') continue;
+        else { isHex = false; break; }
+        byte = (byte << 4) | value;
+        if (++nibbles % 2 == 0) data.push_back(byte);
+    }
+    if (!isHex || nibbles % 2 != 0 || data.empty()) {
+        data.assign((const uint8_t*)text, (const uint8_t*)text + length);
+    }
+
+    // 一次粘贴只产生一条撤销记录
+    bool ok = m_isInsertMode
+        ? m_journal.Insert(start, data.data(), data.size())
+        : m_journal.Overwrite(start, data.data(), data.size());
+    if (!ok) return;
+    m_isLow4BitEditing = false;
+    onDataChanged();
+    SelectRange(start, data.size());
+}
+
 // 设置状态缓冲区
 void HexTable::SetStatusBuffer(Fl_Text_Buffer* buffer) {
     m_statusBuffer = buffer;
@@ -117,38 +512,395 @@ void HexTable::SetStatusBuffer(Fl_Text_Buffer* buffer) {
 void HexTable::UpdateStatus() {
     if (!m_statusBuffer) return;
     
-    char status[512];
+    char status[768];
+    m_statusModified = m_editBuffer.IsModified() != 0;
     if (m_fileName[0] != '\0') {
-        sprintf(status, "文件: %s | 大小: %zu 字节 | 当前偏移: 0x%zx", 
-                m_fileName, m_fileSize, m_visitOffset);
+        PrefetchStats stats;
+        m_prefetcher.GetStats(&stats);
+        ScreenLoadStats loadStats;
+        m_loader.GetStats(&loadStats);
+        CFileBackend* backend = m_largeFile.GetBackend();
+        snprintf(status, sizeof(status), "文件: %s%s | 大小: %" PRIu64 " 字节 | 当前偏移: 0x%" PRIx64 " | %s | 显示: %s%s, 每行 %zu 字节 | UI缺页帧: %" PRIu64 " | %s %.1f MB/s"
+                " | 绘制: %.2f ms, 平均 %.2f, 最长 %.2f, 超时 %" PRIu64 "/%" PRIu64 " 帧, 最长卡顿 %.1f ms"
+                " | 读取: %.1f ms, 最长 %.1f ms, 占位 %" PRIu64 " 帧%s",
+                m_fileName, m_editBuffer.IsModified() ? " [已修改]" : "", m_fileSize, m_visitOffset,
+                m_isReadOnly ? "只读" : m_isInsertMode ? "插入" : "改写",
+                CCellFormatter::GetFormatName(m_formatter.GetFormat()),
+                m_formatter.GetElementSize() > 1 ? (IsBigEndian() ? " 大端" : " 小端") : "", m_bytesPerRow,
+                stats.nUiFaultFrames,
+                backend ? backend->GetName() : "-", backend ? backend->GetThroughput() : 0.0,
+                m_frameLastMs, m_frameAvgMs, m_frameMaxMs, m_slowFrames, m_frameCount, m_frameWorstMs,
+                loadStats.dLastMs, loadStats.dMaxMs, m_placeholderFrames, m_loadFailed ? ", 读取失败" : "");
     } else {
         strcpy(status, "未打开文件");
     }
     m_statusBuffer->text(status);
 }
 
+// 移动虚拟滚动窗口，使fileRow成为表格顶行
+void HexTable::setTopFileRow(FileOffset fileRow) {
+    if (m_fileRowCount == 0) return;
+    if (fileRow >= m_fileRowCount) fileRow = m_fileRowCount - 1;
+    if (m_fileRowCount > (FileOffset)kMaxTableRows) {
+        // 让目标行落在窗口中部，前后都留出滚动余量
+        FileOffset first = fileRow > (FileOffset)(kMaxTableRows / 2) ? fileRow - kMaxTableRows / 2 : 0;
+        if (first + kMaxTableRows > m_fileRowCount) first = m_fileRowCount - kMaxTableRows;
+        m_firstRow = first;
+    }
+    row_position(tableRowOf(fileRow));
+    // Fl_Table记录的是表格行号，窗口移动后要同步光标，否则方向键会从旧位置继续
+    if (m_rowStartSelect >= (int64_t)m_firstRow && m_rowStartSelect < (int64_t)m_firstRow + rows()) {
+        int r = tableRowOf(m_rowStartSelect);
+        set_selection(r, m_colStartSelect, r, m_colStartSelect);
+    }
+    updateView();
+    redraw();
+}
+
+// 滚动到窗口边缘时重新定位虚拟滚动窗口
+void HexTable::rebaseRowWindow() {
+    if (m_fileRowCount <= (FileOffset)kMaxTableRows) return;
+    int top = row_position();
+    bool nearTop = top < kRebaseMargin && m_firstRow > 0;
+    bool nearBottom = top > kMaxTableRows - kRebaseMargin && m_firstRow + kMaxTableRows < m_fileRowCount;
+    if (nearTop || nearBottom) {
+        setTopFileRow(fileRowOf(top));
+    }
+}
+
+// 确保可见行都在当前映射的视图内
+void HexTable::updateView() {
+    int r1, r2, c1, c2;
+    visible_cells(r1, r2, c1, c2);
+    if (r1 < 0 || r2 < 0)
+        return;
+    FileOffset firstByte = fileRowOf(r1) * m_bytesPerRow;
+    FileOffset lastByte = fileRowOf(r2) * m_bytesPerRow;
+    m_prefetcher.OnScroll(firstByte, lastByte + m_bytesPerRow);
+    if (loadScreen(fileRowOf(r1), fileRowOf(r2)))
+        redraw();
+}
+
+// 请求把[firstRow, lastRow]附近的数据读到屏幕缓冲区并等待很短的时间，屏幕缓冲区有变化时返回true；
+// 来不及读完时先返回，读完后由screenLoadedCallback换入并重绘
+bool HexTable::loadScreen(FileOffset firstRow, FileOffset lastRow) {
+    FileOffset firstByte = firstRow * m_bytesPerRow;
+    FileOffset endByte = std::min<FileOffset>((lastRow + 1) * m_bytesPerRow, m_fileSize);
+    if (m_bufferSize && firstByte >= m_visitOffset && endByte <= m_visitOffset + m_bufferSize)
+        return false;
+    // 正在读的范围已经覆盖时不重复请求，否则前后各多读一屏，小幅滚动时不必重新读取
+    if (!m_loadPending || firstByte < m_loadOffset || endByte > m_loadOffset + m_loadLength) {
+        FileOffset screenRows = lastRow - firstRow + 1;
+        FileOffset startRow = firstRow > screenRows ? firstRow - screenRows : 0;
+        m_loadOffset = startRow * m_bytesPerRow;
+        m_loadLength = (size_t)(screenRows * 3 * m_bytesPerRow);
+        m_loadSerial = m_loader.Request(&m_editBuffer, m_loadOffset, m_loadLength);
+        m_loadPending = true;
+    }
+    // 屏幕缓冲区中已有的行照常显示，其余的行先画占位
+    m_loader.Wait(m_loadSerial, kLoadWaitMs);
+    return takeScreen();
+}
+
+// 把已完成的读取结果换入屏幕缓冲区，没有时返回false
+bool HexTable::takeScreen() {
+    FileOffset offset = 0;
+    int failed = FALSE;
+    if (!m_loadPending || !m_loader.TakeResult(m_loadSerial, m_loadData, &offset, &failed))
+        return false;
+    m_loadPending = false;
+    if (m_loadData.size() > m_bufferCapacity) {
+        uint8_t* buffer = (uint8_t*)realloc(m_buffer, m_loadData.size());
+        if (!buffer)
+            return false;
+        m_buffer = buffer;
+        m_bufferCapacity = m_loadData.size();
+    }
+    if (!m_loadData.empty())
+        memcpy(m_buffer, &m_loadData[0], m_loadData.size());
+    m_visitOffset = offset;
+    m_bufferSize = m_loadData.size();
+    m_bufferSerial++;
+    if ((failed != 0) != m_loadFailed) {
+        m_loadFailed = failed != 0;
+        UpdateStatus();
+    }
+    return true;
+}
+
+// 后台读取完成后由Fl::awake在UI线程调用
+void HexTable::screenLoadedCallback(void* data) {
+    HexTable* table = static_cast<HexTable*>(data);
+    if (table->takeScreen())
+        table->redraw();
+}
+
+// 后台统计有进展时由Fl::awake在UI线程调用
+void HexTable::summaryUpdatedCallback(void* data) {
+    HexTable* table = static_cast<HexTable*>(data);
+    if (table->m_overview) table->m_overview->DataChanged();
+}
+
+// 从结果索引中取出[firstRow, lastRow]中的匹配，更新m_hitMask
+void HexTable::loadVisibleHits(FileOffset firstRow, FileOffset lastRow) {
+    m_hitMaskStart = firstRow * m_bytesPerRow;
+    m_hitMask.assign((size_t)((lastRow - firstRow + 1) * m_bytesPerRow), 0);
+    if (m_hitIndex.IsEmpty()) return;
+    FileOffset end = m_hitMaskStart + m_hitMask.size();
+    m_visibleHits.clear();
+    m_hitIndex.GetHitsInRange(m_hitMaskStart, end, m_visibleHits);
+    for (size_t i = 0; i < m_visibleHits.size(); i++) {
+        FileOffset a = std::max(m_visibleHits[i].nOffset, m_hitMaskStart);
+        FileOffset b = std::min(m_visibleHits[i].nOffset + m_visibleHits[i].nLength, end);
+        for (FileOffset o = a; o < b; o++) m_hitMask[(size_t)(o - m_hitMaskStart)] = 1;
+    }
+}
+
+// 编辑后屏幕缓冲区失效，大小变化时同步行数
+void HexTable::onDataChanged() {
+    // 屏幕缓冲区和还没换入的读取结果都是编辑前的数据
+    m_bufferSize = 0;
+    m_loadPending = false;
+    // 查找结果的偏移已经不对应编辑后的数据
+    m_hitIndex.Clear();
+    if (m_overview) m_overview->DataChanged();
+    if (m_fileSize != m_editBuffer.GetSize()) {
+        m_fileSize = m_editBuffer.GetSize();
+        m_fileRowCount = (m_fileSize + m_bytesPerRow - 1) / m_bytesPerRow;
+        FileOffset topRow = fileRowOf(row_position());
+        rows((int)std::min<FileOffset>(m_fileRowCount, kMaxTableRows));
+        if (m_fileRowCount <= (FileOffset)kMaxTableRows)
+            m_firstRow = 0;
+        // 窗口可能越过了新的文件尾，按原来的顶行重新定位
+        setTopFileRow(topRow);
+    }
+    updateView();
+    UpdateStatus();
+    redraw();
+}
+
+// 改写了[start, end)（大小不变）：只更新屏幕缓冲区中的这些字节并重绘它们的单元格
+void HexTable::onBytesChanged(FileOffset start, FileOffset end) {
+    // 大小变了，要清掉全部查找结果的高亮，或者还有编辑前提出的读取请求时整个重画
+    if (m_editBuffer.GetSize() != m_fileSize || !m_hitIndex.IsEmpty() || m_loadPending) {
+        onDataChanged();
+        return;
+    }
+    FileOffset a = std::max(start, m_visitOffset);
+    FileOffset b = std::min(end, m_visitOffset + m_bufferSize);
+    if (a < b) {
+        m_editBuffer.Read(a, m_buffer + (a - m_visitOffset), (size_t)(b - a));
+        m_bufferSerial++;
+    }
+    redrawBytes(start, end);
+    if (m_overview) m_overview->DataChanged();
+    // 状态栏只在修改标记变化时刷新
+    if ((m_editBuffer.IsModified() != 0) != m_statusModified)
+        UpdateStatus();
+}
+
+// 当前选择对应的字节范围（列选择时只取光标所在元素），两端的元素都整个包括在内
+bool HexTable::getSelectionRange(FileOffset& start, FileOffset& length) {
+    if (m_rowStartSelect < 0 || m_colStartSelect < 1 || m_colStartSelect > (int)m_cellsPerRow)
+        return false;
+    FileOffset a = (FileOffset)m_rowStartSelect * m_bytesPerRow + byteOfCell(m_colStartSelect);
+    FileOffset aEnd = (FileOffset)m_rowStartSelect * m_bytesPerRow + cellEndByte(m_colStartSelect);
+    FileOffset b = a, bEnd = aEnd;
+    if (!m_isVertSelecting && m_rowEndSelect >= 0 && m_colEndSelect >= 1 && m_colEndSelect <= (int)m_cellsPerRow) {
+        b = (FileOffset)m_rowEndSelect * m_bytesPerRow + byteOfCell(m_colEndSelect);
+        bEnd = (FileOffset)m_rowEndSelect * m_bytesPerRow + cellEndByte(m_colEndSelect);
+    }
+    start = std::min(a, b);
+    if (start >= m_fileSize)
+        return false;
+    length = std::min(std::max(aEnd, bEnd), m_fileSize) - start;
+    return true;
+}
+
+// 删除字节并把光标放到删除位置
+void HexTable::deleteBytes(FileOffset start, FileOffset length) {
+    if (!m_journal.Delete(start, length))
+        return;
+    onDataChanged();
+    if (m_fileSize == 0) {
+        m_rowStartSelect = m_rowEndSelect = -1;
+        m_colStartSelect = m_colEndSelect = -1;
+        return;
+    }
+    GotoOffset(std::min(start, m_fileSize - 1));
+}
+
+// 跳转到文件偏移并选中该字节
+void HexTable::GotoOffset(FileOffset offset) {
+    if (m_fileSize == 0) return;
+    if (offset >= m_fileSize) offset = m_fileSize - 1;
+    FileOffset fileRow = offset / m_bytesPerRow;
+    int r1, r2, c1, c2;
+    visible_cells(r1, r2, c1, c2);
+    int visibleRows = (r2 >= r1 && r1 >= 0) ? r2 - r1 + 1 : 1;
+    m_rowStartSelect = m_rowEndSelect = fileRow;
+    m_colStartSelect = m_colEndSelect = cellOfByte((size_t)(offset % m_bytesPerRow));
+    m_isLow4BitEditing = false;
+    // 目标行放在可见区域的三分之一处
+    setTopFileRow(fileRow > (FileOffset)(visibleRows / 3) ? fileRow - visibleRows / 3 : 0);
+    UpdateStatus();
+    redraw();
+}
+
+// 当前可见的字节范围[start, end)，没有可见行时返回false
+bool HexTable::GetVisibleRange(FileOffset& start, FileOffset& end) {
+    int r1, r2, c1, c2;
+    visible_cells(r1, r2, c1, c2);
+    if (m_fileSize == 0 || r1 < 0 || r2 < r1)
+        return false;
+    start = fileRowOf(r1) * m_bytesPerRow;
+    end = std::min<FileOffset>((fileRowOf(r2) + 1) * m_bytesPerRow, m_fileSize);
+    return start < end;
+}
+
+// 滚动使offset所在行位于可见区域中部，不改变选择
+void HexTable::ScrollToOffset(FileOffset offset) {
+    if (m_fileSize == 0) return;
+    if (offset >= m_fileSize) offset = m_fileSize - 1;
+    FileOffset fileRow = offset / m_bytesPerRow;
+    int r1, r2, c1, c2;
+    visible_cells(r1, r2, c1, c2);
+    int visibleRows = (r2 >= r1 && r1 >= 0) ? r2 - r1 + 1 : 1;
+    setTopFileRow(fileRow > (FileOffset)(visibleRows / 2) ? fileRow - visibleRows / 2 : 0);
+}
+
+// 按行宽和显示方式设置列数和列宽
+void HexTable::layoutColumns() {
+    size_t elementSize = m_formatter.GetElementSize();
+    m_cellsPerRow = (m_bytesPerRow + elementSize - 1) / elementSize;
+    cols((int)m_cellsPerRow + 2);
+    // 数据列至少是原来十六进制列的40像素，更长的文字按字符数加宽；先整体设置，避免逐列重排
+    col_width_all(std::max(40, (int)m_formatter.GetTextWidth() * 8 + 12));
+    // 超过4GB的偏移量需要更多位数
+    col_width(0, m_fileSize > 0xFFFFFFFFull ? 110 : 80);
+    col_width((int)m_cellsPerRow + 1, std::max(180, (int)m_bytesPerRow * 8 + 12));
+}
+
+// 改变行宽或显示方式，保持顶行和选择的字节位置
+void HexTable::applyLayout(size_t bytesPerRow, int format, bool bigEndian) {
+    FileOffset topByte = fileRowOf(row_position()) * m_bytesPerRow;
+    FileOffset selStart = 0, selLength = 0;
+    bool hasSelection = getSelectionRange(selStart, selLength);
+
+    m_bytesPerRow = bytesPerRow;
+    m_formatter.SetFormat(format, bigEndian);
+    layoutColumns();
+    m_fileRowCount = (m_fileSize + m_bytesPerRow - 1) / m_bytesPerRow;
+    rows((int)std::min<FileOffset>(m_fileRowCount, kMaxTableRows));
+    if (m_fileRowCount <= (FileOffset)kMaxTableRows)
+        m_firstRow = 0;
+    // 屏幕缓冲区按原来的行对齐，重新读取
+    m_bufferSize = 0;
+    m_loadPending = false;
+    m_regionFrame = UINT64_MAX;
+    m_rowTextFrame = UINT64_MAX;
+    m_isLow4BitEditing = false;
+
+    // 选择换算成新的行列，整个包括原来选中的字节
+    if (hasSelection) {
+        FileOffset last = selStart + selLength - 1;
+        m_isVertSelecting = false;
+        m_rowStartSelect = (int64_t)(selStart / m_bytesPerRow);
+        m_colStartSelect = cellOfByte((size_t)(selStart % m_bytesPerRow));
+        m_rowEndSelect = (int64_t)(last / m_bytesPerRow);
+        m_colEndSelect = cellOfByte((size_t)(last % m_bytesPerRow));
+    } else {
+        m_rowStartSelect = m_rowEndSelect = -1;
+        m_colStartSelect = m_colEndSelect = -1;
+    }
+    setTopFileRow(topByte / m_bytesPerRow);
+    UpdateStatus();
+    redraw();
+}
+
+// 每行显示的字节数，限制在1~kMaxBytesPerRow
+void HexTable::SetBytesPerRow(size_t bytesPerRow) {
+    bytesPerRow = std::max<size_t>(1, std::min(bytesPerRow, kMaxBytesPerRow));
+    if (bytesPerRow != m_bytesPerRow)
+        applyLayout(bytesPerRow, m_formatter.GetFormat(), IsBigEndian());
+}
+
+// 数据列的显示方式和字节序
+void HexTable::SetCellFormat(int format, bool bigEndian) {
+    if (format < 0 || format >= CELL_FORMAT_COUNT)
+        return;
+    if (format != m_formatter.GetFormat() || bigEndian != IsBigEndian())
+        applyLayout(m_bytesPerRow, format, bigEndian);
+}
+
+// 重写绘制函数，统计UI线程绘制时的缺页和每帧耗时
+void HexTable::draw() {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    // 新的一帧，上一帧格式化的行作废
+    m_frameSerial++;
+    m_framePlaceholder = false;
+    uint64_t faults = CPrefetcher::GetThreadMajorFaults();
+    Fl_Table::draw();
+    uint64_t newFaults = CPrefetcher::GetThreadMajorFaults() - faults;
+    if (newFaults) {
+        m_prefetcher.RecordUiFaults(newFaults);
+    }
+    if (m_framePlaceholder) m_placeholderFrames++;
+    // 滚动后重画概览条上的位置框；概览条在窗口中排在表格之后，同一次刷新里就会画上
+    if (m_overview) {
+        int r1, r2, c1, c2;
+        visible_cells(r1, r2, c1, c2);
+        FileOffset top = r1 >= 0 ? fileRowOf(r1) : 0;
+        if (top != m_overviewTop) {
+            m_overviewTop = top;
+            m_overview->redraw();
+        }
+    }
+    recordFrame(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(), newFaults != 0);
+}
+
 // 表格绘制回调
 void HexTable::draw_cell(TableContext context, int ROW, int COL, int X, int Y, int W, int H) {
-    if (!m_buffer || m_fileSize == 0) {
+    if (m_fileSize == 0) {
         return;
     }
     
     switch (context) {
+        case CONTEXT_STARTPAGE: {
+            // 每次绘制前确认要画的行都在屏幕缓冲区中，并从结果索引中取出这些行里的匹配
+            int r1, r2, c1, c2;
+            visible_cells(r1, r2, c1, c2);
+            if (r1 >= 0 && r2 >= r1) {
+                loadScreen(fileRowOf(r1), fileRowOf(r2));
+                loadVisibleHits(fileRowOf(r1), fileRowOf(r2));
+                // 可见行的文字一次转换好，各单元格直接取用
+                formatRegion(fileRowOf(r1), fileRowOf(r2));
+            }
+            // 本帧各行的选中列都按这个快照计算
+            m_drawSelection = selectionState();
+            // 字体和字符尺寸每帧取一次，单元格里不再逐个设置和排版
+            fl_font(getFixedFont(), kFontSize);
+            m_charWidth = (int)fl_width("0", 1);
+            m_textBaseline = ((int)m_rowHeight - fl_height()) / 2 + fl_height() - fl_descent();
+            break;
+        }
+
         case CONTEXT_COL_HEADER: {
             fl_push_clip(X, Y, W, H);
             fl_draw_box(FL_THIN_UP_BOX, X, Y, W, H, col_header_color());
             fl_color(FL_BLACK);
             
             // 确保使用支持中文的等宽字体
-            fl_font(getFixedFont(), 12);
+            fl_font(getFixedFont(), kFontSize);
             
             if (COL == 0) {
                 fl_draw("偏移量", X+2, Y, W, H, FL_ALIGN_LEFT, nullptr, 0);
-            } else if (COL == m_bytesPerRow + 1) {
-                fl_draw("ASCII", X+2, Y, W, H, FL_ALIGN_LEFT, nullptr, 0);
+            } else if (COL == (int)m_cellsPerRow + 1) {
+                fl_draw(CTextDecoder::GetEncodingName(m_textDecoder.GetEncoding()), X+2, Y, W, H, FL_ALIGN_LEFT, nullptr, 0);
             } else {
-                char label[4];
-                sprintf(label, "%02X", COL-1);
+                // 列标题是这一列在行内的字节位置
+                char label[8];
+                snprintf(label, sizeof(label), "%02zX", byteOfCell(COL));
                 fl_draw(label, X, Y, W, H, FL_ALIGN_CENTER, nullptr, 0);
             }
             fl_pop_clip();
@@ -156,103 +908,110 @@ void HexTable::draw_cell(TableContext context, int ROW, int COL, int X, int Y, i
         }
         
         case CONTEXT_CELL: {
-            fl_push_clip(X, Y, W, H);
+            int64_t fileRow = fileRowOf(ROW);
             
-            // 检查单元格是否在选择区域内
-            bool isSelected = false;
-            if (m_rowStartSelect != -1 && m_rowEndSelect != -1 && 
-                m_colStartSelect != -1 && m_colEndSelect != -1 && 
-                !(COL == 0) && !(COL == m_bytesPerRow + 1)) {
-                // 检查是否按下了Alt键
-                bool isAltPressed = m_isVertSelecting;
-
-                if (isAltPressed) {
-                    int minRow = std::min(m_rowStartSelect, m_rowEndSelect);
-                    int maxRow = std::max(m_rowStartSelect, m_rowEndSelect);
-                    int minCol = std::min(m_colStartSelect, m_colEndSelect);
-                    int maxCol = std::max(m_colStartSelect, m_colEndSelect);
-                    // Alt键按下，使用块选择模式
-                    if (ROW >= minRow && ROW <= maxRow && COL >= minCol && COL <= maxCol) {
-                        isSelected = true;
-                    }
-                } else {
-                    // 默认模式，使用多行文本选择模式
-                    if ( m_rowStartSelect == m_rowEndSelect) {
-                        int minCol = std::min(m_colStartSelect, m_colEndSelect);
-                        int maxCol = std::max(m_colStartSelect, m_colEndSelect);
-                        if (ROW == m_rowStartSelect && COL >= minCol && COL <= maxCol) {
-                            isSelected = true;
-                        }
-                    } else if (m_rowStartSelect < m_rowEndSelect) {
-                        if ((ROW == m_rowStartSelect && COL >= m_colStartSelect) ||
-                            (ROW == m_rowEndSelect && COL <= m_colEndSelect) ||
-                            (ROW > m_rowStartSelect && ROW < m_rowEndSelect)) {
-                            isSelected = true;
-                        }
-                    } else {
-                        if ((ROW == m_rowStartSelect && COL <= m_colStartSelect) ||
-                            (ROW == m_rowEndSelect && COL >= m_colEndSelect) ||
-                            (ROW < m_rowStartSelect && ROW > m_rowEndSelect)) {
-                            isSelected = true;
-                        }
+            // 整行的文字和选中的列在这一行的第一个单元格里求出一次
+            formatRow((FileOffset)fileRow);
+            FileOffset offset = (FileOffset)fileRow * m_bytesPerRow;
+            bool isHexCol = COL >= 1 && COL <= (int)m_cellsPerRow;
+            size_t cellByte = isHexCol ? byteOfCell(COL) : 0;
+            bool isSelected = COL >= m_rowSelFirst && COL <= m_rowSelLast;
+            bool isHitCell = false;
+            if (!isSelected && isHexCol) {
+                for (size_t i = cellByte; i < cellEndByte(COL) && !isHitCell; i++) isHitCell = isHit(offset + i);
+            }
+
+            // 着色时元素的各个字节颜色相同才画这个颜色
+            Fl_Color background = FL_WHITE;
+            if (m_rowColors && isHexCol && cellByte < m_rowTextBytes) {
+                background = m_rowColors[cellByte];
+                size_t end = std::min(cellEndByte(COL), m_rowTextBytes);
+                for (size_t i = cellByte + 1; i < end; i++) {
+                    if (m_rowColors[i] != background) {
+                        background = FL_WHITE;
+                        break;
                     }
                 }
             }
-            fl_color(FL_WHITE); // 白色背景
+
+            // 背景直接画成最终的颜色：选择为浅蓝色，查找结果为黄色，其次是着色
+            if (isSelected && !m_drawSelection.low4) {
+                fl_color(FL_LIGHT1);
+            } else if (isHitCell) {
+                fl_color(FL_YELLOW);
+            } else {
+                fl_color(background);
+            }
             fl_rectf(X, Y, W, H);
-            
-            // 设置背景色
-            if (isSelected) {
-                fl_color(FL_LIGHT1); // 浅蓝色背景
-                if (m_isLow4BitEditing) {
-                    fl_rectf(X + W / 2, Y, W / 2, H);
-                } else {
-                    fl_rectf(X, Y, W, H);
-                }
+            if (isSelected && m_drawSelection.low4) {
+                fl_color(FL_LIGHT1);
+                fl_rectf(X + W / 2, Y, W / 2, H);
             }
-            
-            // 确保使用支持中文的等宽字体
-            fl_font(getFixedFont(), 12);
-            
-            // 计算实际偏移量
-            size_t offset = ROW * m_bytesPerRow;
-            
+
+            // 列宽足够时文字不会越界，不必裁剪
+            int cellTextWidth = (int)m_formatter.GetTextWidth() * m_charWidth;
+            int textWidth = COL == 0 ? 2 + m_rowOffsetLength * m_charWidth
+                          : isHexCol ? cellTextWidth : 2 + (int)(m_bytesPerRow + (m_rowWideCount ? 1 : 0)) * m_charWidth;
+            bool clip = textWidth > W;
+            if (clip) fl_push_clip(X, Y, W, H);
+            if (fl_font() != getFixedFont() || fl_size() != kFontSize) fl_font(getFixedFont(), kFontSize);
+            int baseline = Y + m_textBaseline;
+
             if (COL == 0) {
                 // 偏移列
                 fl_color(FL_BLUE);
-                char offsetStr[20];
-                sprintf(offsetStr, "%08x", offset);
-                fl_draw(offsetStr, X+2, Y, W, H, FL_ALIGN_LEFT, nullptr, 0);
-            } else if (COL == m_bytesPerRow + 1) {
-                // ASCII列
-                fl_color(FL_BLACK);
-                char asciiStr[m_bytesPerRow + 1];
-                for (int i = 0; i < m_bytesPerRow; i++) {
-                    if (offset + i - m_visitOffset < m_fileSize &&
-                        ROW * m_bytesPerRow + i - m_visitOffset < m_bufferSize) {
-                        asciiStr[i] = getPrintableChar(m_buffer[ROW * m_bytesPerRow + i - m_visitOffset]);
-                    } else {
-                        asciiStr[i] = ' ';
+                fl_draw(m_rowOffset, m_rowOffsetLength, X + 2, baseline);
+            } else if (!isHexCol) {
+                // ASCII列，颜色相同的连续字符合并成一次填充，再把查找结果的连续字符合并成一个黄色背景
+                for (size_t i = 0; m_rowColors && i < m_rowTextBytes; ) {
+                    size_t j = i + 1;
+                    while (j < m_rowTextBytes && m_rowColors[j] == m_rowColors[i]) j++;
+                    if (m_rowColors[i] != FL_WHITE) {
+                        fl_color(m_rowColors[i]);
+                        fl_rectf(X + 2 + (int)i * m_charWidth, Y, (int)(j - i) * m_charWidth, H);
                     }
+                    i = j;
                 }
-                asciiStr[m_bytesPerRow] = '\0';
-                fl_draw(asciiStr, X+2, Y, W, H, FL_ALIGN_LEFT, nullptr, 0);
-            } else {
-                // 十六进制数据列
-                fl_color(FL_BLACK);
-                int byteIndex = COL - 1;
-                if (offset + byteIndex - m_visitOffset < m_fileSize &&
-                        ROW * m_bytesPerRow + byteIndex - m_visitOffset < m_bufferSize) {
-                    char hexStr[4];
-                    formatByte(hexStr, m_buffer[ROW * m_bytesPerRow + byteIndex - m_visitOffset]);
-                    fl_draw(hexStr, X, Y, W, H, FL_ALIGN_CENTER, nullptr, 0);
+                fl_color(FL_YELLOW);
+                for (size_t i = 0; i < m_bytesPerRow; ) {
+                    if (!isHit(offset + i)) {
+                        i++;
+                        continue;
+                    }
+                    size_t j = i + 1;
+                    while (j < m_bytesPerRow && isHit(offset + j)) j++;
+                    fl_rectf(X + 2 + (int)i * m_charWidth, Y, (int)(j - i) * m_charWidth, H);
+                    i = j;
                 }
+                if (m_rowTextBytes) {
+                    fl_color(FL_BLACK);
+                    fl_draw(m_rowAscii, (int)m_rowTextBytes, X + 2, baseline);
+                    // 非ASCII字符画在它的第一个字节处，行末的宽字符可能多占一格
+                    for (size_t i = 0; i < m_rowWideCount; i++) {
+                        fl_draw(m_rowWide[i].text, m_rowWide[i].length, X + 2 + m_rowWide[i].index * m_charWidth, baseline);
+                    }
+                }
+                if (m_rowTextBytes < m_rowExpectedBytes) {
+                    // 还没读到的字符画占位
+                    fl_color(FL_LIGHT2);
+                    fl_rectf(X + 2 + (int)m_rowTextBytes * m_charWidth, Y + 4,
+                             (int)(m_rowExpectedBytes - m_rowTextBytes) * m_charWidth, H - 8);
+                }
+            } else if (cellByte < m_rowTextBytes) {
+                // 数据列
+                fl_color(FL_BLACK);
+                fl_draw(m_rowText + (size_t)(COL - 1) * m_formatter.GetTextWidth(), (int)m_formatter.GetTextWidth(),
+                        X + (W - cellTextWidth) / 2, baseline);
+            } else if (cellByte < m_rowExpectedBytes) {
+                // 还没读到的字节画占位，读完后重绘
+                fl_color(FL_LIGHT2);
+                fl_rectf(X + (W - cellTextWidth) / 2, Y + 4, cellTextWidth, H - 8);
             }
             
             // 绘制单元格边框
             fl_color(color());
             fl_rect(X, Y, W, H);
-            fl_pop_clip();
+            if (clip) fl_pop_clip();
             break;
         }
         
@@ -277,21 +1036,24 @@ int HexTable::handle(int event) {
             // 获取鼠标点击位置对应的单元格行列
             TableContext context = cursor2rowcol(R, C, resizeflag);
             if (context == CONTEXT_CELL) {
+                SelectionState old = selectionState();
                 // 开始选择
                 m_isSelecting = true;
                 if (Fl::get_key(FL_Alt_L) || Fl::get_key(FL_Alt_R))
                     m_isVertSelecting = true;
                 else
                     m_isVertSelecting = false;
-                m_rowStartSelect = m_rowEndSelect = R;
+                m_rowStartSelect = m_rowEndSelect = fileRowOf(R);
                 m_colStartSelect = m_colEndSelect = C;
+                // 光标移动后的输入不再与之前的连续输入合并
+                m_journal.Seal();
                 int X,Y,W,H;
                 find_cell(CONTEXT_CELL, R,C, X,Y,W,H);
-                // 检查是否点击在高4位
-                m_isLow4BitEditing = ((Fl::event_x() - X) >= W / 2);
+                // 检查是否点击在低4位，只有十六进制显示时按半个字节编辑
+                m_isLow4BitEditing = m_formatter.GetFormat() == CELL_HEX && ((Fl::event_x() - X) >= W / 2);
 
-                // 触发重绘以显示选中状态
-                redraw();
+                // 只重绘选择变化的单元格
+                redrawSelectionChange(old);
             }
             break;
         }
@@ -304,14 +1066,15 @@ int HexTable::handle(int event) {
             TableContext context = cursor2rowcol(R, C, resizeflag);
             if (context == CONTEXT_CELL) {
                 if (m_isSelecting) {
+                    SelectionState old = selectionState();
                     // 更新选择的结束位置
-                    m_rowEndSelect = R;
+                    m_rowEndSelect = fileRowOf(R);
                     m_colEndSelect = C;
-                    // 触发重绘以更新选择区域
                     if (m_rowStartSelect != m_rowEndSelect || m_colStartSelect != m_colEndSelect) {
                         m_isLow4BitEditing = 0;
                     }
-                    redraw();
+                    // 只重绘两次拖动之间选择变化的单元格
+                    redrawSelectionChange(old);
                 }
             }
             break;
@@ -320,14 +1083,18 @@ int HexTable::handle(int event) {
         case FL_RELEASE: {
             // 鼠标释放事件
             if (m_isSelecting) {
-                // 结束选择
+                // 结束选择，选择的显示不变
                 m_isSelecting = false;
-                // 触发重绘以清除选中状态
-                redraw();
             }
             break;
         }
         
+        case FL_PASTE: {
+            // Fl::paste()送来的剪贴板内容
+            pasteText(Fl::event_text(), Fl::event_length());
+            return 1;
+        }
+
         case FL_KEYBOARD: {
             // 键盘事件
             switch (Fl::event_key())
@@ -335,20 +1102,60 @@ int HexTable::handle(int event) {
                 case FL_Escape:
                     return 0;
 
-                case FL_Page_Up:
-                case FL_Page_Down:
                 case FL_Home:
                 case FL_End:
+                    // Ctrl+Home/End跳到文件头尾，而不只是虚拟滚动窗口的头尾
+                    if (Fl::event_state(FL_CTRL)) {
+                        GotoOffset(Fl::event_key() == FL_Home ? 0 : m_fileSize - 1);
+                        return 1;
+                    }
                     event = FL_SHORTCUT;
                     break;
 
+                case FL_Page_Up:
+                case FL_Page_Down:
+                    event = FL_SHORTCUT;
+                    break;
+
+                case FL_Insert:
+                    m_isInsertMode = !m_isInsertMode;
+                    UpdateStatus();
+                    return 1;
+
+                case FL_Delete:
+                case FL_BackSpace:
+                    {
+                        FileOffset start, length;
+                        if (m_isReadOnly || !getSelectionRange(start, length))
+                            return 1;
+                        // 没有选择范围时退格删除光标前一个字节
+                        if (Fl::event_key() == FL_BackSpace && length == 1 && !m_isLow4BitEditing) {
+                            if (start == 0)
+                                return 1;
+                            start--;
+                        }
+                        m_isLow4BitEditing = false;
+                        deleteBytes(start, length);
+                        return 1;
+                    }
+
                 case FL_Up:
                 case FL_Down:
                 case FL_Left:
                 case FL_Right:
                     {
+                        SelectionState old = selectionState();
                         Fl_Table::handle(event);
-                        get_selection(m_rowStartSelect, m_colStartSelect, m_rowEndSelect, m_colEndSelect);
+                        m_journal.Seal();
+                        int r1, c1, r2, c2;
+                        get_selection(r1, c1, r2, c2);
+                        m_rowStartSelect = fileRowOf(r1);
+                        m_colStartSelect = c1;
+                        m_rowEndSelect = fileRowOf(r2);
+                        m_colEndSelect = c2;
+                        redrawSelectionChange(old);
+                        rebaseRowWindow();
+                        updateView();
                         return 1; // return 0 cause future arrow key fail
                     }
                     break;
@@ -361,21 +1168,22 @@ int HexTable::handle(int event) {
                         if (m_colStartSelect == 0) m_colStartSelect = 1;
                         if (m_colEndSelect == 0) m_colEndSelect = 1;
                     }
-                    int R = m_rowStartSelect;
+                    SelectionState old = selectionState();
+                    int64_t R = m_rowStartSelect;
                     int C = m_colStartSelect;
 
-                    // 只有十六进制数据列可以编辑
-                    if (C >= 1 && C <= m_bytesPerRow) {
+                    // 只有十六进制显示时数据列可以直接输入编辑
+                    if (!m_isReadOnly && m_formatter.GetFormat() == CELL_HEX && C >= 1 && C <= (int)m_cellsPerRow) {
                         // 检查是否输入了有效的十六进制字符
                         char key = Fl::e_text[0];
                         if ((key >= '0' && key <= '9') || 
                             (key >= 'a' && key <= 'f') || 
                             (key >= 'A' && key <= 'F')) {
-                            // 计算缓冲区中的索引
-                            size_t bufferIndex = R * m_bytesPerRow + (C - 1);
+                            // 计算编辑的字节偏移
+                            FileOffset byteOffset = (FileOffset)R * m_bytesPerRow + (C - 1);
                             
-                            // 确保索引在缓冲区范围内
-                            if (bufferIndex < m_bufferSize) {
+                            // 确保偏移在数据范围内
+                            if (byteOffset < m_fileSize) {
                                 // 将字符转换为数值
                                 int value = 0;
                                 if (key >= '0' && key <= '9') {
@@ -387,39 +1195,56 @@ int HexTable::handle(int event) {
                                 }
 
                                 // 根据m_isLow4BitEditing标志决定更新高4位还是低4位
+                                uint8_t byte = 0;
+                                bool resized = false;
+                                // 可见的字节已在屏幕缓冲区中，不必在UI线程上读文件
+                                if (byteOffset >= m_visitOffset && byteOffset - m_visitOffset < m_bufferSize)
+                                    byte = m_buffer[byteOffset - m_visitOffset];
+                                else
+                                    m_editBuffer.Read(byteOffset, &byte, 1);
                                 if (m_isLow4BitEditing) {
                                     // 更新低4位
-                                    m_buffer[bufferIndex] = (m_buffer[bufferIndex] & 0xF0) | value;
+                                    byte = (byte & 0xF0) | value;
+                                    m_journal.Overwrite(byteOffset, &byte, 1, TRUE);
                                     m_isLow4BitEditing = 0;
                                     m_colStartSelect++;
                                     // 确保不超出当前行的边界
-                                    int oldRow = m_rowStartSelect;
+                                    int64_t oldRow = m_rowStartSelect;
                                     if (m_colStartSelect > m_bytesPerRow) {
                                         m_colStartSelect = 1;
                                         m_rowStartSelect++;
                                     }
-                                    if (m_rowStartSelect * m_bytesPerRow + m_colStartSelect >= m_fileSize) {
+                                    if ((FileOffset)m_rowStartSelect * m_bytesPerRow + m_colStartSelect > m_fileSize) {
                                         m_colStartSelect = (m_fileSize - 1) % m_bytesPerRow + 1;
                                         m_rowStartSelect = (m_fileSize - 1) / m_bytesPerRow;
                                     } else if (oldRow != m_rowStartSelect) {
                                         int r1, r2, c1, c2;
                                         visible_cells(r1, r2, c1, c2);
-                                        if (m_rowStartSelect > r2)
+                                        if (m_rowStartSelect > (int64_t)fileRowOf(r2))
                                             row_position(r1 + 1);
                                     }
+                                } else if (m_isInsertMode) {
+                                    // 插入模式下输入高4位时在光标处插入新字节
+                                    byte = value << 4;
+                                    m_journal.Insert(byteOffset, &byte, 1, TRUE);
+                                    m_isLow4BitEditing = 1;
+                                    resized = true;
                                 } else {
                                     // 更新高4位
-                                    m_buffer[bufferIndex] = (m_buffer[bufferIndex] & 0x0F) | (value << 4);
+                                    byte = (byte & 0x0F) | (value << 4);
+                                    m_journal.Overwrite(byteOffset, &byte, 1, TRUE);
                                     m_isLow4BitEditing = 1;
                                 }
                                 m_rowEndSelect = m_rowStartSelect;
                                 m_colEndSelect = m_colStartSelect;
                                 
-                                // 触发重绘以更新显示
-                                redraw();
-                                
-                                // 更新状态信息
-                                UpdateStatus();
+                                // 改写只重绘这个字节和光标变化的单元格；插入后面的数据都移动了，整个重画
+                                if (resized) {
+                                    onDataChanged();
+                                } else {
+                                    onBytesChanged(byteOffset, byteOffset + 1);
+                                    redrawSelectionChange(old);
+                                }
                             }
                         } else if (key == '\r' || key == '\n') {
                             // Enter键处理
@@ -431,20 +1256,9 @@ int HexTable::handle(int event) {
         }
     }
     int result = Fl_Table::handle(event);
-    int r1, r2, c1, c2;
-    visible_cells(r1, r2, c1, c2);
-    if (r1 >= 0 && r2 >= 0 &&
-        (r1 * m_bytesPerRow < m_visitOffset || r2 * m_bytesPerRow >= m_visitOffset + m_bufferSize))
-    {
-        uint32_t visitOffset = (r1 + (r2 - r1) / 2) * m_bytesPerRow;
-        m_largeFile.VisitFilePosition(visitOffset);
-        uint32_t nFileOffsetLow, nFileOffsetHigh, dwAvalibleSize;
-        m_buffer = (uint8_t*)m_largeFile.GetMappingInfo(nFileOffsetLow, nFileOffsetHigh, dwAvalibleSize);
-        m_visitOffset = nFileOffsetLow;
-        m_bufferSize = dwAvalibleSize;
-        if (!m_buffer || !m_bufferSize)
-            CloseFile();
-        redraw();
+    if (m_fileSize) {
+        rebaseRowWindow();
+        updateView();
     }
     
     return result;
@@ -4,38 +4,223 @@
 #include <FL/Fl_Table.H>
 #include <FL/Fl_Text_Buffer.H>
 #include <cstdint>
+#include <algorithm>
 #include "LargeFile.h"
+#include "Prefetcher.h"
+#include "ScreenLoader.h"
+#include "DataSummary.h"
+#include "FileBackend.h"
+#include "EditBuffer.h"
+#include "SaveEngine.h"
+#include "ReplaceEngine.h"
+#include "UndoJournal.h"
+#include "HitIndex.h"
+#include "CellFormat.h"
+#include "ByteColorMap.h"
+#include "TextDecoder.h"
+#include <vector>
+
+class OverviewBar;
 
 // 十六进制表格类
 class HexTable : public Fl_Table {
 private:
     CLargeFile m_largeFile;
-    uint8_t* m_buffer;          // 数据缓冲区
-    size_t m_bufferSize;        // 缓冲区大小
-    size_t m_fileSize;          // 文件大小
-    size_t m_bytesPerRow;       // 每行显示的字节数
-    size_t m_visitOffset;       // 当前文件映射的起始偏移量
+    CEditBuffer m_editBuffer;   // 编辑层，所有读写都经过它，原文件映射保持只读
+    CUndoJournal m_journal;     // 撤销/重做记录，编辑都通过它写入m_editBuffer
+    CPrefetcher m_prefetcher;   // 后台预取即将滚动到的视图
+    CScreenLoader m_loader;     // 后台读取屏幕数据，UI线程不直接读原文件
+    CDataSummary m_summary;     // 概览条用的统计，后台统计原文件
+    OverviewBar* m_overview;    // 概览条，可以没有
+    FileOffset m_overviewTop;   // 概览条上次画位置框时的顶行
+    uint8_t* m_buffer;          // 屏幕缓冲区，保存可见行附近编辑后的数据
+    size_t m_bufferSize;        // 缓冲区中有效数据的大小
+    size_t m_bufferCapacity;    // 缓冲区容量
+    uint64_t m_bufferSerial;    // 屏幕缓冲区内容的版本，换入或改写时加一
+    FileOffset m_fileSize;      // 编辑后的数据大小
+    size_t m_bytesPerRow;       // 每行显示的字节数，可以设置成结构体的大小
+    CCellFormatter m_formatter; // 数据列的显示方式，一个单元格显示一个元素
+    size_t m_cellsPerRow;       // 每行的数据列数，行宽不是元素大小的整数倍时最后一列不满一个元素
+    ByteColorMap m_byteColors;  // 按字节值着色的颜色表
+    bool m_byteColoring;        // 是否按字节值着色
+    CTextDecoder m_textDecoder; // 文本列的解码，结果按屏幕缓冲区缓存
+    FileOffset m_visitOffset;   // 屏幕缓冲区对应的起始偏移量
+    bool m_loadPending;         // 有还没有换入屏幕缓冲区的读取请求
+    uint64_t m_loadSerial;      // 它的序号
+    FileOffset m_loadOffset;    // 它的范围
+    size_t m_loadLength;
+    std::vector<uint8_t> m_loadData;    // 读取结果，换入屏幕缓冲区后重复使用
+    bool m_loadFailed;          // 最近一次读取有读不出的数据
+    FileOffset m_fileRowCount;  // 文件总行数
+    FileOffset m_firstRow;      // 表格第0行对应的文件行号（虚拟滚动窗口起点）
     const size_t m_rowHeight = 20; // 行高
     char m_fileName[256];       // 当前打开的文件名
+    BackendType m_backendType;  // 打开文件时使用的存储后端，BACKEND_AUTO为自动选择
     Fl_Text_Buffer* m_statusBuffer; // 状态信息缓冲区
     
-    // 选择相关变量
+    // 选择相关变量（行号为文件行号，不是表格行号）
     bool m_isSelecting;           // 是否正在进行选择
     bool m_isVertSelecting;       // 是否列选择
-    int m_rowStartSelect, m_colStartSelect; // 选择的起始位置
-    int m_rowEndSelect, m_colEndSelect;     // 选择的结束位置
+    int64_t m_rowStartSelect;     // 选择的起始行
+    int m_colStartSelect;         // 选择的起始列
+    int64_t m_rowEndSelect;       // 选择的结束行
+    int m_colEndSelect;           // 选择的结束列
     bool m_isLow4BitEditing; // 是否正在选择高4位
+    bool m_isInsertMode;     // 插入模式，输入高4位时插入新字节而不是改写
+    bool m_isReadOnly;       // 后台线程读取编辑层期间禁止编辑
+    bool m_statusModified;   // 状态栏显示的修改标记，没有变化时输入字节不必刷新状态
+
+    // 选择状态的快照：绘制时求每行选中的列，事件前后比较得到需要重绘的单元格
+    struct SelectionState {
+        int64_t rowStart, rowEnd;
+        int colStart, colEnd;
+        bool vertical;
+        bool low4;
+    };
+    SelectionState m_drawSelection;     // 本帧绘制用的选择，每帧开始时取一次
+
+    // 全部查找的结果，可见行中的匹配高亮显示
+    CHitIndex m_hitIndex;
+    std::vector<uint8_t> m_hitMask;     // 可见行每个字节是否在匹配中，每次绘制前更新
+    FileOffset m_hitMaskStart;          // m_hitMask第一个字节的偏移
+    std::vector<SearchHit> m_visibleHits;
+
+    // 可见区域格式化好的文字，每帧开始时整个区域一起转换，缓冲区重复使用
+    uint64_t m_frameSerial;             // 每次draw()加一，区域和行缓存只在同一帧内有效
+    uint64_t m_regionFrame;             // 区域文字所属的帧
+    FileOffset m_regionFirstRow;        // 区域的第一行
+    size_t m_regionRows;                // 区域的行数
+    std::vector<char> m_regionText;     // 每行m_cellsPerRow个单元格，每个GetTextWidth()个字符
+    std::vector<char> m_regionAscii;    // 每行m_bytesPerRow个可打印字符
+    std::vector<size_t> m_regionBytes;  // 每行有数据的字节数
+    std::vector<Fl_Color> m_regionColors;   // 着色时每个字节的背景色，和m_regionAscii一样排列
+    // 文本列中的非ASCII字符，画在它的第一个字节处；m_regionAscii中它的各个字节都是空格
+    struct WideGlyph {
+        uint16_t index;                 // 在行内的字节位置
+        uint8_t length;                 // UTF-8的字节数
+        char text[4];
+    };
+    std::vector<WideGlyph> m_regionWide;
+    std::vector<size_t> m_regionWideStart;  // 每行第一个非ASCII字符在m_regionWide中的位置，最后多一项
+
+    // 正在绘制的行，同一帧中这一行的各个单元格共用
+    uint64_t m_rowTextFrame;            // 行缓存所属的帧
+    FileOffset m_rowTextRow;            // 行缓存对应的文件行
+    size_t m_rowTextBytes;              // 这一行有数据的字节数
+    size_t m_rowExpectedBytes;          // 这一行在文件中的字节数，多出m_rowTextBytes的部分还没读到，画占位
+    const char* m_rowText;              // 这一行数据列的文字，指向区域缓冲区
+    const char* m_rowAscii;             // 这一行ASCII列的文字
+    const Fl_Color* m_rowColors;        // 这一行每个字节的背景色，不着色时为nullptr
+    const WideGlyph* m_rowWide;         // 这一行的非ASCII字符
+    size_t m_rowWideCount;
+    char m_rowOffset[24];               // 偏移列的文字
+    int m_rowOffsetLength;
+    int m_rowSelFirst, m_rowSelLast;    // 这一行选中的十六进制列[first, last]，first > last表示没有
+    int m_charWidth;                    // 等宽字体的字符宽度，每帧开始时取一次
+    int m_textBaseline;                 // 文字基线相对单元格顶部的位置
+
+    // 帧耗时，确认滚动时能保持60帧每秒
+    uint64_t m_frameCount;
+    uint64_t m_slowFrames;              // 超过一帧预算（1/60秒）的帧数
+    double m_frameLastMs;
+    double m_frameAvgMs;                // 指数移动平均
+    double m_frameMaxMs;                // 上次刷新状态以来最长的一帧
+    double m_frameWorstMs;              // 打开文件以来最长的一帧（最长卡顿）
+    bool m_framePlaceholder;            // 这一帧画了占位
+    uint64_t m_placeholderFrames;       // 画了占位的帧数
+    uint64_t m_frameStatusTick;         // 上次刷新状态的时间（毫秒）
     
     // 事件处理方法
     virtual int handle(int event) override; // 重写的事件处理函数
+    // 重写绘制函数，统计UI线程绘制时的缺页和每帧耗时
+    virtual void draw() override;
     // 设置并返回支持中文的等宽字体
     Fl_Font getFixedFont();
 
-    // 格式化字节为十六进制字符串
-    void formatByte(char* buf, uint8_t byte);
+    // 取出fileRow的数据列和ASCII文字，格式化偏移，并求出这一行选中的列，
+    // 同一帧内已格式化时直接返回
+    void formatRow(FileOffset fileRow);
+
+    // 把[firstRow, lastRow]在屏幕缓冲区中的数据一次转换成区域文字
+    void formatRegion(FileOffset firstRow, FileOffset lastRow);
+
+    // 按行宽和显示方式设置列数和列宽
+    void layoutColumns();
+
+    // 改变行宽或显示方式，保持顶行和选择的字节位置
+    void applyLayout(size_t bytesPerRow, int format, bool bigEndian);
+
+    // 数据列与行内字节位置互相转换：第col列是行内[byteOfCell(col), cellEndByte(col))的字节
+    int cellOfByte(size_t byteInRow) const { return (int)(byteInRow / m_formatter.GetElementSize()) + 1; }
+    size_t byteOfCell(int col) const { return (size_t)(col - 1) * m_formatter.GetElementSize(); }
+    size_t cellEndByte(int col) const { return std::min(byteOfCell(col + 1), m_bytesPerRow); }
+
+    // 当前的选择状态
+    SelectionState selectionState() const;
+
+    // sel在fileRow中选中的数据列[first, last]，没有时返回false
+    bool selectionSpan(const SelectionState& sel, FileOffset fileRow, int& first, int& last) const;
+
+    // 只重绘选择从old变成当前状态时变化了的单元格
+    void redrawSelectionChange(const SelectionState& old);
+
+    // 只重绘[start, end)字节所在的可见单元格（数据列和ASCII列）
+    void redrawBytes(FileOffset start, FileOffset end);
+
+    // 记录一帧的绘制耗时，定期（或forceStatus时立即）刷新状态
+    void recordFrame(double ms, bool forceStatus);
+
+    // 表格行号与文件行号互相转换
+    FileOffset fileRowOf(int tableRow) const { return m_firstRow + tableRow; }
+    int tableRowOf(FileOffset fileRow) const { return (int)(fileRow - m_firstRow); }
+
+    // 移动虚拟滚动窗口，使fileRow成为表格顶行
+    void setTopFileRow(FileOffset fileRow);
+
+    // 滚动到窗口边缘时重新定位虚拟滚动窗口
+    void rebaseRowWindow();
+
+    // 保存或替换后重新打开path，回到原来的位置
+    void reopenFile(const char* path);
+
+    // 确保可见行都在当前映射的视图内
+    void updateView();
+
+    // 请求把[firstRow, lastRow]附近的数据读到屏幕缓冲区并等待很短的时间，屏幕缓冲区有变化时返回true；
+    // 来不及读完时先返回，读完后由screenLoadedCallback换入并重绘
+    bool loadScreen(FileOffset firstRow, FileOffset lastRow);
+
+    // 把已完成的读取结果换入屏幕缓冲区，没有时返回false
+    bool takeScreen();
+
+    // 后台读取完成后由Fl::awake在UI线程调用
+    static void screenLoadedCallback(void* data);
+
+    // 后台统计有进展时由Fl::awake在UI线程调用
+    static void summaryUpdatedCallback(void* data);
+
+    // 从结果索引中取出[firstRow, lastRow]中的匹配，更新m_hitMask
+    void loadVisibleHits(FileOffset firstRow, FileOffset lastRow);
+
+    // offset处的字节是否在可见的匹配中
+    bool isHit(FileOffset offset) const {
+        return offset >= m_hitMaskStart && offset - m_hitMaskStart < m_hitMask.size() && m_hitMask[offset - m_hitMaskStart];
+    }
+
+    // 编辑后屏幕缓冲区失效，大小变化时同步行数
+    void onDataChanged();
 
-    // 获取可打印字符或替代字符
-    char getPrintableChar(uint8_t byte);
+    // 改写了[start, end)（大小不变）：只更新屏幕缓冲区中的这些字节并重绘它们的单元格
+    void onBytesChanged(FileOffset start, FileOffset end);
+
+    // 当前选择对应的字节范围（列选择时只取光标所在字节）
+    bool getSelectionRange(FileOffset& start, FileOffset& length);
+
+    // 删除字节并把光标放到删除位置
+    void deleteBytes(FileOffset start, FileOffset length);
+
+    // 粘贴剪贴板文本：十六进制文本按字节值解析，否则按原始字节
+    void pasteText(const char* text, int length);
 
 public:
     HexTable(int x, int y, int w, int h);
@@ -47,12 +232,91 @@ public:
     // 关闭文件
     void CloseFile();
 
+    // 保存编辑结果到path（为空时保存回原文件），成功后重新打开保存的文件
+    bool SaveFile(const char* path, const SaveProgress& progress, SaveStats* stats);
+
+    // 把每个匹配替换为replacements[匹配的模式序号]写回原文件（包括未保存的修改），成功后重新打开
+    // 调用者在整个替换期间把表格设为只读
+    bool ReplaceAll(CMatcher* matcher, const std::vector<std::vector<uint8_t> >& replacements,
+                    const SaveProgress& progress, ReplaceStats* stats);
+
+    // 选中[start, start+length)并滚动到起点
+    void SelectRange(FileOffset start, FileOffset length);
+
+    // 当前选择（或光标）的字节范围，没有选择时返回false
+    bool GetSelection(FileOffset& start, FileOffset& length) { return getSelectionRange(start, length); }
+
+    // 编辑后的数据，查找等功能直接在上面扫描
+    CEditBuffer* GetEditBuffer() { return &m_editBuffer; }
+
+    // 全部查找的结果，查找过程中陆续加入，加入后调用redraw()即可高亮；编辑或关闭文件时清空
+    CHitIndex& GetHitIndex() { return m_hitIndex; }
+
+    // 撤销/重做，没有可撤销的内容时返回false
+    bool Undo();
+    bool Redo();
+
+    // 用同一个字节填充选择范围
+    bool FillSelection(uint8_t value);
+
+    // 禁止/允许编辑，后台查找期间表格仍可浏览
+    void SetReadOnly(bool readOnly) { m_isReadOnly = readOnly; UpdateStatus(); }
+    bool IsReadOnly() const { return m_isReadOnly; }
+
+    // 是否有未保存的修改
+    bool IsModified() const { return m_editBuffer.IsModified() != 0; }
+
+    // 当前打开的文件名
+    const char* GetFileName() const { return m_fileName; }
+
+    // 指定之后打开文件时使用的存储后端
+    void SetBackendType(BackendType type) { m_backendType = type; }
+
     // 设置状态缓冲区
     void SetStatusBuffer(Fl_Text_Buffer* buffer);
 
     // 更新状态信息
     void UpdateStatus();
 
+    // 跳转到文件偏移并选中该字节
+    void GotoOffset(FileOffset offset);
+
+    // 文件大小
+    FileOffset GetFileSize() const { return m_fileSize; }
+
+    // 每行显示的字节数，限制在1~kMaxBytesPerRow
+    void SetBytesPerRow(size_t bytesPerRow);
+    size_t GetBytesPerRow() const { return m_bytesPerRow; }
+
+    // 数据列的显示方式（CellFormat）和多字节元素的字节序，只有CELL_HEX时可以直接输入编辑
+    void SetCellFormat(int format, bool bigEndian);
+    int GetCellFormat() const { return m_formatter.GetFormat(); }
+    bool IsBigEndian() const { return m_formatter.IsBigEndian() != 0; }
+
+    static const size_t kMaxBytesPerRow = 4096;
+
+    // 按字节值给数据列和ASCII列着色，用户范围覆盖默认的分类颜色
+    void SetByteColoring(bool enable) { m_byteColoring = enable; redraw(); }
+    bool IsByteColoring() const { return m_byteColoring; }
+    void SetByteColorRanges(const std::vector<ByteColorRange>& ranges) { m_byteColors.SetRanges(ranges); redraw(); }
+    const std::vector<ByteColorRange>& GetByteColorRanges() const { return m_byteColors.GetRanges(); }
+
+    // 文本列的编码（TextDecoding）
+    void SetTextEncoding(int encoding) { m_textDecoder.SetEncoding(encoding); redraw(); }
+    int GetTextEncoding() const { return m_textDecoder.GetEncoding(); }
+
+    // 设置概览条，数据变化或滚动时通知它重画
+    void SetOverview(OverviewBar* overview) { m_overview = overview; }
+
+    // 概览统计
+    CDataSummary* GetSummary() { return &m_summary; }
+
+    // 当前可见的字节范围[start, end)，没有可见行时返回false
+    bool GetVisibleRange(FileOffset& start, FileOffset& end);
+
+    // 滚动使offset所在行位于可见区域中部，不改变选择
+    void ScrollToOffset(FileOffset offset);
+
     // 表格绘制回调
     void draw_cell(TableContext context, int ROW, int COL, int X, int Y, int W, int H) override;
     
@@ -0,0 +1,171 @@
+#include "HitIndex.h"
+#include <algorithm>
+
+// 每块的匹配数：越大头部越省空间，越小查找时要解码的越少
+static const size_t kHitsPerBlock = 64;
+
+static void PutVarint(std::vector<uint8_t>& vecData, uint64_t nValue)
+{
+    while (nValue >= 0x80)
+    {
+        vecData.push_back((uint8_t)(nValue | 0x80));
+        nValue >>= 7;
+    }
+    vecData.push_back((uint8_t)nValue);
+}
+
+static const uint8_t* GetVarint(const uint8_t* p, uint64_t* pnValue)
+{
+    uint64_t nValue = 0;
+    int nShift = 0;
+    while (*p & 0x80)
+    {
+        nValue |= (uint64_t)(*p++ & 0x7F) << nShift;
+        nShift += 7;
+    }
+    *pnValue = nValue | (uint64_t)*p++ << nShift;
+    return p;
+}
+
+CHitIndex::CHitIndex()
+    : m_nCount(0), m_nLastOffset(0), m_nMaxEnd(0)
+{
+}
+
+void CHitIndex::Clear()
+{
+    std::vector<Block>().swap(m_vecBlocks);
+    std::vector<uint8_t>().swap(m_vecData);
+    m_nCount = 0;
+    m_nLastOffset = 0;
+    m_nMaxEnd = 0;
+}
+
+void CHitIndex::Append(const SearchHit* pHits, size_t nCount)
+{
+    for (size_t i = 0; i < nCount; i++)
+    {
+        const SearchHit& hit = pHits[i];
+        if (m_nCount && hit.nOffset < m_nLastOffset)
+            continue;
+        FileOffset nEnd = hit.nOffset + hit.nLength;
+        if (nEnd > m_nMaxEnd)
+            m_nMaxEnd = nEnd;
+        // 块的第一个匹配的偏移在块头里，不再存距离
+        if (m_nCount % kHitsPerBlock == 0)
+        {
+            Block block;
+            block.nFirstOffset = hit.nOffset;
+            block.nMaxEnd = m_nMaxEnd;
+            block.nData = m_vecData.size();
+            m_vecBlocks.push_back(block);
+        }
+        else
+        {
+            PutVarint(m_vecData, hit.nOffset - m_nLastOffset);
+            m_vecBlocks.back().nMaxEnd = m_nMaxEnd;
+        }
+        PutVarint(m_vecData, hit.nLength);
+        PutVarint(m_vecData, hit.nPattern);
+        m_nLastOffset = hit.nOffset;
+        m_nCount++;
+    }
+}
+
+const uint8_t* CHitIndex::DecodeFirst(size_t nBlock, SearchHit* pHit) const
+{
+    const uint8_t* p = &m_vecData[m_vecBlocks[nBlock].nData];
+    uint64_t nValue;
+    pHit->nOffset = m_vecBlocks[nBlock].nFirstOffset;
+    p = GetVarint(p, &nValue);
+    pHit->nLength = nValue;
+    p = GetVarint(p, &nValue);
+    pHit->nPattern = (uint32_t)nValue;
+    return p;
+}
+
+const uint8_t* CHitIndex::DecodeNext(const uint8_t* p, SearchHit* pHit)
+{
+    uint64_t nValue;
+    p = GetVarint(p, &nValue);
+    pHit->nOffset += nValue;
+    p = GetVarint(p, &nValue);
+    pHit->nLength = nValue;
+    p = GetVarint(p, &nValue);
+    pHit->nPattern = (uint32_t)nValue;
+    return p;
+}
+
+int CHitIndex::GetHit(size_t nIndex, SearchHit* pHit) const
+{
+    if (nIndex >= m_nCount)
+        return FALSE;
+    const uint8_t* p = DecodeFirst(nIndex / kHitsPerBlock, pHit);
+    for (size_t i = nIndex % kHitsPerBlock; i > 0; i--)
+        p = DecodeNext(p, pHit);
+    return TRUE;
+}
+
+size_t CHitIndex::LowerBound(FileOffset nOffset) const
+{
+    if (!m_nCount || m_vecBlocks[0].nFirstOffset >= nOffset)
+        return 0;
+    // 偏移相同的匹配可能跨块，从第一个偏移小于nOffset的块的最后一个里往后找
+    size_t nLow = 0, nHigh = m_vecBlocks.size();
+    while (nHigh - nLow > 1)
+    {
+        size_t nMid = (nLow + nHigh) / 2;
+        if (m_vecBlocks[nMid].nFirstOffset < nOffset)
+            nLow = nMid;
+        else
+            nHigh = nMid;
+    }
+    size_t nIndex = nLow * kHitsPerBlock;
+    size_t nBlockEnd = std::min(nIndex + kHitsPerBlock, m_nCount);
+    SearchHit hit;
+    const uint8_t* p = DecodeFirst(nLow, &hit);
+    while (hit.nOffset < nOffset)
+    {
+        if (++nIndex == nBlockEnd)
+            break;
+        p = DecodeNext(p, &hit);
+    }
+    return nIndex;
+}
+
+void CHitIndex::GetHitsInRange(FileOffset nStart, FileOffset nEnd, std::vector<SearchHit>& vecHits) const
+{
+    if (!m_nCount || nStart >= nEnd)
+        return;
+    // nMaxEnd是前缀最大值，单调不减：第一个nMaxEnd > nStart的块之前没有跨进范围的匹配
+    size_t nBlock = 0, nHigh = m_vecBlocks.size();
+    while (nBlock < nHigh)
+    {
+        size_t nMid = (nBlock + nHigh) / 2;
+        if (m_vecBlocks[nMid].nMaxEnd <= nStart)
+            nBlock = nMid + 1;
+        else
+            nHigh = nMid;
+    }
+    // 较长的匹配很少，通常这里就是nStart所在的块
+    for (; nBlock < m_vecBlocks.size() && m_vecBlocks[nBlock].nFirstOffset < nEnd; nBlock++)
+    {
+        size_t nHits = std::min(kHitsPerBlock, m_nCount - nBlock * kHitsPerBlock);
+        SearchHit hit;
+        const uint8_t* p = DecodeFirst(nBlock, &hit);
+        for (size_t i = 0; i < nHits; i++)
+        {
+            if (i)
+                p = DecodeNext(p, &hit);
+            if (hit.nOffset >= nEnd)
+                return;
+            if (hit.nOffset + hit.nLength > nStart)
+                vecHits.push_back(hit);
+        }
+    }
+}
+
+size_t CHitIndex::GetMemorySize() const
+{
+    return m_vecBlocks.capacity() * sizeof(Block) + m_vecData.capacity();
+}
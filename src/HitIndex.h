@@ -0,0 +1,72 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include "Search.h"
+
+/************************************************************************/
+/* sorted index of search hits, compact enough for millions of them.
+/* hits are appended in offset order and packed in blocks of a fixed
+/* number of hits. a block header keeps the offset of its first hit, the
+/* largest hit end up to and including the block, and where its bytes
+/* start; inside a block every hit is stored as varints: the distance to
+/* the previous hit, the length and the pattern index, usually 3 bytes
+/* instead of the 24 of a SearchHit.
+/* every lookup is a binary search over the block headers plus decoding
+/* at most one block, so next/prev/count and the hits of the visible rows
+/* cost O(log n) however many hits there are.
+/************************************************************************/
+class CHitIndex
+{
+public:
+    CHitIndex();
+
+    void Clear();
+
+    /************************************************************************/
+    /* append hits sorted by offset, none before the last hit already in
+    /* the index (hits out of order are dropped).
+    /************************************************************************/
+    void Append(const SearchHit* pHits, size_t nCount);
+
+    size_t GetCount() const { return m_nCount; }
+    int IsEmpty() const { return m_nCount == 0; }
+
+    /************************************************************************/
+    /* the nIndex-th hit in offset order, FALSE if out of range.
+    /************************************************************************/
+    int GetHit(size_t nIndex, SearchHit* pHit) const;
+
+    /************************************************************************/
+    /* index of the first hit starting at or after nOffset, GetCount() if
+    /* there is none.
+    /************************************************************************/
+    size_t LowerBound(FileOffset nOffset) const;
+
+    /************************************************************************/
+    /* hits overlapping [nStart, nEnd), appended to vecHits in offset order.
+    /************************************************************************/
+    void GetHitsInRange(FileOffset nStart, FileOffset nEnd, std::vector<SearchHit>& vecHits) const;
+
+    /************************************************************************/
+    /* bytes used by the index, for reporting.
+    /************************************************************************/
+    size_t GetMemorySize() const;
+
+private:
+    struct Block
+    {
+        FileOffset nFirstOffset;   // 块中第一个匹配的偏移
+        FileOffset nMaxEnd;        // 这个块及之前所有块中匹配结束位置的最大值
+        size_t nData;              // 块的数据在m_vecData中的起点
+    };
+
+    // 从块nBlock开头解码，pHit依次得到块中的每个匹配；返回解码器的位置
+    const uint8_t* DecodeFirst(size_t nBlock, SearchHit* pHit) const;
+    static const uint8_t* DecodeNext(const uint8_t* p, SearchHit* pHit);
+
+    std::vector<Block> m_vecBlocks;
+    std::vector<uint8_t> m_vecData;
+    size_t m_nCount;
+    FileOffset m_nLastOffset;      // 最后一个匹配的偏移
+    FileOffset m_nMaxEnd;
+};
@@ -1,4 +1,5 @@
 #include "LargeFile.h"
+#include "FileBackend.h"
 #include <cstring>
 
 // 平台特定的头文件和实现
@@ -19,20 +20,10 @@ void GetSystemPageSize(uint32_t& pageSize)
     pageSize = si.dwAllocationGranularity;
 }
 
-// Windows平台的文件大小获取函数
-bool GetFileSize64(int fileHandle, LargeInteger& fileSize)
-{
-    return ::GetFileSizeEx((HANDLE)fileHandle, (LARGE_INTEGER*)&fileSize) != FALSE;
-}
-
 #else
 // Linux/Unix平台的头文件
-#include <sys/mman.h>
-#include <sys/stat.h>
-#include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
-#include <sys/types.h>
 
 // Linux平台的GetLastError实现
 ErrorCode GetLastError()
@@ -46,18 +37,6 @@ void GetSystemPageSize(uint32_t& pageSize)
     pageSize = sysconf(_SC_PAGE_SIZE);
 }
 
-// Linux平台的文件大小获取函数
-bool GetFileSize64(int fileHandle, LargeInteger& fileSize)
-{
-    struct stat st;
-    if (fstat(fileHandle, &st) < 0)
-    {
-        return false;
-    }
-    fileSize.QuadPart = st.st_size;
-    return true;
-}
-
 #endif
 
 
@@ -67,6 +46,8 @@ CLargeFile::CLargeFile()
 	GetSystemPageSize(pageSize);
 	m_dwPageSize = pageSize;
 	m_dwPageCount = 3;
+	m_nCacheBudget = LARGEFILE_DEFAULT_CACHE_BUDGET;
+	m_nMappedBytes = 0;
 	init();
 }
 
@@ -76,71 +57,36 @@ CLargeFile::~CLargeFile()
     CloseFile();
 }
 
-int CLargeFile::OpenFile(const char* pFilePathName, uint32_t nPageCount /*= 3*/)
+int CLargeFile::OpenFile(const char* pFilePathName, uint32_t nPageCount /*= 3*/, BackendType eBackend /*= BACKEND_AUTO*/)
 {
 	CloseFile();
 
-#ifdef _WIN32
-	m_hFile = (int)CreateFileA(pFilePathName,
-		GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
-		FILE_ATTRIBUTE_NORMAL, NULL);
-	if (m_hFile == INVALID_HANDLE_VALUE)
-	{
-		return FALSE;
-	}
-	if (!GetFileSize64(m_hFile, m_nFileSize))
-	{
-		CloseHandle((HANDLE)m_hFile);
-		m_hFile = INVALID_HANDLE_VALUE;
-		return FALSE;
-	}
-	m_hMap = (int)CreateFileMappingA((HANDLE)m_hFile, NULL, PAGE_WRITECOPY, 0, 0, NULL);
-	if (!m_hMap)
-	{
-		CloseHandle((HANDLE)m_hFile);
-		m_hFile = INVALID_HANDLE_VALUE;
-		return FALSE;
-	}
-#else
-	// Linux平台的文件打开和映射
-	m_hFile = open(pFilePathName, O_RDWR);
-	if (m_hFile < 0)
-	{
-		return FALSE;
-	}
-	if (!GetFileSize64(m_hFile, m_nFileSize))
+	CFileBackend* pBackend = CFileBackend::Create(eBackend, pFilePathName);
+	if (!pBackend->Open(pFilePathName, m_dwPageSize))
 	{
-		close(m_hFile);
-		m_hFile = INVALID_HANDLE_VALUE;
-		errno = EINVAL;
+		delete pBackend;
 		return FALSE;
 	}
-	// 在Linux中，我们不需要单独的文件映射对象，直接使用文件描述符
-	m_hMap = m_hFile; // 简单地复用文件描述符
-#endif
-	
-	if (!m_nFileSize.QuadPart)
+	if (!pBackend->GetSize())
 	{
-#ifdef _WIN32
-		CloseHandle((HANDLE)m_hFile);
-		CloseHandle((HANDLE)m_hMap);
-#else
-		close(m_hFile);
-#endif
-		m_hFile = INVALID_HANDLE_VALUE;
-		m_hMap = 0;
+		pBackend->Close();
+		delete pBackend;
 		return FALSE;
 	}
+	m_pBackend = pBackend;
+	m_nFileSize.QuadPart = pBackend->GetSize();
 	strcpy(m_szFilePathName, pFilePathName);
 	m_pView = 0;
 	m_nViewStart.QuadPart = 0;
-	m_dwPageCount = nPageCount;
+	// 访问点前后各需一页，窗口至少3页
+	m_dwPageCount = nPageCount < 3 ? 3 : nPageCount;
+	ResetViewCacheStats();
 	return TRUE;
 }
 
 int CLargeFile::IsOpenFile()
 {
-	return (m_hFile != INVALID_HANDLE_VALUE) && (m_hMap != 0);
+	return m_pBackend != NULL;
 }
 
 const char* CLargeFile::GetFilePathName()
@@ -148,26 +94,19 @@ const char* CLargeFile::GetFilePathName()
 	return m_szFilePathName;
 }
 
+CFileBackend* CLargeFile::GetBackend()
+{
+	return m_pBackend;
+}
+
 void CLargeFile::CloseFile()
 {
-	if (m_pView)
-	{
-        OnUnmapViewOfFile();
-	}
-	if (m_hMap)
-	{
-#ifdef _WIN32
-		CloseHandle((HANDLE)m_hMap);
-		// Linux平台不需要额外关闭m_hMap，因为它与m_hFile相同
-#endif
-	}
-	if (m_hFile != INVALID_HANDLE_VALUE)
+	std::lock_guard<std::mutex> lock(m_cacheLock);
+	UnmapAllViews();
+	if (m_pBackend)
 	{
-#ifdef _WIN32
-		CloseHandle((HANDLE)m_hFile);
-#else
-		close(m_hFile);
-#endif
+		m_pBackend->Close();
+		delete m_pBackend;
 	}
 	init();
 }
@@ -188,149 +127,366 @@ void CLargeFile::GetFileSizeEx(LargeInteger* puFileSize)
 		puFileSize->QuadPart = m_nFileSize.QuadPart;
 }
 
+uint32_t CLargeFile::GetPageSize()
+{
+	return m_dwPageSize;
+}
+
+uint32_t CLargeFile::GetViewSize()
+{
+	return m_dwPageSize * m_dwPageCount;
+}
+
 void* CLargeFile::VisitFilePosition(LargeInteger nVisit, uint32_t* pdwAvalibleSize /*= 0*/)
 {
-	if (m_hFile == INVALID_HANDLE_VALUE)
+	std::lock_guard<std::mutex> lock(m_cacheLock);
+	ViewSlot* pSlot = AcquireView(nVisit, TRUE);
+	if (!pSlot)
 	{
 		return NULL;
 	}
-	if (nVisit.QuadPart >= m_nFileSize.QuadPart)
+	return VisitView(pSlot, nVisit, pdwAvalibleSize);
+}
+
+void* CLargeFile::VisitFilePosition(uint32_t nVisitLow, uint32_t nVisitHigh /*= 0*/, uint32_t* pdwAvalibleSize /*= 0*/)
+{
+	LargeInteger nVisit;
+	nVisit.LowPart = nVisitLow;
+	nVisit.HighPart = nVisitHigh;
+	return VisitFilePosition(nVisit, pdwAvalibleSize);
+}
+
+void* CLargeFile::GetMappingInfo(uint32_t& nFileOffsetLow, uint32_t& nFileOffsetHigh, uint32_t& dwAvalibleSize)
+{
+	LargeInteger nFileOffset;
+	void* ptr = GetMappingInfo(nFileOffset, dwAvalibleSize);
+	nFileOffsetLow = nFileOffset.LowPart;
+	nFileOffsetHigh = nFileOffset.HighPart;
+	return ptr;
+}
+
+void* CLargeFile::GetMappingInfo(LargeInteger& nFileOffset, uint32_t& dwAvalibleSize)
+{
+	std::lock_guard<std::mutex> lock(m_cacheLock);
+	nFileOffset = m_nViewStart;
+	dwAvalibleSize = m_dwMapSize;
+	return m_pView;
+}
+
+void* CLargeFile::PinFilePosition(LargeInteger nVisit, uint32_t* pdwAvalibleSize /*= 0*/)
+{
+	// 固定视图不改变当前视图：调用者可能仍在使用VisitFilePosition返回的指针
+	std::lock_guard<std::mutex> lock(m_cacheLock);
+	ViewSlot* pSlot = AcquireView(nVisit, FALSE);
+	if (!pSlot)
 	{
 		return NULL;
 	}
-	uint32_t dwAvalibleSize = 0;
-	uint32_t dwVisitOffset = 0;
+	pSlot->nPinCount++;
+	return VisitView(pSlot, nVisit, pdwAvalibleSize);
+}
+
+void CLargeFile::UnpinView(const void* pAddress)
+{
+	std::lock_guard<std::mutex> lock(m_cacheLock);
+	ViewSlot* pSlot = FindViewByAddress(pAddress);
+	if (pSlot && pSlot->nPinCount)
+	{
+		pSlot->nPinCount--;
+	}
+}
+
+void CLargeFile::SetViewCacheBudget(uint64_t nBudget)
+{
+	std::lock_guard<std::mutex> lock(m_cacheLock);
+	m_nCacheBudget = nBudget;
+	TrimViewCache(0);
+}
+
+uint64_t CLargeFile::GetViewCacheBudget()
+{
+	return m_nCacheBudget;
+}
+
+void CLargeFile::GetViewCacheStats(ViewCacheStats* pStats)
+{
+	if (!pStats)
+		return;
+	std::lock_guard<std::mutex> lock(m_cacheLock);
+	pStats->nHits = m_nCacheHits;
+	pStats->nMisses = m_nCacheMisses;
+	pStats->nEvictions = m_nCacheEvictions;
+	pStats->nPrefetched = m_nCachePrefetched;
+	pStats->nViews = (uint32_t)m_lstViews.size();
+	pStats->nPinnedViews = 0;
+	for (ViewList::iterator it = m_lstViews.begin(); it != m_lstViews.end(); ++it)
+	{
+		if (it->nPinCount)
+			pStats->nPinnedViews++;
+	}
+	pStats->nMappedBytes = m_nMappedBytes;
+	pStats->nBudget = m_nCacheBudget;
+}
+
+void CLargeFile::ResetViewCacheStats()
+{
+	std::lock_guard<std::mutex> lock(m_cacheLock);
+	m_nCacheHits = 0;
+	m_nCacheMisses = 0;
+	m_nCacheEvictions = 0;
+	m_nCachePrefetched = 0;
+}
 
-	if (m_pView)
+int CLargeFile::PrefetchFilePosition(LargeInteger nVisit)
+{
+	ViewSlot slot;
 	{
-		if (nVisit.QuadPart >= m_nViewStart.QuadPart + m_dwPageSize &&
-			nVisit.QuadPart <= m_nViewStart.QuadPart + m_dwPageSize * 2)
+		std::lock_guard<std::mutex> lock(m_cacheLock);
+		if (!m_pBackend || nVisit.QuadPart >= m_nFileSize.QuadPart)
 		{
-            dwVisitOffset = (uint32_t)(nVisit.QuadPart - m_nViewStart.QuadPart);
-			dwAvalibleSize = m_dwPageSize * 3 - dwVisitOffset;
+			return FALSE;
 		}
-
-		if (nVisit.QuadPart >= m_nViewStart.QuadPart && // m_nViewStart.QuadPart means 0
-			nVisit.QuadPart < m_dwPageSize)
+		for (std::map<uint64_t, ViewList::iterator>::iterator it = m_mapViewByStart.upper_bound(nVisit.QuadPart);
+			it != m_mapViewByStart.begin();)
 		{
-            dwVisitOffset = (uint32_t)nVisit.QuadPart;
-			dwAvalibleSize = m_dwPageSize * 3 - dwVisitOffset;
+			--it;
+			if (it->first + (uint64_t)m_dwPageSize * m_dwPageCount <= nVisit.QuadPart)
+				break;
+			if (IsViewUsable(*it->second, nVisit.QuadPart))
+				return FALSE;
 		}
+		LayoutView(nVisit, slot);
+	}
+
+	// 映射和预读都在锁外进行，调用线程承担缺页，UI线程只在放入缓存时短暂持锁
+	slot.pView = OnMapViewOfFile(slot.nStart, slot.dwSize);
+	if (!slot.pView)
+	{
+		return FALSE;
+	}
+	m_pBackend->WarmView(slot.pView, slot.dwSize);
+
+	std::lock_guard<std::mutex> lock(m_cacheLock);
+	if (!m_pBackend || m_mapViewByStart.count(slot.nStart.QuadPart))
+	{
+		OnUnmapViewOfFile(slot.pView, slot.dwSize);
+		return FALSE;
+	}
+	TrimViewCache(slot.dwSize);
+	InsertView(slot);
+	m_nCachePrefetched++;
+	return TRUE;
+}
+
+void CLargeFile::AdviseWillNeed(LargeInteger nStart, uint64_t nLength)
+{
+	if (!m_pBackend || nStart.QuadPart >= m_nFileSize.QuadPart)
+	{
+		return;
+	}
+	if (nLength > m_nFileSize.QuadPart - nStart.QuadPart)
+	{
+		nLength = m_nFileSize.QuadPart - nStart.QuadPart;
+	}
+	m_pBackend->AdviseWillNeed(nStart.QuadPart, nLength);
+}
+
+CLargeFile::ViewSlot* CLargeFile::AcquireView(LargeInteger nVisit, int bMakeCurrent)
+{
+	if (!m_pBackend)
+	{
+		return NULL;
+	}
+	if (nVisit.QuadPart >= m_nFileSize.QuadPart)
+	{
+		return NULL;
+	}
+
+	ViewSlot* pSlot = FindView(nVisit.QuadPart);
+	if (pSlot)
+	{
+		m_nCacheHits++;
+	}
+	else
+	{
+		m_nCacheMisses++;
 
-		if (dwAvalibleSize)
+		ViewSlot slot;
+		LayoutView(nVisit, slot);
+		TrimViewCache(slot.dwSize);
+		slot.pView = OnMapViewOfFile(slot.nStart, slot.dwSize);
+		if (!slot.pView)
 		{
-			if (dwAvalibleSize > m_nFileSize.QuadPart - nVisit.QuadPart)
-			{
-                dwAvalibleSize = (uint32_t)(m_nFileSize.QuadPart - nVisit.QuadPart);
-			}
-			if (pdwAvalibleSize)
-			{
-				*pdwAvalibleSize = dwAvalibleSize;
-			}
-			return m_pView + dwVisitOffset;
+			return NULL;
 		}
+		pSlot = InsertView(slot);
 	}
 
-	if (m_pView)
+	if (bMakeCurrent)
 	{
-		OnUnmapViewOfFile();
+		m_pView = pSlot->pView;
+		m_nViewStart = pSlot->nStart;
+		m_dwMapSize = pSlot->dwSize;
 	}
+	return pSlot;
+}
 
+void CLargeFile::LayoutView(LargeInteger nVisit, ViewSlot& slot)
+{
+	// 新窗口的布局与原先单视图一致：访问点所在页的前一页起，共m_dwPageCount页
 	if (nVisit.QuadPart < m_dwPageSize)
 	{
-		m_nViewStart.QuadPart = 0;
+		slot.nStart.QuadPart = 0;
 	}
 	else
 	{
-		m_nViewStart.QuadPart = ALIGN_DOWN_BY(nVisit.QuadPart, m_dwPageSize) - m_dwPageSize;
+		slot.nStart.QuadPart = ALIGN_DOWN_BY(nVisit.QuadPart, m_dwPageSize) - m_dwPageSize;
 	}
+	slot.dwSize = m_dwPageSize * m_dwPageCount;
+	if (slot.nStart.QuadPart + slot.dwSize > m_nFileSize.QuadPart)
+	{
+		slot.dwSize = (uint32_t)(m_nFileSize.QuadPart - slot.nStart.QuadPart);
+	}
+	slot.pView = NULL;
+	slot.nPinCount = 0;
+}
+
+CLargeFile::ViewSlot* CLargeFile::InsertView(const ViewSlot& slot)
+{
+	m_lstViews.push_front(slot);
+	m_mapViewByStart[slot.nStart.QuadPart] = m_lstViews.begin();
+	m_mapViewByAddress[(uintptr_t)slot.pView] = m_lstViews.begin();
+	m_nMappedBytes += slot.dwSize;
+	return &m_lstViews.front();
+}
 
-	m_dwMapSize = m_dwPageSize * m_dwPageCount;
-	if (m_nViewStart.QuadPart + m_dwMapSize > m_nFileSize.QuadPart)
+CLargeFile::ViewSlot* CLargeFile::FindView(uint64_t nVisit)
+{
+	// 所有窗口大小相同，能覆盖nVisit的窗口起点一定落在(nVisit - 窗口大小, nVisit]内
+	uint64_t nWindowSize = (uint64_t)m_dwPageSize * m_dwPageCount;
+	std::map<uint64_t, ViewList::iterator>::iterator it = m_mapViewByStart.upper_bound(nVisit);
+	while (it != m_mapViewByStart.begin())
 	{
-        m_dwMapSize = (uint32_t)(m_nFileSize.QuadPart - m_nViewStart.QuadPart);
+		--it;
+		if (it->first + nWindowSize <= nVisit)
+		{
+			break;
+		}
+		if (IsViewUsable(*it->second, nVisit))
+		{
+			// 移到LRU表头
+			m_lstViews.splice(m_lstViews.begin(), m_lstViews, it->second);
+			return &m_lstViews.front();
+		}
 	}
+	return NULL;
+}
 
-	m_pView = OnMapViewOfFile(m_nViewStart, m_dwMapSize);
-	if (!m_pView)
+CLargeFile::ViewSlot* CLargeFile::FindViewByAddress(const void* pAddress)
+{
+	std::map<uintptr_t, ViewList::iterator>::iterator it = m_mapViewByAddress.upper_bound((uintptr_t)pAddress);
+	if (it == m_mapViewByAddress.begin())
 	{
 		return NULL;
 	}
-    dwVisitOffset = (uint32_t)(nVisit.QuadPart - m_nViewStart.QuadPart);
-	dwAvalibleSize = m_dwMapSize - dwVisitOffset;
-	if (pdwAvalibleSize)
+	--it;
+	ViewSlot& slot = *it->second;
+	if ((uintptr_t)pAddress >= (uintptr_t)slot.pView + slot.dwSize)
 	{
-		*pdwAvalibleSize = dwAvalibleSize;
+		return NULL;
 	}
-
-	return m_pView + dwVisitOffset;
+	return &slot;
 }
 
-void* CLargeFile::VisitFilePosition(uint32_t nVisitLow, uint32_t nVisitHigh /*= 0*/, uint32_t* pdwAvalibleSize /*= 0*/)
+int CLargeFile::IsViewUsable(const ViewSlot& slot, uint64_t nVisit)
 {
-	LargeInteger nVisit;
-	nVisit.LowPart = nVisitLow;
-	nVisit.HighPart = nVisitHigh;
-	return VisitFilePosition(nVisit, pdwAvalibleSize);
+	uint64_t nStart = slot.nStart.QuadPart;
+	uint64_t nEnd = nStart + slot.dwSize;
+	if (nVisit < nStart || nVisit >= nEnd)
+	{
+		return FALSE;
+	}
+	// 访问点前后都至少要留一页，除非视图已经贴住文件头或文件尾
+	if (nStart != 0 && nVisit - nStart < m_dwPageSize)
+	{
+		return FALSE;
+	}
+	if (nEnd != m_nFileSize.QuadPart && nEnd - nVisit < m_dwPageSize)
+	{
+		return FALSE;
+	}
+	return TRUE;
 }
 
-void* CLargeFile::GetMappingInfo(uint32_t& nFileOffsetLow, uint32_t& nFileOffsetHigh, uint32_t& dwAvalibleSize)
+void CLargeFile::TrimViewCache(uint64_t nIncoming)
 {
-	LargeInteger nFileOffset;
-	void* ptr = GetMappingInfo(nFileOffset, dwAvalibleSize);
-	nFileOffsetLow = nFileOffset.LowPart;
-	nFileOffsetHigh = nFileOffset.HighPart;
-	return ptr;
+	// 从表尾（最久未用）开始淘汰，跳过被固定的视图和当前视图
+	ViewList::iterator it = m_lstViews.end();
+	while (it != m_lstViews.begin() && m_nMappedBytes + nIncoming > m_nCacheBudget)
+	{
+		--it;
+		if (it->nPinCount || it->pView == m_pView)
+		{
+			continue;
+		}
+		ViewList::iterator itVictim = it++;
+		UnmapView(itVictim);
+		m_nCacheEvictions++;
+	}
 }
 
-void* CLargeFile::GetMappingInfo(LargeInteger& nFileOffset, uint32_t& dwAvalibleSize)
+void CLargeFile::UnmapView(ViewList::iterator it)
 {
-	nFileOffset = m_nViewStart;
-	dwAvalibleSize = m_dwMapSize;
-	return m_pView;
+	m_mapViewByStart.erase(it->nStart.QuadPart);
+	m_mapViewByAddress.erase((uintptr_t)it->pView);
+	m_nMappedBytes -= it->dwSize;
+	if (it->pView == m_pView)
+	{
+		m_pView = NULL;
+	}
+	OnUnmapViewOfFile(it->pView, it->dwSize);
+	m_lstViews.erase(it);
 }
 
-void CLargeFile::OnUnmapViewOfFile()
+void CLargeFile::UnmapAllViews()
 {
-#ifdef _WIN32
-	UnmapViewOfFile(m_pView);
-#else
-	munmap(m_pView, m_dwMapSize);
-#endif
-	m_pView = NULL;
+	while (!m_lstViews.empty())
+	{
+		UnmapView(m_lstViews.begin());
+	}
 }
 
-uint8_t* CLargeFile::OnMapViewOfFile(LargeInteger nViewStart, uint32_t dwMapSize)
+void* CLargeFile::VisitView(ViewSlot* pSlot, LargeInteger nVisit, uint32_t* pdwAvalibleSize)
 {
-#ifdef _WIN32
-	return (uint8_t*)MapViewOfFile((HANDLE)m_hMap, FILE_MAP_COPY, nViewStart.HighPart,
-		nViewStart.LowPart, dwMapSize);
-#else
-	// Linux平台的内存映射
-	uint64_t offset = nViewStart.QuadPart;
-	// 确保offset是页对齐的
-	size_t page_size = m_dwPageSize;
-	uint64_t aligned_offset = offset & ~(page_size - 1);
-	size_t offset_in_page = offset - aligned_offset;
-
-	// 使用PROT_READ|PROT_WRITE和MAP_PRIVATE实现写时复制功能，与Windows的FILE_MAP_COPY对应
-	void* addr = mmap(NULL, dwMapSize + offset_in_page, PROT_READ | PROT_WRITE, MAP_PRIVATE, m_hMap, aligned_offset);
-	if (addr == MAP_FAILED)
+	uint32_t dwVisitOffset = (uint32_t)(nVisit.QuadPart - pSlot->nStart.QuadPart);
+	if (pdwAvalibleSize)
 	{
-		return NULL;
+		*pdwAvalibleSize = pSlot->dwSize - dwVisitOffset;
 	}
-	// 返回调整后的指针，考虑页内偏移
-	return (uint8_t*)addr + offset_in_page;
-#endif
+	return pSlot->pView + dwVisitOffset;
+}
+
+void CLargeFile::OnUnmapViewOfFile(uint8_t* pView, uint32_t dwMapSize)
+{
+	m_pBackend->UnmapView(pView, dwMapSize);
+}
+
+uint8_t* CLargeFile::OnMapViewOfFile(LargeInteger nViewStart, uint32_t dwMapSize)
+{
+	return m_pBackend->MapView(nViewStart, dwMapSize);
 }
 
 void CLargeFile::init()
 {
-	m_hFile = INVALID_HANDLE_VALUE;
-	m_hMap = 0;
+	m_pBackend = NULL;
 	m_pView = NULL;
 
 	m_nFileSize.QuadPart = 0;
 	m_nViewStart.QuadPart = 0;
+	m_dwMapSize = 0;
 	m_szFilePathName[0] = 0;
+	m_nCacheHits = 0;
+	m_nCacheMisses = 0;
+	m_nCacheEvictions = 0;
+	m_nCachePrefetched = 0;
 }
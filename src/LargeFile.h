@@ -2,6 +2,9 @@
 #include <stdint.h>
 #include <limits.h>
 #include <stddef.h>
+#include <list>
+#include <map>
+#include <mutex>
 
 // 跨平台类型定义
 typedef uint32_t ErrorCode;
@@ -12,12 +15,12 @@ typedef uint32_t ErrorCode;
 #define TRUE 1
 #define FALSE 0
 
-// 跨平台的对齐宏
+// 跨平台的对齐宏（长度按64位计算，32位的alignment取反后不能截断高位）
 #define ALIGN_DOWN_BY(length, alignment) \
-    ((uintptr_t)(length) & ~(alignment - 1))
+    ((uint64_t)(length) & ~((uint64_t)(alignment) - 1))
 
 #define ALIGN_UP_BY(length, alignment) \
-    (ALIGN_DOWN_BY(((uintptr_t)(length) + alignment - 1), alignment))
+    (ALIGN_DOWN_BY(((uint64_t)(length) + alignment - 1), alignment))
 
 #define ALIGN_DOWN_POINTER_BY(address, alignment) \
     ((void*)((uintptr_t)(address) & ~((uintptr_t)alignment - 1)))
@@ -48,6 +51,36 @@ typedef struct {
     };
 } LargeInteger;
 
+// 文件偏移/大小统一使用64位，避免超过4GB的文件回绕
+typedef uint64_t FileOffset;
+
+// 存储后端类型
+enum BackendType
+{
+    BACKEND_AUTO = 0,   // 按路径和文件类型自动选择
+    BACKEND_MMAP,       // 内存映射，普通本地文件最快
+    BACKEND_PREAD,      // pread读入缓冲池，用于FUSE、/proc文件、管道等mmap不可用或很慢的场合
+    BACKEND_PROCESS,    // 读取另一个进程的地址空间（/proc/<pid>/mem或"pid:<pid>"）
+};
+
+
+class CFileBackend;
+
+// 默认视图缓存预算（字节）
+#define LARGEFILE_DEFAULT_CACHE_BUDGET (16 * 1024 * 1024)
+
+// 视图缓存统计信息，用于调整缓存预算
+typedef struct {
+    uint64_t nHits;         // 命中已映射视图的次数
+    uint64_t nMisses;       // 需要新建映射的次数
+    uint64_t nEvictions;    // 因超出预算被淘汰的视图数
+    uint64_t nPrefetched;   // 由PrefetchFilePosition提前映射的视图数
+    uint32_t nViews;        // 当前映射的视图数
+    uint32_t nPinnedViews;  // 当前被固定的视图数
+    uint64_t nMappedBytes;  // 当前映射的总字节数
+    uint64_t nBudget;       // 缓存预算
+} ViewCacheStats;
+
 class CLargeFile
 {
 public:
@@ -57,8 +90,9 @@ public:
 	/************************************************************************/
 	/* open file, return 1 if success; if 0, use GetLastError to get error code
 	/* error may occur at file opening or memory mapping
+	/* eBackend overrides the automatically chosen storage backend.
 	/************************************************************************/
-	int OpenFile(const char* pFilePathName, uint32_t nPageCount = 3);
+	int OpenFile(const char* pFilePathName, uint32_t nPageCount = 3, BackendType eBackend = BACKEND_AUTO);
 
 	/************************************************************************/
 	/* check if i have opened a file.
@@ -70,6 +104,11 @@ public:
 	/************************************************************************/
 	const char* GetFilePathName();
 
+	/************************************************************************/
+	/* get the storage backend of the opened file (NULL if not opened).
+	/************************************************************************/
+	CFileBackend* GetBackend();
+
 	/************************************************************************/
 	/* just close file, NOTHING saved.
 	/* if you want to save, call SaveFile() before CloseFile().
@@ -83,6 +122,12 @@ public:
 	uint32_t GetFileSizeHigh();
 	void GetFileSizeEx(LargeInteger* puFileSize);
 
+	/************************************************************************/
+	/* get mapping granularity and the size of one view window.
+	/************************************************************************/
+	uint32_t GetPageSize();
+	uint32_t GetViewSize();
+
 	/************************************************************************/
 	/* visit file position. return a pointer point to the data at the position.
 	/* dwAvalibleSize received the avalible size of the data that you can use, 
@@ -100,8 +145,42 @@ public:
 	void* GetMappingInfo(uint32_t& nFileOffsetLow, uint32_t& nFileOffsetHigh, uint32_t& dwAvalibleSize);
 	void* GetMappingInfo(LargeInteger& nFileOffset, uint32_t& dwAvalibleSize);
 
+	/************************************************************************/
+	/* visit file position and pin the view that holds it.
+	/* a pinned view is never evicted from the view cache, so the returned
+	/* pointer stays valid until UnpinView() is called with it.
+	/* pinning does not change the current view, so a pointer returned by
+	/* VisitFilePosition() stays valid as well.
+	/************************************************************************/
+	void* PinFilePosition(LargeInteger nVisit, uint32_t* pdwAvalibleSize = 0);
+	void UnpinView(const void* pAddress);
+
+	/************************************************************************/
+	/* view cache: several windows stay mapped at the same time and the
+	/* least recently used one is unmapped once the budget is exceeded.
+	/* pinned views and the current view do not count as evictable.
+	/************************************************************************/
+	void SetViewCacheBudget(uint64_t nBudget);
+	uint64_t GetViewCacheBudget();
+	void GetViewCacheStats(ViewCacheStats* pStats);
+	void ResetViewCacheStats();
+
+	/************************************************************************/
+	/* map the view that VisitFilePosition(nVisit) would use and fault its
+	/* pages in on the calling thread, then put it into the view cache.
+	/* meant for a background thread; return 1 if a new view was added.
+	/* the cache is guarded by a lock, so visiting/prefetching may run on
+	/* different threads, but OpenFile/CloseFile must not race with them.
+	/************************************************************************/
+	int PrefetchFilePosition(LargeInteger nVisit);
+
+	/************************************************************************/
+	/* ask the OS to start reading a range of the file in the background.
+	/************************************************************************/
+	void AdviseWillNeed(LargeInteger nStart, uint64_t nLength);
+
 protected:
-	virtual void OnUnmapViewOfFile();
+	virtual void OnUnmapViewOfFile(uint8_t* pView, uint32_t dwMapSize);
 	virtual uint8_t* OnMapViewOfFile(LargeInteger nViewStart, uint32_t dwMapSize);
 	LargeInteger m_nViewStart;
 	uint32_t m_dwMapSize;
@@ -109,10 +188,40 @@ protected:
 	uint32_t m_dwPageCount;
 	uint8_t* m_pView;
 private:
+	struct ViewSlot
+	{
+		LargeInteger nStart;
+		uint32_t dwSize;
+		uint8_t* pView;
+		uint32_t nPinCount;
+	};
+	typedef std::list<ViewSlot> ViewList;
+
 	void init();
+	ViewSlot* AcquireView(LargeInteger nVisit, int bMakeCurrent);
+	void LayoutView(LargeInteger nVisit, ViewSlot& slot);
+	ViewSlot* InsertView(const ViewSlot& slot);
+	ViewSlot* FindView(uint64_t nVisit);
+	ViewSlot* FindViewByAddress(const void* pAddress);
+	int IsViewUsable(const ViewSlot& slot, uint64_t nVisit);
+	void TrimViewCache(uint64_t nIncoming);
+	void UnmapView(ViewList::iterator it);
+	void UnmapAllViews();
+	void* VisitView(ViewSlot* pSlot, LargeInteger nVisit, uint32_t* pdwAvalibleSize);
+
+	ViewList m_lstViews;                            // 按最近使用排序，表头最新
+	std::map<uint64_t, ViewList::iterator> m_mapViewByStart;
+	std::map<uintptr_t, ViewList::iterator> m_mapViewByAddress;
+	uint64_t m_nMappedBytes;
+	uint64_t m_nCacheBudget;
+	uint64_t m_nCacheHits;
+	uint64_t m_nCacheMisses;
+	uint64_t m_nCacheEvictions;
+	uint64_t m_nCachePrefetched;
+	std::mutex m_cacheLock;
+
 	char m_szFilePathName[MAX_PATH];
-	int m_hFile;
-	int m_hMap;
+	CFileBackend* m_pBackend;
 
 	LargeInteger m_nFileSize;
 };
@@ -0,0 +1,118 @@
+#include "MaskMatcher.h"
+
+// CByteSet
+
+void CByteSet::AddRange(uint8_t nFirst, uint8_t nLast)
+{
+    for (int c = nFirst; c <= nLast; c++)
+        Add((uint8_t)c);
+}
+
+void CByteSet::AddMasked(uint8_t nValue, uint8_t nMask)
+{
+    for (int c = 0; c < 256; c++)
+    {
+        if ((c & nMask) == (nValue & nMask))
+            Add((uint8_t)c);
+    }
+}
+
+int CByteSet::Count() const
+{
+    int nCount = 0;
+    for (int c = 0; c < 256; c++)
+        nCount += Contains((uint8_t)c);
+    return nCount;
+}
+
+int CByteSet::IsSingle(uint8_t* pValue) const
+{
+    int nCount = 0;
+    for (int c = 0; c < 256 && nCount < 2; c++)
+    {
+        if (Contains((uint8_t)c))
+        {
+            *pValue = (uint8_t)c;
+            nCount++;
+        }
+    }
+    return nCount == 1;
+}
+
+// CMaskMatcher
+
+// 找出模式中最长的一段确定字节，返回它的位置
+static size_t ChooseAnchor(const std::vector<CByteSet>& vecPattern, std::vector<uint8_t>& vecAnchor)
+{
+    vecAnchor.clear();
+    size_t nBestOffset = 0;
+    size_t nRunStart = 0;
+    std::vector<uint8_t> vecRun;
+    for (size_t i = 0; i <= vecPattern.size(); i++)
+    {
+        uint8_t c;
+        if (i < vecPattern.size() && vecPattern[i].IsSingle(&c))
+        {
+            if (vecRun.empty())
+                nRunStart = i;
+            vecRun.push_back(c);
+            continue;
+        }
+        if (vecRun.size() > vecAnchor.size())
+        {
+            vecAnchor = vecRun;
+            nBestOffset = nRunStart;
+        }
+        vecRun.clear();
+    }
+    return nBestOffset;
+}
+
+CMaskMatcher::CMaskMatcher(const std::vector<CByteSet>& vecPattern)
+    : CFixedLengthMatcher(vecPattern.size()), m_vecPattern(vecPattern)
+    , m_nAnchorOffset(ChooseAnchor(vecPattern, m_vecAnchor))
+    , m_kernel(m_vecAnchor.empty() ? NULL : &m_vecAnchor[0], m_vecAnchor.size())
+{
+}
+
+int CMaskMatcher::Verify(const uint8_t* pData) const
+{
+    for (size_t i = 0; i < m_vecPattern.size(); i++)
+    {
+        if (!m_vecPattern[i].Contains(pData[i]))
+            return 0;
+    }
+    return 1;
+}
+
+const uint8_t* CMaskMatcher::FindFirst(const uint8_t* pData, size_t nLength) const
+{
+    size_t nPattern = m_vecPattern.size();
+    if (!nPattern || nLength < nPattern)
+        return NULL;
+    size_t nLastStart = nLength - nPattern;
+    if (m_vecAnchor.empty())
+    {
+        for (size_t i = 0; i <= nLastStart; i++)
+        {
+            if (Verify(pData + i))
+                return pData + i;
+        }
+        return NULL;
+    }
+
+    // 只在锚点出现的位置检查整个模式；锚点的范围限制在起点不超过nLastStart
+    const uint8_t* pFrom = pData + m_nAnchorOffset;
+    const uint8_t* pEnd = pData + nLastStart + m_nAnchorOffset + m_vecAnchor.size();
+    while (pFrom < pEnd)
+    {
+        const uint8_t* pAnchor = m_kernel.Find(pFrom, pEnd - pFrom);
+        if (!pAnchor)
+            return NULL;
+        const uint8_t* pStart = pAnchor - m_nAnchorOffset;
+        if (Verify(pStart))
+            return pStart;
+        pFrom = pAnchor + 1;
+    }
+    return NULL;
+}
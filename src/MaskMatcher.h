@@ -0,0 +1,56 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include "Search.h"
+#include "SearchKernel.h"
+
+/************************************************************************/
+/* the set of byte values one position of a masked pattern accepts.
+/************************************************************************/
+class CByteSet
+{
+public:
+    CByteSet() { Clear(); }
+    void Clear() { m_aBits[0] = m_aBits[1] = m_aBits[2] = m_aBits[3] = 0; }
+    void Add(uint8_t c) { m_aBits[c >> 6] |= (uint64_t)1 << (c & 63); }
+    void AddRange(uint8_t nFirst, uint8_t nLast);
+    // 所有满足(c & nMask) == nValue的字节，如"4?"为nValue=0x40, nMask=0xF0
+    void AddMasked(uint8_t nValue, uint8_t nMask);
+    int Contains(uint8_t c) const { return (int)(m_aBits[c >> 6] >> (c & 63)) & 1; }
+    int Count() const;
+    // 只有一个值时返回1并给出这个值
+    int IsSingle(uint8_t* pValue) const;
+private:
+    uint64_t m_aBits[4];
+};
+
+/************************************************************************/
+/* streaming matcher for hex patterns with wildcards: every position is a
+/* CByteSet ("??", "4?", "[00-1F|7F]"...).
+/* the longest run of single-valued positions is searched for with the
+/* vector CSearchKernel and the other positions are only checked at the
+/* candidates it returns, so a pattern like "4D 5A ?? ?? 50 45" runs at
+/* almost literal speed. a pattern without any single-valued position is
+/* checked at every offset.
+/************************************************************************/
+class CMaskMatcher : public CFixedLengthMatcher
+{
+public:
+    CMaskMatcher(const std::vector<CByteSet>& vecPattern);
+    CMatcher* Clone() const { return new CMaskMatcher(*this); }
+
+    /************************************************************************/
+    /* the literal run the search is anchored on, 0 length if there is none.
+    /************************************************************************/
+    size_t GetAnchorOffset() const { return m_nAnchorOffset; }
+    size_t GetAnchorLength() const { return m_vecAnchor.size(); }
+protected:
+    const uint8_t* FindFirst(const uint8_t* pData, size_t nLength) const;
+private:
+    int Verify(const uint8_t* pData) const;
+
+    std::vector<CByteSet> m_vecPattern;
+    std::vector<uint8_t> m_vecAnchor;   // 最长的一段确定字节
+    size_t m_nAnchorOffset;             // 它在模式中的位置
+    CSearchKernel m_kernel;             // 查找m_vecAnchor
+};
@@ -0,0 +1,421 @@
+#include "NgramIndex.h"
+#include "SaveEngine.h"
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+// 索引文件的格式
+static const char kMagic[8] = { 'F', 'H', 'N', 'G', 'R', 'A', 'M', '1' };
+static const uint32_t kVersion = 1;
+// 每块的位图2^17位（16KB），块256KB，索引约为文件的1/16
+static const uint32_t kHashBits = 17;
+static const uint32_t kBlockSize = 256 * 1024;
+// 起点在块后这么多字节内的4-gram也计入这个块，模式中这个位置之前的4-gram都可以用来过滤
+static const uint32_t kOverlap = 256;
+// 一段最多的块数（1GB数据），建立时一段的位图整个在内存中（64MB）
+static const uint32_t kMaxBlocksPerSegment = 4096;
+// 一个线程一次处理的块数，正好是每行的一个64位字
+static const uint32_t kBlocksPerGroup = 64;
+// 每个字面量最多使用的4-gram数，更多的几乎不再减少候选块，只增加读取
+static const size_t kMaxGramsPerLiteral = 16;
+// 建立索引时调用进度回调的间隔（毫秒）
+static const int kProgressMilliseconds = 100;
+
+static uint64_t NowNanoseconds()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static inline uint32_t HashGram(uint32_t nGram, uint32_t nHashBits)
+{
+    return (nGram * 0x9E3779B1u) >> (32 - nHashBits);
+}
+
+CNgramIndex::CNgramIndex()
+    : m_hIndex(INVALID_HANDLE_VALUE), m_nLastCandidates(0)
+{
+    memset(&m_header, 0, sizeof(m_header));
+}
+
+CNgramIndex::~CNgramIndex()
+{
+    Close();
+}
+
+std::string CNgramIndex::GetIndexPath(const char* pszFile)
+{
+    return std::string(pszFile) + ".fhidx";
+}
+
+uint64_t CNgramIndex::GetIndexBytes() const
+{
+    if (!IsOpen())
+        return 0;
+    uint64_t nSegments = (m_header.nBlocks + m_header.nBlocksPerSegment - 1) / m_header.nBlocksPerSegment;
+    return sizeof(Header) + (nSegments << m_header.nHashBits) * (m_header.nBlocksPerSegment / 8);
+}
+
+#ifdef _WIN32
+
+int CNgramIndex::Build(const char* pszFile, CLargeFile* pFile, uint32_t nThreads, const SearchProgress& progress)
+{
+    return FALSE;
+}
+
+int CNgramIndex::Open(const char* pszFile)
+{
+    return FALSE;
+}
+
+void CNgramIndex::Close()
+{
+}
+
+int CNgramIndex::ReadRow(uint64_t nSegment, uint32_t nHash, std::vector<uint64_t>& vecRow)
+{
+    return FALSE;
+}
+
+#else
+
+void CNgramIndex::Close()
+{
+    if (m_hIndex >= 0)
+        close(m_hIndex);
+    m_hIndex = INVALID_HANDLE_VALUE;
+    m_strFile.clear();
+    memset(&m_header, 0, sizeof(m_header));
+}
+
+// 把块nFirstBlock开始的nBlocks块的4-gram记入pBits，第i块是每个字的第i位
+static int IndexGroup(CLargeFile* pFile, FileOffset nFileSize, uint64_t nFirstBlock, uint32_t nBlocks,
+                      uint64_t* pBits, const std::atomic<bool>& bCancel, std::atomic<uint64_t>& nDone)
+{
+    memset(pBits, 0, sizeof(uint64_t) << kHashBits);
+    for (uint32_t i = 0; i < nBlocks && !bCancel; i++)
+    {
+        FileOffset nStart = (nFirstBlock + i) * kBlockSize;
+        FileOffset nEnd = nStart + kBlockSize + kOverlap + 3;
+        if (nEnd > nFileSize)
+            nEnd = nFileSize;
+        uint64_t nBit = (uint64_t)1 << i;
+        uint32_t nGram = 0;
+        uint32_t nLastGram = 0;
+        FileOffset nOffset = nStart;
+        while (nOffset < nEnd)
+        {
+            LargeInteger nVisit;
+            nVisit.QuadPart = nOffset;
+            uint32_t dwView = 0;
+            const uint8_t* pData = (const uint8_t*)pFile->PinFilePosition(nVisit, &dwView);
+            if (!pData || !dwView)
+                return FALSE;
+            size_t nLength = dwView < nEnd - nOffset ? dwView : (size_t)(nEnd - nOffset);
+            for (size_t j = 0; j < nLength; j++)
+            {
+                nGram = (nGram << 8) | pData[j];
+                // 连续相同的4-gram（全0的区域等）只记一次
+                if (nOffset + j >= nStart + 3 && (nGram != nLastGram || nOffset + j == nStart + 3))
+                {
+                    pBits[HashGram(nGram, kHashBits)] |= nBit;
+                    nLastGram = nGram;
+                }
+            }
+            pFile->UnpinView(pData);
+            nOffset += nLength;
+        }
+        nDone += nEnd - nStart;
+    }
+    return TRUE;
+}
+
+int CNgramIndex::Build(const char* pszFile, CLargeFile* pFile, uint32_t nThreads, const SearchProgress& progress)
+{
+    Close();
+    uint64_t nStartTime = NowNanoseconds();
+    struct stat st;
+    LargeInteger nSize;
+    pFile->GetFileSizeEx(&nSize);
+    if (stat(pszFile, &st) != 0)
+        return FALSE;
+    if ((uint64_t)st.st_size != nSize.QuadPart)
+    {
+        // 打开之后文件被别人改过了
+        errno = EINVAL;
+        return FALSE;
+    }
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.szMagic, kMagic, sizeof(kMagic));
+    header.nVersion = kVersion;
+    header.nHashBits = kHashBits;
+    header.nBlockSize = kBlockSize;
+    header.nOverlap = kOverlap;
+    header.nFileSize = nSize.QuadPart;
+    header.nMtimeSeconds = st.st_mtim.tv_sec;
+    header.nMtimeNanoseconds = st.st_mtim.tv_nsec;
+    header.nBlocks = (header.nFileSize + kBlockSize - 1) / kBlockSize;
+    // 小文件的段也小，索引不会比需要的大太多
+    uint64_t nBlocksPerSegment = ALIGN_UP_BY(header.nBlocks ? header.nBlocks : 1, kBlocksPerGroup);
+    header.nBlocksPerSegment = (uint32_t)(nBlocksPerSegment < kMaxBlocksPerSegment ? nBlocksPerSegment : kMaxBlocksPerSegment);
+
+    // 写到临时文件，完成后rename，中途取消不会留下不完整的索引
+    CTempFile temp;
+    if (!temp.Create(GetIndexPath(pszFile).c_str(), "."))
+        return FALSE;
+
+    if (!nThreads)
+        nThreads = std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 1;
+    uint32_t nWords = header.nBlocksPerSegment / kBlocksPerGroup;
+    size_t nRowBytes = header.nBlocksPerSegment / 8;
+    std::vector<uint64_t> vecSegment((size_t)nWords << kHashBits);
+    std::atomic<bool> bCancel(false);
+    std::atomic<bool> bFailed(false);
+    std::atomic<uint64_t> nDone(0);
+    int bResult = TRUE;
+    uint64_t nSegments = (header.nBlocks + header.nBlocksPerSegment - 1) / header.nBlocksPerSegment;
+    for (uint64_t nSegment = 0; nSegment < nSegments && bResult; nSegment++)
+    {
+        uint64_t nFirstBlock = nSegment * header.nBlocksPerSegment;
+        uint64_t nSegmentBlocks = header.nBlocks - nFirstBlock;
+        if (nSegmentBlocks > header.nBlocksPerSegment)
+            nSegmentBlocks = header.nBlocksPerSegment;
+        uint32_t nGroups = (uint32_t)((nSegmentBlocks + kBlocksPerGroup - 1) / kBlocksPerGroup);
+
+        // 每个线程轮流取一组块，在自己的1MB位图里做完再写入段中这组对应的字，扫描时线程之间不共享缓存行
+        memset(&vecSegment[0], 0, vecSegment.size() * sizeof(uint64_t));
+        std::atomic<uint32_t> nNextGroup(0);
+        uint32_t nRunning = 0;
+        std::mutex lockRunning;
+        std::condition_variable cvRunning;
+        std::vector<std::thread> vecThreads;
+        uint32_t nWorkers = nThreads < nGroups ? nThreads : nGroups;
+        nRunning = nWorkers;
+        for (uint32_t t = 0; t < nWorkers; t++)
+        {
+            vecThreads.push_back(std::thread([&]() {
+                std::vector<uint64_t> vecBits((size_t)1 << kHashBits);
+                uint32_t nGroup;
+                while (!bCancel && (nGroup = nNextGroup++) < nGroups)
+                {
+                    uint64_t nGroupFirst = nFirstBlock + (uint64_t)nGroup * kBlocksPerGroup;
+                    uint64_t nGroupBlocks = nFirstBlock + nSegmentBlocks - nGroupFirst;
+                    if (nGroupBlocks > kBlocksPerGroup)
+                        nGroupBlocks = kBlocksPerGroup;
+                    if (!IndexGroup(pFile, header.nFileSize, nGroupFirst, (uint32_t)nGroupBlocks, &vecBits[0], bCancel, nDone))
+                    {
+                        bFailed = true;
+                        bCancel = true;
+                        break;
+                    }
+                    for (size_t nHash = 0; nHash < vecBits.size(); nHash++)
+                        vecSegment[nHash * nWords + nGroup] = vecBits[nHash];
+                }
+                std::lock_guard<std::mutex> lock(lockRunning);
+                nRunning--;
+                cvRunning.notify_one();
+            }));
+        }
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(lockRunning);
+                if (cvRunning.wait_for(lock, std::chrono::milliseconds(kProgressMilliseconds), [&]() { return nRunning == 0; }))
+                    break;
+            }
+            if (progress && !bCancel && !progress(nDone, header.nFileSize))
+                bCancel = true;
+        }
+        for (size_t t = 0; t < vecThreads.size(); t++)
+            vecThreads[t].join();
+
+        if (bCancel)
+        {
+            errno = bFailed ? EIO : ECANCELED;
+            bResult = FALSE;
+            break;
+        }
+        // 段内按行存放：第h行是哈希值为h的位在这段每个块中的值
+        FileOffset nSegmentOffset = sizeof(Header) + ((FileOffset)nSegment << kHashBits) * nRowBytes;
+        bResult = temp.Write(nSegmentOffset, &vecSegment[0], vecSegment.size() * sizeof(uint64_t));
+    }
+
+    header.nBuildNanoseconds = NowNanoseconds() - nStartTime;
+    if (bResult)
+        bResult = temp.Write(0, &header, sizeof(header));
+    if (bResult)
+        bResult = temp.Commit();
+    if (!bResult)
+    {
+        temp.Discard();
+        return FALSE;
+    }
+    return Open(pszFile);
+}
+
+int CNgramIndex::Open(const char* pszFile)
+{
+    Close();
+    struct stat st;
+    if (stat(pszFile, &st) != 0)
+        return FALSE;
+    int hIndex = open(GetIndexPath(pszFile).c_str(), O_RDONLY);
+    if (hIndex < 0)
+        return FALSE;
+    Header header;
+    struct stat stIndex;
+    if (pread(hIndex, &header, sizeof(header), 0) != (ssize_t)sizeof(header) || fstat(hIndex, &stIndex) != 0
+        || memcmp(header.szMagic, kMagic, sizeof(kMagic)) != 0 || header.nVersion != kVersion
+        || header.nHashBits < 8 || header.nHashBits > 24 || !header.nBlockSize
+        || !header.nBlocksPerSegment || header.nBlocksPerSegment % kBlocksPerGroup)
+    {
+        close(hIndex);
+        return FALSE;
+    }
+    // 文件改过了，索引作废
+    if (header.nFileSize != (uint64_t)st.st_size || header.nMtimeSeconds != st.st_mtim.tv_sec
+        || header.nMtimeNanoseconds != st.st_mtim.tv_nsec)
+    {
+        close(hIndex);
+        return FALSE;
+    }
+    m_hIndex = hIndex;
+    m_header = header;
+    m_strFile = pszFile;
+    if ((uint64_t)stIndex.st_size < GetIndexBytes())
+    {
+        // 不完整的索引
+        Close();
+        return FALSE;
+    }
+    return TRUE;
+}
+
+int CNgramIndex::ReadRow(uint64_t nSegment, uint32_t nHash, std::vector<uint64_t>& vecRow)
+{
+    size_t nRowBytes = m_header.nBlocksPerSegment / 8;
+    vecRow.resize(m_header.nBlocksPerSegment / 64);
+    FileOffset nOffset = sizeof(Header) + (((FileOffset)nSegment << m_header.nHashBits) + nHash) * nRowBytes;
+    return pread(m_hIndex, &vecRow[0], nRowBytes, (off_t)nOffset) == (ssize_t)nRowBytes;
+}
+
+#endif // _WIN32
+
+int CNgramIndex::ReadGramRow(uint64_t nSegment, const uint8_t* pGram, int bIgnoreCase, std::vector<uint64_t>& vecRow)
+{
+    // 忽略大小写时每个字母两种形式，最多16种组合
+    uint32_t nLetters = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        uint8_t c = pGram[i] | 0x20;
+        if (bIgnoreCase && c >= 'a' && c <= 'z')
+            nLetters |= 1 << i;
+    }
+    vecRow.assign(m_header.nBlocksPerSegment / 64, 0);
+    for (uint32_t nCase = 0; nCase < 16; nCase++)
+    {
+        if (nCase & ~nLetters)
+            continue;
+        uint32_t nGram = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            uint8_t c = pGram[i];
+            if (nLetters & (1 << i))
+                c = (nCase & (1 << i)) ? (c & ~0x20) : (c | 0x20);
+            nGram = (nGram << 8) | c;
+        }
+        if (!ReadRow(nSegment, HashGram(nGram, m_header.nHashBits), m_vecRowBuffer))
+            return FALSE;
+        for (size_t w = 0; w < vecRow.size(); w++)
+            vecRow[w] |= m_vecRowBuffer[w];
+    }
+    return TRUE;
+}
+
+int CNgramIndex::Query(const std::vector<NgramLiteral>& vecLiterals, int bIgnoreCase, std::vector<SearchRange>& vecRanges)
+{
+    vecRanges.clear();
+    m_nLastCandidates = 0;
+    if (!IsOpen() || vecLiterals.empty())
+        return FALSE;
+    // 每个字面量可用的4-gram：起点不超过匹配起点之后nOverlap个字节
+    std::vector<std::vector<const uint8_t*> > vecGrams(vecLiterals.size());
+    for (size_t i = 0; i < vecLiterals.size(); i++)
+    {
+        const NgramLiteral& literal = vecLiterals[i];
+        for (size_t j = 0; j + 4 <= literal.vecBytes.size() && literal.nOffset + j <= m_header.nOverlap; j++)
+        {
+            if (vecGrams[i].size() == kMaxGramsPerLiteral)
+                break;
+            vecGrams[i].push_back(&literal.vecBytes[j]);
+        }
+        // 有一个字面量不能过滤，所有块都可能匹配
+        if (vecGrams[i].empty())
+            return FALSE;
+    }
+
+    // 候选块 = 各字面量的候选块的并集，字面量的候选块 = 它的各个4-gram所在块的交集
+    uint64_t nSegments = (m_header.nBlocks + m_header.nBlocksPerSegment - 1) / m_header.nBlocksPerSegment;
+    size_t nWords = m_header.nBlocksPerSegment / 64;
+    std::vector<uint64_t> vecCandidates, vecLiteral, vecRow;
+    for (uint64_t nSegment = 0; nSegment < nSegments; nSegment++)
+    {
+        vecCandidates.assign(nWords, 0);
+        for (size_t i = 0; i < vecGrams.size(); i++)
+        {
+            vecLiteral.assign(nWords, ~(uint64_t)0);
+            for (size_t j = 0; j < vecGrams[i].size(); j++)
+            {
+                if (!ReadGramRow(nSegment, vecGrams[i][j], bIgnoreCase, vecRow))
+                {
+                    vecRanges.clear();
+                    m_nLastCandidates = 0;
+                    return FALSE;
+                }
+                for (size_t w = 0; w < nWords; w++)
+                    vecLiteral[w] &= vecRow[w];
+            }
+            for (size_t w = 0; w < nWords; w++)
+                vecCandidates[w] |= vecLiteral[w];
+        }
+
+        for (size_t w = 0; w < nWords; w++)
+        {
+            for (uint64_t nBits = vecCandidates[w]; nBits; nBits &= nBits - 1)
+            {
+                int nBit = __builtin_ctzll(nBits);
+                uint64_t nBlock = nSegment * m_header.nBlocksPerSegment + w * 64 + nBit;
+                if (nBlock >= m_header.nBlocks)
+                    break;
+                FileOffset nStart = nBlock * m_header.nBlockSize;
+                FileOffset nEnd = nStart + m_header.nBlockSize;
+                if (nEnd > m_header.nFileSize)
+                    nEnd = m_header.nFileSize;
+                if (!vecRanges.empty() && vecRanges.back().nEnd == nStart)
+                    vecRanges.back().nEnd = nEnd;
+                else
+                {
+                    SearchRange range;
+                    range.nStart = nStart;
+                    range.nEnd = nEnd;
+                    vecRanges.push_back(range);
+                }
+                m_nLastCandidates++;
+            }
+        }
+    }
+    return TRUE;
+}
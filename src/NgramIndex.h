@@ -0,0 +1,97 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "Search.h"
+
+// 查找时必须出现的一段字节，nOffset是它在匹配中的位置
+typedef struct {
+    std::vector<uint8_t> vecBytes;
+    size_t nOffset;
+} NgramLiteral;
+
+/************************************************************************/
+/* optional on-disk index that tells which blocks of a big read-only file
+/* can contain a literal, so repeated searches skip most of the file.
+/* the file is cut into blocks; for every block the 4-byte substrings
+/* (4-grams) starting in it, or in the first bytes after it, are hashed
+/* into a bitmap. a literal can only occur in a block whose bitmap has
+/* the bits of all its 4-grams, so a query is a few AND/OR over bitmaps.
+/* the bitmaps are stored transposed per segment of blocks: one row of
+/* block bits per hash value, so a query reads one short row per 4-gram
+/* and segment instead of touching the whole index.
+/* the index lives next to the file as <file>.fhidx and is keyed by the
+/* size and modification time of the file; a stale index is ignored. it
+/* describes the file on disk, so it only applies while the buffer is
+/* unmodified.
+/************************************************************************/
+class CNgramIndex
+{
+public:
+    CNgramIndex();
+    ~CNgramIndex();
+
+    static std::string GetIndexPath(const char* pszFile);
+
+    /************************************************************************/
+    /* build the index of pFile (opened from pszFile) on nThreads threads
+    /* (0 = one per core) and write it next to the file. progress is called
+    /* on the calling thread and can cancel. return FALSE if cancelled or
+    /* the index cannot be written (errno tells why). on success the new
+    /* index is open.
+    /************************************************************************/
+    int Build(const char* pszFile, CLargeFile* pFile, uint32_t nThreads, const SearchProgress& progress = SearchProgress());
+
+    /************************************************************************/
+    /* open the index of pszFile, FALSE if there is none or it does not
+    /* match the file any more.
+    /************************************************************************/
+    int Open(const char* pszFile);
+    void Close();
+    int IsOpen() const { return m_hIndex >= 0; }
+    const std::string& GetFilePath() const { return m_strFile; }
+
+    /************************************************************************/
+    /* the ranges that may contain a match holding one of vecLiterals
+    /* (bIgnoreCase: ASCII letters in either case), merged and in order. a
+    /* match starting in a range may run past its end. return FALSE if no
+    /* literal is long enough to use the index: everything must be scanned.
+    /************************************************************************/
+    int Query(const std::vector<NgramLiteral>& vecLiterals, int bIgnoreCase, std::vector<SearchRange>& vecRanges);
+
+    /************************************************************************/
+    /* for reporting.
+    /************************************************************************/
+    uint64_t GetIndexBytes() const;
+    uint64_t GetBlockCount() const { return m_header.nBlocks; }
+    uint32_t GetBlockSize() const { return m_header.nBlockSize; }
+    double GetBuildSeconds() const { return m_header.nBuildNanoseconds / 1e9; }
+    uint64_t GetLastCandidateBlocks() const { return m_nLastCandidates; }
+
+private:
+    struct Header
+    {
+        char szMagic[8];
+        uint32_t nVersion;
+        uint32_t nHashBits;             // 每块的位图有2^nHashBits位
+        uint32_t nBlockSize;
+        uint32_t nOverlap;              // 块之后也计入这个块的4-gram起点数
+        uint32_t nBlocksPerSegment;     // 每段的块数，64的倍数
+        uint32_t nReserved;
+        uint64_t nFileSize;
+        int64_t nMtimeSeconds;
+        int64_t nMtimeNanoseconds;
+        uint64_t nBlocks;
+        uint64_t nBuildNanoseconds;
+    };
+
+    // 一个4-gram在段nSegment中的位图行，多个大小写形式时取或；返回FALSE表示读取失败
+    int ReadGramRow(uint64_t nSegment, const uint8_t* pGram, int bIgnoreCase, std::vector<uint64_t>& vecRow);
+    int ReadRow(uint64_t nSegment, uint32_t nHash, std::vector<uint64_t>& vecRow);
+
+    std::string m_strFile;
+    int m_hIndex;                       // 打开的索引文件
+    Header m_header;
+    uint64_t m_nLastCandidates;
+    std::vector<uint64_t> m_vecRowBuffer;
+};
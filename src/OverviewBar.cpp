@@ -0,0 +1,91 @@
+#include "OverviewBar.h"
+#include <FL/Fl.H>
+#include <FL/fl_draw.H>
+#include <algorithm>
+#include "HexTable.h"
+
+// 三列的颜色，t都在0~1之间
+// 熵：低为深蓝，中为红，高为黄，压缩/加密的数据很显眼
+static Fl_Color entropyColor(float t) {
+    int r = std::min(255, (int)(510 * t));
+    int g = t > 0.5f ? (int)(510 * (t - 0.5f)) : 0;
+    int b = t < 0.5f ? (int)(160 * (1 - 2 * t)) : 0;
+    return fl_rgb_color((uchar)r, (uchar)g, (uchar)std::min(255, b));
+}
+
+// 连续0：越多越黑
+static Fl_Color zeroColor(float t) {
+    return fl_rgb_color((uchar)(35 + 220 * (1 - t)));
+}
+
+// ASCII：越多越绿
+static Fl_Color asciiColor(float t) {
+    return fl_rgb_color((uchar)(60 * (1 - t)), (uchar)(60 + 195 * t), (uchar)(60 * (1 - t)));
+}
+
+OverviewBar::OverviewBar(int x, int y, int w, int h, HexTable* table)
+    : Fl_Widget(x, y, w, h), m_table(table), m_dirty(true) {
+    tooltip("概览：熵 | 连续0 | ASCII，点击跳转");
+}
+
+// 纵坐标对应的文件偏移
+FileOffset OverviewBar::offsetAt(int py) const {
+    FileOffset size = m_table->GetFileSize();
+    if (size == 0 || h() <= 0) return 0;
+    int row = std::max(0, std::min(py - y(), h() - 1));
+    return std::min((FileOffset)((double)row / h() * size), size - 1);
+}
+
+void OverviewBar::draw() {
+    fl_color(FL_GRAY);
+    fl_rectf(x(), y(), w(), h());
+    FileOffset size = m_table->GetFileSize();
+    if (size == 0 || h() <= 0) {
+        m_slices.clear();
+        return;
+    }
+
+    // 只有数据或统计进度变化时才重新组合，单纯滚动只重画位置框；代价只和像素数、片段数有关
+    CDataSummary* summary = m_table->GetSummary();
+    if (summary->Update(m_table->GetEditBuffer())) m_dirty = true;
+    size_t count = (size_t)std::min<FileOffset>(h(), size);
+    if (m_dirty || m_slices.size() != count) {
+        summary->Render(m_table->GetEditBuffer(), count, m_slices);
+        m_dirty = false;
+    }
+
+    int band = w() / 3;
+    for (int row = 0; row < h(); row++) {
+        const ByteSummary& s = m_slices[(size_t)row * count / h()];
+        if (s.fKnown <= 0) continue;    // 还没统计到的保持灰色
+        Fl_Color colors[3] = { entropyColor(s.fEntropy / 8), zeroColor(s.fZero), asciiColor(s.fAscii) };
+        for (int i = 0; i < 3; i++) {
+            // 部分统计过的按已知比例向灰色过渡
+            fl_color(s.fKnown < 1 ? fl_color_average(colors[i], FL_GRAY, s.fKnown) : colors[i]);
+            fl_rectf(x() + i * band, y() + row, i == 2 ? w() - 2 * band : band, 1);
+        }
+    }
+
+    // 框出表格当前可见的范围
+    FileOffset start, end;
+    if (m_table->GetVisibleRange(start, end)) {
+        int top = y() + (int)((double)start / size * h());
+        int bottom = y() + (int)((double)end / size * h());
+        fl_color(FL_RED);
+        fl_rect(x(), top, w(), std::max(bottom - top, 2));
+    }
+}
+
+int OverviewBar::handle(int event) {
+    switch (event) {
+        case FL_PUSH:
+        case FL_DRAG:
+            // 直接滚动到对应位置，不改变选择
+            if (m_table->GetFileSize()) m_table->ScrollToOffset(offsetAt(Fl::event_y()));
+            return 1;
+        case FL_RELEASE:
+            return 1;
+        default:
+            return Fl_Widget::handle(event);
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef OVERVIEWBAR_H
+#define OVERVIEWBAR_H
+
+#include <FL/Fl_Widget.H>
+#include <vector>
+#include "DataSummary.h"
+
+class HexTable;
+
+// 文件概览条：从上到下对应整个文件，三列分别显示熵、连续0和ASCII比例，
+// 框出当前可见的范围，点击或拖动时跳转到对应位置
+class OverviewBar : public Fl_Widget {
+private:
+    HexTable* m_table;
+    std::vector<ByteSummary> m_slices;  // 每个像素行一片，数据变化时才重新计算
+    bool m_dirty;                       // 数据或统计进度变化了，下次绘制时重新计算m_slices
+
+    // 纵坐标对应的文件偏移
+    FileOffset offsetAt(int y) const;
+
+public:
+    OverviewBar(int x, int y, int w, int h, HexTable* table);
+
+    // 数据或统计进度变化后调用
+    void DataChanged() { m_dirty = true; redraw(); }
+
+    void draw() override;
+    int handle(int event) override;
+};
+
+#endif // OVERVIEWBAR_H
@@ -0,0 +1,350 @@
+#include "ParallelSearch.h"
+#include <algorithm>
+#include <chrono>
+
+// 自动选择分块大小时的上下限，每个线程平均分到kChunksPerThread块以上
+static const FileOffset kMinChunkSize = 1024 * 1024;
+static const FileOffset kMaxChunkSize = 64 * 1024 * 1024;
+static const FileOffset kChunksPerThread = 8;
+// 匹配长度不定时，分块之间重叠的长度上限
+static const FileOffset kUnboundedOverlap = 64 * 1024;
+// 每次Scan最多收集的匹配数
+static const size_t kHitsPerScan = 256;
+// 扫描FILL片段时展开的缓冲区大小
+static const size_t kFillBufferSize = 64 * 1024;
+
+static uint64_t NowNanoseconds()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+CParallelSearcher::CParallelSearcher()
+    : m_pBuffer(NULL), m_pFile(NULL), m_nSize(0), m_nTotal(0), m_nOverlap(0), m_nChunkSize(0), m_nThreads(0)
+    , m_bCancel(false), m_nRunning(0), m_nNextDeliver(0), m_nDelivered(0)
+    , m_nSteals(0), m_nReadFailures(0), m_nBytesScanned(0), m_nStartTime(0), m_dSeconds(0)
+{
+}
+
+CParallelSearcher::~CParallelSearcher()
+{
+    Cancel();
+    Wait();
+}
+
+uint32_t CParallelSearcher::GetDefaultThreadCount()
+{
+    uint32_t nCores = std::thread::hardware_concurrency();
+    return nCores ? nCores : 1;
+}
+
+double CParallelSearcher::GetThroughput() const
+{
+    if (m_dSeconds <= 0)
+    {
+        return 0;
+    }
+    return m_nBytesScanned / m_dSeconds / (1024 * 1024);
+}
+
+int CParallelSearcher::Start(CEditBuffer* pBuffer, const CMatcher* pMatcher, uint32_t nThreads,
+                             const ParallelHitsCallback& onHits, const ParallelDoneCallback& onDone,
+                             const std::vector<SearchRange>* pRanges)
+{
+    if (IsRunning())
+    {
+        return FALSE;
+    }
+    m_pBuffer = pBuffer;
+    m_pFile = pBuffer->GetFile();
+    m_nSize = pBuffer->GetSize();
+    pBuffer->GetPieces(0, m_nSize, m_vecPieces);
+    m_vecPieceStart.resize(m_vecPieces.size());
+    FileOffset nPieceStart = 0;
+    for (size_t i = 0; i < m_vecPieces.size(); i++)
+    {
+        m_vecPieceStart[i] = nPieceStart;
+        nPieceStart += m_vecPieces[i].nLength;
+    }
+    m_nOverlap = pMatcher->GetMaxLength() ? pMatcher->GetMaxLength() - 1 : kUnboundedOverlap;
+
+    std::vector<SearchRange> vecRanges;
+    if (pRanges)
+    {
+        for (size_t i = 0; i < pRanges->size(); i++)
+        {
+            SearchRange range = (*pRanges)[i];
+            range.nEnd = std::min(range.nEnd, m_nSize);
+            if (range.nStart < range.nEnd)
+                vecRanges.push_back(range);
+        }
+    }
+    else if (m_nSize)
+    {
+        SearchRange range;
+        range.nStart = 0;
+        range.nEnd = m_nSize;
+        vecRanges.push_back(range);
+    }
+    m_nTotal = 0;
+    for (size_t i = 0; i < vecRanges.size(); i++)
+        m_nTotal += vecRanges[i].nEnd - vecRanges[i].nStart;
+
+    // 分块：线程数不超过块数
+    m_nThreads = nThreads ? nThreads : GetDefaultThreadCount();
+    FileOffset nChunkSize = m_nChunkSize;
+    if (!nChunkSize)
+    {
+        nChunkSize = m_nTotal / (m_nThreads * kChunksPerThread);
+        nChunkSize = std::max(kMinChunkSize, std::min(kMaxChunkSize, nChunkSize));
+    }
+    m_vecChunks.clear();
+    for (size_t i = 0; i < vecRanges.size(); i++)
+    {
+        for (FileOffset nStart = vecRanges[i].nStart; nStart < vecRanges[i].nEnd; nStart += nChunkSize)
+        {
+            Chunk chunk;
+            chunk.nStart = nStart;
+            chunk.nEnd = std::min(nStart + nChunkSize, vecRanges[i].nEnd);
+            chunk.bDone = FALSE;
+            chunk.bReadFailed = FALSE;
+            m_vecChunks.push_back(chunk);
+        }
+    }
+    if (m_nThreads > m_vecChunks.size())
+        m_nThreads = m_vecChunks.empty() ? 1 : (uint32_t)m_vecChunks.size();
+
+    m_vecStats.assign(m_vecChunks.size(), ChunkStats());
+    for (size_t i = 0; i < m_vecChunks.size(); i++)
+    {
+        m_vecStats[i].nStart = m_vecChunks[i].nStart;
+        m_vecStats[i].nLength = m_vecChunks[i].nEnd - m_vecChunks[i].nStart;
+    }
+
+    // 轮流发牌，各线程大致同步地从头扫到尾，按顺序合并时积压的结果少
+    for (uint32_t i = 0; i < m_nThreads; i++)
+    {
+        m_vecQueues.push_back(new WorkQueue);
+        m_vecMatchers.push_back(pMatcher->Clone());
+    }
+    for (size_t i = 0; i < m_vecChunks.size(); i++)
+    {
+        m_vecQueues[i % m_nThreads]->deqChunks.push_back(i);
+    }
+
+    m_onHits = onHits;
+    m_onDone = onDone;
+    m_bCancel = false;
+    m_nNextDeliver = 0;
+    m_nDelivered = 0;
+    m_nSteals = 0;
+    m_nReadFailures = 0;
+    m_nBytesScanned = 0;
+    m_dSeconds = 0;
+    m_nStartTime = NowNanoseconds();
+    m_nRunning = m_nThreads;
+    for (uint32_t i = 0; i < m_nThreads; i++)
+    {
+        m_vecThreads.push_back(std::thread(&CParallelSearcher::WorkerMain, this, i));
+    }
+    return TRUE;
+}
+
+void CParallelSearcher::Wait()
+{
+    for (size_t i = 0; i < m_vecThreads.size(); i++)
+    {
+        m_vecThreads[i].join();
+    }
+    m_vecThreads.clear();
+    for (size_t i = 0; i < m_vecMatchers.size(); i++)
+    {
+        delete m_vecMatchers[i];
+        delete m_vecQueues[i];
+    }
+    m_vecMatchers.clear();
+    m_vecQueues.clear();
+    m_vecChunks.clear();
+}
+
+int CParallelSearcher::TakeChunk(uint32_t nWorker, size_t* pnChunk, int* pbStolen)
+{
+    // 先从自己队列的头部取
+    {
+        WorkQueue* pQueue = m_vecQueues[nWorker];
+        std::lock_guard<std::mutex> lock(pQueue->lock);
+        if (!pQueue->deqChunks.empty())
+        {
+            *pnChunk = pQueue->deqChunks.front();
+            pQueue->deqChunks.pop_front();
+            *pbStolen = FALSE;
+            return TRUE;
+        }
+    }
+    // 再从别的线程队列的尾部偷，尾部离它们当前扫描的位置最远
+    for (uint32_t i = 1; i < m_nThreads; i++)
+    {
+        WorkQueue* pQueue = m_vecQueues[(nWorker + i) % m_nThreads];
+        std::lock_guard<std::mutex> lock(pQueue->lock);
+        if (!pQueue->deqChunks.empty())
+        {
+            *pnChunk = pQueue->deqChunks.back();
+            pQueue->deqChunks.pop_back();
+            *pbStolen = TRUE;
+            m_nSteals++;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+void CParallelSearcher::WorkerMain(uint32_t nWorker)
+{
+    CMatcher* pMatcher = m_vecMatchers[nWorker];
+    size_t nChunk;
+    int bStolen;
+    while (!m_bCancel && TakeChunk(nWorker, &nChunk, &bStolen))
+    {
+        uint64_t nStartTime = NowNanoseconds();
+        if (!ScanChunk(pMatcher, m_vecChunks[nChunk]))
+        {
+            break;
+        }
+        ChunkStats& stats = m_vecStats[nChunk];
+        stats.nWorker = nWorker;
+        stats.bStolen = bStolen;
+        stats.bReadFailed = m_vecChunks[nChunk].bReadFailed;
+        if (stats.bReadFailed)
+            m_nReadFailures++;
+        stats.nNanoseconds = NowNanoseconds() - nStartTime;
+        stats.nHits = m_vecChunks[nChunk].vecHits.size();
+        m_nBytesScanned += stats.nLength;
+        Finish(nChunk);
+    }
+
+    // 最后一个结束的线程通知调用者
+    if (--m_nRunning == 0)
+    {
+        m_dSeconds = (NowNanoseconds() - m_nStartTime) / 1e9;
+        int bCompleted;
+        {
+            std::lock_guard<std::mutex> lock(m_mergeLock);
+            bCompleted = !m_bCancel && m_nNextDeliver == m_vecChunks.size() && !m_nReadFailures;
+        }
+        if (m_onDone)
+        {
+            m_onDone(bCompleted);
+        }
+    }
+}
+
+int CParallelSearcher::Feed(CMatcher* pMatcher, const uint8_t* pData, size_t nLength, FileOffset nBase,
+                            Chunk& chunk, std::vector<SearchHit>& vecHits)
+{
+    size_t nPos = 0;
+    while (nPos < nLength)
+    {
+        vecHits.clear();
+        nPos += pMatcher->Scan(pData + nPos, nLength - nPos, nBase + nPos, vecHits, kHitsPerScan);
+        for (size_t i = 0; i < vecHits.size(); i++)
+        {
+            // 起点在重叠部分的匹配属于下一块
+            if (vecHits[i].nOffset < chunk.nEnd)
+                chunk.vecHits.push_back(vecHits[i]);
+        }
+    }
+    return !m_bCancel;
+}
+
+int CParallelSearcher::ScanChunk(CMatcher* pMatcher, Chunk& chunk)
+{
+    FileOffset nScanEnd = std::min(chunk.nEnd + m_nOverlap, m_nSize);
+    if (m_pFile && !m_pBuffer->IsModified())
+    {
+        LargeInteger nAdvise;
+        nAdvise.QuadPart = chunk.nStart;
+        m_pFile->AdviseWillNeed(nAdvise, nScanEnd - chunk.nStart);
+    }
+
+    pMatcher->Reset();
+    std::vector<SearchHit> vecHits;
+    std::vector<uint8_t> vecFill;
+    size_t nPiece = std::upper_bound(m_vecPieceStart.begin(), m_vecPieceStart.end(), chunk.nStart) - m_vecPieceStart.begin() - 1;
+    FileOffset nOffset = chunk.nStart;
+    while (nOffset < nScanEnd && nPiece < m_vecPieces.size())
+    {
+        const EditPiece& piece = m_vecPieces[nPiece];
+        FileOffset nInPiece = nOffset - m_vecPieceStart[nPiece];
+        FileOffset nLength = std::min(piece.nLength - nInPiece, nScanEnd - nOffset);
+        FileOffset nDone = 0;
+        if (piece.nSource == PIECE_FILL)
+        {
+            vecFill.assign((size_t)std::min((FileOffset)kFillBufferSize, nLength), piece.nFill);
+        }
+        while (nDone < nLength)
+        {
+            size_t nAvalible;
+            if (piece.nSource == PIECE_ORIGINAL)
+            {
+                // 固定住视图，其他线程换入视图时不会把它换出
+                LargeInteger nVisit;
+                nVisit.QuadPart = piece.nOffset + nInPiece + nDone;
+                uint32_t dwView = 0;
+                const uint8_t* pData = (const uint8_t*)m_pFile->PinFilePosition(nVisit, &dwView);
+                if (!pData || !dwView)
+                {
+                    // 读取失败，分块照常交付已找到的匹配，但记下失败，整个查找不算完成
+                    chunk.bReadFailed = TRUE;
+                    return TRUE;
+                }
+                nAvalible = (size_t)std::min((FileOffset)dwView, nLength - nDone);
+                int bContinue = Feed(pMatcher, pData, nAvalible, nOffset + nDone, chunk, vecHits);
+                m_pFile->UnpinView(pData);
+                if (!bContinue)
+                    return FALSE;
+            }
+            else if (piece.nSource == PIECE_ADDED)
+            {
+                nAvalible = (size_t)(nLength - nDone);
+                if (!Feed(pMatcher, m_pBuffer->GetAddedData(piece.nOffset + nInPiece + nDone), nAvalible,
+                          nOffset + nDone, chunk, vecHits))
+                    return FALSE;
+            }
+            else
+            {
+                nAvalible = (size_t)std::min((FileOffset)vecFill.size(), nLength - nDone);
+                if (!Feed(pMatcher, &vecFill[0], nAvalible, nOffset + nDone, chunk, vecHits))
+                    return FALSE;
+            }
+            nDone += nAvalible;
+        }
+        nOffset += nLength;
+        nPiece++;
+    }
+    vecHits.clear();
+    pMatcher->Flush(vecHits);
+    for (size_t i = 0; i < vecHits.size(); i++)
+    {
+        if (vecHits[i].nOffset < chunk.nEnd)
+            chunk.vecHits.push_back(vecHits[i]);
+    }
+    return TRUE;
+}
+
+void CParallelSearcher::Finish(size_t nChunk)
+{
+    std::lock_guard<std::mutex> lock(m_mergeLock);
+    m_vecChunks[nChunk].bDone = TRUE;
+    // 交付从m_nNextDeliver开始连续完成的分块
+    while (m_nNextDeliver < m_vecChunks.size() && m_vecChunks[m_nNextDeliver].bDone)
+    {
+        Chunk& chunk = m_vecChunks[m_nNextDeliver];
+        m_nDelivered += chunk.nEnd - chunk.nStart;
+        if (m_onHits)
+        {
+            m_onHits(chunk.vecHits, m_nDelivered, m_nTotal);
+        }
+        std::vector<SearchHit>().swap(chunk.vecHits);
+        m_nNextDeliver++;
+    }
+}
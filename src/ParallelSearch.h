@@ -0,0 +1,134 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include "Search.h"
+
+// 一个分块的扫描统计
+typedef struct {
+    FileOffset nStart;      // 分块起点（逻辑偏移）
+    FileOffset nLength;     // 分块长度，不含向后重叠扫描的部分
+    uint32_t nWorker;       // 扫描它的线程
+    uint32_t bStolen;       // 是否是从别的线程的队列里偷来的
+    uint32_t bReadFailed;   // 读取文件失败，分块后面的部分没有扫描
+    uint64_t nNanoseconds;  // 扫描耗时
+    uint64_t nHits;         // 起点在分块内的匹配数
+} ChunkStats;
+
+// 按偏移顺序交付的一批匹配，在工作线程上调用，但各次调用不会同时进行
+typedef std::function<void(const std::vector<SearchHit>& vecHits, FileOffset nDone, FileOffset nTotal)> ParallelHitsCallback;
+// 全部线程结束后调用一次（在最后结束的工作线程上），bCompleted为0表示被取消或有分块读取失败
+typedef std::function<void(int bCompleted)> ParallelDoneCallback;
+
+/************************************************************************/
+/* search-all on a pool of worker threads.
+/* the edited data is cut into chunks; every chunk is scanned with its own
+/* clone of the matcher, plus the longest match length - 1 bytes past its
+/* end, and keeps only the hits that start inside it. chunks are dealt
+/* round-robin to per-thread queues so all threads advance through the
+/* file together; a thread whose queue runs dry steals from the back of
+/* another's. finished chunks are merged in offset order and handed to
+/* the caller as soon as every chunk before them is done.
+/* workers read a GetPieces() snapshot: original data through pinned
+/* views of the shared CLargeFile, added data straight from the append
+/* buffer, so the caller must not edit the buffer until the search ends.
+/************************************************************************/
+class CParallelSearcher
+{
+public:
+    CParallelSearcher();
+    ~CParallelSearcher();
+
+    /************************************************************************/
+    /* start scanning the whole buffer on nThreads threads (0 = one per
+    /* core) and return immediately. return 0 if a search is running.
+    /* with pRanges (sorted, disjoint) only the hits starting inside them
+    /* are looked for and the progress counts only their bytes.
+    /************************************************************************/
+    int Start(CEditBuffer* pBuffer, const CMatcher* pMatcher, uint32_t nThreads,
+              const ParallelHitsCallback& onHits, const ParallelDoneCallback& onDone,
+              const std::vector<SearchRange>* pRanges = NULL);
+
+    /************************************************************************/
+    /* ask the workers to stop after their current view / wait for them.
+    /* Wait must be called before starting again (the destructor cancels
+    /* and waits).
+    /************************************************************************/
+    void Cancel() { m_bCancel = true; }
+    void Wait();
+    int IsRunning() const { return !m_vecThreads.empty(); }
+
+    /************************************************************************/
+    /* chunk size, 0 = choose from the data size and the thread count.
+    /************************************************************************/
+    void SetChunkSize(FileOffset nChunkSize) { m_nChunkSize = nChunkSize; }
+
+    static uint32_t GetDefaultThreadCount();
+
+    /************************************************************************/
+    /* statistics of the last search, valid after Wait().
+    /************************************************************************/
+    const std::vector<ChunkStats>& GetChunkStats() const { return m_vecStats; }
+    uint32_t GetThreadCount() const { return m_nThreads; }
+    uint64_t GetStealCount() const { return m_nSteals; }
+    uint64_t GetReadFailureCount() const { return m_nReadFailures; }
+    uint64_t GetBytesScanned() const { return m_nBytesScanned; }
+    double GetSeconds() const { return m_dSeconds; }
+    double GetThroughput() const; // MB/s
+
+private:
+    struct Chunk
+    {
+        FileOffset nStart;
+        FileOffset nEnd;
+        std::vector<SearchHit> vecHits;
+        int bDone;
+        int bReadFailed;
+    };
+    struct WorkQueue
+    {
+        std::mutex lock;
+        std::deque<size_t> deqChunks;
+    };
+
+    void WorkerMain(uint32_t nWorker);
+    int TakeChunk(uint32_t nWorker, size_t* pnChunk, int* pbStolen);
+    int ScanChunk(CMatcher* pMatcher, Chunk& chunk);
+    int Feed(CMatcher* pMatcher, const uint8_t* pData, size_t nLength, FileOffset nBase,
+             Chunk& chunk, std::vector<SearchHit>& vecHits);
+    void Finish(size_t nChunk);
+
+    CEditBuffer* m_pBuffer;
+    CLargeFile* m_pFile;
+    std::vector<EditPiece> m_vecPieces;     // 开始查找时的片段快照
+    std::vector<FileOffset> m_vecPieceStart; // 每个片段的逻辑起点
+    FileOffset m_nSize;
+    FileOffset m_nTotal;                    // 所有分块的长度之和
+    FileOffset m_nOverlap;
+    FileOffset m_nChunkSize;
+    uint32_t m_nThreads;
+
+    std::vector<CMatcher*> m_vecMatchers;   // 每个线程一个
+    std::vector<std::thread> m_vecThreads;
+    std::vector<WorkQueue*> m_vecQueues;
+    std::vector<Chunk> m_vecChunks;
+    std::vector<ChunkStats> m_vecStats;
+    std::atomic<bool> m_bCancel;
+    std::atomic<uint32_t> m_nRunning;
+
+    std::mutex m_mergeLock;                 // 保护下面的合并状态和结果交付
+    size_t m_nNextDeliver;                  // 下一个要交付的分块
+    FileOffset m_nDelivered;
+    ParallelHitsCallback m_onHits;
+    ParallelDoneCallback m_onDone;
+
+    std::atomic<uint64_t> m_nSteals;
+    std::atomic<uint64_t> m_nReadFailures;   // 读取失败的分块数
+    std::atomic<uint64_t> m_nBytesScanned;
+    uint64_t m_nStartTime;
+    double m_dSeconds;
+};
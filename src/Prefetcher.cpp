@@ -0,0 +1,180 @@
+#include "Prefetcher.h"
+#include <algorithm>
+#include <cmath>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+// 按当前速度预取多长时间内会看到的数据
+static const double kLookaheadSeconds = 0.5;
+// 预取区间上限，避免快速拖动时把缓存预算一次用光
+static const uint64_t kMaxLookaheadBytes = 8 * 1024 * 1024;
+// 两次滚动间隔超过这个时间认为是新的滚动手势，速度重新估计
+static const double kGestureGapSeconds = 0.3;
+
+CPrefetcher::CPrefetcher()
+    : m_pFile(NULL), m_bStop(false), m_nGeneration(0), m_nTargetStart(0), m_nTargetEnd(0),
+      m_nDirection(0), m_nLastStart(0), m_dVelocity(0),
+      m_nRequests(0), m_nViewsPrefetched(0), m_nBytesAdvised(0), m_nUiFaultFrames(0), m_nUiMajorFaults(0)
+{
+}
+
+CPrefetcher::~CPrefetcher()
+{
+    Detach();
+}
+
+void CPrefetcher::Attach(CLargeFile* pFile)
+{
+    Detach();
+    m_pFile = pFile;
+    m_bStop = false;
+    m_nLastStart = 0;
+    m_dVelocity = 0;
+    m_lastTime = std::chrono::steady_clock::now();
+    m_thread = std::thread(&CPrefetcher::ThreadProc, this);
+}
+
+void CPrefetcher::Detach()
+{
+    if (!m_thread.joinable())
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_bStop = true;
+    }
+    m_cond.notify_all();
+    m_thread.join();
+    m_pFile = NULL;
+}
+
+void CPrefetcher::OnScroll(FileOffset nVisibleStart, FileOffset nVisibleEnd)
+{
+    if (!m_pFile || nVisibleStart == m_nLastStart)
+    {
+        return;
+    }
+
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    double dt = std::chrono::duration<double>(now - m_lastTime).count();
+    double delta = (double)nVisibleStart - (double)m_nLastStart;
+    m_nLastStart = nVisibleStart;
+    m_lastTime = now;
+
+    double v = delta / std::max(dt, 0.001);
+    if (dt > kGestureGapSeconds || (v > 0) != (m_dVelocity > 0))
+    {
+        // 新手势或者换了方向，不沿用旧速度
+        m_dVelocity = v;
+    }
+    else
+    {
+        m_dVelocity = m_dVelocity * 0.5 + v * 0.5;
+    }
+
+    uint64_t nScreen = nVisibleEnd - nVisibleStart;
+    uint64_t nLookahead = (uint64_t)(std::fabs(m_dVelocity) * kLookaheadSeconds);
+    nLookahead = std::max(nLookahead, nScreen * 2);
+    nLookahead = std::min(nLookahead, kMaxLookaheadBytes);
+
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (m_dVelocity > 0)
+        {
+            m_nDirection = 1;
+            m_nTargetStart = nVisibleEnd;
+            m_nTargetEnd = nVisibleEnd + nLookahead;
+        }
+        else
+        {
+            m_nDirection = -1;
+            m_nTargetStart = nVisibleStart > nLookahead ? nVisibleStart - nLookahead : 0;
+            m_nTargetEnd = nVisibleStart;
+        }
+        m_nGeneration++;
+    }
+    m_nRequests++;
+    m_cond.notify_one();
+}
+
+void CPrefetcher::RecordUiFaults(uint64_t nMajorFaults)
+{
+    if (nMajorFaults)
+    {
+        m_nUiFaultFrames++;
+        m_nUiMajorFaults += nMajorFaults;
+    }
+}
+
+void CPrefetcher::GetStats(PrefetchStats* pStats)
+{
+    if (!pStats)
+        return;
+    pStats->nRequests = m_nRequests;
+    pStats->nViewsPrefetched = m_nViewsPrefetched;
+    pStats->nBytesAdvised = m_nBytesAdvised;
+    pStats->nUiFaultFrames = m_nUiFaultFrames;
+    pStats->nUiMajorFaults = m_nUiMajorFaults;
+    pStats->dVelocity = m_dVelocity;
+}
+
+uint64_t CPrefetcher::GetThreadMajorFaults()
+{
+#if !defined(_WIN32) && defined(RUSAGE_THREAD)
+    struct rusage usage;
+    if (getrusage(RUSAGE_THREAD, &usage) == 0)
+    {
+        return usage.ru_majflt;
+    }
+#endif
+    return 0;
+}
+
+void CPrefetcher::ThreadProc()
+{
+    uint64_t nDoneGeneration = 0;
+    for (;;)
+    {
+        FileOffset nStart, nEnd;
+        int nDirection;
+        uint64_t nGeneration;
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_cond.wait(lock, [&] { return m_bStop || m_nGeneration != nDoneGeneration; });
+            if (m_bStop)
+            {
+                return;
+            }
+            nStart = m_nTargetStart;
+            nEnd = m_nTargetEnd;
+            nDirection = m_nDirection;
+            nGeneration = nDoneGeneration = m_nGeneration;
+        }
+
+        LargeInteger nVisit;
+        nVisit.QuadPart = nStart;
+        m_pFile->AdviseWillNeed(nVisit, nEnd - nStart);
+        m_nBytesAdvised += nEnd - nStart;
+
+        // 每个窗口前后各留一页，相邻访问点间隔为窗口中间可用的部分
+        uint64_t nStep = m_pFile->GetViewSize() > 3 * (uint64_t)m_pFile->GetPageSize()
+            ? m_pFile->GetViewSize() - 2 * (uint64_t)m_pFile->GetPageSize()
+            : m_pFile->GetPageSize();
+        for (uint64_t i = 0; nStart + i < nEnd; i += nStep)
+        {
+            // 有更新的请求就放弃当前区间，离视口近的窗口已经先处理了
+            if (m_nGeneration != nGeneration || m_bStop)
+            {
+                break;
+            }
+            nVisit.QuadPart = nDirection > 0 ? nStart + i : nEnd - 1 - i;
+            if (m_pFile->PrefetchFilePosition(nVisit))
+            {
+                m_nViewsPrefetched++;
+            }
+        }
+    }
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <stdint.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include "LargeFile.h"
+
+// 预取统计信息
+typedef struct {
+    uint64_t nRequests;         // 收到的预取请求数
+    uint64_t nViewsPrefetched;  // 后台线程新映射的视图数
+    uint64_t nBytesAdvised;     // 通知系统预读的字节数
+    uint64_t nUiFaultFrames;    // UI线程绘制时仍然发生主缺页的帧数
+    uint64_t nUiMajorFaults;    // UI线程绘制时发生的主缺页总数
+    double dVelocity;           // 当前估计的滚动速度（字节/秒，负数表示向上）
+} PrefetchStats;
+
+/************************************************************************/
+/* background prefetcher for CLargeFile views.
+/* the UI thread reports the visible byte range after every scroll; the
+/* prefetcher estimates scroll velocity/direction from these reports and
+/* maps + faults in the windows that will be visited next on its own
+/* thread, so VisitFilePosition() on the UI thread becomes a cache hit.
+/************************************************************************/
+class CPrefetcher
+{
+public:
+    CPrefetcher();
+    ~CPrefetcher();
+
+    /************************************************************************/
+    /* start prefetching for an opened file. Detach() must be called
+    /* before the file is closed.
+    /************************************************************************/
+    void Attach(CLargeFile* pFile);
+    void Detach();
+
+    /************************************************************************/
+    /* called by the UI thread whenever the visible range changes.
+    /************************************************************************/
+    void OnScroll(FileOffset nVisibleStart, FileOffset nVisibleEnd);
+
+    /************************************************************************/
+    /* called by the UI thread with the number of major faults it took
+    /* while drawing one frame.
+    /************************************************************************/
+    void RecordUiFaults(uint64_t nMajorFaults);
+
+    void GetStats(PrefetchStats* pStats);
+
+    /************************************************************************/
+    /* major page faults taken so far by the calling thread (0 if the
+    /* platform cannot report it).
+    /************************************************************************/
+    static uint64_t GetThreadMajorFaults();
+
+private:
+    void ThreadProc();
+
+    CLargeFile* m_pFile;
+    std::thread m_thread;
+    std::mutex m_lock;
+    std::condition_variable m_cond;
+    std::atomic<bool> m_bStop;
+
+    // 待处理的预取区间，新请求直接覆盖旧请求
+    std::atomic<uint64_t> m_nGeneration;
+    FileOffset m_nTargetStart;
+    FileOffset m_nTargetEnd;
+    int m_nDirection;
+
+    // 滚动速度估计，只在UI线程访问
+    FileOffset m_nLastStart;
+    std::chrono::steady_clock::time_point m_lastTime;
+    double m_dVelocity;
+
+    std::atomic<uint64_t> m_nRequests;
+    std::atomic<uint64_t> m_nViewsPrefetched;
+    std::atomic<uint64_t> m_nBytesAdvised;
+    std::atomic<uint64_t> m_nUiFaultFrames;
+    std::atomic<uint64_t> m_nUiMajorFaults;
+};
@@ -0,0 +1,834 @@
+#include "RegexMatcher.h"
+#include <stdio.h>
+#include <string.h>
+
+enum {
+    INST_BYTE = 0,  // 读一个属于集合的字节
+    INST_SPLIT,     // 两个空转移
+    INST_MATCH,     // 匹配结束
+};
+
+// 语法树节点
+enum {
+    NODE_SET = 0,
+    NODE_CONCAT,
+    NODE_ALT,
+    NODE_REPEAT,
+};
+
+// 重复次数和NFA大小的上限，超出时当作无效的模式
+static const int kMaxRepeat = 1000;
+static const size_t kMaxInsts = 100000;
+// 重复次数没有上限
+static const int kInfinite = -1;
+
+// 每个DFA状态在缓存中的固定开销（估计值，包括std::map的节点）
+static const size_t kStateOverhead = sizeof(std::vector<int32_t>) * 2 + 64;
+
+/************************************************************************/
+/* parses a pattern into a syntax tree and emits the NFA of a
+/* CRegexMatcher from it.
+/************************************************************************/
+class CRegexCompiler
+{
+public:
+    CRegexCompiler(CRegexMatcher& matcher, int bIgnoreCase)
+        : m_matcher(matcher), m_pszPattern(NULL), m_p(NULL), m_nPattern(0), m_nPatterns(0), m_bIgnoreCase(bIgnoreCase)
+    {
+    }
+
+    int Compile(const std::vector<std::string>& vecPatterns)
+    {
+        if (vecPatterns.empty())
+        {
+            m_matcher.m_strError = "没有正则表达式";
+            return FALSE;
+        }
+        m_nPatterns = vecPatterns.size();
+        std::vector<int> vecRoots;
+        for (m_nPattern = 0; m_nPattern < m_nPatterns; m_nPattern++)
+        {
+            m_pszPattern = m_p = vecPatterns[m_nPattern].c_str();
+            int nRoot = ParseAlt();
+            if (nRoot < 0)
+                return FALSE;
+            if (*m_p)
+                return Fail(*m_p == ')' ? "多余的)" : "无法解析");
+            vecRoots.push_back(nRoot);
+        }
+
+        // 每个模式有自己的结束指令，入口依次分支到各个模式
+        int32_t nStart = -1;
+        int64_t nMaxLength = 0;
+        for (size_t i = vecRoots.size(); i > 0; i--)
+        {
+            int32_t nMatch = Emit(INST_MATCH, (uint32_t)(i - 1), -1, -1);
+            int32_t nEntry = EmitNode(vecRoots[i - 1], nMatch);
+            if (nEntry < 0)
+                return FALSE;
+            nStart = nStart < 0 ? nEntry : Emit(INST_SPLIT, 0, nEntry, nStart);
+            if (nStart < 0)
+                return FALSE;
+            int64_t nLength = MaxLength(vecRoots[i - 1]);
+            if (nLength < 0 || nMaxLength < 0)
+                nMaxLength = -1;
+            else if (nLength > nMaxLength)
+                nMaxLength = nLength;
+        }
+        m_matcher.m_nStart = nStart;
+        // 只能匹配空串的模式不会报告匹配，长度按1算
+        m_matcher.m_nMaxLength = nMaxLength < 0 ? 0 : nMaxLength == 0 ? 1 : (size_t)nMaxLength;
+        return TRUE;
+    }
+
+private:
+    struct Node
+    {
+        int nType;
+        uint32_t nSet;              // NODE_SET
+        int nMin;                   // NODE_REPEAT
+        int nMax;                   // NODE_REPEAT，kInfinite表示没有上限
+        std::vector<int> vecChildren;
+    };
+
+    int Fail(const char* pszMessage)
+    {
+        char szText[160];
+        if (m_nPatterns > 1)
+            snprintf(szText, sizeof(szText), "第%d个正则表达式第%d个字符: %s", (int)m_nPattern + 1, (int)(m_p - m_pszPattern) + 1, pszMessage);
+        else
+            snprintf(szText, sizeof(szText), "正则表达式第%d个字符: %s", (int)(m_p - m_pszPattern) + 1, pszMessage);
+        m_matcher.m_strError = szText;
+        return FALSE;
+    }
+
+    int AddNode(int nType)
+    {
+        Node node;
+        node.nType = nType;
+        node.nSet = 0;
+        node.nMin = 0;
+        node.nMax = 0;
+        m_vecNodes.push_back(node);
+        return (int)m_vecNodes.size() - 1;
+    }
+
+    static void FoldCase(CByteSet& set)
+    {
+        for (int c = 'a'; c <= 'z'; c++)
+        {
+            if (set.Contains((uint8_t)c) || set.Contains((uint8_t)(c - 0x20)))
+            {
+                set.Add((uint8_t)c);
+                set.Add((uint8_t)(c - 0x20));
+            }
+        }
+    }
+
+    int AddSetNode(CByteSet set)
+    {
+        if (m_bIgnoreCase)
+            FoldCase(set);
+        int nNode = AddNode(NODE_SET);
+        m_vecNodes[nNode].nSet = (uint32_t)m_matcher.m_vecSets.size();
+        m_matcher.m_vecSets.push_back(set);
+        return nNode;
+    }
+
+    // alt := concat ('|' concat)*
+    int ParseAlt()
+    {
+        int nFirst = ParseConcat();
+        if (nFirst < 0 || *m_p != '|')
+            return nFirst;
+        int nAlt = AddNode(NODE_ALT);
+        m_vecNodes[nAlt].vecChildren.push_back(nFirst);
+        while (*m_p == '|')
+        {
+            m_p++;
+            int nNext = ParseConcat();
+            if (nNext < 0)
+                return -1;
+            m_vecNodes[nAlt].vecChildren.push_back(nNext);
+        }
+        return nAlt;
+    }
+
+    // concat := repeat*
+    int ParseConcat()
+    {
+        int nConcat = AddNode(NODE_CONCAT);
+        while (*m_p && *m_p != '|' && *m_p != ')')
+        {
+            int nChild = ParseRepeat();
+            if (nChild < 0)
+                return -1;
+            m_vecNodes[nConcat].vecChildren.push_back(nChild);
+        }
+        return nConcat;
+    }
+
+    int ParseNumber(int* pnValue)
+    {
+        if (*m_p < '0' || *m_p > '9')
+            return Fail("应该是数字");
+        int nValue = 0;
+        while (*m_p >= '0' && *m_p <= '9')
+        {
+            nValue = nValue * 10 + (*m_p++ - '0');
+            if (nValue > kMaxRepeat)
+                return Fail("重复次数太大");
+        }
+        *pnValue = nValue;
+        return TRUE;
+    }
+
+    // repeat := atom ('*' | '+' | '?' | '{n}' | '{n,}' | '{n,m}')* 后面可以再跟一个'?'
+    int ParseRepeat()
+    {
+        int nAtom = ParseAtom();
+        while (nAtom >= 0 && (*m_p == '*' || *m_p == '+' || *m_p == '?' || *m_p == '{'))
+        {
+            int nMin, nMax;
+            if (*m_p == '{')
+            {
+                m_p++;
+                if (!ParseNumber(&nMin))
+                    return -1;
+                nMax = nMin;
+                if (*m_p == ',')
+                {
+                    m_p++;
+                    nMax = kInfinite;
+                    if (*m_p != '}' && !ParseNumber(&nMax))
+                        return -1;
+                }
+                if (*m_p != '}')
+                {
+                    Fail("缺少}");
+                    return -1;
+                }
+                if (nMax != kInfinite && nMax < nMin)
+                {
+                    Fail("重复次数的上限小于下限");
+                    return -1;
+                }
+            }
+            else
+            {
+                nMin = *m_p == '+' ? 1 : 0;
+                nMax = *m_p == '?' ? 1 : kInfinite;
+            }
+            m_p++;
+            // 非贪婪的写法：总是报告最短的匹配，所以和贪婪没有区别
+            if (*m_p == '?')
+                m_p++;
+            int nRepeat = AddNode(NODE_REPEAT);
+            m_vecNodes[nRepeat].nMin = nMin;
+            m_vecNodes[nRepeat].nMax = nMax;
+            m_vecNodes[nRepeat].vecChildren.push_back(nAtom);
+            nAtom = nRepeat;
+        }
+        return nAtom;
+    }
+
+    int ParseAtom()
+    {
+        CByteSet set;
+        switch (*m_p)
+        {
+        case '(':
+        {
+            m_p++;
+            if (m_p[0] == '?' && m_p[1] == ':')
+                m_p += 2;
+            int nGroup = ParseAlt();
+            if (nGroup < 0)
+                return -1;
+            if (*m_p != ')')
+            {
+                Fail("缺少)");
+                return -1;
+            }
+            m_p++;
+            return nGroup;
+        }
+        case '.':
+            m_p++;
+            set.AddRange(0x00, 0xFF);
+            return AddSetNode(set);
+        case '[':
+            return ParseClass();
+        case '\\':
+            m_p++;
+            if (!ParseEscape(set))
+                return -1;
+            return AddSetNode(set);
+        case '*':
+        case '+':
+        case '?':
+        case '{':
+            Fail("重复的前面没有内容");
+            return -1;
+        case '^':
+        case '$':
+            Fail("不支持^和$");
+            return -1;
+        default:
+            set.Add((uint8_t)*m_p++);
+            return AddSetNode(set);
+        }
+    }
+
+    static int HexDigit(char c)
+    {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    // m_p指向\后面的字符，把它表示的字节加入set
+    int ParseEscape(CByteSet& set)
+    {
+        char c = *m_p;
+        if (!c)
+            return Fail("\\后面缺少字符");
+        m_p++;
+        CByteSet named;
+        switch (c)
+        {
+        case 'x':
+        {
+            int nHigh = HexDigit(m_p[0]);
+            int nLow = nHigh < 0 ? -1 : HexDigit(m_p[1]);
+            if (nLow < 0)
+                return Fail("\\x后面应该是两位十六进制数");
+            m_p += 2;
+            set.Add((uint8_t)(nHigh << 4 | nLow));
+            return TRUE;
+        }
+        case 'n': set.Add('\n'); return TRUE;
+        case 'r': set.Add('\r'); return TRUE;
+        case 't': set.Add('\t'); return TRUE;
+        case 'f': set.Add('\f'); return TRUE;
+        case 'v': set.Add('\v'); return TRUE;
+        case '0': set.Add(0); return TRUE;
+        case 'd': case 'D':
+            named.AddRange('0', '9');
+            break;
+        case 'w': case 'W':
+            named.AddRange('0', '9');
+            named.AddRange('A', 'Z');
+            named.AddRange('a', 'z');
+            named.Add('_');
+            break;
+        case 's': case 'S':
+            named.Add(' ');
+            named.AddRange('\t', '\r');
+            break;
+        default:
+            // 字母和数字的转义保留给以后使用，其他字符表示它本身
+            if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))
+            {
+                m_p--;
+                return Fail("未知的转义");
+            }
+            set.Add((uint8_t)c);
+            return TRUE;
+        }
+        int bNegate = c >= 'A' && c <= 'Z';
+        for (int b = 0; b < 256; b++)
+        {
+            if (named.Contains((uint8_t)b) != bNegate)
+                set.Add((uint8_t)b);
+        }
+        return TRUE;
+    }
+
+    // [...]、[^...]，开头的]是普通字符
+    int ParseClass()
+    {
+        m_p++;
+        int bNegate = *m_p == '^';
+        if (bNegate)
+            m_p++;
+        CByteSet set;
+        int bFirst = TRUE;
+        while (bFirst || *m_p != ']')
+        {
+            bFirst = FALSE;
+            if (!*m_p)
+            {
+                Fail("缺少]");
+                return -1;
+            }
+            CByteSet item;
+            if (*m_p == '\\')
+            {
+                m_p++;
+                if (!ParseEscape(item))
+                    return -1;
+            }
+            else
+            {
+                item.Add((uint8_t)*m_p++);
+            }
+            uint8_t nFirst;
+            if (m_p[0] == '-' && m_p[1] && m_p[1] != ']' && item.IsSingle(&nFirst))
+            {
+                m_p++;
+                CByteSet last;
+                if (*m_p == '\\')
+                {
+                    m_p++;
+                    if (!ParseEscape(last))
+                        return -1;
+                }
+                else
+                {
+                    last.Add((uint8_t)*m_p++);
+                }
+                uint8_t nLast;
+                if (!last.IsSingle(&nLast) || nLast < nFirst)
+                {
+                    Fail("无效的范围");
+                    return -1;
+                }
+                item.AddRange(nFirst, nLast);
+            }
+            for (int b = 0; b < 256; b++)
+            {
+                if (item.Contains((uint8_t)b))
+                    set.Add((uint8_t)b);
+            }
+        }
+        m_p++;
+        // 先补全大小写再取反，[^a]忽略大小写时也不匹配A
+        if (m_bIgnoreCase)
+            FoldCase(set);
+        if (bNegate)
+        {
+            CByteSet negated;
+            for (int b = 0; b < 256; b++)
+            {
+                if (!set.Contains((uint8_t)b))
+                    negated.Add((uint8_t)b);
+            }
+            set = negated;
+        }
+        return AddSetNode(set);
+    }
+
+    int32_t Emit(uint8_t nOp, uint32_t nSet, int32_t nOut, int32_t nOut1)
+    {
+        if (m_matcher.m_vecInsts.size() >= kMaxInsts)
+        {
+            m_matcher.m_strError = "正则表达式太复杂";
+            return -1;
+        }
+        CRegexMatcher::Inst inst;
+        inst.nOp = nOp;
+        inst.nSet = nSet;
+        inst.nOut = nOut;
+        inst.nOut1 = nOut1;
+        m_matcher.m_vecInsts.push_back(inst);
+        return (int32_t)m_matcher.m_vecInsts.size() - 1;
+    }
+
+    // 从后向前生成：节点匹配完以后转到nNext，返回节点的入口
+    int32_t EmitNode(int nNode, int32_t nNext)
+    {
+        if (nNext < 0)
+            return -1;
+        const Node& node = m_vecNodes[nNode];
+        switch (node.nType)
+        {
+        case NODE_SET:
+            return Emit(INST_BYTE, node.nSet, nNext, -1);
+        case NODE_CONCAT:
+            for (size_t i = node.vecChildren.size(); i > 0; i--)
+                nNext = EmitNode(node.vecChildren[i - 1], nNext);
+            return nNext;
+        case NODE_ALT:
+        {
+            int32_t nEntry = EmitNode(node.vecChildren.back(), nNext);
+            for (size_t i = node.vecChildren.size() - 1; i > 0 && nEntry >= 0; i--)
+            {
+                int32_t nBranch = EmitNode(node.vecChildren[i - 1], nNext);
+                nEntry = nBranch < 0 ? -1 : Emit(INST_SPLIT, 0, nBranch, nEntry);
+            }
+            return nEntry;
+        }
+        case NODE_REPEAT:
+        {
+            int nChild = node.vecChildren[0];
+            int nMin = node.nMin;
+            int32_t nEntry;
+            if (node.nMax == kInfinite)
+            {
+                // x*：循环入口先分支到x或者结束，x结束后回到入口
+                int32_t nLoop = Emit(INST_SPLIT, 0, -1, nNext);
+                int32_t nBody = EmitNode(nChild, nLoop);
+                if (nLoop < 0 || nBody < 0)
+                    return -1;
+                m_matcher.m_vecInsts[nLoop].nOut = nBody;
+                nEntry = nLoop;
+            }
+            else
+            {
+                // x{0,k}展开成(x(x(...)?)?)?
+                nEntry = nNext;
+                for (int i = nMin; i < node.nMax && nEntry >= 0; i++)
+                {
+                    int32_t nBody = EmitNode(nChild, nEntry);
+                    nEntry = nBody < 0 ? -1 : Emit(INST_SPLIT, 0, nBody, nNext);
+                }
+            }
+            for (int i = 0; i < nMin; i++)
+                nEntry = EmitNode(nChild, nEntry);
+            return nEntry;
+        }
+        default:
+            return nNext;
+        }
+    }
+
+    // 最长匹配长度，-1表示没有上限
+    int64_t MaxLength(int nNode) const
+    {
+        const Node& node = m_vecNodes[nNode];
+        int64_t nLength = 0;
+        switch (node.nType)
+        {
+        case NODE_SET:
+            return 1;
+        case NODE_CONCAT:
+            for (size_t i = 0; i < node.vecChildren.size(); i++)
+            {
+                int64_t nChild = MaxLength(node.vecChildren[i]);
+                if (nChild < 0)
+                    return -1;
+                nLength += nChild;
+            }
+            return nLength;
+        case NODE_ALT:
+            for (size_t i = 0; i < node.vecChildren.size(); i++)
+            {
+                int64_t nChild = MaxLength(node.vecChildren[i]);
+                if (nChild < 0)
+                    return -1;
+                if (nChild > nLength)
+                    nLength = nChild;
+            }
+            return nLength;
+        case NODE_REPEAT:
+        {
+            int64_t nChild = MaxLength(node.vecChildren[0]);
+            if (node.nMax == 0 || nChild == 0)
+                return 0;
+            if (nChild < 0 || node.nMax == kInfinite)
+                return -1;
+            nLength = nChild * node.nMax;
+            return nLength > 0x40000000 ? -1 : nLength;
+        }
+        default:
+            return 0;
+        }
+    }
+
+    CRegexMatcher& m_matcher;
+    const char* m_pszPattern;     // 正在解析的模式
+    const char* m_p;
+    size_t m_nPattern;            // 它的序号
+    size_t m_nPatterns;
+    int m_bIgnoreCase;
+    std::vector<Node> m_vecNodes;
+};
+
+// CRegexMatcher
+
+CRegexMatcher::CRegexMatcher(size_t nCacheSize)
+    : m_nStart(-1), m_nClasses(1), m_nMaxLength(0), m_nCacheSize(nCacheSize), m_nCacheBytes(0), m_nCacheFlushes(0)
+    , m_nMark(0), m_nState(0), m_bImplicitStart(TRUE), m_nImplicitStart(0), m_bBasePending(TRUE)
+{
+    memset(m_aClass, 0, sizeof(m_aClass));
+    memset(m_aRepresentative, 0, sizeof(m_aRepresentative));
+}
+
+int CRegexMatcher::Compile(const char* pszPattern, int bIgnoreCase)
+{
+    return Compile(std::vector<std::string>(1, pszPattern), bIgnoreCase);
+}
+
+int CRegexMatcher::Compile(const std::vector<std::string>& vecPatterns, int bIgnoreCase)
+{
+    m_vecInsts.clear();
+    m_vecSets.clear();
+    m_nStart = -1;
+    m_nMaxLength = 0;
+    m_strError.clear();
+    m_vecStates.clear();
+    m_mapStates.clear();
+    m_vecTable.clear();
+    m_vecMapPool.clear();
+    m_nCacheBytes = 0;
+    m_nCacheFlushes = 0;
+
+    CRegexCompiler compiler(*this, bIgnoreCase);
+    if (!compiler.Compile(vecPatterns))
+    {
+        m_vecInsts.clear();
+        m_nStart = -1;
+        return FALSE;
+    }
+
+    // 等价类：逐个集合细分，同一类中的字节对每个集合的归属都相同
+    memset(m_aClass, 0, sizeof(m_aClass));
+    m_nClasses = 1;
+    for (size_t s = 0; s < m_vecSets.size() && m_nClasses < 256; s++)
+    {
+        int aSplit[512];
+        for (int i = 0; i < 512; i++)
+            aSplit[i] = -1;
+        uint32_t nClasses = 0;
+        for (int c = 0; c < 256; c++)
+        {
+            int nKey = m_aClass[c] * 2 + m_vecSets[s].Contains((uint8_t)c);
+            if (aSplit[nKey] < 0)
+                aSplit[nKey] = nClasses++;
+            m_aClass[c] = (uint8_t)aSplit[nKey];
+        }
+        m_nClasses = nClasses;
+    }
+    for (int c = 255; c >= 0; c--)
+        m_aRepresentative[m_aClass[c]] = (uint8_t)c;
+
+    m_vecMark.assign(m_vecInsts.size(), 0);
+    m_nMark = 0;
+    int32_t nState = 0;
+    FlushCache(nState);
+    m_nCacheFlushes = 0;
+    Reset();
+    return TRUE;
+}
+
+void CRegexMatcher::Reset()
+{
+    m_nState = 0;
+    m_bImplicitStart = TRUE;
+    m_bBasePending = TRUE;
+}
+
+void CRegexMatcher::AddThread(int32_t nInst, int32_t nOrigin)
+{
+    // 按深度优先的顺序展开空转移，用栈代替递归，长的分支链不会用尽栈空间
+    m_vecStack.clear();
+    m_vecStack.push_back(nInst);
+    while (!m_vecStack.empty())
+    {
+        int32_t n = m_vecStack.back();
+        m_vecStack.pop_back();
+        if (m_vecMark[n] == m_nMark)
+            continue;
+        m_vecMark[n] = m_nMark;
+        const Inst& inst = m_vecInsts[n];
+        switch (inst.nOp)
+        {
+        case INST_SPLIT:
+            m_vecStack.push_back(inst.nOut1);
+            m_vecStack.push_back(inst.nOut);
+            break;
+        case INST_MATCH:
+            // 新起点上的匹配是空匹配，不报告
+            if (nOrigin < 0)
+                break;
+            m_vecStep.push_back(n);
+            m_vecStepMap.push_back(nOrigin);
+            break;
+        default:
+            m_vecStep.push_back(n);
+            m_vecStepMap.push_back(nOrigin);
+            break;
+        }
+    }
+}
+
+int32_t CRegexMatcher::FindOrAddState(const std::vector<int32_t>& vecThreads)
+{
+    std::map<std::vector<int32_t>, int32_t>::const_iterator it = m_mapStates.find(vecThreads);
+    if (it != m_mapStates.end())
+        return it->second;
+
+    DfaState state;
+    state.vecThreads = vecThreads;
+    state.nMatch = -1;
+    state.nMatchPattern = 0;
+    for (size_t i = 0; i < vecThreads.size(); i++)
+    {
+        if (m_vecInsts[vecThreads[i]].nOp == INST_MATCH)
+        {
+            state.nMatch = (int32_t)i;
+            state.nMatchPattern = m_vecInsts[vecThreads[i]].nSet;
+            break;
+        }
+    }
+    int32_t nState = (int32_t)m_vecStates.size();
+    m_vecStates.push_back(state);
+    m_mapStates[vecThreads] = nState;
+    Transition unknown;
+    unknown.nNext = -1;
+    unknown.nMap = -1;
+    m_vecTable.resize(m_vecStates.size() * m_nClasses, unknown);
+    // 线程列表存了两份（状态里和std::map的键），再加上转移表的一行
+    m_nCacheBytes += kStateOverhead + vecThreads.size() * sizeof(int32_t) * 2 + m_nClasses * sizeof(int32_t) * 2;
+    return nState;
+}
+
+void CRegexMatcher::FlushCache(int32_t& nState)
+{
+    std::vector<int32_t> vecCurrent;
+    if (nState > 0)
+        vecCurrent = m_vecStates[nState].vecThreads;
+    m_vecStates.clear();
+    m_mapStates.clear();
+    m_vecTable.clear();
+    m_vecMapPool.clear();
+    m_nCacheBytes = 0;
+    m_nCacheFlushes++;
+
+    // 初始状态：所有新起点
+    m_nMark++;
+    m_vecStep.clear();
+    m_vecStepMap.clear();
+    AddThread(m_nStart, -1);
+    FindOrAddState(m_vecStep);
+    // 当前状态的线程顺序不变，m_vecStarts仍然有效
+    nState = vecCurrent.empty() ? 0 : FindOrAddState(vecCurrent);
+}
+
+int32_t CRegexMatcher::AddTransition(int32_t& nState, uint32_t nClass)
+{
+    // 每个线程读入这个类的字节后到达的状态，按线程顺序（即起点顺序）排列，最后是新起点
+    uint8_t c = m_aRepresentative[nClass];
+    m_nMark++;
+    m_vecStep.clear();
+    m_vecStepMap.clear();
+    const std::vector<int32_t>& vecThreads = m_vecStates[nState].vecThreads;
+    for (size_t i = 0; i < vecThreads.size(); i++)
+    {
+        const Inst& inst = m_vecInsts[vecThreads[i]];
+        if (inst.nOp == INST_BYTE && m_vecSets[inst.nSet].Contains(c))
+            AddThread(inst.nOut, (int32_t)i);
+    }
+    AddThread(m_nStart, -1);
+
+    int bAllFresh = TRUE;
+    for (size_t i = 0; i < m_vecStepMap.size(); i++)
+    {
+        if (m_vecStepMap[i] >= 0)
+        {
+            bAllFresh = FALSE;
+            break;
+        }
+    }
+
+    // 缓存满了就整个清空，重新从当前状态开始
+    if (m_nCacheBytes >= m_nCacheSize)
+    {
+        std::vector<int32_t> vecStep, vecStepMap;
+        vecStep.swap(m_vecStep);
+        vecStepMap.swap(m_vecStepMap);
+        FlushCache(nState);
+        m_vecStep.swap(vecStep);
+        m_vecStepMap.swap(vecStepMap);
+    }
+
+    int32_t nNext = FindOrAddState(m_vecStep);
+    Transition& entry = m_vecTable[(size_t)nState * m_nClasses + nClass];
+    entry.nNext = nNext;
+    if (!bAllFresh)
+    {
+        entry.nMap = (int32_t)m_vecMapPool.size();
+        m_vecMapPool.insert(m_vecMapPool.end(), m_vecStepMap.begin(), m_vecStepMap.end());
+        m_nCacheBytes += m_vecStepMap.size() * sizeof(int32_t);
+    }
+    return nNext;
+}
+
+size_t CRegexMatcher::Scan(const uint8_t* pData, size_t nLength, FileOffset nBase,
+                           std::vector<SearchHit>& vecHits, size_t nMaxHits)
+{
+    if (m_nStart < 0)
+    {
+        return nLength;
+    }
+    if (m_bBasePending)
+    {
+        m_bBasePending = FALSE;
+        m_bImplicitStart = TRUE;
+        m_nImplicitStart = nBase;
+    }
+    // 热循环里用局部变量，结束时写回
+    size_t nHits = 0;
+    size_t nConsumed = nLength;
+    int32_t nState = m_nState;
+    int bImplicitStart = m_bImplicitStart;
+    FileOffset nImplicitStart = m_nImplicitStart;
+    const Transition* pTable = &m_vecTable[0];
+    uint32_t nClasses = m_nClasses;
+    for (size_t i = 0; i < nLength; i++)
+    {
+        uint32_t nClass = m_aClass[pData[i]];
+        const Transition* pEntry = pTable + (size_t)nState * nClasses + nClass;
+        if (pEntry->nNext < 0)
+        {
+            AddTransition(nState, nClass);
+            pTable = &m_vecTable[0];
+            pEntry = pTable + (size_t)nState * nClasses + nClass;
+        }
+        nState = pEntry->nNext;
+        if (pEntry->nMap < 0)
+        {
+            // 只剩新起点（大部分字节都是这种情况），不用逐个复制起点
+            bImplicitStart = TRUE;
+            nImplicitStart = nBase + i + 1;
+            continue;
+        }
+
+        FileOffset nPos = nBase + i + 1;
+        const int32_t* pMap = &m_vecMapPool[pEntry->nMap];
+        const DfaState& state = m_vecStates[nState];
+        size_t nThreads = state.vecThreads.size();
+        m_vecNewStarts.resize(nThreads);
+        for (size_t t = 0; t < nThreads; t++)
+        {
+            int32_t nOrigin = pMap[t];
+            m_vecNewStarts[t] = nOrigin < 0 ? nPos : bImplicitStart ? nImplicitStart : m_vecStarts[nOrigin];
+        }
+        m_vecStarts.swap(m_vecNewStarts);
+        bImplicitStart = FALSE;
+
+        if (state.nMatch >= 0)
+        {
+            SearchHit hit;
+            hit.nOffset = m_vecStarts[state.nMatch];
+            hit.nLength = nPos - hit.nOffset;
+            hit.nPattern = state.nMatchPattern;
+            vecHits.push_back(hit);
+            // 匹配不重叠，从匹配结束处重新开始
+            nState = 0;
+            bImplicitStart = TRUE;
+            nImplicitStart = nPos;
+            if (++nHits >= nMaxHits)
+            {
+                nConsumed = i + 1;
+                break;
+            }
+        }
+    }
+    m_nState = nState;
+    m_bImplicitStart = bImplicitStart;
+    m_nImplicitStart = nImplicitStart;
+    return nConsumed;
+}
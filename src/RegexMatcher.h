@@ -0,0 +1,128 @@
+#pragma once
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "Search.h"
+#include "MaskMatcher.h"
+
+/************************************************************************/
+/* streaming regular expression matcher over bytes.
+/* the pattern is compiled into a Thompson NFA and the DFA is built
+/* lazily while scanning: a DFA state is the ordered list of NFA states
+/* alive at a position, and the transition for a byte class is computed
+/* the first time that class is seen in that state. the DFA states live
+/* in a cache of bounded size; when it is full it is thrown away and
+/* rebuilt from the current state, so memory stays bounded and a byte
+/* costs at most one NFA step: time is linear in the input, there is no
+/* backtracking whatever the pattern and the data.
+/* the start of a match is carried as one offset per NFA state. the
+/* states are kept in order of their start, so when two paths reach the
+/* same NFA state the one with the leftmost start is kept.
+/* a match is reported as soon as it ends (the shortest match, with the
+/* leftmost start among the matches ending there) and scanning restarts
+/* after it, so matches do not overlap; empty matches are not reported.
+/* several patterns can be compiled into one automaton and found in one
+/* pass, SearchHit::nPattern tells which one matched.
+/*
+/* syntax: bytes stand for themselves; \xHH, \n \r \t \f \v \0;
+/* \d \w \s \D \W \S; '.' is any byte; [...] and [^...] with ranges;
+/* ( ), (?: ); |; * + ? {n} {n,} {n,m} (a trailing '?' is accepted and
+/* makes no difference, every match is the shortest).
+/************************************************************************/
+class CRegexMatcher : public CMatcher
+{
+public:
+    CRegexMatcher(size_t nCacheSize = 2 * 1024 * 1024);
+
+    /************************************************************************/
+    /* compile pszPattern (or all of vecPatterns), return FALSE and set
+    /* GetError() if it is not valid. with bIgnoreCase letters match both
+    /* cases.
+    /************************************************************************/
+    int Compile(const char* pszPattern, int bIgnoreCase = FALSE);
+    int Compile(const std::vector<std::string>& vecPatterns, int bIgnoreCase = FALSE);
+    const std::string& GetError() const { return m_strError; }
+
+    void Reset();
+    size_t Scan(const uint8_t* pData, size_t nLength, FileOffset nBase,
+                std::vector<SearchHit>& vecHits, size_t nMaxHits);
+    size_t GetMaxLength() const { return m_nMaxLength; }
+    CMatcher* Clone() const { return new CRegexMatcher(*this); }
+
+    /************************************************************************/
+    /* size of the automaton, for reporting.
+    /************************************************************************/
+    size_t GetNfaStateCount() const { return m_vecInsts.size(); }
+    size_t GetClassCount() const { return m_nClasses; }
+    size_t GetDfaStateCount() const { return m_vecStates.size(); }
+    size_t GetCacheBytes() const { return m_nCacheBytes; }
+    uint64_t GetCacheFlushes() const { return m_nCacheFlushes; }
+
+private:
+    // NFA指令
+    struct Inst
+    {
+        uint8_t nOp;       // INST_BYTE/INST_SPLIT/INST_MATCH
+        uint32_t nSet;     // INST_BYTE接受的字节集合在m_vecSets中的序号，INST_MATCH的模式序号
+        int32_t nOut;
+        int32_t nOut1;     // INST_SPLIT的第二个分支
+    };
+    // DFA状态
+    struct DfaState
+    {
+        std::vector<int32_t> vecThreads;   // 按起点排序的NFA状态（只有INST_BYTE和INST_MATCH）
+        int32_t nMatch;                    // 第一个INST_MATCH在vecThreads中的位置，-1表示没有
+        uint32_t nMatchPattern;            // 它的模式序号
+    };
+
+    // 一个转移
+    struct Transition
+    {
+        int32_t nNext;                     // 目标状态，-1表示还没有计算
+        int32_t nMap;                      // 起点映射在m_vecMapPool中的位置，-1表示目标全部是新起点
+    };
+
+    friend class CRegexCompiler;
+
+    // 把从nInst出发经过空转移能到达的状态加入m_vecStep，来源为nOrigin（-1表示新起点）
+    void AddThread(int32_t nInst, int32_t nOrigin);
+    // 计算状态nState在类nClass上的转移，必要时先清空缓存（nState随之改变）
+    int32_t AddTransition(int32_t& nState, uint32_t nClass);
+    int32_t FindOrAddState(const std::vector<int32_t>& vecThreads);
+    void FlushCache(int32_t& nState);
+
+    // 编译结果
+    std::vector<Inst> m_vecInsts;
+    std::vector<CByteSet> m_vecSets;
+    int32_t m_nStart;                      // 入口指令
+    uint8_t m_aClass[256];                 // 字节 -> 等价类
+    uint8_t m_aRepresentative[256];        // 每个类的一个字节
+    uint32_t m_nClasses;
+    size_t m_nMaxLength;
+    std::string m_strError;
+
+    // 惰性DFA缓存，状态0是只有新起点的初始状态
+    size_t m_nCacheSize;
+    size_t m_nCacheBytes;
+    uint64_t m_nCacheFlushes;
+    std::vector<DfaState> m_vecStates;
+    std::map<std::vector<int32_t>, int32_t> m_mapStates;
+    std::vector<Transition> m_vecTable;    // 下标为状态*类数+类
+    std::vector<int32_t> m_vecMapPool;     // 目标状态的每个NFA状态来自源状态的第几个，-1表示新起点
+
+    // 计算转移时的临时数据
+    std::vector<uint32_t> m_vecMark;
+    uint32_t m_nMark;
+    std::vector<int32_t> m_vecStack;
+    std::vector<int32_t> m_vecStep;
+    std::vector<int32_t> m_vecStepMap;
+
+    // 跨缓冲区保留的扫描状态
+    int32_t m_nState;
+    std::vector<FileOffset> m_vecStarts;   // 当前状态每个NFA状态的起点
+    std::vector<FileOffset> m_vecNewStarts;
+    int m_bImplicitStart;                  // 当前状态全部是新起点，起点都是m_nImplicitStart
+    FileOffset m_nImplicitStart;
+    int m_bBasePending;                    // Reset之后第一次Scan时从nBase开始
+};
@@ -0,0 +1,424 @@
+#include "ReplaceEngine.h"
+#include "FileBackend.h"
+#include <cstring>
+#include <chrono>
+#include <cerrno>
+
+// 输出块大小和个数：写线程写一块时查找可以填充其余的块
+static const size_t kBlockSize = 4 * 1024 * 1024;
+static const size_t kBlockCount = 4;
+// 最长匹配不确定时，视图之间保留的数据（与查找一致）
+static const FileOffset kUnboundedOverlap = 64 * 1024;
+// 每次Scan最多返回的匹配数
+static const size_t kHitsPerScan = 256;
+// 进度回调的最小间隔（字节）
+static const uint64_t kReportInterval = 16 * 1024 * 1024;
+
+CReplaceEngine::CReplaceEngine()
+    : m_pReplacements(NULL), m_nLastReport(0), m_nCopied(0), m_nReplacedEnd(0), m_nFlushed(0), m_nCarryStart(0), m_pCurrent(NULL),
+      m_hOutput(INVALID_HANDLE_VALUE), m_bFinish(FALSE), m_bWriteFailed(FALSE), m_nWriteError(0)
+{
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+CReplaceEngine::~CReplaceEngine()
+{
+    if (m_writer.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_bFinish = TRUE;
+        }
+        m_cvFull.notify_all();
+        m_writer.join();
+    }
+}
+
+int CReplaceEngine::Report(uint64_t nBytes, uint64_t nTotal)
+{
+    if (!m_progress || nBytes - m_nLastReport < kReportInterval)
+    {
+        return TRUE;
+    }
+    m_nLastReport = nBytes;
+    return m_progress(nBytes, nTotal) ? TRUE : FALSE;
+}
+
+int CReplaceEngine::Count(CEditBuffer* pBuffer, CMatcher* pMatcher, uint64_t* pnCount, const SaveProgress& progress)
+{
+    auto tStart = std::chrono::steady_clock::now();
+    memset(&m_stats, 0, sizeof(m_stats));
+    m_pReplacements = NULL;
+    m_progress = progress;
+    m_nLastReport = 0;
+    int bResult = Scan(pBuffer, pMatcher);
+    m_stats.dSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - tStart).count();
+    m_progress = SaveProgress();
+    if (pnCount)
+    {
+        *pnCount = m_stats.nReplaced;
+    }
+    return bResult;
+}
+
+int CReplaceEngine::Scan(CEditBuffer* pBuffer, CMatcher* pMatcher)
+{
+    FileOffset nSize = pBuffer->GetSize();
+    // 之后的匹配不会从视图结尾前nKeep个字节之前开始，再往前的数据可以输出了
+    FileOffset nKeep = pMatcher->GetMaxLength() ? pMatcher->GetMaxLength() - 1 : kUnboundedOverlap;
+    std::vector<SearchHit> vecHits;
+    m_nCopied = 0;
+    m_nReplacedEnd = 0;
+    m_nFlushed = 0;
+    m_nCarryStart = 0;
+    m_vecCarry.clear();
+    pMatcher->Reset();
+
+    FileOffset nOffset = 0;
+    while (nOffset < nSize)
+    {
+        uint32_t dwAvalible = 0;
+        const uint8_t* pData = pBuffer->Visit(nOffset, &dwAvalible);
+        if (!pData || !dwAvalible)
+        {
+            errno = EIO;
+            return FALSE;
+        }
+        size_t nLength = dwAvalible < nSize - nOffset ? dwAvalible : (size_t)(nSize - nOffset);
+        size_t nPos = 0;
+        while (nPos < nLength)
+        {
+            vecHits.clear();
+            nPos += pMatcher->Scan(pData + nPos, nLength - nPos, nOffset + nPos, vecHits, kHitsPerScan);
+            if (!Apply(vecHits, pData, nOffset))
+            {
+                return FALSE;
+            }
+        }
+
+        FileOffset nEnd = nOffset + nLength;
+        // 只计数时也按替换时的输出进度记录，预览和替换对超长匹配的处理一致
+        if (nEnd > nKeep && nEnd - nKeep > m_nFlushed)
+        {
+            m_nFlushed = nEnd - nKeep;
+        }
+        if (m_pReplacements)
+        {
+            if (nEnd - m_nCopied > nKeep && !EmitSource(nEnd - nKeep, pData, nOffset))
+            {
+                return FALSE;
+            }
+            // 视图在下一次Visit后失效，把还不能输出的部分留下
+            m_vecCarryNext.clear();
+            if (m_nCopied < nOffset)
+            {
+                m_vecCarryNext.insert(m_vecCarryNext.end(), m_vecCarry.begin() + (size_t)(m_nCopied - m_nCarryStart), m_vecCarry.end());
+            }
+            FileOffset nFrom = m_nCopied > nOffset ? m_nCopied : nOffset;
+            m_vecCarryNext.insert(m_vecCarryNext.end(), pData + (size_t)(nFrom - nOffset), pData + nLength);
+            m_vecCarry.swap(m_vecCarryNext);
+            m_nCarryStart = m_nCopied;
+        }
+        nOffset = nEnd;
+        m_stats.nBytesScanned = nOffset;
+        if (!Report(nOffset, nSize))
+        {
+            errno = ECANCELED;
+            return FALSE;
+        }
+    }
+
+    // 还没有报告的匹配（如近似查找等待更好的结尾）
+    vecHits.clear();
+    pMatcher->Flush(vecHits);
+    if (!Apply(vecHits, NULL, nOffset))
+    {
+        return FALSE;
+    }
+    if (m_pReplacements && !EmitSource(nSize, NULL, nOffset))
+    {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+int CReplaceEngine::Apply(const std::vector<SearchHit>& vecHits, const uint8_t* pView, FileOffset nViewStart)
+{
+    for (size_t i = 0; i < vecHits.size(); i++)
+    {
+        const SearchHit& hit = vecHits[i];
+        if (hit.nOffset < m_nReplacedEnd)
+        {
+            // 和已替换的匹配重叠
+            continue;
+        }
+        if (hit.nOffset < m_nFlushed)
+        {
+            // 匹配比保留的数据还长，开头已经原样输出，不能悄悄跳过
+            errno = E2BIG;
+            return FALSE;
+        }
+        m_stats.nReplaced++;
+        m_nReplacedEnd = hit.nOffset + hit.nLength;
+        if (!m_pReplacements)
+        {
+            m_nCopied = m_nReplacedEnd;
+            continue;
+        }
+        if (!EmitSource(hit.nOffset, pView, nViewStart))
+        {
+            return FALSE;
+        }
+        if (!m_pReplacements->empty())
+        {
+            size_t nIndex = hit.nPattern < m_pReplacements->size() ? hit.nPattern : m_pReplacements->size() - 1;
+            const std::vector<uint8_t>& vecReplacement = (*m_pReplacements)[nIndex];
+            if (!vecReplacement.empty() && !Emit(&vecReplacement[0], vecReplacement.size()))
+            {
+                return FALSE;
+            }
+        }
+        m_nCopied = hit.nOffset + hit.nLength;
+    }
+    return TRUE;
+}
+
+int CReplaceEngine::EmitSource(FileOffset nTo, const uint8_t* pView, FileOffset nViewStart)
+{
+    if (nTo <= m_nCopied)
+    {
+        return TRUE;
+    }
+    // 视图之前的部分在m_vecCarry中
+    if (m_nCopied < nViewStart)
+    {
+        FileOffset nCarryEnd = nTo < nViewStart ? nTo : nViewStart;
+        if (!Emit(&m_vecCarry[(size_t)(m_nCopied - m_nCarryStart)], (size_t)(nCarryEnd - m_nCopied)))
+        {
+            return FALSE;
+        }
+        m_nCopied = nCarryEnd;
+    }
+    if (m_nCopied < nTo)
+    {
+        if (!Emit(pView + (size_t)(m_nCopied - nViewStart), (size_t)(nTo - m_nCopied)))
+        {
+            return FALSE;
+        }
+        m_nCopied = nTo;
+    }
+    return TRUE;
+}
+
+int CReplaceEngine::Emit(const uint8_t* pData, size_t nLength)
+{
+    m_stats.nBytesWritten += nLength;
+    while (nLength)
+    {
+        size_t nCopy = kBlockSize - m_pCurrent->size();
+        if (nCopy > nLength)
+            nCopy = nLength;
+        m_pCurrent->insert(m_pCurrent->end(), pData, pData + nCopy);
+        pData += nCopy;
+        nLength -= nCopy;
+        if (m_pCurrent->size() == kBlockSize && !SubmitBlock())
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+int CReplaceEngine::SubmitBlock()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!m_pCurrent->empty())
+    {
+        m_deqFull.push_back(m_pCurrent);
+        m_pCurrent = NULL;
+        m_cvFull.notify_one();
+        if (m_deqFree.empty() && !m_bWriteFailed)
+        {
+            auto tWait = std::chrono::steady_clock::now();
+            m_cvFree.wait(lock, [this] { return !m_deqFree.empty() || m_bWriteFailed; });
+            m_stats.dScanStallSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - tWait).count();
+        }
+        if (!m_deqFree.empty())
+        {
+            m_pCurrent = m_deqFree.front();
+            m_deqFree.pop_front();
+            m_pCurrent->clear();
+        }
+    }
+    if (m_bWriteFailed)
+    {
+        errno = m_nWriteError;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+#ifdef _WIN32
+
+void CReplaceEngine::WriterMain()
+{
+}
+
+int CReplaceEngine::ReplaceAll(CEditBuffer* /*pBuffer*/, CMatcher* /*pMatcher*/,
+                               const std::vector<std::vector<uint8_t> >& /*vecReplacements*/,
+                               const char* /*pPath*/, const SaveProgress& /*progress*/)
+{
+    // 界面在Windows下不提供替换，见FindDialog
+    SetLastError(ERROR_CALL_NOT_IMPLEMENTED);
+    return FALSE;
+}
+
+#else
+
+void CReplaceEngine::WriterMain()
+{
+    FileOffset nOffset = 0;
+    double dIdle = 0;
+    int bFirst = TRUE;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;)
+    {
+        if (m_deqFull.empty() && !m_bFinish)
+        {
+            // 第一块之前的等待是启动，不算空闲
+            auto tWait = std::chrono::steady_clock::now();
+            m_cvFull.wait(lock, [this] { return !m_deqFull.empty() || m_bFinish; });
+            if (!bFirst)
+                dIdle += std::chrono::duration<double>(std::chrono::steady_clock::now() - tWait).count();
+        }
+        if (m_deqFull.empty())
+        {
+            break;
+        }
+        bFirst = FALSE;
+        std::vector<uint8_t>* pBlock = m_deqFull.front();
+        m_deqFull.pop_front();
+        int bFailed = m_bWriteFailed;
+        lock.unlock();
+        // 失败之后只归还块，让查找线程尽快停下
+        int nError = 0;
+        if (!bFailed && !CTempFile::WriteAll(m_hOutput, nOffset, &(*pBlock)[0], pBlock->size()))
+        {
+            nError = errno;
+        }
+        nOffset += pBlock->size();
+        lock.lock();
+        if (nError)
+        {
+            m_bWriteFailed = TRUE;
+            m_nWriteError = nError;
+        }
+        m_deqFree.push_back(pBlock);
+        m_cvFree.notify_one();
+    }
+    m_stats.dWriterIdleSeconds = dIdle;
+}
+
+int CReplaceEngine::ReplaceAll(CEditBuffer* pBuffer, CMatcher* pMatcher,
+                               const std::vector<std::vector<uint8_t> >& vecReplacements,
+                               const char* pPath, const SaveProgress& progress)
+{
+    CLargeFile* pFile = pBuffer->GetFile();
+    if (!pFile || !pMatcher || !pPath || !pPath[0])
+    {
+        errno = EINVAL;
+        return FALSE;
+    }
+    if (pFile->GetBackend() && pFile->GetBackend()->GetType() == BACKEND_PROCESS)
+    {
+        // 进程内存只读
+        errno = ENOTSUP;
+        return FALSE;
+    }
+
+    auto tStart = std::chrono::steady_clock::now();
+    memset(&m_stats, 0, sizeof(m_stats));
+    m_pReplacements = &vecReplacements;
+    m_progress = progress;
+    m_nLastReport = 0;
+
+    // 源文件在替换完成前一直可读，替换完成后临时文件才换上去
+    CTempFile output;
+    if (!output.Create(pPath, ".fhreplace."))
+    {
+        m_pReplacements = NULL;
+        m_progress = SaveProgress();
+        return FALSE;
+    }
+    CFileBackend* pBackend = pFile->GetBackend();
+    output.InheritMode(pBackend ? pBackend->GetFileHandle() : INVALID_HANDLE_VALUE);
+    m_hOutput = output.GetHandle();
+
+    m_vecBlocks.assign(kBlockCount, std::vector<uint8_t>());
+    m_deqFull.clear();
+    m_deqFree.clear();
+    for (size_t i = 0; i < kBlockCount; i++)
+    {
+        m_vecBlocks[i].reserve(kBlockSize);
+        if (i)
+            m_deqFree.push_back(&m_vecBlocks[i]);
+    }
+    m_pCurrent = &m_vecBlocks[0];
+    m_pCurrent->clear();
+    m_bFinish = FALSE;
+    m_bWriteFailed = FALSE;
+    m_nWriteError = 0;
+    m_writer = std::thread(&CReplaceEngine::WriterMain, this);
+
+    // 查找在本线程进行，写入在写线程进行
+    int bResult = Scan(pBuffer, pMatcher);
+    if (bResult)
+    {
+        bResult = SubmitBlock();
+    }
+    int nError = errno;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bFinish = TRUE;
+    }
+    m_cvFull.notify_all();
+    m_writer.join();
+    if (bResult && m_bWriteFailed)
+    {
+        bResult = FALSE;
+        nError = m_nWriteError;
+    }
+    errno = nError;
+
+    if (bResult)
+    {
+        bResult = output.Commit();
+    }
+    else
+    {
+        output.Discard();
+    }
+    nError = errno;
+    m_hOutput = INVALID_HANDLE_VALUE;
+    m_vecBlocks.clear();
+    m_deqFree.clear();
+    m_pCurrent = NULL;
+    m_vecCarry.clear();
+    m_pReplacements = NULL;
+    m_stats.dSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - tStart).count();
+    if (!bResult)
+    {
+        m_progress = SaveProgress();
+        errno = nError;
+        return FALSE;
+    }
+
+    if (m_progress)
+    {
+        m_progress(m_stats.nBytesScanned, m_stats.nBytesScanned);
+    }
+    m_progress = SaveProgress();
+    return TRUE;
+}
+
+#endif // _WIN32
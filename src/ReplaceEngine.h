@@ -0,0 +1,107 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "EditBuffer.h"
+#include "Search.h"
+#include "SaveEngine.h"
+
+// 全部替换统计
+typedef struct {
+    uint64_t nReplaced;          // 替换的处数
+    uint64_t nBytesScanned;      // 查找过的数据（替换前的大小）
+    uint64_t nBytesWritten;      // 写出的数据（替换后的大小）
+    double dSeconds;             // 耗时
+    double dWriterIdleSeconds;   // 写线程等待数据的时间，大说明查找跟不上磁盘
+    double dScanStallSeconds;    // 查找等待空闲输出块的时间，大说明磁盘跟不上查找
+} ReplaceStats;
+
+/************************************************************************/
+/* find-and-replace-all over a whole CEditBuffer in one streaming pass.
+/* the data is scanned view by view (CEditBuffer::Visit) with a CMatcher
+/* and the output, the data with every hit replaced, is assembled into a
+/* few fixed-size blocks; a writer thread writes the full blocks to a temp
+/* file in the target's directory while the next ones are searched, then
+/* the temp file is renamed over the target. replacements may be longer or
+/* shorter than the hits (empty deletes them). memory is the blocks plus
+/* the last GetMaxLength()-1 bytes of the previous view (64 KB for an
+/* unbounded matcher), whatever the size of the file.
+/* hits are taken in the order the matcher reports them and a hit that
+/* overlaps one already replaced is left alone, so replacements never
+/* overlap. a hit that starts in data already passed on to the output (a
+/* hit of an unbounded matcher longer than 64 KB) cannot be replaced any
+/* more: Count and ReplaceAll then fail with E2BIG instead of skipping it.
+/* hit.nPattern selects the replacement, so every pattern of a
+/* multi-pattern matcher can have its own (the last one is used if there
+/* are fewer replacements than patterns).
+/* after a successful replace the caller must reopen the file, the pieces
+/* of the edit buffer no longer describe it.
+/************************************************************************/
+class CReplaceEngine
+{
+public:
+    CReplaceEngine();
+    ~CReplaceEngine();
+
+    /************************************************************************/
+    /* count the hits ReplaceAll would replace, without writing anything:
+    /* the preview before committing. return 1 if success; if 0, use
+    /* GetLastError to get error code (ECANCELED if cancelled).
+    /************************************************************************/
+    int Count(CEditBuffer* pBuffer, CMatcher* pMatcher, uint64_t* pnCount, const SaveProgress& progress = SaveProgress());
+
+    /************************************************************************/
+    /* write pBuffer with every hit of pMatcher replaced to pPath (the
+    /* original file or a new one). progress is called on the calling thread
+    /* with the bytes scanned and can cancel, the target is then untouched.
+    /* return 1 if success; if 0, use GetLastError to get error code.
+    /************************************************************************/
+    int ReplaceAll(CEditBuffer* pBuffer, CMatcher* pMatcher,
+                   const std::vector<std::vector<uint8_t> >& vecReplacements,
+                   const char* pPath, const SaveProgress& progress = SaveProgress());
+
+    void GetStats(ReplaceStats* pStats) { *pStats = m_stats; }
+
+private:
+    // 扫描整个缓冲区；m_pReplacements为NULL时只计数
+    int Scan(CEditBuffer* pBuffer, CMatcher* pMatcher);
+    // 处理一批匹配，pView是从nViewStart开始的当前视图
+    int Apply(const std::vector<SearchHit>& vecHits, const uint8_t* pView, FileOffset nViewStart);
+    // 输出源数据[m_nCopied, nTo)，前面的部分在m_vecCarry中，其余在当前视图中
+    int EmitSource(FileOffset nTo, const uint8_t* pView, FileOffset nViewStart);
+    int Emit(const uint8_t* pData, size_t nLength);
+    // 把当前输出块交给写线程，换一个空闲块
+    int SubmitBlock();
+    void WriterMain();
+    int Report(uint64_t nBytes, uint64_t nTotal);
+
+    const std::vector<std::vector<uint8_t> >* m_pReplacements;
+    SaveProgress m_progress;
+    uint64_t m_nLastReport;
+    ReplaceStats m_stats;
+
+    // 扫描状态
+    FileOffset m_nCopied;                  // 源数据中已处理（输出或被替换）的结尾
+    FileOffset m_nReplacedEnd;             // 最后一个被替换的匹配的结尾
+    FileOffset m_nFlushed;                 // 这之前的源数据不再保留，之后的匹配不能从这之前开始
+    FileOffset m_nCarryStart;              // m_vecCarry第一个字节的偏移
+    std::vector<uint8_t> m_vecCarry;       // 上一个视图末尾还不能输出的源数据
+    std::vector<uint8_t> m_vecCarryNext;
+
+    // 输出流水线
+    std::vector<std::vector<uint8_t> > m_vecBlocks;
+    std::vector<uint8_t>* m_pCurrent;      // 正在填充的块
+    std::deque<std::vector<uint8_t>*> m_deqFull;
+    std::deque<std::vector<uint8_t>*> m_deqFree;
+    std::mutex m_mutex;
+    std::condition_variable m_cvFull;
+    std::condition_variable m_cvFree;
+    std::thread m_writer;
+    int m_hOutput;
+    int m_bFinish;                         // 不会再有新的块
+    int m_bWriteFailed;
+    int m_nWriteError;
+};
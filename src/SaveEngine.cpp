@@ -0,0 +1,398 @@
+#include "SaveEngine.h"
+#include "FileBackend.h"
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <chrono>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+// 进度回调的最小间隔（字节），避免每个片段都刷新界面
+static const uint64_t kReportInterval = 16 * 1024 * 1024;
+// 单次copy_file_range的最大长度，长片段分段复制以便报告进度
+static const uint64_t kCopyChunkSize = 256 * 1024 * 1024;
+
+CSaveEngine::CSaveEngine()
+    : m_nDone(0), m_nLastReport(0)
+{
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+int CSaveEngine::CanSaveInPlace(CEditBuffer* pBuffer)
+{
+    CLargeFile* pFile = pBuffer->GetFile();
+    if (!pFile || !pFile->GetBackend() || pFile->GetBackend()->GetType() == BACKEND_PROCESS)
+    {
+        return FALSE;
+    }
+    LargeInteger nFileSize;
+    pFile->GetFileSizeEx(&nFileSize);
+    if (pBuffer->GetSize() != nFileSize.QuadPart)
+    {
+        return FALSE;
+    }
+    // 只有改写时，所有原文件片段都还在原来的位置
+    int bInPlace = TRUE;
+    pBuffer->ForEachPiece([&](FileOffset nLogical, const EditPiece& piece) {
+        if (piece.nSource == PIECE_ORIGINAL && piece.nOffset != nLogical)
+        {
+            bInPlace = FALSE;
+            return false;
+        }
+        return true;
+    });
+    return bInPlace;
+}
+
+int CSaveEngine::Report(uint64_t nBytes)
+{
+    m_nDone += nBytes;
+    if (!m_progress || m_nDone - m_nLastReport < kReportInterval)
+    {
+        return TRUE;
+    }
+    m_nLastReport = m_nDone;
+    return m_progress(m_nDone, m_stats.nBytesTotal) ? TRUE : FALSE;
+}
+
+#ifdef _WIN32
+
+int CSaveEngine::Save(CEditBuffer* pBuffer, const char* pPath, const SaveProgress& progress)
+{
+    SetLastError(ERROR_CALL_NOT_IMPLEMENTED);
+    return FALSE;
+}
+
+#else
+
+CTempFile::CTempFile()
+    : m_hFile(INVALID_HANDLE_VALUE), m_bSetMode(FALSE), m_nMode(0)
+{
+}
+
+CTempFile::~CTempFile()
+{
+    Discard();
+}
+
+int CTempFile::WriteAll(int hFile, FileOffset nOffset, const void* pData, size_t nLength)
+{
+    const uint8_t* p = (const uint8_t*)pData;
+    while (nLength)
+    {
+        ssize_t n = pwrite(hFile, p, nLength, (off_t)nOffset);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return FALSE;
+        }
+        p += n;
+        nOffset += n;
+        nLength -= n;
+    }
+    return TRUE;
+}
+
+int CTempFile::Create(const char* pPath, const char* pSuffix)
+{
+    Discard();
+    // 临时文件放在目标目录下，rename才是原子的
+    m_strTarget = pPath;
+    m_strTemp = m_strTarget + pSuffix + "XXXXXX";
+    m_hFile = mkstemp(&m_strTemp[0]);
+    if (m_hFile < 0)
+    {
+        m_strTemp.clear();
+        return FALSE;
+    }
+    m_bSetMode = FALSE;
+    return TRUE;
+}
+
+void CTempFile::InheritMode(int hSource)
+{
+    // 新文件沿用目标或原文件的权限
+    struct stat st;
+    m_nMode = 0644;
+    if (hSource >= 0 && fstat(hSource, &st) == 0 && S_ISREG(st.st_mode))
+    {
+        m_nMode = st.st_mode & 07777;
+    }
+    if (stat(m_strTarget.c_str(), &st) == 0)
+    {
+        m_nMode = st.st_mode & 07777;
+    }
+    m_bSetMode = TRUE;
+}
+
+int CTempFile::Commit()
+{
+    if (m_bSetMode)
+    {
+        fchmod(m_hFile, (mode_t)m_nMode);
+    }
+    if (fsync(m_hFile) != 0 || rename(m_strTemp.c_str(), m_strTarget.c_str()) != 0)
+    {
+        Discard();
+        return FALSE;
+    }
+    close(m_hFile);
+    m_hFile = INVALID_HANDLE_VALUE;
+    m_strTemp.clear();
+
+    // rename本身也要落盘
+    size_t nSlash = m_strTarget.find_last_of('/');
+    std::string strDir = nSlash == std::string::npos ? "." : nSlash == 0 ? "/" : m_strTarget.substr(0, nSlash);
+    int hDir = open(strDir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (hDir >= 0)
+    {
+        fsync(hDir);
+        close(hDir);
+    }
+    return TRUE;
+}
+
+void CTempFile::Discard()
+{
+    int nError = errno;
+    if (m_hFile >= 0)
+    {
+        close(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+    }
+    if (!m_strTemp.empty())
+    {
+        unlink(m_strTemp.c_str());
+        m_strTemp.clear();
+    }
+    errno = nError;
+}
+
+// 后端打开的普通文件描述符，没有时返回-1
+static int GetSourceHandle(CLargeFile* pFile)
+{
+    CFileBackend* pBackend = pFile->GetBackend();
+    int hSource = pBackend ? pBackend->GetFileHandle() : INVALID_HANDLE_VALUE;
+    struct stat st;
+    if (hSource < 0 || fstat(hSource, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        return INVALID_HANDLE_VALUE;
+    }
+    return hSource;
+}
+
+// 目标是否就是已打开的那个文件（按inode比较，路径可能已被替换）
+static int IsSameFile(CLargeFile* pFile, const char* pPath)
+{
+    struct stat st1, st2;
+    int hSource = GetSourceHandle(pFile);
+    if (hSource < 0 || fstat(hSource, &st1) != 0 || stat(pPath, &st2) != 0)
+    {
+        return FALSE;
+    }
+    return st1.st_dev == st2.st_dev && st1.st_ino == st2.st_ino;
+}
+
+int CSaveEngine::Save(CEditBuffer* pBuffer, const char* pPath, const SaveProgress& progress)
+{
+    CLargeFile* pFile = pBuffer->GetFile();
+    if (!pFile || !pPath || !pPath[0])
+    {
+        errno = EINVAL;
+        return FALSE;
+    }
+    if (pFile->GetBackend() && pFile->GetBackend()->GetType() == BACKEND_PROCESS)
+    {
+        // 进程内存只读
+        errno = ENOTSUP;
+        return FALSE;
+    }
+
+    auto tStart = std::chrono::steady_clock::now();
+    memset(&m_stats, 0, sizeof(m_stats));
+    m_stats.nBytesTotal = pBuffer->GetSize();
+    m_progress = progress;
+    m_nDone = 0;
+    m_nLastReport = 0;
+
+    int bResult;
+    if (IsSameFile(pFile, pPath) && CanSaveInPlace(pBuffer))
+    {
+        m_stats.bInPlace = TRUE;
+        bResult = SaveInPlace(pBuffer, pPath);
+    }
+    else
+    {
+        bResult = SaveByRewrite(pBuffer, pPath);
+    }
+
+    m_stats.dSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - tStart).count();
+    if (bResult && m_progress)
+    {
+        m_progress(m_stats.nBytesTotal, m_stats.nBytesTotal);
+    }
+    m_progress = SaveProgress();
+    return bResult;
+}
+
+int CSaveEngine::WriteEdited(int hFile, CEditBuffer* pBuffer, FileOffset nOffset, FileOffset nLength, FileOffset nTarget)
+{
+    // 用Visit取得编辑层数据的直接指针，不经过中间缓冲区
+    while (nLength)
+    {
+        uint32_t dwAvalible = 0;
+        const uint8_t* pData = pBuffer->Visit(nOffset, &dwAvalible);
+        if (!pData || !dwAvalible)
+        {
+            errno = EIO;
+            return FALSE;
+        }
+        size_t nWrite = dwAvalible < nLength ? dwAvalible : (size_t)nLength;
+        if (!CTempFile::WriteAll(hFile, nTarget, pData, nWrite))
+        {
+            return FALSE;
+        }
+        nOffset += nWrite;
+        nTarget += nWrite;
+        nLength -= nWrite;
+        if (!Report(nWrite))
+        {
+            errno = ECANCELED;
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+int CSaveEngine::SaveInPlace(CEditBuffer* pBuffer, const char* pPath)
+{
+    int hFile = open(pPath, O_WRONLY);
+    if (hFile < 0)
+    {
+        return FALSE;
+    }
+    // 进度只按需要写入的字节计算
+    m_stats.nBytesTotal = 0;
+    pBuffer->ForEachPiece([&](FileOffset /*nLogical*/, const EditPiece& piece) {
+        if (piece.nSource != PIECE_ORIGINAL)
+            m_stats.nBytesTotal += piece.nLength;
+        return true;
+    });
+    // 写入开始后取消会留下一半新一半旧的文件，所以不再响应取消
+    SaveProgress progress = m_progress;
+    m_progress = [progress](uint64_t nDone, uint64_t nTotal) {
+        if (progress)
+            progress(nDone, nTotal);
+        return true;
+    };
+
+    int bResult = TRUE;
+    pBuffer->ForEachPiece([&](FileOffset nLogical, const EditPiece& piece) {
+        if (piece.nSource == PIECE_ORIGINAL)
+        {
+            m_stats.nBytesReused += piece.nLength;
+            return true;
+        }
+        if (!WriteEdited(hFile, pBuffer, nLogical, piece.nLength, nLogical))
+        {
+            bResult = FALSE;
+            return false;
+        }
+        m_stats.nBytesWritten += piece.nLength;
+        return true;
+    });
+    if (bResult && fsync(hFile) != 0)
+    {
+        bResult = FALSE;
+    }
+    int nError = errno;
+    close(hFile);
+    m_stats.nBytesTotal = pBuffer->GetSize();
+    errno = nError;
+    return bResult;
+}
+
+int CSaveEngine::SaveByRewrite(CEditBuffer* pBuffer, const char* pPath)
+{
+    CTempFile temp;
+    if (!temp.Create(pPath, ".fhsave."))
+    {
+        return FALSE;
+    }
+    int hTemp = temp.GetHandle();
+    // 直接用后端已打开的描述符做copy_file_range，路径可能已经指向别的文件；
+    // 没有普通文件描述符（如进程内存）时全部走用户态复制
+    int hSource = GetSourceHandle(pBuffer->GetFile());
+    int bCopyRange = hSource >= 0;
+    temp.InheritMode(hSource);
+
+    int bResult = TRUE;
+    pBuffer->ForEachPiece([&](FileOffset nLogical, const EditPiece& piece) {
+        if (piece.nSource != PIECE_ORIGINAL)
+        {
+            if (!WriteEdited(hTemp, pBuffer, nLogical, piece.nLength, nLogical))
+            {
+                bResult = FALSE;
+                return false;
+            }
+            m_stats.nBytesWritten += piece.nLength;
+            return true;
+        }
+
+        FileOffset nDone = 0;
+#ifdef __linux__
+        while (bCopyRange && nDone < piece.nLength)
+        {
+            loff_t nIn = (loff_t)(piece.nOffset + nDone);
+            loff_t nOut = (loff_t)(nLogical + nDone);
+            FileOffset nChunk = piece.nLength - nDone;
+            if (nChunk > kCopyChunkSize)
+                nChunk = kCopyChunkSize;
+            ssize_t n = copy_file_range(hSource, &nIn, hTemp, &nOut, (size_t)nChunk, 0);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+            {
+                // 跨文件系统、内核不支持等情况，之后都退回到用户态复制
+                bCopyRange = FALSE;
+                break;
+            }
+            nDone += n;
+            m_stats.nBytesReused += n;
+            if (!Report(n))
+            {
+                errno = ECANCELED;
+                bResult = FALSE;
+                return false;
+            }
+        }
+#endif
+        if (nDone < piece.nLength)
+        {
+            FileOffset nRemain = piece.nLength - nDone;
+            if (!WriteEdited(hTemp, pBuffer, nLogical + nDone, nRemain, nLogical + nDone))
+            {
+                bResult = FALSE;
+                return false;
+            }
+            m_stats.nBytesCopied += nRemain;
+        }
+        return true;
+    });
+
+    if (!bResult)
+    {
+        temp.Discard();
+        return FALSE;
+    }
+    return temp.Commit();
+}
+
+#endif // _WIN32
@@ -0,0 +1,116 @@
+#pragma once
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include "EditBuffer.h"
+
+// 保存统计
+typedef struct {
+    uint64_t nBytesTotal;    // 保存后的文件大小
+    uint64_t nBytesWritten;  // 实际写入的新数据
+    uint64_t nBytesReused;   // 直接沿用原文件的数据（原地保存时未触碰，重写时由内核复制/共享）
+    uint64_t nBytesCopied;   // 重写时内核复制失败、退回到用户态复制的原文件数据
+    int bInPlace;            // 1表示原地改写，0表示写临时文件后替换
+    double dSeconds;         // 耗时
+} SaveStats;
+
+// 进度回调，返回false表示取消（原地保存开始写入后不能取消）
+typedef std::function<bool(uint64_t nDone, uint64_t nTotal)> SaveProgress;
+
+/************************************************************************/
+/* a temp file in the directory of a target path that is renamed over the
+/* target once it is complete, so the target is either untouched or
+/* entirely replaced, even after a crash. used by everything that rewrites
+/* a whole file (save, replace-all, the 4-gram index). a file that is not
+/* committed is removed by Discard() or the destructor.
+/* calls return 1 if success; if 0, errno tells why. POSIX only.
+/************************************************************************/
+class CTempFile
+{
+public:
+    CTempFile();
+    ~CTempFile();
+
+    /************************************************************************/
+    /* create <pPath><pSuffix>XXXXXX next to the target pPath.
+    /************************************************************************/
+    int Create(const char* pPath, const char* pSuffix);
+
+    /************************************************************************/
+    /* give the file the permissions of the target, or of hSource (an open
+    /* regular file, may be -1) if there is no target yet. without this the
+    /* file keeps the 0600 of mkstemp.
+    /************************************************************************/
+    void InheritMode(int hSource);
+
+    int GetHandle() const { return m_hFile; }
+    int Write(FileOffset nOffset, const void* pData, size_t nLength) { return WriteAll(m_hFile, nOffset, pData, nLength); }
+
+    /************************************************************************/
+    /* fsync the file, rename it over the target and fsync the directory so
+    /* the rename is durable too. the file is discarded if this fails.
+    /************************************************************************/
+    int Commit();
+
+    /************************************************************************/
+    /* close and remove the file. keeps errno, so it can be called on an
+    /* error path.
+    /************************************************************************/
+    void Discard();
+
+    /************************************************************************/
+    /* pwrite all of pData at nOffset, retrying short writes and EINTR.
+    /************************************************************************/
+    static int WriteAll(int hFile, FileOffset nOffset, const void* pData, size_t nLength);
+
+private:
+    std::string m_strTarget;
+    std::string m_strTemp;
+    int m_hFile;
+    int m_bSetMode;
+    uint32_t m_nMode;
+};
+
+/************************************************************************/
+/* writes the contents of a CEditBuffer to disk, touching as little as
+/* possible:
+/* - if the target is the original file and every original piece is
+/*   still at its original offset (only overwrites), the dirty ranges are
+/*   patched in place with pwrite and one fsync;
+/* - otherwise the data is streamed to a temp file in the target's
+/*   directory, unchanged extents are copied by the kernel with
+/*   copy_file_range (which reflinks on filesystems that support it),
+/*   then the temp file is renamed over the target.
+/* after a successful save the caller must reopen the file, the pieces
+/* of the edit buffer no longer describe it.
+/************************************************************************/
+class CSaveEngine
+{
+public:
+    CSaveEngine();
+
+    /************************************************************************/
+    /* return 1 if saving pBuffer back to its own file can be done in place.
+    /************************************************************************/
+    static int CanSaveInPlace(CEditBuffer* pBuffer);
+
+    /************************************************************************/
+    /* save pBuffer to pPath (the original file or a new one). return 1 if
+    /* success; if 0, use GetLastError to get error code (ECANCELED if the
+    /* progress callback cancelled).
+    /************************************************************************/
+    int Save(CEditBuffer* pBuffer, const char* pPath, const SaveProgress& progress = SaveProgress());
+
+    void GetStats(SaveStats* pStats) { *pStats = m_stats; }
+
+private:
+    int SaveInPlace(CEditBuffer* pBuffer, const char* pPath);
+    int SaveByRewrite(CEditBuffer* pBuffer, const char* pPath);
+    int WriteEdited(int hFile, CEditBuffer* pBuffer, FileOffset nOffset, FileOffset nLength, FileOffset nTarget);
+    int Report(uint64_t nBytes);
+
+    SaveProgress m_progress;
+    uint64_t m_nDone;
+    uint64_t m_nLastReport;
+    SaveStats m_stats;
+};
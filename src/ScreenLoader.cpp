@@ -0,0 +1,214 @@
+#include "ScreenLoader.h"
+#include <algorithm>
+#include <cstring>
+
+CScreenLoader::CScreenLoader()
+    : m_pFile(NULL), m_bStop(FALSE), m_nSerial(0), m_bPending(FALSE), m_nDoneSerial(0)
+{
+    memset(&m_stats, 0, sizeof(m_stats));
+    m_result.nSerial = 0;
+}
+
+CScreenLoader::~CScreenLoader()
+{
+    Detach();
+}
+
+void CScreenLoader::Attach(CLargeFile* pFile, const Notify& notify)
+{
+    Detach();
+    m_pFile = pFile;
+    m_notify = notify;
+    m_bStop = FALSE;
+    m_thread = std::thread(&CScreenLoader::ThreadProc, this);
+}
+
+void CScreenLoader::Detach()
+{
+    if (m_thread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_bStop = TRUE;
+        }
+        m_cond.notify_all();
+        m_thread.join();
+    }
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_pFile = NULL;
+    m_notify = Notify();
+    m_bPending = FALSE;
+    m_pending.vecData.clear();
+    m_pending.vecSegments.clear();
+    m_result.nSerial = 0;
+    m_result.vecData.clear();
+}
+
+uint64_t CScreenLoader::Request(CEditBuffer* pBuffer, FileOffset nOffset, size_t nLength)
+{
+    Job job;
+    job.nOffset = nOffset;
+    job.bFailed = FALSE;
+    job.tRequest = std::chrono::steady_clock::now();
+    FileOffset nSize = pBuffer->GetSize();
+    nLength = nOffset < nSize ? (size_t)std::min<FileOffset>(nLength, nSize - nOffset) : 0;
+    job.vecData.resize(nLength);
+
+    // 内存中的片段现在就复制，原文件的片段留给后台线程
+    std::vector<EditPiece> vecPieces;
+    if (nLength)
+    {
+        pBuffer->GetPieces(nOffset, nLength, vecPieces);
+    }
+    size_t nTarget = 0;
+    for (size_t i = 0; i < vecPieces.size(); i++)
+    {
+        const EditPiece& piece = vecPieces[i];
+        size_t n = (size_t)piece.nLength;
+        if (piece.nSource == PIECE_ORIGINAL)
+        {
+            Segment segment = { nTarget, piece.nOffset, n };
+            job.vecSegments.push_back(segment);
+        }
+        else if (piece.nSource == PIECE_ADDED)
+        {
+            memcpy(&job.vecData[nTarget], pBuffer->GetAddedData(piece.nOffset), n);
+        }
+        else
+        {
+            memset(&job.vecData[nTarget], piece.nFill, n);
+        }
+        nTarget += n;
+    }
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    job.nSerial = ++m_nSerial;
+    m_stats.nRequests++;
+    if (job.vecSegments.empty() || !m_thread.joinable())
+    {
+        // 全部在内存中（或者没有打开文件），不经过后台线程
+        job.bFailed = !job.vecSegments.empty();
+        Complete(job);
+        return m_nSerial;
+    }
+    m_stats.nAsyncRequests++;
+    if (m_bPending)
+    {
+        m_stats.nAbandoned++;
+    }
+    m_pending = std::move(job);
+    m_bPending = TRUE;
+    m_cond.notify_one();
+    return m_nSerial;
+}
+
+int CScreenLoader::Wait(uint64_t nSerial, uint32_t nMilliseconds)
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+    return m_condDone.wait_for(lock, std::chrono::milliseconds(nMilliseconds),
+                               [&] { return m_nDoneSerial >= nSerial; }) ? TRUE : FALSE;
+}
+
+int CScreenLoader::TakeResult(uint64_t nSerial, std::vector<uint8_t>& vecData, FileOffset* pnOffset, int* pbFailed)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (!nSerial || m_result.nSerial != nSerial)
+    {
+        return FALSE;
+    }
+    vecData.swap(m_result.vecData);
+    if (pnOffset)
+        *pnOffset = m_result.nOffset;
+    if (pbFailed)
+        *pbFailed = m_result.bFailed;
+    m_result.nSerial = 0;
+    return TRUE;
+}
+
+void CScreenLoader::GetStats(ScreenLoadStats* pStats)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    *pStats = m_stats;
+}
+
+void CScreenLoader::Complete(Job& job)
+{
+    double dMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - job.tRequest).count();
+    m_stats.dLastMs = dMs;
+    m_stats.dMaxMs = std::max(m_stats.dMaxMs, dMs);
+    if (job.bFailed)
+    {
+        m_stats.nFailed++;
+    }
+    m_nDoneSerial = job.nSerial;
+    m_result = std::move(job);
+    m_condDone.notify_all();
+}
+
+int CScreenLoader::LoadSegments(Job& job)
+{
+    for (size_t i = 0; i < job.vecSegments.size(); i++)
+    {
+        const Segment& segment = job.vecSegments[i];
+        size_t nDone = 0;
+        while (nDone < segment.nLength)
+        {
+            {
+                // 每换一个视图检查一次，用户滚走了就不再读这一段
+                std::lock_guard<std::mutex> lock(m_lock);
+                if (m_bStop || m_nSerial != job.nSerial)
+                    return FALSE;
+            }
+            LargeInteger nVisit;
+            nVisit.QuadPart = segment.nFileOffset + nDone;
+            uint32_t dwView = 0;
+            const uint8_t* pData = (const uint8_t*)m_pFile->PinFilePosition(nVisit, &dwView);
+            if (!pData || !dwView)
+            {
+                // 读不到的部分保持为0
+                job.bFailed = TRUE;
+                break;
+            }
+            size_t n = std::min((size_t)dwView, segment.nLength - nDone);
+            memcpy(&job.vecData[segment.nTarget + nDone], pData, n);
+            m_pFile->UnpinView(pData);
+            nDone += n;
+        }
+    }
+    return TRUE;
+}
+
+void CScreenLoader::ThreadProc()
+{
+    for (;;)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_cond.wait(lock, [this] { return m_bStop || m_bPending; });
+            if (m_bStop)
+            {
+                return;
+            }
+            job = std::move(m_pending);
+            m_bPending = FALSE;
+        }
+
+        int bLoaded = LoadSegments(job);
+        Notify notify;
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            if (!bLoaded || job.nSerial != m_nSerial)
+            {
+                m_stats.nAbandoned++;
+                continue;
+            }
+            Complete(job);
+            notify = m_notify;
+        }
+        if (notify)
+        {
+            notify();
+        }
+    }
+}
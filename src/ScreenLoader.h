@@ -0,0 +1,109 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+#include "EditBuffer.h"
+
+// 屏幕数据读取统计
+typedef struct {
+    uint64_t nRequests;         // 收到的请求数
+    uint64_t nAsyncRequests;    // 需要后台线程读原文件的请求数
+    uint64_t nAbandoned;        // 被更新的请求取代、没有读完的请求数
+    uint64_t nFailed;           // 读取失败的请求数
+    double dLastMs;             // 最近一个请求从提出到完成的时间
+    double dMaxMs;              // 最长的一次
+} ScreenLoadStats;
+
+/************************************************************************/
+/* asynchronous loader for the bytes the table shows.
+/* the UI thread asks for a range of the edited data. the pieces of the
+/* range are looked up on the UI thread: appended and fill pieces are in
+/* memory and copied right away, only the parts that come from the
+/* original file are left to a worker thread, which pins the file views
+/* and copies them. so a slow device or a major page fault delays those
+/* bytes, never the UI thread, and the worker never touches the edit
+/* buffer itself. a newer request replaces an unfinished older one. when
+/* a request completes, the notify callback is called on the worker
+/* thread (the table posts an Fl::awake from it) and the data can be taken
+/* with TakeResult.
+/************************************************************************/
+class CScreenLoader
+{
+public:
+    typedef std::function<void()> Notify;
+
+    CScreenLoader();
+    ~CScreenLoader();
+
+    /************************************************************************/
+    /* start loading from an opened file. Detach() must be called before
+    /* the file is closed.
+    /************************************************************************/
+    void Attach(CLargeFile* pFile, const Notify& notify);
+    void Detach();
+
+    /************************************************************************/
+    /* ask for [nOffset, nOffset+nLength) of pBuffer (clipped to its size),
+    /* return the serial number of the request.
+    /************************************************************************/
+    uint64_t Request(CEditBuffer* pBuffer, FileOffset nOffset, size_t nLength);
+
+    /************************************************************************/
+    /* wait at most nMilliseconds for request nSerial, return TRUE if it is
+    /* complete.
+    /************************************************************************/
+    int Wait(uint64_t nSerial, uint32_t nMilliseconds);
+
+    /************************************************************************/
+    /* take the data of request nSerial if it is complete: vecData gets the
+    /* bytes, *pnOffset their offset, *pbFailed whether the file could not
+    /* be read (the bytes that could not be read are 0). return FALSE if it
+    /* is not complete yet, or it was replaced by a newer request.
+    /************************************************************************/
+    int TakeResult(uint64_t nSerial, std::vector<uint8_t>& vecData, FileOffset* pnOffset, int* pbFailed);
+
+    void GetStats(ScreenLoadStats* pStats);
+
+private:
+    // 需要从原文件复制的一段
+    struct Segment
+    {
+        size_t nTarget;             // 在vecData中的位置
+        FileOffset nFileOffset;
+        size_t nLength;
+    };
+    struct Job
+    {
+        uint64_t nSerial;
+        FileOffset nOffset;
+        std::vector<uint8_t> vecData;
+        std::vector<Segment> vecSegments;
+        std::chrono::steady_clock::time_point tRequest;
+        int bFailed;
+    };
+
+    void ThreadProc();
+    // 在本线程上读完job的原文件部分，有更新的请求时放弃并返回FALSE
+    int LoadSegments(Job& job);
+    // 记录完成的job，调用者持有m_lock
+    void Complete(Job& job);
+
+    CLargeFile* m_pFile;
+    Notify m_notify;
+    std::thread m_thread;
+    std::mutex m_lock;
+    std::condition_variable m_cond;         // 有新请求
+    std::condition_variable m_condDone;     // 有请求完成
+    int m_bStop;
+
+    uint64_t m_nSerial;                     // 最新请求的序号
+    int m_bPending;                         // m_pending还没有交给后台线程
+    Job m_pending;
+    uint64_t m_nDoneSerial;                 // 最近完成的请求序号
+    Job m_result;
+    ScreenLoadStats m_stats;
+};
@@ -0,0 +1,383 @@
+#include "Search.h"
+#include "kmp.h"
+#include <chrono>
+#include <cstring>
+
+// 每扫描这么多字节调用一次进度回调（UI在回调里处理事件和取消）
+static const uint64_t kProgressInterval = 16 * 1024 * 1024;
+// 向前查找时每块的大小
+static const FileOffset kBackwardBlockSize = 4 * 1024 * 1024;
+// 匹配长度不定时，块与块之间重叠的长度上限
+static const FileOffset kUnboundedOverlap = 64 * 1024;
+// 未修改的文件顺序扫描时提前通知系统预读的长度
+static const FileOffset kReadAheadSize = 16 * 1024 * 1024;
+// 每次Scan最多收集的匹配数，避免密集匹配时一次产生大量结果
+static const size_t kHitsPerScan = 256;
+
+static uint64_t NowNanoseconds()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// CKmpMatcher
+
+CKmpMatcher::CKmpMatcher(const uint8_t* pPattern, size_t nLength, int bIgnoreCase)
+    : m_vecPattern(pPattern, pPattern + nLength), m_bIgnoreCase(bIgnoreCase), m_nState(-1)
+{
+    if (m_bIgnoreCase)
+    {
+        for (size_t i = 0; i < m_vecPattern.size(); i++)
+        {
+            if (m_vecPattern[i] >= 'A' && m_vecPattern[i] <= 'Z')
+                m_vecPattern[i] += 0x20;
+        }
+    }
+    m_vecNext.resize(nLength ? nLength : 1);
+    if (nLength)
+    {
+        if (m_bIgnoreCase)
+            kmp_cal_next_ignore_case(&m_vecPattern[0], (int)nLength, &m_vecNext[0]);
+        else
+            kmp_cal_next(&m_vecPattern[0], (int)nLength, &m_vecNext[0]);
+    }
+}
+
+size_t CKmpMatcher::Scan(const uint8_t* pData, size_t nLength, FileOffset nBase,
+                         std::vector<SearchHit>& vecHits, size_t nMaxHits)
+{
+    int nPattern = (int)m_vecPattern.size();
+    if (!nPattern)
+    {
+        return nLength;
+    }
+    size_t nPos = 0;
+    size_t nHits = 0;
+    while (nPos < nLength)
+    {
+        // kmp.cpp的接口是int长度，视图不会超过这个大小，这里只是保险
+        int nChunk = nLength - nPos > 0x40000000 ? 0x40000000 : (int)(nLength - nPos);
+        int nEnd = m_bIgnoreCase
+            ? KMP_stream_ignore_case(pData + nPos, nChunk, &m_vecPattern[0], nPattern, &m_vecNext[0], &m_nState)
+            : KMP_stream(pData + nPos, nChunk, &m_vecPattern[0], nPattern, &m_vecNext[0], &m_nState);
+        if (nEnd < 0)
+        {
+            nPos += nChunk;
+            continue;
+        }
+        SearchHit hit;
+        hit.nOffset = nBase + nPos + nEnd + 1 - nPattern;
+        hit.nLength = nPattern;
+        hit.nPattern = 0;
+        vecHits.push_back(hit);
+        nPos += nEnd + 1;
+        if (++nHits >= nMaxHits)
+        {
+            break;
+        }
+    }
+    return nPos;
+}
+
+// CFixedLengthMatcher
+
+void CFixedLengthMatcher::KeepTail(const uint8_t* pData, size_t nLength)
+{
+    size_t nKeep = m_nPatternLength - 1;
+    if (nLength >= nKeep)
+    {
+        m_vecTail.assign(pData + nLength - nKeep, pData + nLength);
+        return;
+    }
+    m_vecTail.insert(m_vecTail.end(), pData, pData + nLength);
+    if (m_vecTail.size() > nKeep)
+        m_vecTail.erase(m_vecTail.begin(), m_vecTail.end() - nKeep);
+}
+
+size_t CFixedLengthMatcher::Scan(const uint8_t* pData, size_t nLength, FileOffset nBase,
+                                 std::vector<SearchHit>& vecHits, size_t nMaxHits)
+{
+    size_t nPattern = m_nPatternLength;
+    if (!nPattern)
+    {
+        return nLength;
+    }
+    size_t nHits = 0;
+
+    // 起点在之前的数据里的匹配：尾部缓冲区比模式短，所以这样的匹配一定结束在本块开头的nPattern-1个字节内
+    if (!m_vecTail.empty())
+    {
+        size_t nTail = m_vecTail.size();
+        size_t nHead = nLength < nPattern - 1 ? nLength : nPattern - 1;
+        m_vecStitch.assign(m_vecTail.begin(), m_vecTail.end());
+        m_vecStitch.insert(m_vecStitch.end(), pData, pData + nHead);
+        const uint8_t* pStitch = &m_vecStitch[0];
+        size_t nPos = 0;
+        const uint8_t* pFound;
+        while ((pFound = FindFirst(pStitch + nPos, m_vecStitch.size() - nPos)) != NULL)
+        {
+            size_t nStart = pFound - pStitch;
+            if (nStart >= nTail)
+            {
+                // 完全在本块里的匹配由下面查找
+                break;
+            }
+            SearchHit hit;
+            hit.nOffset = nBase - nTail + nStart;
+            hit.nLength = nPattern;
+            hit.nPattern = 0;
+            vecHits.push_back(hit);
+            nPos = nStart + 1;
+            if (++nHits >= nMaxHits)
+            {
+                size_t nConsumed = nStart + nPattern - nTail;
+                KeepTail(pData, nConsumed);
+                return nConsumed;
+            }
+        }
+    }
+
+    size_t nPos = 0;
+    const uint8_t* pFound;
+    while ((pFound = FindFirst(pData + nPos, nLength - nPos)) != NULL)
+    {
+        size_t nStart = pFound - pData;
+        SearchHit hit;
+        hit.nOffset = nBase + nStart;
+        hit.nLength = nPattern;
+        hit.nPattern = 0;
+        vecHits.push_back(hit);
+        nPos = nStart + 1;
+        if (++nHits >= nMaxHits)
+        {
+            KeepTail(pData, nStart + nPattern);
+            return nStart + nPattern;
+        }
+    }
+    KeepTail(pData, nLength);
+    return nLength;
+}
+
+// CLiteralMatcher
+
+CLiteralMatcher::CLiteralMatcher(const uint8_t* pPattern, size_t nLength, int bIgnoreCase)
+    : CFixedLengthMatcher(nLength), m_kernel(pPattern, nLength, bIgnoreCase)
+{
+}
+
+// CSearcher
+
+CSearcher::CSearcher()
+    : m_nBytesScanned(0), m_nLastReport(0), m_nProgressTotal(0), m_dSeconds(0), m_nStartTime(0), m_bRanges(FALSE)
+{
+}
+
+double CSearcher::GetThroughput() const
+{
+    if (m_dSeconds <= 0)
+    {
+        return 0;
+    }
+    return m_nBytesScanned / m_dSeconds / (1024 * 1024);
+}
+
+void CSearcher::BeginStats(FileOffset nTotal)
+{
+    m_nBytesScanned = 0;
+    m_nLastReport = 0;
+    m_nProgressTotal = nTotal;
+    m_nStartTime = NowNanoseconds();
+}
+
+void CSearcher::EndStats()
+{
+    m_dSeconds = (NowNanoseconds() - m_nStartTime) / 1e9;
+}
+
+int CSearcher::ScanBlock(CEditBuffer* pBuffer, CMatcher* pMatcher, FileOffset nStart, FileOffset nEnd,
+                         const std::function<bool(const SearchHit& hit)>& onHit, const SearchProgress& progress)
+{
+    CLargeFile* pFile = pBuffer->GetFile();
+    // 未修改时逻辑偏移就是文件偏移，可以提前让系统预读
+    int bAdvise = pFile && !pBuffer->IsModified();
+    FileOffset nAdvised = nStart;
+
+    std::vector<SearchHit> vecHits;
+    pMatcher->Reset();
+    FileOffset nOffset = nStart;
+    while (nOffset < nEnd)
+    {
+        if (bAdvise && nOffset + kReadAheadSize / 2 >= nAdvised)
+        {
+            LargeInteger nAdvise;
+            nAdvise.QuadPart = nAdvised;
+            pFile->AdviseWillNeed(nAdvise, kReadAheadSize);
+            nAdvised += kReadAheadSize;
+        }
+
+        uint32_t dwAvalible = 0;
+        const uint8_t* pData = pBuffer->Visit(nOffset, &dwAvalible);
+        if (!pData || !dwAvalible)
+        {
+            break;
+        }
+        size_t nLength = dwAvalible < nEnd - nOffset ? dwAvalible : (size_t)(nEnd - nOffset);
+        // pData只在下一次Visit之前有效，回调里不能再访问编辑层，所以先扫完整块再报告
+        size_t nPos = 0;
+        while (nPos < nLength)
+        {
+            vecHits.clear();
+            nPos += pMatcher->Scan(pData + nPos, nLength - nPos, nOffset + nPos, vecHits, kHitsPerScan);
+            for (size_t i = 0; i < vecHits.size(); i++)
+            {
+                if (!onHit(vecHits[i]))
+                {
+                    m_nBytesScanned += nPos;
+                    return TRUE;
+                }
+            }
+        }
+        nOffset += nLength;
+        m_nBytesScanned += nLength;
+
+        if (progress && m_nBytesScanned - m_nLastReport >= kProgressInterval)
+        {
+            m_nLastReport = m_nBytesScanned;
+            if (!progress(m_nBytesScanned, m_nProgressTotal))
+            {
+                return FALSE;
+            }
+        }
+    }
+    vecHits.clear();
+    pMatcher->Flush(vecHits);
+    for (size_t i = 0; i < vecHits.size(); i++)
+    {
+        if (!onHit(vecHits[i]))
+            break;
+    }
+    return TRUE;
+}
+
+int CSearcher::ScanRange(CEditBuffer* pBuffer, CMatcher* pMatcher, FileOffset nStart, FileOffset nEnd,
+                         const std::function<bool(const SearchHit& hit)>& onHit, const SearchProgress& progress)
+{
+    if (nEnd > pBuffer->GetSize())
+        nEnd = pBuffer->GetSize();
+    BeginStats(nEnd > nStart ? nEnd - nStart : 0);
+    int bResult = nStart < nEnd ? ScanBlock(pBuffer, pMatcher, nStart, nEnd, onHit, progress) : TRUE;
+    EndStats();
+    return bResult;
+}
+
+void CSearcher::ClipRanges(FileOffset nStart, FileOffset nEnd, std::vector<SearchRange>& vecRanges) const
+{
+    vecRanges.clear();
+    if (!m_bRanges)
+    {
+        if (nStart < nEnd)
+        {
+            SearchRange range;
+            range.nStart = nStart;
+            range.nEnd = nEnd;
+            vecRanges.push_back(range);
+        }
+        return;
+    }
+    for (size_t i = 0; i < m_vecRanges.size(); i++)
+    {
+        SearchRange range = m_vecRanges[i];
+        if (range.nStart < nStart)
+            range.nStart = nStart;
+        if (range.nEnd > nEnd)
+            range.nEnd = nEnd;
+        if (range.nStart < range.nEnd)
+            vecRanges.push_back(range);
+    }
+}
+
+int CSearcher::FindNext(CEditBuffer* pBuffer, CMatcher* pMatcher, FileOffset nFrom,
+                        SearchHit* pHit, int* pbFound, const SearchProgress& progress)
+{
+    *pbFound = FALSE;
+    FileOffset nSize = pBuffer->GetSize();
+    std::vector<SearchRange> vecRanges;
+    ClipRanges(nFrom, nSize, vecRanges);
+    FileOffset nTotal = 0;
+    for (size_t i = 0; i < vecRanges.size(); i++)
+        nTotal += vecRanges[i].nEnd - vecRanges[i].nStart;
+    BeginStats(nTotal);
+
+    // 起点在范围内的匹配可以越过范围的结尾
+    FileOffset nOverlap = pMatcher->GetMaxLength() ? pMatcher->GetMaxLength() - 1 : kUnboundedOverlap;
+    int bResult = TRUE;
+    for (size_t i = 0; i < vecRanges.size() && bResult && !*pbFound; i++)
+    {
+        FileOffset nEnd = vecRanges[i].nEnd;
+        FileOffset nScanEnd = nSize - nEnd > nOverlap ? nEnd + nOverlap : nSize;
+        bResult = ScanBlock(pBuffer, pMatcher, vecRanges[i].nStart, nScanEnd, [&](const SearchHit& hit) {
+            if (hit.nOffset >= nEnd)
+                return true;
+            *pHit = hit;
+            *pbFound = TRUE;
+            return false;
+        }, progress);
+    }
+    EndStats();
+    return bResult;
+}
+
+int CSearcher::FindPrevIn(CEditBuffer* pBuffer, CMatcher* pMatcher, FileOffset nLow, FileOffset nHigh,
+                          SearchHit* pHit, int* pbFound, const SearchProgress& progress)
+{
+    FileOffset nSize = pBuffer->GetSize();
+    // 匹配可以越过块尾，所以每块向后多扫描最长匹配长度-1个字节
+    FileOffset nOverlap = pMatcher->GetMaxLength() ? pMatcher->GetMaxLength() - 1 : kUnboundedOverlap;
+    FileOffset nBlockEnd = nHigh;
+    int bResult = TRUE;
+    while (nBlockEnd > nLow && !*pbFound)
+    {
+        FileOffset nBlockStart = nBlockEnd - nLow > kBackwardBlockSize ? nBlockEnd - kBackwardBlockSize : nLow;
+        FileOffset nScanEnd = nSize - nBlockEnd > nOverlap ? nBlockEnd + nOverlap : nSize;
+        bResult = ScanBlock(pBuffer, pMatcher, nBlockStart, nScanEnd, [&](const SearchHit& hit) {
+            if (hit.nOffset >= nBlockEnd)
+                return true;
+            // 起点相同的匹配取最先报告的那个，与向后查找一致
+            if (!*pbFound || hit.nOffset > pHit->nOffset)
+            {
+                *pHit = hit;
+                *pbFound = TRUE;
+            }
+            return true;
+        }, progress);
+        if (!bResult)
+        {
+            break;
+        }
+        nBlockEnd = nBlockStart;
+    }
+    return bResult;
+}
+
+int CSearcher::FindPrev(CEditBuffer* pBuffer, CMatcher* pMatcher, FileOffset nBefore,
+                        SearchHit* pHit, int* pbFound, const SearchProgress& progress)
+{
+    *pbFound = FALSE;
+    FileOffset nSize = pBuffer->GetSize();
+    if (nBefore > nSize)
+        nBefore = nSize;
+    std::vector<SearchRange> vecRanges;
+    ClipRanges(0, nBefore, vecRanges);
+    FileOffset nTotal = 0;
+    for (size_t i = 0; i < vecRanges.size(); i++)
+        nTotal += vecRanges[i].nEnd - vecRanges[i].nStart;
+    BeginStats(nTotal);
+
+    int bResult = TRUE;
+    for (size_t i = vecRanges.size(); i > 0 && bResult && !*pbFound; i--)
+    {
+        bResult = FindPrevIn(pBuffer, pMatcher, vecRanges[i - 1].nStart, vecRanges[i - 1].nEnd, pHit, pbFound, progress);
+    }
+    EndStats();
+    return bResult;
+}
@@ -0,0 +1,194 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include <functional>
+#include "EditBuffer.h"
+#include "SearchKernel.h"
+
+// 一次匹配
+typedef struct {
+    FileOffset nOffset;
+    FileOffset nLength;
+    uint32_t nPattern;  // 多模式查找时匹配的是第几个模式，单模式为0
+} SearchHit;
+
+// 一段逻辑偏移[nStart, nEnd)
+typedef struct {
+    FileOffset nStart;
+    FileOffset nEnd;
+} SearchRange;
+
+// 查找进度回调，返回false取消查找
+typedef std::function<bool(FileOffset nDone, FileOffset nTotal)> SearchProgress;
+
+/************************************************************************/
+/* streaming matcher.
+/* data is fed chunk by chunk in stream order; the matcher keeps whatever
+/* state it needs between chunks, so a match that spans two chunks (two
+/* CLargeFile views) is found without copying the data together.
+/************************************************************************/
+class CMatcher
+{
+public:
+    virtual ~CMatcher() {}
+
+    /************************************************************************/
+    /* forget the state carried over from earlier chunks.
+    /************************************************************************/
+    virtual void Reset() = 0;
+
+    /************************************************************************/
+    /* scan the next chunk, pData is at stream offset nBase. hits are
+    /* appended to vecHits in the order their last byte is reached; a hit
+    /* may start in an earlier chunk. stops after nMaxHits hits and returns
+    /* the number of bytes consumed (nLength if it did not stop early); the
+    /* rest of the chunk must be passed to the next call.
+    /************************************************************************/
+    virtual size_t Scan(const uint8_t* pData, size_t nLength, FileOffset nBase,
+                        std::vector<SearchHit>& vecHits, size_t nMaxHits) = 0;
+
+    /************************************************************************/
+    /* the stream ends: append the hits that were still waiting for the
+    /* data after them. most matchers report every hit in Scan and have
+    /* none.
+    /************************************************************************/
+    virtual void Flush(std::vector<SearchHit>& /*vecHits*/) {}
+
+    /************************************************************************/
+    /* longest possible match, used as the overlap between blocks that are
+    /* scanned independently. 0 if a match can be arbitrarily long.
+    /************************************************************************/
+    virtual size_t GetMaxLength() const = 0;
+
+    /************************************************************************/
+    /* a fresh matcher for the same pattern, for scanning on another thread.
+    /************************************************************************/
+    virtual CMatcher* Clone() const = 0;
+};
+
+// 基于kmp.cpp的流式KMP匹配器
+class CKmpMatcher : public CMatcher
+{
+public:
+    CKmpMatcher(const uint8_t* pPattern, size_t nLength, int bIgnoreCase = FALSE);
+    void Reset() { m_nState = -1; }
+    size_t Scan(const uint8_t* pData, size_t nLength, FileOffset nBase,
+                std::vector<SearchHit>& vecHits, size_t nMaxHits);
+    size_t GetMaxLength() const { return m_vecPattern.size(); }
+    CMatcher* Clone() const { return new CKmpMatcher(*this); }
+private:
+    std::vector<uint8_t> m_vecPattern; // 忽略大小写时已转成小写
+    std::vector<int> m_vecNext;
+    int m_bIgnoreCase;
+    int m_nState;                      // 跨缓冲区保留的KMP状态
+};
+
+/************************************************************************/
+/* base of the matchers whose matches all have the same length and that
+/* can find the first match inside one contiguous buffer.
+/* a buffer search only sees one chunk, so the last length-1 bytes of the
+/* stream are kept in a small stitch buffer; at the start of the next
+/* chunk the stitch buffer plus the first length-1 bytes of the chunk are
+/* searched for the matches that start in the previous chunk.
+/************************************************************************/
+class CFixedLengthMatcher : public CMatcher
+{
+public:
+    CFixedLengthMatcher(size_t nPatternLength) : m_nPatternLength(nPatternLength) {}
+    void Reset() { m_vecTail.clear(); }
+    size_t Scan(const uint8_t* pData, size_t nLength, FileOffset nBase,
+                std::vector<SearchHit>& vecHits, size_t nMaxHits);
+    size_t GetMaxLength() const { return m_nPatternLength; }
+protected:
+    /************************************************************************/
+    /* first match lying completely inside [pData, pData + nLength), NULL if
+    /* there is none.
+    /************************************************************************/
+    virtual const uint8_t* FindFirst(const uint8_t* pData, size_t nLength) const = 0;
+private:
+    // 把已消耗的数据记入尾部缓冲区，只保留最后模式长度-1个字节
+    void KeepTail(const uint8_t* pData, size_t nLength);
+
+    size_t m_nPatternLength;
+    std::vector<uint8_t> m_vecTail;    // 之前的数据的最后最多模式长度-1个字节
+    std::vector<uint8_t> m_vecStitch;  // 尾部缓冲区+本块开头，避免每次重新分配
+};
+
+// 基于CSearchKernel（SSE2/AVX2）的流式字面量匹配器
+class CLiteralMatcher : public CFixedLengthMatcher
+{
+public:
+    CLiteralMatcher(const uint8_t* pPattern, size_t nLength, int bIgnoreCase = FALSE);
+    CMatcher* Clone() const { return new CLiteralMatcher(*this); }
+    int GetImplementation() const { return m_kernel.GetImplementation(); }
+protected:
+    const uint8_t* FindFirst(const uint8_t* pData, size_t nLength) const { return m_kernel.Find(pData, nLength); }
+private:
+    CSearchKernel m_kernel;
+};
+
+/************************************************************************/
+/* drives a CMatcher over the edited data of a CEditBuffer, view by view,
+/* using CEditBuffer::Visit so the data is never copied.
+/* all functions return 1 when the scan ran to completion (found or not)
+/* and 0 when it was cancelled by the progress callback.
+/************************************************************************/
+class CSearcher
+{
+public:
+    CSearcher();
+
+    /************************************************************************/
+    /* only look for hits starting inside vecRanges (sorted, disjoint), e.g.
+    /* the blocks a CNgramIndex says can hold the pattern; the rest of the
+    /* buffer is skipped by FindNext/FindPrev. ClearRanges searches all.
+    /************************************************************************/
+    void SetRanges(const std::vector<SearchRange>& vecRanges) { m_vecRanges = vecRanges; m_bRanges = TRUE; }
+    void ClearRanges() { m_vecRanges.clear(); m_bRanges = FALSE; }
+
+    /************************************************************************/
+    /* first hit starting at or after nFrom. *pbFound tells if there was one.
+    /************************************************************************/
+    int FindNext(CEditBuffer* pBuffer, CMatcher* pMatcher, FileOffset nFrom,
+                 SearchHit* pHit, int* pbFound, const SearchProgress& progress = SearchProgress());
+
+    /************************************************************************/
+    /* last hit starting before nBefore, scanning backwards block by block.
+    /************************************************************************/
+    int FindPrev(CEditBuffer* pBuffer, CMatcher* pMatcher, FileOffset nBefore,
+                 SearchHit* pHit, int* pbFound, const SearchProgress& progress = SearchProgress());
+
+    /************************************************************************/
+    /* feed [nStart, nEnd) to pMatcher (after Reset) and call onHit for every
+    /* hit; onHit returns false to stop early.
+    /************************************************************************/
+    int ScanRange(CEditBuffer* pBuffer, CMatcher* pMatcher, FileOffset nStart, FileOffset nEnd,
+                  const std::function<bool(const SearchHit& hit)>& onHit,
+                  const SearchProgress& progress = SearchProgress());
+
+    /************************************************************************/
+    /* statistics of the last FindNext/FindPrev/ScanRange call.
+    /************************************************************************/
+    uint64_t GetBytesScanned() const { return m_nBytesScanned; }
+    double GetSeconds() const { return m_dSeconds; }
+    double GetThroughput() const; // MB/s
+
+private:
+    void BeginStats(FileOffset nTotal);
+    void EndStats();
+    int ScanBlock(CEditBuffer* pBuffer, CMatcher* pMatcher, FileOffset nStart, FileOffset nEnd,
+                  const std::function<bool(const SearchHit& hit)>& onHit, const SearchProgress& progress);
+    // 在[nLow, nHigh)中从后往前分块找最后一个起点在其中的匹配
+    int FindPrevIn(CEditBuffer* pBuffer, CMatcher* pMatcher, FileOffset nLow, FileOffset nHigh,
+                   SearchHit* pHit, int* pbFound, const SearchProgress& progress);
+    // 要查找的范围：设置了m_vecRanges时是它们与[nStart, nEnd)的交集，否则就是[nStart, nEnd)
+    void ClipRanges(FileOffset nStart, FileOffset nEnd, std::vector<SearchRange>& vecRanges) const;
+
+    uint64_t m_nBytesScanned;
+    uint64_t m_nLastReport;
+    FileOffset m_nProgressTotal;
+    double m_dSeconds;
+    uint64_t m_nStartTime;
+    std::vector<SearchRange> m_vecRanges;
+    int m_bRanges;
+};
@@ -0,0 +1,229 @@
+#include "SearchKernel.h"
+#include "kmp.h"
+#include <string.h>
+
+// GCC/Clang（包括MinGW）在x86上用target属性单独编译SSE2/AVX2版本，运行时按CPU选择；
+// 其他编译器/平台只有标量实现
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define FOOLHEX_KERNEL_X86 1
+#include <immintrin.h>
+#endif
+
+// kmp.cpp的接口是int长度，超过的部分分段查找
+static const size_t kMaxKmpChunk = 0x40000000;
+
+static inline uint8_t ToLower(uint8_t c)
+{
+    return (uint8_t)(c - 'A') < 26 ? c | 0x20 : c;
+}
+
+// 比较nLength个字节，pPattern忽略大小写时已是小写
+template<int bIgnoreCase>
+static inline int Verify(const uint8_t* pData, const uint8_t* pPattern, size_t nLength)
+{
+    if (!bIgnoreCase)
+    {
+        return memcmp(pData, pPattern, nLength) == 0;
+    }
+    for (size_t i = 0; i < nLength; i++)
+    {
+        if (ToLower(pData[i]) != pPattern[i])
+            return 0;
+    }
+    return 1;
+}
+
+// 逐个位置比较，只用于向量循环剩下的不足一个向量的尾部
+template<int bIgnoreCase>
+static const uint8_t* FindTail(const CSearchKernel& kernel, const uint8_t* pData, size_t nLength)
+{
+    size_t nPattern = kernel.GetLength();
+    for (size_t i = 0; i + nPattern <= nLength; i++)
+    {
+        if (Verify<bIgnoreCase>(pData + i, kernel.GetPattern(), nPattern))
+            return pData + i;
+    }
+    return NULL;
+}
+
+#if defined(FOOLHEX_KERNEL_X86)
+
+// 把'A'-'Z'转成小写：加上0x80-'A'后大写字母落在有符号的[-128, -103]，一次比较得到掩码
+__attribute__((target("sse2")))
+static inline __m128i FoldSse2(__m128i x)
+{
+    __m128i t = _mm_add_epi8(x, _mm_set1_epi8((char)(0x80 - 'A')));
+    __m128i upper = _mm_cmplt_epi8(t, _mm_set1_epi8((char)(-128 + 26)));
+    return _mm_or_si128(x, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i FoldAvx2(__m256i x)
+{
+    __m256i t = _mm256_add_epi8(x, _mm256_set1_epi8((char)(0x80 - 'A')));
+    __m256i upper = _mm256_cmpgt_epi8(_mm256_set1_epi8((char)(-128 + 26)), t);
+    return _mm256_or_si256(x, _mm256_and_si256(upper, _mm256_set1_epi8(0x20)));
+}
+
+/************************************************************************/
+/* first/last byte filter: for 16 candidate starts i..i+15 load the bytes
+/* at i and at i + n - 1, compare with the first and last pattern byte and
+/* only verify the middle of the positions where both compare equal.
+/************************************************************************/
+template<int bIgnoreCase>
+__attribute__((target("sse2")))
+static const uint8_t* FindSse2(const CSearchKernel& kernel, const uint8_t* pData, size_t nLength)
+{
+    size_t nPattern = kernel.GetLength();
+    const uint8_t* pPattern = kernel.GetPattern();
+    if (nLength < nPattern)
+        return NULL;
+    const __m128i first = _mm_set1_epi8((char)pPattern[0]);
+    const __m128i last = _mm_set1_epi8((char)pPattern[nPattern - 1]);
+    size_t i = 0;
+    for (; i + nPattern - 1 + 16 <= nLength; i += 16)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i*)(pData + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(pData + i + nPattern - 1));
+        if (bIgnoreCase)
+        {
+            a = FoldSse2(a);
+            b = FoldSse2(b);
+        }
+        unsigned nMask = (unsigned)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+        while (nMask)
+        {
+            size_t nBit = __builtin_ctz(nMask);
+            if (nPattern <= 2 || Verify<bIgnoreCase>(pData + i + nBit + 1, pPattern + 1, nPattern - 2))
+                return pData + i + nBit;
+            nMask &= nMask - 1;
+        }
+    }
+    return FindTail<bIgnoreCase>(kernel, pData + i, nLength - i);
+}
+
+template<int bIgnoreCase>
+__attribute__((target("avx2")))
+static const uint8_t* FindAvx2(const CSearchKernel& kernel, const uint8_t* pData, size_t nLength)
+{
+    size_t nPattern = kernel.GetLength();
+    const uint8_t* pPattern = kernel.GetPattern();
+    if (nLength < nPattern)
+        return NULL;
+    const __m256i first = _mm256_set1_epi8((char)pPattern[0]);
+    const __m256i last = _mm256_set1_epi8((char)pPattern[nPattern - 1]);
+    size_t i = 0;
+    for (; i + nPattern - 1 + 32 <= nLength; i += 32)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(pData + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(pData + i + nPattern - 1));
+        if (bIgnoreCase)
+        {
+            a = FoldAvx2(a);
+            b = FoldAvx2(b);
+        }
+        unsigned nMask = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+        while (nMask)
+        {
+            size_t nBit = __builtin_ctz(nMask);
+            if (nPattern <= 2 || Verify<bIgnoreCase>(pData + i + nBit + 1, pPattern + 1, nPattern - 2))
+                return pData + i + nBit;
+            nMask &= nMask - 1;
+        }
+    }
+    // 剩下不到32个候选位置，交给SSE2版本
+    return FindSse2<bIgnoreCase>(kernel, pData + i, nLength - i);
+}
+
+#endif // FOOLHEX_KERNEL_X86
+
+CSearchKernel::CSearchKernel(const uint8_t* pPattern, size_t nLength, int bIgnoreCase, int nImpl)
+    : m_vecPattern(pPattern, pPattern + nLength), m_bIgnoreCase(bIgnoreCase), m_nImpl(KERNEL_SCALAR)
+    , m_pfnFind(FindScalar)
+{
+    if (m_bIgnoreCase)
+    {
+        for (size_t i = 0; i < m_vecPattern.size(); i++)
+            m_vecPattern[i] = ToLower(m_vecPattern[i]);
+    }
+    m_vecNext.resize(nLength ? nLength : 1);
+    if (nLength)
+    {
+        if (m_bIgnoreCase)
+            kmp_cal_next_ignore_case(&m_vecPattern[0], (int)nLength, &m_vecNext[0]);
+        else
+            kmp_cal_next(&m_vecPattern[0], (int)nLength, &m_vecNext[0]);
+    }
+
+    int nBest = GetBestImplementation();
+    if (nImpl == KERNEL_AUTO || nImpl > nBest)
+        nImpl = nBest;
+    if (!nLength)
+        return;
+#if defined(FOOLHEX_KERNEL_X86)
+    // 单字节区分大小写时libc的memchr已经是向量化的，标量版本直接用它
+    if (nLength == 1 && !m_bIgnoreCase)
+        return;
+    if (nImpl == KERNEL_AVX2)
+    {
+        m_nImpl = KERNEL_AVX2;
+        m_pfnFind = m_bIgnoreCase ? FindAvx2<1> : FindAvx2<0>;
+    }
+    else if (nImpl == KERNEL_SSE2)
+    {
+        m_nImpl = KERNEL_SSE2;
+        m_pfnFind = m_bIgnoreCase ? FindSse2<1> : FindSse2<0>;
+    }
+#endif
+}
+
+const uint8_t* CSearchKernel::FindScalar(const CSearchKernel& kernel, const uint8_t* pData, size_t nLength)
+{
+    size_t nPattern = kernel.GetLength();
+    if (!nPattern || nLength < nPattern)
+        return NULL;
+    if (nPattern == 1 && !kernel.m_bIgnoreCase)
+        return (const uint8_t*)memchr(pData, kernel.m_vecPattern[0], nLength);
+
+    // 分段时相邻两段重叠nPattern-1个字节，跨段的匹配不会漏掉
+    size_t nPos = 0;
+    while (nPos + nPattern <= nLength)
+    {
+        int nChunk = nLength - nPos > kMaxKmpChunk ? (int)kMaxKmpChunk : (int)(nLength - nPos);
+        int nFound = kernel.m_bIgnoreCase
+            ? KMP_ignore_case(pData + nPos, nChunk, &kernel.m_vecPattern[0], (int)nPattern, &kernel.m_vecNext[0])
+            : KMP(pData + nPos, nChunk, &kernel.m_vecPattern[0], (int)nPattern, &kernel.m_vecNext[0]);
+        if (nFound >= 0)
+            return pData + nPos + nFound;
+        if (nPos + nChunk >= nLength)
+            break;
+        nPos += nChunk - (nPattern - 1);
+    }
+    return NULL;
+}
+
+int CSearchKernel::GetBestImplementation()
+{
+#if defined(FOOLHEX_KERNEL_X86)
+    static int s_nBest = __builtin_cpu_supports("avx2") ? KERNEL_AVX2
+                       : __builtin_cpu_supports("sse2") ? KERNEL_SSE2 : KERNEL_SCALAR;
+    return s_nBest;
+#else
+    return KERNEL_SCALAR;
+#endif
+}
+
+const char* CSearchKernel::GetImplementationName(int nImpl)
+{
+    switch (nImpl)
+    {
+    case KERNEL_SCALAR:
+        return "kmp";
+    case KERNEL_SSE2:
+        return "sse2";
+    case KERNEL_AVX2:
+        return "avx2";
+    default:
+        return "auto";
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+// 查找内核的实现，KERNEL_AUTO按CPU自动选择
+enum {
+    KERNEL_AUTO = 0,
+    KERNEL_SCALAR,  // kmp.cpp的KMP/KMP_ignore_case
+    KERNEL_SSE2,
+    KERNEL_AVX2,
+};
+
+/************************************************************************/
+/* literal byte pattern search kernel.
+/* the vector versions compare the first and the last pattern byte against
+/* 16/32 candidate positions at once and only verify the positions where
+/* both match, so short hex patterns run close to memory bandwidth.
+/* ignore-case folds 'A'-'Z' inside the vector registers the same way.
+/* the implementation is picked once per kernel from the running CPU; the
+/* KMP functions of kmp.cpp are the fallback for other CPUs/compilers.
+/************************************************************************/
+class CSearchKernel
+{
+public:
+    /************************************************************************/
+    /* nImpl forces an implementation (for benchmarks); one the CPU does not
+    /* support falls back to the best supported one below it.
+    /************************************************************************/
+    CSearchKernel(const uint8_t* pPattern, size_t nLength, int bIgnoreCase = 0, int nImpl = KERNEL_AUTO);
+
+    /************************************************************************/
+    /* first occurrence of the pattern that lies completely inside
+    /* [pData, pData + nLength), NULL if there is none.
+    /************************************************************************/
+    const uint8_t* Find(const uint8_t* pData, size_t nLength) const
+    {
+        return m_pfnFind(*this, pData, nLength);
+    }
+
+    size_t GetLength() const { return m_vecPattern.size(); }
+    int IsIgnoreCase() const { return m_bIgnoreCase; }
+    int GetImplementation() const { return m_nImpl; }
+    const uint8_t* GetPattern() const { return m_vecPattern.empty() ? NULL : &m_vecPattern[0]; }
+
+    /************************************************************************/
+    /* best implementation the running CPU supports, and a printable name.
+    /************************************************************************/
+    static int GetBestImplementation();
+    static const char* GetImplementationName(int nImpl);
+
+private:
+    typedef const uint8_t* (*FindFunc)(const CSearchKernel& kernel, const uint8_t* pData, size_t nLength);
+
+    // 向量版本在SearchKernel.cpp里，按CPU在构造时选定
+    static const uint8_t* FindScalar(const CSearchKernel& kernel, const uint8_t* pData, size_t nLength);
+
+    std::vector<uint8_t> m_vecPattern;  // 忽略大小写时已转成小写
+    std::vector<int> m_vecNext;         // 标量实现用的KMP next表
+    int m_bIgnoreCase;
+    int m_nImpl;
+    FindFunc m_pfnFind;
+};
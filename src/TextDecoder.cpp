@@ -0,0 +1,280 @@
+#include "TextDecoder.h"
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <iconv.h>
+#endif
+
+// 单字节的显示：32~126显示本身，其余为'.'
+struct AsciiGlyphTable
+{
+    uint32_t aGlyph[256];
+    AsciiGlyphTable()
+    {
+        for (int i = 0; i < 256; i++)
+            aGlyph[i] = (i >= 32 && i <= 126) ? (uint32_t)i : GLYPH_INVALID;
+    }
+};
+static const AsciiGlyphTable kAscii;
+
+// UTF-8首字节对应的序列长度，0为后续字节或不可能出现的字节（C0、C1、F5~FF）
+struct Utf8LengthTable
+{
+    uint8_t aLength[256];
+    Utf8LengthTable()
+    {
+        for (int i = 0; i < 256; i++)
+        {
+            aLength[i] = i < 0x80 ? 1 : (i >= 0xC2 && i <= 0xDF) ? 2 : (i >= 0xE0 && i <= 0xEF) ? 3
+                       : (i >= 0xF0 && i <= 0xF4) ? 4 : 0;
+        }
+    }
+};
+static const Utf8LengthTable kUtf8;
+
+// GBK双字节到Unicode的表（首字节0x81~0xFE，尾字节0x40~0xFE），第一次用到时由平台的转换器生成
+struct GbkTable
+{
+    uint16_t aUnicode[126][191];
+    GbkTable()
+    {
+        memset(aUnicode, 0, sizeof(aUnicode));
+#ifdef _WIN32
+        for (int nLead = 0x81; nLead <= 0xFE; nLead++)
+        {
+            for (int nTrail = 0x40; nTrail <= 0xFE; nTrail++)
+            {
+                char in[2] = { (char)nLead, (char)nTrail };
+                wchar_t out[2];
+                if (MultiByteToWideChar(936, MB_ERR_INVALID_CHARS, in, 2, out, 2) == 1)
+                    aUnicode[nLead - 0x81][nTrail - 0x40] = (uint16_t)out[0];
+            }
+        }
+#else
+        iconv_t cd = iconv_open("UTF-16LE", "GBK");
+        if (cd == (iconv_t)-1)
+            return;
+        for (int nLead = 0x81; nLead <= 0xFE; nLead++)
+        {
+            for (int nTrail = 0x40; nTrail <= 0xFE; nTrail++)
+            {
+                char in[2] = { (char)nLead, (char)nTrail };
+                char out[8];
+                char* pIn = in;
+                char* pOut = out;
+                size_t nIn = sizeof(in);
+                size_t nOut = sizeof(out);
+                if (iconv(cd, &pIn, &nIn, &pOut, &nOut) != (size_t)-1 && nIn == 0 && sizeof(out) - nOut == 2)
+                    aUnicode[nLead - 0x81][nTrail - 0x40] = (uint16_t)((uint8_t)out[0] | (uint8_t)out[1] << 8);
+                iconv(cd, NULL, NULL, NULL, NULL);
+            }
+        }
+        iconv_close(cd);
+#endif
+    }
+};
+
+static const GbkTable& GetGbkTable()
+{
+    static const GbkTable s_table;
+    return s_table;
+}
+
+// 可以显示的码点：排除控制字符和代理区
+static inline uint32_t GlyphOf(uint32_t nCodePoint)
+{
+    if (nCodePoint < 0x20 || nCodePoint == 0x7F || (nCodePoint >= 0x80 && nCodePoint < 0xA0) ||
+        (nCodePoint >= 0xD800 && nCodePoint <= 0xDFFF) || nCodePoint > 0x10FFFF)
+        return GLYPH_INVALID;
+    return nCodePoint;
+}
+
+// 从pData开始连续的ASCII字节，每次检查8个字节，返回处理的字节数
+static size_t CopyAscii(const uint8_t* pData, size_t nSize, uint32_t* pGlyphs)
+{
+    size_t i = 0;
+    while (i + 8 <= nSize)
+    {
+        uint64_t nWord;
+        memcpy(&nWord, pData + i, 8);
+        if (nWord & 0x8080808080808080ull)
+            break;
+        for (int j = 0; j < 8; j++)
+            pGlyphs[i + j] = kAscii.aGlyph[pData[i + j]];
+        i += 8;
+    }
+    while (i < nSize && pData[i] < 0x80)
+    {
+        pGlyphs[i] = kAscii.aGlyph[pData[i]];
+        i++;
+    }
+    return i;
+}
+
+CTextDecoder::CTextDecoder()
+{
+    m_nEncoding = DECODE_ASCII;
+    m_bValid = FALSE;
+    m_nOffset = 0;
+    m_nSize = 0;
+    m_nSerial = 0;
+    m_nDecodes = 0;
+    m_nCacheHits = 0;
+}
+
+void CTextDecoder::SetEncoding(int nEncoding)
+{
+    if (nEncoding < 0 || nEncoding >= DECODE_ENCODING_COUNT || nEncoding == m_nEncoding)
+        return;
+    m_nEncoding = nEncoding;
+    m_bValid = FALSE;
+}
+
+const char* CTextDecoder::GetEncodingName(int nEncoding)
+{
+    static const char* const kNames[DECODE_ENCODING_COUNT] = { "ASCII", "UTF-8", "UTF-16LE", "UTF-16BE", "GBK" };
+    return nEncoding >= 0 && nEncoding < DECODE_ENCODING_COUNT ? kNames[nEncoding] : "?";
+}
+
+uint32_t CTextDecoder::GbkToUnicode(uint8_t nLead, uint8_t nTrail)
+{
+    if (nLead < 0x81 || nLead > 0xFE || nTrail < 0x40 || nTrail > 0xFE)
+        return 0;
+    return GetGbkTable().aUnicode[nLead - 0x81][nTrail - 0x40];
+}
+
+const uint32_t* CTextDecoder::Decode(const uint8_t* pData, size_t nSize, FileOffset nOffset, uint64_t nSerial)
+{
+    if (m_bValid && m_nOffset == nOffset && m_nSize == nSize && m_nSerial == nSerial)
+    {
+        m_nCacheHits++;
+        return m_vecGlyphs.empty() ? NULL : &m_vecGlyphs[0];
+    }
+    m_vecGlyphs.resize(nSize);
+    if (nSize)
+    {
+        switch (m_nEncoding)
+        {
+        case DECODE_UTF8:
+            DecodeUtf8(pData, nSize, &m_vecGlyphs[0]);
+            break;
+        case DECODE_UTF16LE:
+        case DECODE_UTF16BE:
+            DecodeUtf16(pData, nSize, nOffset, m_nEncoding == DECODE_UTF16BE, &m_vecGlyphs[0]);
+            break;
+        case DECODE_GBK:
+            DecodeGbk(pData, nSize, &m_vecGlyphs[0]);
+            break;
+        default:
+            DecodeAscii(pData, nSize, &m_vecGlyphs[0]);
+            break;
+        }
+    }
+    m_bValid = TRUE;
+    m_nOffset = nOffset;
+    m_nSize = nSize;
+    m_nSerial = nSerial;
+    m_nDecodes++;
+    return m_vecGlyphs.empty() ? NULL : &m_vecGlyphs[0];
+}
+
+void CTextDecoder::DecodeAscii(const uint8_t* pData, size_t nSize, uint32_t* pGlyphs)
+{
+    for (size_t i = 0; i < nSize; i++)
+        pGlyphs[i] = kAscii.aGlyph[pData[i]];
+}
+
+void CTextDecoder::DecodeUtf8(const uint8_t* pData, size_t nSize, uint32_t* pGlyphs)
+{
+    // 缓冲区开头的后续字节属于前面的字符
+    size_t i = 0;
+    while (i < nSize && i < 3 && (pData[i] & 0xC0) == 0x80)
+        pGlyphs[i++] = GLYPH_CONTINUATION;
+    static const uint32_t kMinimum[5] = { 0, 0, 0x80, 0x800, 0x10000 };
+    while (i < nSize)
+    {
+        i += CopyAscii(pData + i, nSize - i, pGlyphs + i);
+        if (i >= nSize)
+            break;
+        size_t nLength = kUtf8.aLength[pData[i]];
+        // 无效的首字节，或者序列不完整，这个字节显示为'.'，从下一个字节重新开始
+        int bValid = nLength > 1 && i + nLength <= nSize;
+        uint32_t nCodePoint = pData[i] & (0x7F >> nLength);
+        for (size_t j = 1; bValid && j < nLength; j++)
+        {
+            if ((pData[i + j] & 0xC0) != 0x80)
+                bValid = FALSE;
+            nCodePoint = nCodePoint << 6 | (pData[i + j] & 0x3F);
+        }
+        // 过长的编码、代理区和超出范围的码点都是无效的
+        if (!bValid || nCodePoint < kMinimum[nLength] || nCodePoint > 0x10FFFF ||
+            (nCodePoint >= 0xD800 && nCodePoint <= 0xDFFF))
+        {
+            pGlyphs[i++] = GLYPH_INVALID;
+            continue;
+        }
+        pGlyphs[i] = GlyphOf(nCodePoint);
+        for (size_t j = 1; j < nLength; j++)
+            pGlyphs[i + j] = GLYPH_CONTINUATION;
+        i += nLength;
+    }
+}
+
+void CTextDecoder::DecodeUtf16(const uint8_t* pData, size_t nSize, FileOffset nOffset, int bBigEndian, uint32_t* pGlyphs)
+{
+    // 代码单元对齐到文件中的偶数偏移
+    size_t i = 0;
+    if (nOffset & 1)
+        pGlyphs[i++] = GLYPH_CONTINUATION;
+    size_t nStart = i;
+    while (i + 2 <= nSize)
+    {
+        uint32_t nUnit = bBigEndian ? (uint32_t)pData[i] << 8 | pData[i + 1] : pData[i] | (uint32_t)pData[i + 1] << 8;
+        pGlyphs[i + 1] = GLYPH_CONTINUATION;
+        if (nUnit >= 0xD800 && nUnit <= 0xDBFF && i + 4 <= nSize)
+        {
+            uint32_t nLow = bBigEndian ? (uint32_t)pData[i + 2] << 8 | pData[i + 3] : pData[i + 2] | (uint32_t)pData[i + 3] << 8;
+            if (nLow >= 0xDC00 && nLow <= 0xDFFF)
+            {
+                pGlyphs[i] = GlyphOf(0x10000 + ((nUnit - 0xD800) << 10) + (nLow - 0xDC00));
+                pGlyphs[i + 2] = pGlyphs[i + 3] = GLYPH_CONTINUATION;
+                i += 4;
+                continue;
+            }
+        }
+        // 缓冲区开头的低代理属于前面的代理对，其他单独的代理都是无效的
+        if (nUnit >= 0xDC00 && nUnit <= 0xDFFF && i == nStart)
+            pGlyphs[i] = GLYPH_CONTINUATION;
+        else
+            pGlyphs[i] = GlyphOf(nUnit);
+        i += 2;
+    }
+    if (i < nSize)
+        pGlyphs[i] = GLYPH_INVALID;
+}
+
+void CTextDecoder::DecodeGbk(const uint8_t* pData, size_t nSize, uint32_t* pGlyphs)
+{
+    const GbkTable& table = GetGbkTable();
+    size_t i = 0;
+    while (i < nSize)
+    {
+        i += CopyAscii(pData + i, nSize - i, pGlyphs + i);
+        if (i >= nSize)
+            break;
+        uint8_t nLead = pData[i];
+        if (nLead >= 0x81 && nLead <= 0xFE && i + 1 < nSize && pData[i + 1] >= 0x40 && pData[i + 1] <= 0xFE)
+        {
+            uint32_t nCodePoint = table.aUnicode[nLead - 0x81][pData[i + 1] - 0x40];
+            if (nCodePoint)
+            {
+                pGlyphs[i] = GlyphOf(nCodePoint);
+                pGlyphs[i + 1] = GLYPH_CONTINUATION;
+                i += 2;
+                continue;
+            }
+        }
+        pGlyphs[i++] = GLYPH_INVALID;
+    }
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "LargeFile.h"
+
+// 文本列的编码
+enum TextDecoding {
+    DECODE_ASCII = 0,     // 每个字节一个字符，只显示32~126
+    DECODE_UTF8,
+    DECODE_UTF16LE,
+    DECODE_UTF16BE,
+    DECODE_GBK,
+    DECODE_ENCODING_COUNT,
+};
+
+// 解码结果中不是字符起点的字节（多字节字符后面的字节）
+static const uint32_t GLYPH_CONTINUATION = 0xFFFFFFFFu;
+// 无效或不可显示的字节
+static const uint32_t GLYPH_INVALID = '.';
+
+/************************************************************************/
+/* decodes the bytes of the screen buffer for the text column, one glyph
+/* per byte: the code point of the character that starts there, '.' for
+/* invalid or unprintable data, GLYPH_CONTINUATION for the other bytes of
+/* a multi-byte character, so a character that spans two rows is drawn
+/* once, at its first byte, and its bytes in the next row stay blank.
+/* decoding starts at the beginning of the buffer, a screen before the
+/* visible rows: UTF-8 and UTF-16 resynchronize right away (UTF-16 units
+/* are aligned to even file offsets), GBK, whose trail bytes can look like
+/* lead bytes, at the end of the first run of double bytes.
+/* ASCII runs are checked 8 bytes at a time, multi-byte sequences through
+/* a lead byte table; GBK double bytes map through a table built once
+/* from the platform converter (iconv / code page 936).
+/* the result is cached for the buffer, so scrolling within the loaded
+/* rows or redrawing after a selection change does no decoding.
+/* used on the UI thread only.
+/************************************************************************/
+class CTextDecoder
+{
+public:
+    CTextDecoder();
+
+    void SetEncoding(int nEncoding);
+    int GetEncoding() const { return m_nEncoding; }
+
+    /************************************************************************/
+    /* glyphs of the nSize bytes at pData, which are the bytes at nOffset
+    /* of the file. nSerial identifies the buffer content: the cached result
+    /* is returned while the offset, size, serial and encoding stay the same.
+    /************************************************************************/
+    const uint32_t* Decode(const uint8_t* pData, size_t nSize, FileOffset nOffset, uint64_t nSerial);
+
+    // 解码次数和直接使用缓存的次数
+    uint64_t GetDecodeCount() const { return m_nDecodes; }
+    uint64_t GetCacheHitCount() const { return m_nCacheHits; }
+
+    static const char* GetEncodingName(int nEncoding);
+
+    /************************************************************************/
+    /* the code point of a GBK double byte, 0 when it is not a character or
+    /* the platform has no GBK converter.
+    /************************************************************************/
+    static uint32_t GbkToUnicode(uint8_t nLead, uint8_t nTrail);
+
+private:
+    void DecodeAscii(const uint8_t* pData, size_t nSize, uint32_t* pGlyphs);
+    void DecodeUtf8(const uint8_t* pData, size_t nSize, uint32_t* pGlyphs);
+    void DecodeUtf16(const uint8_t* pData, size_t nSize, FileOffset nOffset, int bBigEndian, uint32_t* pGlyphs);
+    void DecodeGbk(const uint8_t* pData, size_t nSize, uint32_t* pGlyphs);
+
+    int m_nEncoding;
+    std::vector<uint32_t> m_vecGlyphs;  // 缓存的结果
+    int m_bValid;
+    FileOffset m_nOffset;               // 缓存对应的缓冲区
+    size_t m_nSize;
+    uint64_t m_nSerial;
+    uint64_t m_nDecodes;
+    uint64_t m_nCacheHits;
+};
@@ -0,0 +1,78 @@
+#include "TextMatcher.h"
+#include "Unicode.h"
+#include <stdio.h>
+
+// 把字节串写成正则表达式里的\xHH
+static void AppendEscaped(const std::string& strBytes, std::string& strRegex)
+{
+    for (size_t i = 0; i < strBytes.size(); i++)
+    {
+        char szByte[8];
+        snprintf(szByte, sizeof(szByte), "\\x%02X", (uint8_t)strBytes[i]);
+        strRegex += szByte;
+    }
+}
+
+int CTextMatcher::SetText(const char* pszText, int nEncodings, int bIgnoreCase)
+{
+    m_vecEncodings.clear();
+    std::vector<uint32_t> vecText;
+    if (!DecodeUtf8(pszText, vecText) || vecText.empty())
+        return FALSE;
+
+    std::vector<std::string> vecPatterns;
+    std::vector<uint32_t> vecVariants;
+    for (int nEncoding = TEXT_UTF8; nEncoding <= TEXT_UTF16BE; nEncoding <<= 1)
+    {
+        if (!(nEncodings & nEncoding))
+            continue;
+        // 每个字符是它所有大小写形式的编码的选择
+        std::string strRegex;
+        for (size_t i = 0; i < vecText.size(); i++)
+        {
+            if (bIgnoreCase)
+                UnicodeCaseVariants(vecText[i], vecVariants);
+            else
+                vecVariants.assign(1, vecText[i]);
+            if (vecVariants.size() > 1)
+                strRegex += "(?:";
+            for (size_t j = 0; j < vecVariants.size(); j++)
+            {
+                std::string strBytes;
+                if (nEncoding == TEXT_UTF8)
+                    AppendUtf8(vecVariants[j], strBytes);
+                else
+                    AppendUtf16(vecVariants[j], nEncoding == TEXT_UTF16BE, strBytes);
+                if (j)
+                    strRegex += '|';
+                AppendEscaped(strBytes, strRegex);
+            }
+            if (vecVariants.size() > 1)
+                strRegex += ')';
+        }
+        vecPatterns.push_back(strRegex);
+        m_vecEncodings.push_back(nEncoding);
+    }
+    if (vecPatterns.empty() || !Compile(vecPatterns))
+    {
+        m_vecEncodings.clear();
+        return FALSE;
+    }
+    return TRUE;
+}
+
+int CTextMatcher::GetPatternEncoding(uint32_t nPattern) const
+{
+    return nPattern < m_vecEncodings.size() ? m_vecEncodings[nPattern] : 0;
+}
+
+const char* CTextMatcher::GetEncodingName(int nEncoding)
+{
+    switch (nEncoding)
+    {
+    case TEXT_UTF8: return "UTF-8";
+    case TEXT_UTF16LE: return "UTF-16LE";
+    case TEXT_UTF16BE: return "UTF-16BE";
+    default: return "";
+    }
+}
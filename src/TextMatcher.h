@@ -0,0 +1,40 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include "RegexMatcher.h"
+
+// 文本查找的编码，可以组合
+enum {
+    TEXT_UTF8 = 1,
+    TEXT_UTF16LE = 2,
+    TEXT_UTF16BE = 4,
+    TEXT_ALL_ENCODINGS = TEXT_UTF8 | TEXT_UTF16LE | TEXT_UTF16BE,
+};
+
+/************************************************************************/
+/* finds a text in several encodings at once: UTF-8, UTF-16LE and
+/* UTF-16BE, optionally with Unicode simple case folding.
+/* every encoding is one pattern of a CRegexMatcher in which a character
+/* is the alternation of the encoded forms of its case variants. those
+/* can differ in length (KELVIN SIGN is 3 bytes in UTF-8, 'k' is 1), which
+/* a byte-wise fold like KMP_ignore_case cannot express. the lazy DFA then
+/* covers every encoding and every case variant in one pass over the data.
+/* SearchHit::nPattern is the pattern index, GetPatternEncoding() maps it
+/* to the TEXT_ encoding that matched.
+/************************************************************************/
+class CTextMatcher : public CRegexMatcher
+{
+public:
+    /************************************************************************/
+    /* pszText is UTF-8. return FALSE if it is empty or not valid UTF-8.
+    /************************************************************************/
+    int SetText(const char* pszText, int nEncodings = TEXT_ALL_ENCODINGS, int bIgnoreCase = FALSE);
+    CMatcher* Clone() const { return new CTextMatcher(*this); }
+
+    size_t GetPatternCount() const { return m_vecEncodings.size(); }
+    int GetPatternEncoding(uint32_t nPattern) const;
+    static const char* GetEncodingName(int nEncoding);
+
+private:
+    std::vector<int> m_vecEncodings;   // 每个模式的编码
+};
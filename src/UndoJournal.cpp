@@ -0,0 +1,183 @@
+#include "UndoJournal.h"
+
+CUndoJournal::CUndoJournal()
+    : m_pBuffer(NULL), m_bSealed(TRUE)
+{
+}
+
+void CUndoJournal::Attach(CEditBuffer* pBuffer)
+{
+    Clear();
+    m_pBuffer = pBuffer;
+}
+
+void CUndoJournal::Clear()
+{
+    std::vector<Record>().swap(m_vecUndo);
+    std::vector<Record>().swap(m_vecRedo);
+    m_bSealed = TRUE;
+}
+
+int CUndoJournal::Overwrite(FileOffset nOffset, const uint8_t* pData, size_t nLength, int bCoalesce)
+{
+    FileOffset nSize = m_pBuffer->GetSize();
+    FileOffset nReplace = nOffset < nSize ? nSize - nOffset : 0;
+    if (nReplace > nLength)
+        nReplace = nLength;
+    return Apply(nOffset, nReplace, nLength, bCoalesce, [&]() {
+        return m_pBuffer->Overwrite(nOffset, pData, nLength);
+    });
+}
+
+int CUndoJournal::Insert(FileOffset nOffset, const uint8_t* pData, size_t nLength, int bCoalesce)
+{
+    return Apply(nOffset, 0, nLength, bCoalesce, [&]() {
+        return m_pBuffer->Insert(nOffset, pData, nLength);
+    });
+}
+
+int CUndoJournal::Delete(FileOffset nOffset, FileOffset nLength)
+{
+    FileOffset nSize = m_pBuffer->GetSize();
+    if (nOffset < nSize && nLength > nSize - nOffset)
+        nLength = nSize - nOffset;
+    return Apply(nOffset, nLength, 0, FALSE, [&]() {
+        return m_pBuffer->Delete(nOffset, nLength);
+    });
+}
+
+int CUndoJournal::Fill(FileOffset nOffset, FileOffset nLength, uint8_t nByte)
+{
+    FileOffset nSize = m_pBuffer->GetSize();
+    if (nOffset < nSize && nLength > nSize - nOffset)
+        nLength = nSize - nOffset;
+    return Apply(nOffset, nLength, nLength, FALSE, [&]() {
+        return m_pBuffer->Fill(nOffset, nLength, nByte);
+    });
+}
+
+int CUndoJournal::Apply(FileOffset nOffset, FileOffset nDeleteLength, FileOffset nInsertLength,
+                        int bCoalesce, const std::function<int()>& edit)
+{
+    if (!m_pBuffer)
+    {
+        return FALSE;
+    }
+    std::vector<EditPiece> vecRemoved;
+    m_pBuffer->GetPieces(nOffset, nDeleteLength, vecRemoved);
+    if (!edit())
+    {
+        return FALSE;
+    }
+    m_vecRedo.clear();
+
+    if (bCoalesce && !m_bSealed && !m_vecUndo.empty())
+    {
+        Record& top = m_vecUndo.back();
+        FileOffset nTopEnd = top.nOffset + top.nLength;
+        if (top.bCoalesce && nOffset >= top.nOffset && nOffset <= nTopEnd)
+        {
+            // 新编辑落在上一条记录产生的范围内或紧接其后：范围内的部分
+            // 本来就会被撤销掉，只需把越过范围的那部分旧片段补到记录后面
+            FileOffset nOverlap = nOffset + nDeleteLength < nTopEnd ? nDeleteLength : nTopEnd - nOffset;
+            AppendPieces(top.vecPieces, vecRemoved, nOverlap);
+            top.nLength = top.nLength - nOverlap + nInsertLength;
+            return TRUE;
+        }
+    }
+
+    Record record;
+    record.nOffset = nOffset;
+    record.nLength = nInsertLength;
+    record.vecPieces.swap(vecRemoved);
+    record.bCoalesce = bCoalesce;
+    m_vecUndo.push_back(std::move(record));
+    m_bSealed = !bCoalesce;
+    return TRUE;
+}
+
+int CUndoJournal::Undo(FileOffset* pnOffset, FileOffset* pnLength)
+{
+    return Swap(m_vecUndo, m_vecRedo, pnOffset, pnLength);
+}
+
+int CUndoJournal::Redo(FileOffset* pnOffset, FileOffset* pnLength)
+{
+    return Swap(m_vecRedo, m_vecUndo, pnOffset, pnLength);
+}
+
+int CUndoJournal::Swap(std::vector<Record>& vecFrom, std::vector<Record>& vecTo, FileOffset* pnOffset, FileOffset* pnLength)
+{
+    if (!m_pBuffer || vecFrom.empty())
+    {
+        return FALSE;
+    }
+    Record record = std::move(vecFrom.back());
+    vecFrom.pop_back();
+
+    // 先取出当前内容作为反方向的记录，再放回记录中的片段
+    std::vector<EditPiece> vecCurrent;
+    m_pBuffer->GetPieces(record.nOffset, record.nLength, vecCurrent);
+    FileOffset nRestoreLength = LengthOf(record.vecPieces);
+    m_pBuffer->ReplacePieces(record.nOffset, record.nLength, record.vecPieces);
+
+    record.nLength = nRestoreLength;
+    record.vecPieces.swap(vecCurrent);
+    record.bCoalesce = FALSE;
+    vecTo.push_back(std::move(record));
+    m_bSealed = TRUE;
+
+    if (pnOffset)
+        *pnOffset = vecTo.back().nOffset;
+    if (pnLength)
+        *pnLength = nRestoreLength;
+    return TRUE;
+}
+
+size_t CUndoJournal::GetMemoryUsage() const
+{
+    size_t nBytes = (m_vecUndo.capacity() + m_vecRedo.capacity()) * sizeof(Record);
+    for (size_t i = 0; i < m_vecUndo.size(); i++)
+        nBytes += m_vecUndo[i].vecPieces.capacity() * sizeof(EditPiece);
+    for (size_t i = 0; i < m_vecRedo.size(); i++)
+        nBytes += m_vecRedo[i].vecPieces.capacity() * sizeof(EditPiece);
+    return nBytes;
+}
+
+void CUndoJournal::AppendPieces(std::vector<EditPiece>& vecTo, const std::vector<EditPiece>& vecFrom, FileOffset nSkip)
+{
+    for (size_t i = 0; i < vecFrom.size(); i++)
+    {
+        EditPiece piece = vecFrom[i];
+        if (nSkip >= piece.nLength)
+        {
+            nSkip -= piece.nLength;
+            continue;
+        }
+        if (piece.nSource != PIECE_FILL)
+            piece.nOffset += nSkip;
+        piece.nLength -= nSkip;
+        nSkip = 0;
+
+        // 与前一个片段首尾相接时合并，连续输入的记录只占一个片段
+        if (!vecTo.empty())
+        {
+            EditPiece& last = vecTo.back();
+            if (last.nSource == piece.nSource &&
+                (piece.nSource == PIECE_FILL ? last.nFill == piece.nFill : last.nOffset + last.nLength == piece.nOffset))
+            {
+                last.nLength += piece.nLength;
+                continue;
+            }
+        }
+        vecTo.push_back(piece);
+    }
+}
+
+FileOffset CUndoJournal::LengthOf(const std::vector<EditPiece>& vecPieces)
+{
+    FileOffset nLength = 0;
+    for (size_t i = 0; i < vecPieces.size(); i++)
+        nLength += vecPieces[i].nLength;
+    return nLength;
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include <functional>
+#include "EditBuffer.h"
+
+/************************************************************************/
+/* undo/redo journal for a CEditBuffer.
+/* a record keeps the range an edit produced and the pieces that were
+/* there before. pieces only point into the original file or the
+/* append-only add buffer, so a record costs a few pieces no matter how
+/* many bytes it covers: undoing a 1 GB fill restores the pieces that
+/* the FILL piece replaced, nothing is copied. the pieces for the other
+/* direction are captured at undo/redo time, so undo/redo cost depends
+/* on the size of the record, not on the depth of the history.
+/* consecutive keystrokes (bCoalesce) that continue the previous run are
+/* merged into one record until Seal() is called.
+/************************************************************************/
+class CUndoJournal
+{
+public:
+    CUndoJournal();
+
+    /************************************************************************/
+    /* start recording for pBuffer / drop all history.
+    /************************************************************************/
+    void Attach(CEditBuffer* pBuffer);
+    void Clear();
+
+    /************************************************************************/
+    /* recorded edits, same semantics as CEditBuffer.
+    /************************************************************************/
+    int Overwrite(FileOffset nOffset, const uint8_t* pData, size_t nLength, int bCoalesce = FALSE);
+    int Insert(FileOffset nOffset, const uint8_t* pData, size_t nLength, int bCoalesce = FALSE);
+    int Delete(FileOffset nOffset, FileOffset nLength);
+    int Fill(FileOffset nOffset, FileOffset nLength, uint8_t nByte);
+
+    /************************************************************************/
+    /* end the current run of coalesced keystrokes (cursor moved etc).
+    /************************************************************************/
+    void Seal() { m_bSealed = TRUE; }
+
+    int CanUndo() const { return !m_vecUndo.empty(); }
+    int CanRedo() const { return !m_vecRedo.empty(); }
+
+    /************************************************************************/
+    /* undo/redo one record. return 1 if success, *pnOffset/*pnLength
+    /* receive the range that now holds the restored data.
+    /************************************************************************/
+    int Undo(FileOffset* pnOffset, FileOffset* pnLength);
+    int Redo(FileOffset* pnOffset, FileOffset* pnLength);
+
+    /************************************************************************/
+    /* bytes held by the journal.
+    /************************************************************************/
+    size_t GetMemoryUsage() const;
+
+private:
+    struct Record
+    {
+        FileOffset nOffset;             // 记录影响的范围在当前数据中的起点
+        FileOffset nLength;             // 该范围在当前数据中的长度
+        std::vector<EditPiece> vecPieces; // 撤销（或重做）时放回该范围的片段
+        int bCoalesce;                  // 是否是可合并的连续输入
+    };
+
+    int Apply(FileOffset nOffset, FileOffset nDeleteLength, FileOffset nInsertLength,
+              int bCoalesce, const std::function<int()>& edit);
+    int Swap(std::vector<Record>& vecFrom, std::vector<Record>& vecTo, FileOffset* pnOffset, FileOffset* pnLength);
+    static void AppendPieces(std::vector<EditPiece>& vecTo, const std::vector<EditPiece>& vecFrom, FileOffset nSkip);
+    static FileOffset LengthOf(const std::vector<EditPiece>& vecPieces);
+
+    CEditBuffer* m_pBuffer;
+    std::vector<Record> m_vecUndo;
+    std::vector<Record> m_vecRedo;
+    int m_bSealed;
+};
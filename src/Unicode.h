@@ -0,0 +1,25 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/************************************************************************/
+/* unicode helpers for the text search: simple case folding and UTF-8 /
+/* UTF-16 conversion.
+/* the folding is the C + S part of the Unicode CaseFolding.txt (one code
+/* point to one code point, Unicode 14), so 'K', 'k' and KELVIN SIGN, or
+/* 'σ', 'ς' and 'Σ' all fold together.
+/************************************************************************/
+
+// 简单大小写折叠后的码点，没有折叠的返回它本身
+uint32_t UnicodeSimpleFold(uint32_t nCodePoint);
+
+// 折叠后与nCodePoint相同的所有码点，包括它自己，从小到大
+void UnicodeCaseVariants(uint32_t nCodePoint, std::vector<uint32_t>& vecVariants);
+
+// 解码UTF-8字符串，遇到无效的序列返回false
+bool DecodeUtf8(const char* pszText, std::vector<uint32_t>& vecCodePoints);
+
+// 把码点追加为UTF-8 / UTF-16（bBigEndian选择字节序，大于0xFFFF的用代理对）
+void AppendUtf8(uint32_t nCodePoint, std::string& strOut);
+void AppendUtf16(uint32_t nCodePoint, int bBigEndian, std::string& strOut);
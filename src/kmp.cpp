@@ -67,3 +67,48 @@ int KMP_ignore_case(const unsigned char *str, int slen, const unsigned char *low
     }
     return -1;
 }
+
+int KMP_stream(const unsigned char *str, int slen, const unsigned char *ptr, int plen, const int* next, int* state)
+{
+    int k = *state;
+    if (k == plen - 1)//上一次调用停在一个完整匹配上，先回退才能继续找重叠的匹配
+        k = next[k];
+    for (int i = 0; i < slen; i++)
+    {
+        while (k > -1 && ptr[k + 1] != str[i])
+            k = next[k];
+        if (ptr[k + 1] == str[i])
+            k = k + 1;
+        if (k == plen - 1)
+        {
+            *state = k;
+            return i;//返回匹配最后一个字节的下标，匹配的起点可能在之前的缓冲区里
+        }
+    }
+    *state = k;
+    return -1;
+}
+
+int KMP_stream_ignore_case(const unsigned char *str, int slen, const unsigned char *lower_str, int plen, const int* next, int* state)
+{
+    int k = *state;
+    if (k == plen - 1)
+        k = next[k];
+    for (int i = 0; i < slen; i++)
+    {
+        unsigned char char_lower = str[i];
+        if (char_lower >= 'A' && char_lower <= 'Z')
+            char_lower += 0x20;
+        while (k > -1 && lower_str[k + 1] != str[i] && lower_str[k + 1] != char_lower)
+            k = next[k];
+        if (lower_str[k + 1] == str[i] || lower_str[k + 1] == char_lower)
+            k = k + 1;
+        if (k == plen - 1)
+        {
+            *state = k;
+            return i;
+        }
+    }
+    *state = k;
+    return -1;
+}
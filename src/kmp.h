@@ -8,3 +8,9 @@ void kmp_cal_next_ignore_case(const unsigned char *lower_str, int len, int *next
 // lower_str룬ҪȷıתСд
 int KMP_ignore_case(const unsigned char *str, int slen, const unsigned char *lower_str, int plen, const int* next);
 
+// ʽKMPڿң*stateƥ״̬һεǰΪ-1
+// ҵƥʱƥһֽstrе±꣨ƥܴ֮ǰĻʼ
+// ӷֵ+1ÿҵ棨صƥ䣻ûƥ䷵-1
+int KMP_stream(const unsigned char *str, int slen, const unsigned char *ptr, int plen, const int* next, int* state);
+// lower_str룬ҪȷıתСд
+int KMP_stream_ignore_case(const unsigned char *str, int slen, const unsigned char *lower_str, int plen, const int* next, int* state);
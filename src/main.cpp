@@ -10,6 +10,9 @@ int main(int argc, char **argv) {
     window->end();
     window->show(argc, argv);
     
+    // 启用多线程支持，后台线程用Fl::awake通知界面
+    Fl::lock();
+
     // 运行主循环
     return Fl::run();
 }